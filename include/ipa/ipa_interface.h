@@ -19,7 +19,9 @@ struct ipa_context {
 
 struct ipa_buffer_plane {
 	int dmabuf;
+	size_t offset;
 	size_t length;
+	unsigned int stride;
 };
 
 struct ipa_buffer {
@@ -9,7 +9,7 @@
 
 #include <stdint.h>
 
-#define IPA_MODULE_API_VERSION 1
+#define IPA_MODULE_API_VERSION 2
 
 namespace libcamera {
 
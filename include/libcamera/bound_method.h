@@ -7,6 +7,8 @@
 #ifndef __LIBCAMERA_BOUND_METHOD_H__
 #define __LIBCAMERA_BOUND_METHOD_H__
 
+#include <memory>
+#include <stddef.h>
 #include <tuple>
 #include <type_traits>
 
@@ -14,11 +16,61 @@ namespace libcamera {
 
 class Object;
 
+enum ConnectionType {
+	ConnectionTypeAuto,
+	ConnectionTypeDirect,
+	ConnectionTypeQueued,
+	ConnectionTypeBlocking,
+};
+
+class BoundMethodPackBase
+{
+public:
+	virtual ~BoundMethodPackBase() {}
+
+	static void *operator new(size_t size);
+	static void operator delete(void *ptr);
+};
+
+template<typename R, typename... Args>
+class BoundMethodPack : public BoundMethodPackBase
+{
+public:
+	BoundMethodPack(const Args &... args)
+		: args_(args...), ret_()
+	{
+	}
+
+	R returnValue()
+	{
+		return ret_;
+	}
+
+	std::tuple<typename std::remove_reference<Args>::type...> args_;
+	R ret_;
+};
+
+template<typename... Args>
+class BoundMethodPack<void, Args...> : public BoundMethodPackBase
+{
+public:
+	BoundMethodPack(const Args &... args)
+		: args_(args...)
+	{
+	}
+
+	void returnValue()
+	{
+	}
+
+	std::tuple<typename std::remove_reference<Args>::type...> args_;
+};
+
 class BoundMethodBase
 {
 public:
-	BoundMethodBase(void *obj, Object *object)
-		: obj_(obj), object_(object) {}
+	BoundMethodBase(void *obj, Object *object, ConnectionType type)
+		: obj_(obj), object_(object), connectionType_(type) {}
 	virtual ~BoundMethodBase() {}
 
 	template<typename T, typename std::enable_if<!std::is_same<Object, T>::value>::type * = nullptr>
@@ -26,19 +78,14 @@ public:
 	bool match(Object *object) { return object == object_; }
 
 	Object *object() const { return object_; }
+	ConnectionType connectionType() const { return connectionType_; }
 
-	void activatePack(void *pack);
-	virtual void invokePack(void *pack) = 0;
+	virtual void invokePack(BoundMethodPackBase *pack) = 0;
 
-protected:
-	void *obj_;
-	Object *object_;
-};
+	static void *operator new(size_t size);
+	static void operator delete(void *ptr);
 
-template<typename... Args>
-class BoundMethodArgs : public BoundMethodBase
-{
-private:
+protected:
 #ifndef __DOXYGEN__
 	/*
 	 * This is a cheap partial implementation of std::integer_sequence<>
@@ -58,71 +105,118 @@ private:
 	};
 #endif
 
-	using PackType = std::tuple<typename std::remove_reference<Args>::type...>;
+	bool activatePack(BoundMethodPackBase *pack, bool deleteMethod);
 
-	template<int... S>
-	void invokePack(void *pack, sequence<S...>)
+	void *obj_;
+	Object *object_;
+
+private:
+	ConnectionType connectionType_;
+};
+
+template<typename R, typename... Args>
+class BoundMethodArgs : public BoundMethodBase
+{
+public:
+	using PackType = BoundMethodPack<R, Args...>;
+
+private:
+	template<typename T = R, int... S>
+	typename std::enable_if<!std::is_void<T>::value>::type
+	invokePack(BoundMethodPackBase *pack, BoundMethodBase::sequence<S...>)
 	{
 		PackType *args = static_cast<PackType *>(pack);
-		invoke(std::get<S>(*args)...);
-		delete args;
+		args->ret_ = invoke(std::get<S>(args->args_)...);
+	}
+
+	template<typename T = R, int... S>
+	typename std::enable_if<std::is_void<T>::value>::type
+	invokePack(BoundMethodPackBase *pack, BoundMethodBase::sequence<S...>)
+	{
+		/* args is unused when the method has no argument. */
+		PackType *args = static_cast<PackType *>(pack);
+		(void)args;
+
+		invoke(std::get<S>(args->args_)...);
 	}
 
 public:
-	BoundMethodArgs(void *obj, Object *object)
-		: BoundMethodBase(obj, object) {}
+	BoundMethodArgs(void *obj, Object *object, ConnectionType type)
+		: BoundMethodBase(obj, object, type) {}
 
-	void invokePack(void *pack) override
+	void invokePack(BoundMethodPackBase *pack) override
 	{
-		invokePack(pack, typename generator<sizeof...(Args)>::type());
+		invokePack(pack, typename BoundMethodBase::generator<sizeof...(Args)>::type());
 	}
 
-	virtual void activate(Args... args) = 0;
-	virtual void invoke(Args... args) = 0;
+	virtual R activate(Args... args, bool deleteMethod = false) = 0;
+	virtual R invoke(Args... args) = 0;
+
+protected:
+	R activateArgs(Args... args, bool deleteMethod)
+	{
+		/*
+		 * The pack is owned by the invocation message for queued
+		 * invocations, and by the caller otherwise.
+		 */
+		PackType *pack = new PackType(args...);
+		if (!BoundMethodBase::activatePack(pack, deleteMethod))
+			return R();
+
+		std::unique_ptr<PackType> owner(pack);
+		return pack->returnValue();
+	}
 };
 
-template<typename T, typename... Args>
-class BoundMemberMethod : public BoundMethodArgs<Args...>
+template<typename T, typename R, typename... Args>
+class BoundMemberMethod : public BoundMethodArgs<R, Args...>
 {
 public:
-	using PackType = std::tuple<typename std::remove_reference<Args>::type...>;
+	BoundMemberMethod(T *obj, Object *object, R (T::*func)(Args...),
+			  ConnectionType type = ConnectionTypeAuto)
+		: BoundMethodArgs<R, Args...>(obj, object, type), func_(func) {}
 
-	BoundMemberMethod(T *obj, Object *object, void (T::*func)(Args...))
-		: BoundMethodArgs<Args...>(obj, object), func_(func) {}
+	bool match(R (T::*func)(Args...)) const { return func == func_; }
 
-	bool match(void (T::*func)(Args...)) const { return func == func_; }
-
-	void activate(Args... args)
+	R activate(Args... args, bool deleteMethod = false) override
 	{
-		if (this->object_)
-			BoundMethodBase::activatePack(new PackType{ args... });
-		else
-			(static_cast<T *>(this->obj_)->*func_)(args...);
+		if (!this->object_)
+			return (static_cast<T *>(this->obj_)->*func_)(args...);
+
+		return this->activateArgs(args..., deleteMethod);
 	}
 
-	void invoke(Args... args)
+	R invoke(Args... args) override
 	{
-		(static_cast<T *>(this->obj_)->*func_)(args...);
+		return (static_cast<T *>(this->obj_)->*func_)(args...);
 	}
 
 private:
-	void (T::*func_)(Args...);
+	R (T::*func_)(Args...);
 };
 
-template<typename... Args>
-class BoundStaticMethod : public BoundMethodArgs<Args...>
+template<typename R, typename... Args>
+class BoundStaticMethod : public BoundMethodArgs<R, Args...>
 {
 public:
-	BoundStaticMethod(void (*func)(Args...))
-		: BoundMethodArgs<Args...>(nullptr, nullptr), func_(func) {}
+	BoundStaticMethod(R (*func)(Args...))
+		: BoundMethodArgs<R, Args...>(nullptr, nullptr, ConnectionTypeAuto),
+		  func_(func) {}
+
+	bool match(R (*func)(Args...)) const { return func == func_; }
 
-	bool match(void (*func)(Args...)) const { return func == func_; }
+	R activate(Args... args, bool deleteMethod = false) override
+	{
+		return (*func_)(args...);
+	}
 
-	void activate(Args... args) { (*func_)(args...); }
-	void invoke(Args... args) {}
+	R invoke(Args... args) override
+	{
+		return (*func_)(args...);
+	}
 
 private:
-	void (*func_)(Args...);
+	R (*func_)(Args...);
 };
 
 }; /* namespace libcamera */
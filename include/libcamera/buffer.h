@@ -17,27 +17,61 @@ class BufferPool;
 class Request;
 class Stream;
 
+enum MappingPolicy {
+	MappingNone,
+	MappingReadOnly,
+	MappingReadWrite,
+	MappingPersistent,
+};
+
+struct DmabufPlane {
+	int fd;
+	unsigned int offset;
+	unsigned int length;
+	unsigned int stride;
+};
+
 class Plane final
 {
 public:
+	enum CpuAccess {
+		AccessRead = 1 << 0,
+		AccessWrite = 1 << 1,
+	};
+
 	Plane();
 	~Plane();
 
 	int dmabuf() const { return fd_; }
-	int setDmabuf(int fd, unsigned int length);
+	int setDmabuf(int fd, unsigned int length, unsigned int offset = 0);
 
 	void *mem();
+	unsigned int offset() const { return offset_; }
 	unsigned int length() const { return length_; }
 
+	unsigned int stride() const { return stride_; }
+	void setStride(unsigned int stride) { stride_ = stride; }
+
+	MappingPolicy mappingPolicy() const { return policy_; }
+
+	int beginCpuAccess(unsigned int access);
+	int endCpuAccess(unsigned int access);
+
 private:
 	friend class Stream;
 
+	void setMappingPolicy(MappingPolicy policy);
+
 	int mmap();
 	int munmap();
+	int sync(uint64_t flags);
 
 	int fd_;
+	unsigned int offset_;
 	unsigned int length_;
+	unsigned int stride_;
 	void *mem_;
+	MappingPolicy policy_;
 };
 
 class BufferMemory final
@@ -77,11 +111,20 @@ public:
 	Buffer(unsigned int index = -1, const Buffer *metadata = nullptr);
 	Buffer(const Buffer &) = delete;
 	Buffer &operator=(const Buffer &) = delete;
+	~Buffer();
 
 	unsigned int index() const { return index_; }
-	const std::array<int, 3> &dmabufs() const { return dmabuf_; }
+	std::array<int, 3> dmabufs() const;
+	const std::vector<DmabufPlane> &dmabufPlanes() const { return dmabufPlanes_; }
 	BufferMemory *mem() { return mem_; }
 
+	int beginCpuAccess(unsigned int access);
+	int endCpuAccess(unsigned int access);
+
+	int acquireFence() const { return acquireFence_; }
+	void setAcquireFence(int fence);
+	int releaseFence() const { return releaseFence_; }
+
 	unsigned int bytesused() const { return bytesused_; }
 	uint64_t timestamp() const { return timestamp_; }
 	unsigned int sequence() const { return sequence_; }
@@ -100,15 +143,19 @@ private:
 	void cancel();
 
 	void setRequest(Request *request) { request_ = request; }
+	void setReleaseFence(int fence);
 
 	unsigned int index_;
-	std::array<int, 3> dmabuf_;
+	std::vector<DmabufPlane> dmabufPlanes_;
 	BufferMemory *mem_;
 
 	unsigned int bytesused_;
 	uint64_t timestamp_;
 	unsigned int sequence_;
 
+	int acquireFence_;
+	int releaseFence_;
+
 	Status status_;
 	Request *request_;
 	Stream *stream_;
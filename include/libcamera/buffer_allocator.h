@@ -0,0 +1,59 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * buffer_allocator.h - Device-independent buffer allocator
+ */
+#ifndef __LIBCAMERA_BUFFER_ALLOCATOR_H__
+#define __LIBCAMERA_BUFFER_ALLOCATOR_H__
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <libcamera/buffer.h>
+
+namespace libcamera {
+
+struct StreamConfiguration;
+
+class BufferAllocator final
+{
+public:
+	enum Backend {
+		DmaHeap,
+		Udmabuf,
+		Memfd,
+	};
+
+	BufferAllocator();
+	BufferAllocator(const BufferAllocator &) = delete;
+	BufferAllocator &operator=(const BufferAllocator &) = delete;
+	~BufferAllocator();
+
+	Backend backend() const { return backend_; }
+
+	std::unique_ptr<BufferMemory> allocate(unsigned int size);
+	int allocate(const StreamConfiguration &cfg,
+		     std::vector<std::unique_ptr<BufferMemory>> *buffers);
+
+	void release(std::unique_ptr<BufferMemory> buffer);
+	void release(std::vector<std::unique_ptr<BufferMemory>> *buffers);
+	void purge();
+
+	unsigned int pooled() const { return pool_.size(); }
+
+	static unsigned int frameSize(const StreamConfiguration &cfg);
+
+private:
+	int allocateDmabuf(unsigned int size);
+
+	Backend backend_;
+	int fd_;
+
+	std::multimap<unsigned int, std::unique_ptr<BufferMemory>> pool_;
+};
+
+} /* namespace libcamera */
+
+#endif /* __LIBCAMERA_BUFFER_ALLOCATOR_H__ */
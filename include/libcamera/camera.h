@@ -7,11 +7,14 @@
 #ifndef __LIBCAMERA_CAMERA_H__
 #define __LIBCAMERA_CAMERA_H__
 
+#include <atomic>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <stdint.h>
 #include <string>
+#include <vector>
 
 #include <libcamera/controls.h>
 #include <libcamera/request.h>
@@ -21,6 +24,7 @@
 namespace libcamera {
 
 class Buffer;
+class CameraManager;
 class PipelineHandler;
 class Request;
 
@@ -95,11 +99,15 @@ public:
 	int freeBuffers();
 
 	Request *createRequest(uint64_t cookie = 0);
+	std::unique_ptr<Request> createReusableRequest(uint64_t cookie = 0);
 	int queueRequest(Request *request);
 
 	int start();
 	int stop();
 
+	unsigned int completionBacklog() const;
+	unsigned int maxCompletionBacklog() const;
+
 private:
 	enum State {
 		CameraAvailable,
@@ -115,18 +123,41 @@ private:
 	bool stateBetween(State low, State high) const;
 	bool stateIs(State state) const;
 
+	struct Completion {
+		enum Type {
+			BufferCompleted,
+			RequestCompleted,
+			Disconnected,
+		};
+
+		Type type;
+		Request *request;
+		Buffer *buffer;
+	};
+
 	friend class PipelineHandler;
 	void disconnect();
 
+	void bufferComplete(Request *request, Buffer *buffer);
 	void requestComplete(Request *request);
+	void postCompletion(const Completion &completion);
+
+	friend class CameraManager;
+	void deliverCompletions();
 
 	std::shared_ptr<PipelineHandler> pipe_;
 	std::string name_;
 	std::set<Stream *> streams_;
 	std::set<Stream *> activeStreams_;
 
-	bool disconnected_;
+	std::atomic<bool> disconnected_;
 	State state_;
+
+	mutable std::mutex completionMutex_;
+	std::vector<Completion> completions_;
+	unsigned int completionHead_;
+	unsigned int backlog_;
+	unsigned int maxBacklog_;
 };
 
 } /* namespace libcamera */
@@ -7,11 +7,14 @@
 #ifndef __LIBCAMERA_CAMERA_MANAGER_H__
 #define __LIBCAMERA_CAMERA_MANAGER_H__
 
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
 #include <libcamera/object.h>
+#include <libcamera/scheduling.h>
 
 namespace libcamera {
 
@@ -23,6 +26,11 @@ class PipelineHandler;
 class CameraManager : public Object
 {
 public:
+	enum ThreadRole {
+		PipelineThread,
+		IPAThread,
+	};
+
 	CameraManager();
 	CameraManager(const CameraManager &) = delete;
 	CameraManager &operator=(const CameraManager &) = delete;
@@ -31,7 +39,7 @@ public:
 	int start();
 	void stop();
 
-	const std::vector<std::shared_ptr<Camera>> &cameras() const { return cameras_; }
+	std::vector<std::shared_ptr<Camera>> cameras() const;
 	std::shared_ptr<Camera> get(const std::string &name);
 
 	void addCamera(std::shared_ptr<Camera> camera);
@@ -42,11 +50,28 @@ public:
 	void setEventDispatcher(std::unique_ptr<EventDispatcher> dispatcher);
 	EventDispatcher *eventDispatcher();
 
+	int setScheduling(ThreadRole role, const ThreadScheduling &scheduling);
+
 private:
+	class CameraThread;
+
+	int enumerate();
+	void cleanup();
+	void applyScheduling();
+
+	friend class Camera;
+	void deliverCompletions(std::weak_ptr<Camera> camera);
+
+	std::unique_ptr<CameraThread> cameraThread_;
+
 	std::unique_ptr<DeviceEnumerator> enumerator_;
 	std::vector<std::shared_ptr<PipelineHandler>> pipes_;
+
+	mutable std::mutex mutex_;
 	std::vector<std::shared_ptr<Camera>> cameras_;
 
+	std::map<ThreadRole, ThreadScheduling> scheduling_;
+
 	static const std::string version_;
 	static CameraManager *self_;
 };
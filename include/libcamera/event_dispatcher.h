@@ -28,6 +28,8 @@ public:
 	virtual void processEvents() = 0;
 
 	virtual void interrupt() = 0;
+
+	void dispatchMessages();
 };
 
 } /* namespace libcamera */
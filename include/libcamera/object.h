@@ -7,6 +7,7 @@
 #ifndef __LIBCAMERA_OBJECT_H__
 #define __LIBCAMERA_OBJECT_H__
 
+#include <atomic>
 #include <list>
 #include <memory>
 #include <vector>
@@ -29,14 +30,14 @@ public:
 
 	void postMessage(std::unique_ptr<Message> msg);
 
-	template<typename T, typename... Args, typename std::enable_if<std::is_base_of<Object, T>::value>::type * = nullptr>
-	void invokeMethod(void (T::*func)(Args...), Args... args)
+	template<typename T, typename R, typename... FuncArgs, typename... Args,
+		 typename std::enable_if<std::is_base_of<Object, T>::value>::type * = nullptr>
+	R invokeMethod(R (T::*func)(FuncArgs...), ConnectionType type,
+		       Args... args)
 	{
 		T *obj = static_cast<T *>(this);
-		BoundMethodBase *method = new BoundMemberMethod<T, Args...>(obj, this, func);
-		void *pack = new typename BoundMemberMethod<T, Args...>::PackType{ args... };
-
-		invokeMethod(method, pack);
+		auto *method = new BoundMemberMethod<T, R, FuncArgs...>(obj, this, func, type);
+		return method->activate(args..., true);
 	}
 
 	Thread *thread() const { return thread_; }
@@ -53,8 +54,6 @@ private:
 	friend class BoundMethodBase;
 	friend class Thread;
 
-	void invokeMethod(BoundMethodBase *method, void *pack);
-
 	void notifyThreadMove();
 
 	void connect(SignalBase *signal);
@@ -65,7 +64,8 @@ private:
 
 	Thread *thread_;
 	std::list<SignalBase *> signals_;
-	unsigned int pendingMessages_;
+	std::atomic<unsigned int> pendingMessages_;
+	std::atomic<bool> latencyRecorded_;
 };
 
 }; /* namespace libcamera */
@@ -10,7 +10,6 @@
 #include <map>
 #include <memory>
 #include <stdint.h>
-#include <unordered_set>
 
 #include <libcamera/controls.h>
 #include <libcamera/signal.h>
@@ -31,11 +30,14 @@ public:
 		RequestCancelled,
 	};
 
-	Request(Camera *camera, uint64_t cookie = 0);
+	Request(Camera *camera, uint64_t cookie = 0, bool reusable = false);
 	Request(const Request &) = delete;
 	Request &operator=(const Request &) = delete;
 	~Request();
 
+	int reuse();
+	bool reusable() const { return reusable_; }
+
 	ControlList &controls() { return *controls_; }
 	ControlList &metadata() { return *metadata_; }
 	const std::map<Stream *, Buffer *> &buffers() const { return bufferMap_; }
@@ -45,7 +47,7 @@ public:
 	uint64_t cookie() const { return cookie_; }
 	Status status() const { return status_; }
 
-	bool hasPendingBuffers() const { return !pending_.empty(); }
+	bool hasPendingBuffers() const { return pendingBuffers_ != 0; }
 
 private:
 	friend class Camera;
@@ -61,9 +63,10 @@ private:
 	ControlList *controls_;
 	ControlList *metadata_;
 	std::map<Stream *, Buffer *> bufferMap_;
-	std::unordered_set<Buffer *> pending_;
+	unsigned int pendingBuffers_;
 
 	const uint64_t cookie_;
+	const bool reusable_;
 	Status status_;
 	bool cancelled_;
 };
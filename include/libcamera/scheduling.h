@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * scheduling.h - Thread scheduling parameters
+ */
+#ifndef __LIBCAMERA_SCHEDULING_H__
+#define __LIBCAMERA_SCHEDULING_H__
+
+#include <string>
+#include <vector>
+
+namespace libcamera {
+
+struct ThreadScheduling {
+	enum Policy {
+		PolicyOther,
+		PolicyFifo,
+		PolicyRoundRobin,
+	};
+
+	ThreadScheduling()
+		: policy(PolicyOther), priority(0), nice(0)
+	{
+	}
+
+	Policy policy;
+	unsigned int priority;
+	int nice;
+	std::vector<unsigned int> cpus;
+
+	int validate() const;
+	const std::string toString() const;
+};
+
+} /* namespace libcamera */
+
+#endif /* __LIBCAMERA_SCHEDULING_H__ */
@@ -7,9 +7,7 @@
 #ifndef __LIBCAMERA_SIGNAL_H__
 #define __LIBCAMERA_SIGNAL_H__
 
-#include <list>
 #include <type_traits>
-#include <vector>
 
 #include <libcamera/bound_method.h>
 #include <libcamera/object.h>
@@ -22,20 +20,51 @@ public:
 	template<typename T>
 	void disconnect(T *obj)
 	{
-		for (auto iter = slots_.begin(); iter != slots_.end(); ) {
-			BoundMethodBase *slot = *iter;
-			if (slot->match(obj)) {
-				iter = slots_.erase(iter);
-				delete slot;
-			} else {
-				++iter;
-			}
-		}
+		disconnectIf([obj](BoundMethodBase *slot) {
+			return slot->match(obj);
+		});
 	}
 
 protected:
 	friend class Object;
-	std::list<BoundMethodBase *> slots_;
+
+	struct Slot {
+		BoundMethodBase *method;
+		bool connected;
+	};
+
+	SignalBase();
+	SignalBase(const SignalBase &) = delete;
+	SignalBase &operator=(const SignalBase &) = delete;
+	~SignalBase();
+
+	template<typename Predicate>
+	void disconnectIf(Predicate pred)
+	{
+		for (unsigned int i = 0; i < size_; ++i) {
+			Slot &slot = slots_[i];
+			if (slot.connected && pred(slot.method)) {
+				slot.connected = false;
+				dirty_ = true;
+			}
+		}
+
+		if (dirty_ && !emitting_)
+			release();
+	}
+
+	void connectSlot(BoundMethodBase *method);
+	void disconnectAll();
+	void release();
+
+	static constexpr unsigned int InlineSlots = 2;
+
+	Slot *slots_;
+	unsigned int size_;
+	unsigned int capacity_;
+	unsigned int emitting_;
+	bool dirty_;
+	Slot inlineSlots_[InlineSlots];
 };
 
 template<typename... Args>
@@ -45,42 +74,42 @@ public:
 	Signal() {}
 	~Signal()
 	{
-		for (BoundMethodBase *slot : slots_) {
-			Object *object = slot->object();
-			if (object)
+		for (unsigned int i = 0; i < size_; ++i) {
+			Slot &slot = slots_[i];
+			Object *object = slot.method->object();
+			if (slot.connected && object)
 				object->disconnect(this);
-			delete slot;
 		}
 	}
 
 #ifndef __DOXYGEN__
 	template<typename T, typename std::enable_if<std::is_base_of<Object, T>::value>::type * = nullptr>
-	void connect(T *obj, void (T::*func)(Args...))
+	void connect(T *obj, void (T::*func)(Args...),
+		     ConnectionType type = ConnectionTypeAuto)
 	{
 		Object *object = static_cast<Object *>(obj);
 		object->connect(this);
-		slots_.push_back(new BoundMemberMethod<T, Args...>(obj, object, func));
+		connectSlot(new BoundMemberMethod<T, void, Args...>(obj, object, func, type));
 	}
 
 	template<typename T, typename std::enable_if<!std::is_base_of<Object, T>::value>::type * = nullptr>
 #else
 	template<typename T>
 #endif
-	void connect(T *obj, void (T::*func)(Args...))
+	void connect(T *obj, void (T::*func)(Args...),
+		     ConnectionType type = ConnectionTypeAuto)
 	{
-		slots_.push_back(new BoundMemberMethod<T, Args...>(obj, nullptr, func));
+		connectSlot(new BoundMemberMethod<T, void, Args...>(obj, nullptr, func));
 	}
 
 	void connect(void (*func)(Args...))
 	{
-		slots_.push_back(new BoundStaticMethod<Args...>(func));
+		connectSlot(new BoundStaticMethod<void, Args...>(func));
 	}
 
 	void disconnect()
 	{
-		for (BoundMethodBase *slot : slots_)
-			delete slot;
-		slots_.clear();
+		disconnectAll();
 	}
 
 	template<typename T>
@@ -92,47 +121,49 @@ public:
 	template<typename T>
 	void disconnect(T *obj, void (T::*func)(Args...))
 	{
-		for (auto iter = slots_.begin(); iter != slots_.end(); ) {
-			BoundMethodArgs<Args...> *slot = static_cast<BoundMethodArgs<Args...> *>(*iter);
+		disconnectIf([obj, func](BoundMethodBase *slot) {
 			/*
 			 * If the object matches the slot, the slot is
 			 * guaranteed to be a member slot, so we can safely
-			 * cast it to BoundMemberMethod<T, Args...> to match
+			 * cast it to BoundMemberMethod<T, void, Args...> to match
 			 * func.
 			 */
-			if (slot->match(obj) &&
-			    static_cast<BoundMemberMethod<T, Args...> *>(slot)->match(func)) {
-				iter = slots_.erase(iter);
-				delete slot;
-			} else {
-				++iter;
-			}
-		}
+			return slot->match(obj) &&
+			       static_cast<BoundMemberMethod<T, void, Args...> *>(slot)->match(func);
+		});
 	}
 
 	void disconnect(void (*func)(Args...))
 	{
-		for (auto iter = slots_.begin(); iter != slots_.end(); ) {
-			BoundMethodArgs<Args...> *slot = *iter;
-			if (slot->match(nullptr) &&
-			    static_cast<BoundStaticMethod<Args...> *>(slot)->match(func)) {
-				iter = slots_.erase(iter);
-				delete slot;
-			} else {
-				++iter;
-			}
-		}
+		disconnectIf([func](BoundMethodBase *slot) {
+			return slot->match(nullptr) &&
+			       static_cast<BoundStaticMethod<void, Args...> *>(slot)->match(func);
+		});
 	}
 
 	void emit(Args... args)
 	{
 		/*
-		 * Make a copy of the slots list as the slot could call the
-		 * disconnect operation, invalidating the iterator.
+		 * Only call the slots connected when the emission starts.
+		 * Slots connected during emission are appended past the end
+		 * of the snapshot, and slots disconnected during emission are
+		 * only marked as such, their removal is deferred until the
+		 * outermost emission completes. The slots array may however
+		 * be reallocated by connections, so index it on every
+		 * iteration.
 		 */
-		std::vector<BoundMethodBase *> slots{ slots_.begin(), slots_.end() };
-		for (BoundMethodBase *slot : slots)
-			static_cast<BoundMethodArgs<Args...> *>(slot)->activate(args...);
+		unsigned int size = size_;
+
+		emitting_++;
+
+		for (unsigned int i = 0; i < size; ++i) {
+			Slot &slot = slots_[i];
+			if (slot.connected)
+				static_cast<BoundMethodArgs<void, Args...> *>(slot.method)->activate(args...);
+		}
+
+		if (--emitting_ == 0 && dirty_)
+			release();
 	}
 };
 
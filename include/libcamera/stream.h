@@ -7,9 +7,12 @@
 #ifndef __LIBCAMERA_STREAM_H__
 #define __LIBCAMERA_STREAM_H__
 
+#include <array>
 #include <map>
 #include <memory>
+#include <stdint.h>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <libcamera/buffer.h>
@@ -48,6 +51,7 @@ struct StreamConfiguration {
 	Size size;
 
 	MemoryType memoryType;
+	MappingPolicy mappingPolicy;
 	unsigned int bufferCount;
 
 	Stream *stream() const { return stream_; }
@@ -72,16 +76,24 @@ using StreamRoles = std::vector<StreamRole>;
 class Stream
 {
 public:
+	struct CacheStats {
+		uint64_t hits;
+		uint64_t misses;
+	};
+
 	Stream();
 
 	std::unique_ptr<Buffer> createBuffer(unsigned int index);
 	std::unique_ptr<Buffer> createBuffer(const std::array<int, 3> &fds);
+	std::unique_ptr<Buffer> createBuffer(const std::vector<DmabufPlane> &planes);
 
 	BufferPool &bufferPool() { return bufferPool_; }
 	std::vector<BufferMemory> &buffers() { return bufferPool_.buffers(); }
 	const StreamConfiguration &configuration() const { return configuration_; }
 	MemoryType memoryType() const { return memoryType_; }
 
+	const CacheStats &cacheStats() const { return cacheStats_; }
+
 protected:
 	friend class Camera;
 
@@ -90,13 +102,52 @@ protected:
 
 	void createBuffers(MemoryType memory, unsigned int count);
 	void destroyBuffers();
+	void applyMappingPolicy();
 
 	BufferPool bufferPool_;
 	StreamConfiguration configuration_;
 	MemoryType memoryType_;
 
 private:
-	std::vector<std::pair<std::array<int, 3>, unsigned int>> bufferCache_;
+	struct DmabufIdentity {
+		bool operator==(const DmabufIdentity &other) const
+		{
+			return dev == other.dev && ino == other.ino &&
+			       offset == other.offset && length == other.length &&
+			       stride == other.stride;
+		}
+
+		std::array<uint64_t, 3> dev;
+		std::array<uint64_t, 3> ino;
+		std::array<unsigned int, 3> offset;
+		std::array<unsigned int, 3> length;
+		std::array<unsigned int, 3> stride;
+	};
+
+	struct DmabufIdentityHash {
+		std::size_t operator()(const DmabufIdentity &identity) const;
+	};
+
+	struct BufferSlot {
+		DmabufIdentity identity;
+		bool cached;
+		bool free;
+		unsigned int prevFree;
+		unsigned int nextFree;
+	};
+
+	bool identify(const std::vector<DmabufPlane> &planes,
+		      DmabufIdentity *identity);
+	void pushFreeSlot(unsigned int index);
+	void removeFreeSlot(unsigned int index);
+
+	std::vector<BufferSlot> bufferSlots_;
+	unsigned int freeHead_;
+	unsigned int freeTail_;
+	std::unordered_map<DmabufIdentity, unsigned int, DmabufIdentityHash> slotMap_;
+	bool identityChecked_;
+	bool identityReliable_;
+	CacheStats cacheStats_;
 };
 
 } /* namespace libcamera */
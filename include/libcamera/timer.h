@@ -9,6 +9,7 @@
 
 #include <chrono>
 #include <cstdint>
+#include <memory>
 
 #include <libcamera/object.h>
 #include <libcamera/signal.h>
@@ -37,11 +38,15 @@ protected:
 	void message(Message *msg) override;
 
 private:
+	class Private;
+	friend class TimerQueue;
+
 	void registerTimer();
 	void unregisterTimer();
 
 	bool running_;
 	std::chrono::steady_clock::time_point deadline_;
+	std::unique_ptr<Private> d_;
 };
 
 } /* namespace libcamera */
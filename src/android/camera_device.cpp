@@ -7,11 +7,12 @@
 
 #include "camera_device.h"
 
+#include <unistd.h>
+
 #include "log.h"
 #include "utils.h"
 
 #include "camera_metadata.h"
-#include "thread_rpc.h"
 
 using namespace libcamera;
 
@@ -64,25 +65,6 @@ CameraDevice::~CameraDevice()
 		delete it.second;
 }
 
-/*
- * Handle RPC request received from the associated proxy.
- */
-void CameraDevice::call(ThreadRpc *rpc)
-{
-	switch (rpc->tag) {
-	case ThreadRpc::ProcessCaptureRequest:
-		processCaptureRequest(rpc->request);
-		break;
-	case ThreadRpc::Close:
-		close();
-		break;
-	default:
-		LOG(HAL, Error) << "Unknown RPC operation: " << rpc->tag;
-	}
-
-	rpc->notifyReception();
-}
-
 int CameraDevice::open()
 {
 	int ret = camera_->acquire();
@@ -698,7 +680,7 @@ int CameraDevice::configureStreams(camera3_stream_configuration_t *stream_list)
 	return 0;
 }
 
-int CameraDevice::processCaptureRequest(camera3_capture_request_t *camera3Request)
+void CameraDevice::processCaptureRequest(camera3_capture_request_t *camera3Request)
 {
 	StreamConfiguration *streamConfiguration = &config_->at(0);
 	Stream *stream = streamConfiguration->stream();
@@ -706,7 +688,7 @@ int CameraDevice::processCaptureRequest(camera3_capture_request_t *camera3Reques
 	if (camera3Request->num_output_buffers != 1) {
 		LOG(HAL, Error) << "Invalid number of output buffers: "
 				<< camera3Request->num_output_buffers;
-		return -EINVAL;
+		return;
 	}
 
 	/* Start the camera if that's the first request we handle. */
@@ -714,14 +696,14 @@ int CameraDevice::processCaptureRequest(camera3_capture_request_t *camera3Reques
 		int ret = camera_->allocateBuffers();
 		if (ret) {
 			LOG(HAL, Error) << "Failed to allocate buffers";
-			return ret;
+			return;
 		}
 
 		ret = camera_->start();
 		if (ret) {
 			LOG(HAL, Error) << "Failed to start camera";
 			camera_->freeBuffers();
-			return ret;
+			return;
 		}
 
 		running_ = true;
@@ -769,9 +751,15 @@ int CameraDevice::processCaptureRequest(camera3_capture_request_t *camera3Reques
 	if (!buffer) {
 		LOG(HAL, Error) << "Failed to create buffer";
 		delete descriptor;
-		return -EINVAL;
+		return;
 	}
 
+	/*
+	 * Hand the acquire fence to libcamera, which waits on it before
+	 * queuing the buffer to the device.
+	 */
+	buffer->setAcquireFence(camera3Buffers[0].acquire_fence);
+
 	Request *request =
 		camera_->createRequest(reinterpret_cast<uint64_t>(descriptor));
 	request->addBuffer(std::move(buffer));
@@ -782,13 +770,11 @@ int CameraDevice::processCaptureRequest(camera3_capture_request_t *camera3Reques
 		goto error;
 	}
 
-	return 0;
+	return;
 
 error:
 	delete request;
 	delete descriptor;
-
-	return ret;
 }
 
 void CameraDevice::requestComplete(Request *request,
@@ -820,6 +806,14 @@ void CameraDevice::requestComplete(Request *request,
 		descriptor->buffers[i].release_fence = -1;
 		descriptor->buffers[i].status = status;
 	}
+
+	/*
+	 * The release fence is owned by the libcamera buffer, duplicate it to
+	 * transfer ownership to the camera service.
+	 */
+	if (libcameraBuffer->releaseFence() != -1)
+		descriptor->buffers[0].release_fence =
+			dup(libcameraBuffer->releaseFence());
 	captureResult.output_buffers =
 		const_cast<const camera3_stream_buffer_t *>(descriptor->buffers);
 
@@ -40,6 +40,14 @@ int BufferWriter::write(libcamera::Buffer *buffer, const std::string &streamName
 	if (fd == -1)
 		return -errno;
 
+	ret = buffer->beginCpuAccess(libcamera::Plane::AccessRead);
+	if (ret < 0) {
+		std::cerr << "Can't access buffer: " << strerror(-ret)
+			  << std::endl;
+		close(fd);
+		return ret;
+	}
+
 	libcamera::BufferMemory *mem = buffer->mem();
 	for (libcamera::Plane &plane : mem->planes()) {
 		void *data = plane.mem();
@@ -59,6 +67,7 @@ int BufferWriter::write(libcamera::Buffer *buffer, const std::string &streamName
 		}
 	}
 
+	buffer->endCpuAccess(libcamera::Plane::AccessRead);
 	close(fd);
 
 	return ret;
@@ -10,6 +10,7 @@
 #include <iomanip>
 #include <iostream>
 #include <sstream>
+#include <string.h>
 
 #include "capture.h"
 #include "main.h"
@@ -30,10 +31,13 @@ int Capture::run(EventLoop *loop, const OptionsParser::Options &options)
 		return -ENODEV;
 	}
 
+	/* Buffers are only accessed by the CPU when writing them to files. */
 	streamName_.clear();
 	for (unsigned int index = 0; index < config_->size(); ++index) {
 		StreamConfiguration &cfg = config_->at(index);
 		streamName_[cfg.stream()] = "stream" + std::to_string(index);
+		cfg.mappingPolicy = options.isSet(OptFile) ? MappingReadOnly
+							   : MappingNone;
 	}
 
 	ret = camera_->configure(config_);
@@ -83,15 +87,18 @@ int Capture::capture(EventLoop *loop)
 	 * example pushing a button. For now run all streams all the time.
 	 */
 
-	std::vector<Request *> requests;
+	/*
+	 * Requests are reused for the whole capture session, and deleted once
+	 * the camera has been stopped.
+	 */
+	requests_.clear();
 	for (unsigned int i = 0; i < nbuffers; i++) {
-		Request *request = camera_->createRequest();
+		std::unique_ptr<Request> request = camera_->createReusableRequest();
 		if (!request) {
 			std::cerr << "Can't create request" << std::endl;
 			return -ENOMEM;
 		}
 
-		std::map<Stream *, Buffer *> map;
 		for (StreamConfiguration &cfg : *config_) {
 			Stream *stream = cfg.stream();
 			std::unique_ptr<Buffer> buffer = stream->createBuffer(i);
@@ -104,20 +111,22 @@ int Capture::capture(EventLoop *loop)
 			}
 		}
 
-		requests.push_back(request);
+		requests_.push_back(std::move(request));
 	}
 
 	ret = camera_->start();
 	if (ret) {
 		std::cout << "Failed to start capture" << std::endl;
+		requests_.clear();
 		return ret;
 	}
 
-	for (Request *request : requests) {
-		ret = camera_->queueRequest(request);
+	for (std::unique_ptr<Request> &request : requests_) {
+		ret = camera_->queueRequest(request.get());
 		if (ret < 0) {
 			std::cerr << "Can't queue request" << std::endl;
 			camera_->stop();
+			requests_.clear();
 			return ret;
 		}
 	}
@@ -131,6 +140,8 @@ int Capture::capture(EventLoop *loop)
 	if (ret)
 		std::cout << "Failed to stop capture" << std::endl;
 
+	requests_.clear();
+
 	return ret;
 }
 
@@ -164,29 +175,13 @@ void Capture::requestComplete(Request *request, const std::map<Stream *, Buffer
 
 	std::cout << info.str() << std::endl;
 
-	/*
-	 * Create a new request and populate it with one buffer for each
-	 * stream.
-	 */
-	request = camera_->createRequest();
-	if (!request) {
-		std::cerr << "Can't create request" << std::endl;
+	/* Requeue the request with the same buffers. */
+	int ret = request->reuse();
+	if (ret) {
+		std::cerr << "Can't reuse request: " << strerror(-ret)
+			  << std::endl;
 		return;
 	}
 
-	for (auto it = buffers.begin(); it != buffers.end(); ++it) {
-		Stream *stream = it->first;
-		Buffer *buffer = it->second;
-		unsigned int index = buffer->index();
-
-		std::unique_ptr<Buffer> newBuffer = stream->createBuffer(index);
-		if (!newBuffer) {
-			std::cerr << "Can't create buffer " << index << std::endl;
-			return;
-		}
-
-		request->addBuffer(std::move(newBuffer));
-	}
-
 	camera_->queueRequest(request);
 }
@@ -9,6 +9,7 @@
 
 #include <chrono>
 #include <memory>
+#include <vector>
 
 #include <libcamera/camera.h>
 #include <libcamera/request.h>
@@ -35,6 +36,7 @@ private:
 	libcamera::CameraConfiguration *config_;
 
 	std::map<libcamera::Stream *, std::string> streamName_;
+	std::vector<std::unique_ptr<libcamera::Request>> requests_;
 	BufferWriter *writer_;
 	std::chrono::steady_clock::time_point last_;
 };
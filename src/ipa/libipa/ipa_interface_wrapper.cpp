@@ -110,7 +110,9 @@ void IPAInterfaceWrapper::map_buffers(struct ipa_context *_ctx,
 		planes.resize(_buffer.num_planes);
 		for (unsigned int j = 0; j < _buffer.num_planes; ++j) {
 			planes[j].setDmabuf(_buffer.planes[j].dmabuf,
-					    _buffer.planes[j].length);
+					    _buffer.planes[j].length,
+					    _buffer.planes[j].offset);
+			planes[j].setStride(_buffer.planes[j].stride);
 			/** \todo Create a Dmabuf class to implement RAII. */
 			::close(_buffer.planes[j].dmabuf);
 		}
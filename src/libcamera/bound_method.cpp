@@ -8,20 +8,118 @@
 #include <libcamera/bound_method.h>
 
 #include "message.h"
+#include "message_allocator.h"
+#include "semaphore.h"
 #include "thread.h"
 #include "utils.h"
 
+/**
+ * \file bound_method.h
+ * \brief Method bind and invocation
+ */
+
 namespace libcamera {
 
-void BoundMethodBase::activatePack(void *pack)
+/**
+ * \enum ConnectionType
+ * \brief Connection type for asynchronous communication
+ *
+ * This enumeration describes the possible types of asynchronous communication
+ * between a sender and a receiver. It applies to Signal::emit() and
+ * Object::invokeMethod().
+ *
+ * \var ConnectionType::ConnectionTypeAuto
+ * \brief If the sender and the receiver live in the same thread,
+ * ConnectionTypeDirect is used. Otherwise ConnectionTypeQueued is used.
+ *
+ * \var ConnectionType::ConnectionTypeDirect
+ * \brief The receiver is invoked immediately and synchronously in the sender's
+ * thread.
+ *
+ * \var ConnectionType::ConnectionTypeQueued
+ * \brief The receiver is invoked asynchronously in its thread when control
+ * returns to the thread's event loop. The sender proceeds without waiting for
+ * the invocation to complete.
+ *
+ * \var ConnectionType::ConnectionTypeBlocking
+ * \brief The receiver is invoked asynchronously in its thread when control
+ * returns to the thread's event loop. The sender blocks until the receiver
+ * signals the completion of the invocation. If the sender and receiver live in
+ * the same thread, the receiver is invoked synchronously instead.
+ */
+
+/*
+ * Activate the method with the packed arguments \a pack. Return true if the
+ * method has been invoked synchronously, in which case the caller retains
+ * ownership of the pack and can retrieve the return value from it, or false if
+ * the invocation has been queued, in which case the pack is owned by the
+ * invocation message.
+ */
+bool BoundMethodBase::activatePack(BoundMethodPackBase *pack, bool deleteMethod)
 {
-	if (Thread::current() == object_->thread()) {
+	ConnectionType type = connectionType_;
+
+	if (type == ConnectionTypeAuto || type == ConnectionTypeBlocking) {
+		if (Thread::current() == object_->thread())
+			type = ConnectionTypeDirect;
+		else if (type == ConnectionTypeAuto)
+			type = ConnectionTypeQueued;
+	}
+
+	switch (type) {
+	case ConnectionTypeDirect:
+	default:
 		invokePack(pack);
-	} else {
+		if (deleteMethod)
+			delete this;
+		return true;
+
+	case ConnectionTypeQueued: {
 		std::unique_ptr<Message> msg =
-			utils::make_unique<InvokeMessage>(this, pack);
+			utils::make_unique<InvokeMessage>(this, pack, nullptr,
+							  deleteMethod);
 		object_->postMessage(std::move(msg));
+		return false;
 	}
+
+	case ConnectionTypeBlocking: {
+		Semaphore semaphore;
+
+		/*
+		 * The message doesn't take ownership of the pack and method,
+		 * which must stay valid until the semaphore is released.
+		 */
+		std::unique_ptr<Message> msg =
+			utils::make_unique<InvokeMessage>(this, pack, &semaphore);
+		object_->postMessage(std::move(msg));
+
+		semaphore.acquire();
+
+		if (deleteMethod)
+			delete this;
+		return true;
+	}
+	}
+}
+
+void *BoundMethodPackBase::operator new(size_t size)
+{
+	return MessageAllocator::allocate(size);
+}
+
+void BoundMethodPackBase::operator delete(void *ptr)
+{
+	MessageAllocator::free(ptr);
+}
+
+void *BoundMethodBase::operator new(size_t size)
+{
+	return MessageAllocator::allocate(size);
+}
+
+void BoundMethodBase::operator delete(void *ptr)
+{
+	MessageAllocator::free(ptr);
 }
 
 } /* namespace libcamera */
@@ -8,7 +8,9 @@
 #include <libcamera/buffer.h>
 
 #include <errno.h>
+#include <linux/dma-buf.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <unistd.h>
 
@@ -23,6 +25,46 @@ namespace libcamera {
 
 LOG_DEFINE_CATEGORY(Buffer)
 
+/**
+ * \enum MappingPolicy
+ * \brief The policy for mapping buffer memory to CPU accessible addresses
+ *
+ * Mapping buffer memory to the CPU isn't free, and buffers that are only
+ * accessed by devices don't need to be mapped at all. The mapping policy lets
+ * applications select, for each stream, how its buffers are mapped.
+ *
+ * \var MappingNone
+ * The buffer memory is never mapped, and isn't accessible by the CPU
+ * \var MappingReadOnly
+ * The buffer memory is mapped read-only on first CPU access
+ * \var MappingReadWrite
+ * The buffer memory is mapped read-write on first CPU access
+ * \var MappingPersistent
+ * The buffer memory is mapped read-write when the buffers are allocated or
+ * imported, avoiding the mapping cost on first CPU access
+ */
+
+/**
+ * \struct DmabufPlane
+ * \brief Description of a plane stored in a dmabuf
+ *
+ * Applications describe the planes of externally allocated buffers with a
+ * DmabufPlane per plane. Multiple planes can be stored in a single dmabuf at
+ * different offsets, which allows importing buffers allocated as a single
+ * memory region, such as NV12 buffers from gralloc or from the
+ * BufferAllocator.
+ *
+ * \var DmabufPlane::fd
+ * \brief The dmabuf file descriptor
+ * \var DmabufPlane::offset
+ * \brief The offset of the plane from the start of the dmabuf, in bytes
+ * \var DmabufPlane::length
+ * \brief The plane length in bytes, or 0 to extend to the end of the dmabuf
+ * \var DmabufPlane::stride
+ * \brief The distance between the start of two consecutive lines in bytes,
+ * or 0 if unknown
+ */
+
 /**
  * \class Plane
  * \brief A memory region to store a single plane of a frame
@@ -42,11 +84,28 @@ LOG_DEFINE_CATEGORY(Buffer)
  *
  * To support CPU access, planes carry the CPU address of their backing memory.
  * Similarly to the dmabuf file handles, the CPU addresses for planes composing
- * an image may or may not be contiguous.
+ * an image may or may not be contiguous. The memory is mapped according to the
+ * plane's mapping policy, which is set from the configuration of the stream
+ * the plane belongs to.
+ *
+ * As devices may access the memory through non-coherent caches, CPU accesses
+ * shall be bracketed by calls to beginCpuAccess() and endCpuAccess(). Those
+ * synchronise the CPU caches with the memory through the dmabuf
+ * DMA_BUF_IOCTL_SYNC ioctl.
+ */
+
+/**
+ * \enum Plane::CpuAccess
+ * \brief The type of CPU access to the plane memory
+ * \var Plane::AccessRead
+ * The CPU reads the plane memory
+ * \var Plane::AccessWrite
+ * The CPU writes the plane memory
  */
 
 Plane::Plane()
-	: fd_(-1), length_(0), mem_(0)
+	: fd_(-1), offset_(0), length_(0), stride_(0), mem_(0),
+	  policy_(MappingReadWrite)
 {
 }
 
@@ -67,19 +126,22 @@ Plane::~Plane()
  * \brief Set the dmabuf file handle backing the buffer
  * \param[in] fd The dmabuf file handle
  * \param[in] length The size of the memory region
+ * \param[in] offset The offset of the memory region within the dmabuf
  *
  * The \a fd dmabuf file handle is duplicated and stored. The caller may close
- * the original file handle.
+ * the original file handle. Any existing CPU mapping is destroyed.
  *
  * \return 0 on success or a negative error code otherwise
  */
-int Plane::setDmabuf(int fd, unsigned int length)
+int Plane::setDmabuf(int fd, unsigned int length, unsigned int offset)
 {
 	if (fd < 0) {
 		LOG(Buffer, Error) << "Invalid dmabuf fd provided";
 		return -EINVAL;
 	}
 
+	munmap();
+
 	if (fd_ != -1) {
 		close(fd_);
 		fd_ = -1;
@@ -93,29 +155,93 @@ int Plane::setDmabuf(int fd, unsigned int length)
 		return ret;
 	}
 
+	offset_ = offset;
 	length_ = length;
 
 	return 0;
 }
 
+/**
+ * \fn Plane::offset()
+ * \brief Retrieve the offset of the memory region within the dmabuf
+ * \return The offset of the memory region in bytes
+ */
+
+/**
+ * \fn Plane::stride()
+ * \brief Retrieve the line stride of the plane
+ * \return The distance between the start of two consecutive lines in bytes, or
+ * 0 if unknown
+ */
+
+/**
+ * \fn Plane::setStride()
+ * \brief Set the line stride of the plane
+ * \param[in] stride The distance between the start of two consecutive lines
+ * in bytes
+ */
+
+/**
+ * \fn Plane::mappingPolicy()
+ * \brief Retrieve the mapping policy of the plane
+ * \return The plane mapping policy
+ */
+
+/**
+ * \brief Set the mapping policy of the plane
+ * \param[in] policy The mapping policy
+ *
+ * An existing mapping that doesn't match the new \a policy is destroyed. If
+ * the \a policy is MappingPersistent, the memory is mapped immediately.
+ */
+void Plane::setMappingPolicy(MappingPolicy policy)
+{
+	if (policy == policy_)
+		return;
+
+	munmap();
+	policy_ = policy;
+
+	if (policy_ == MappingPersistent)
+		mmap();
+}
+
 /**
  * \brief Map the plane memory data to a CPU accessible address
  *
  * The file descriptor to map the memory from must be set by a call to
- * setDmaBuf() before calling this function.
+ * setDmaBuf() before calling this function. The memory is mapped read-only or
+ * read-write depending on the mapping policy.
  *
  * \sa setDmaBuf()
  *
  * \return 0 on success or a negative error code otherwise
+ * \retval -EACCES The mapping policy doesn't allow CPU access
  */
 int Plane::mmap()
 {
 	void *map;
+	int prot;
 
 	if (mem_)
 		return 0;
 
-	map = ::mmap(NULL, length_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+	switch (policy_) {
+	case MappingNone:
+		return -EACCES;
+	case MappingReadOnly:
+		prot = PROT_READ;
+		break;
+	default:
+		prot = PROT_READ | PROT_WRITE;
+		break;
+	}
+
+	/* Mappings must start at a page boundary. */
+	unsigned int pageOffset = offset_ % sysconf(_SC_PAGESIZE);
+
+	map = ::mmap(NULL, length_ + pageOffset, prot, MAP_SHARED, fd_,
+		     offset_ - pageOffset);
 	if (map == MAP_FAILED) {
 		int ret = -errno;
 		LOG(Buffer, Error)
@@ -123,7 +249,7 @@ int Plane::mmap()
 		return ret;
 	}
 
-	mem_ = map;
+	mem_ = static_cast<uint8_t *>(map) + pageOffset;
 
 	return 0;
 }
@@ -139,8 +265,11 @@ int Plane::munmap()
 {
 	int ret = 0;
 
-	if (mem_)
-		ret = ::munmap(mem_, length_);
+	if (mem_) {
+		unsigned int pageOffset = offset_ % sysconf(_SC_PAGESIZE);
+		ret = ::munmap(static_cast<uint8_t *>(mem_) - pageOffset,
+			       length_ + pageOffset);
+	}
 
 	if (ret) {
 		ret = -errno;
@@ -153,9 +282,41 @@ int Plane::munmap()
 	return ret;
 }
 
+/*
+ * Synchronise the CPU caches for the dmabuf. File descriptors that are not
+ * dmabufs, such as memfds, are coherent and don't need synchronisation.
+ */
+int Plane::sync(uint64_t flags)
+{
+	struct dma_buf_sync sync = {};
+	sync.flags = flags;
+
+	int ret;
+	do {
+		ret = ioctl(fd_, DMA_BUF_IOCTL_SYNC, &sync);
+	} while (ret < 0 && (errno == EINTR || errno == EAGAIN));
+
+	if (ret < 0) {
+		if (errno == ENOTTY)
+			return 0;
+
+		ret = -errno;
+		LOG(Buffer, Error)
+			<< "Failed to synchronise plane: " << strerror(-ret);
+		return ret;
+	}
+
+	return 0;
+}
+
 /**
  * \fn Plane::mem()
  * \brief Retrieve the CPU accessible memory address of the Plane
+ *
+ * The memory is mapped on first access, unless the mapping policy is
+ * MappingNone. Accesses to the memory shall be bracketed by calls to
+ * beginCpuAccess() and endCpuAccess() to guarantee cache coherency.
+ *
  * \return The CPU accessible memory address on success or nullptr otherwise.
  */
 void *Plane::mem()
@@ -166,6 +327,63 @@ void *Plane::mem()
 	return mem_;
 }
 
+/**
+ * \brief Prepare the plane memory for CPU access
+ * \param[in] access The type of access, as a bitmask of Plane::CpuAccess
+ *
+ * This method maps the plane memory if needed and synchronises the CPU caches
+ * for the \a access. It shall be called before accessing the memory returned
+ * by mem(), and be paired with a call to endCpuAccess() with the same \a access
+ * once the CPU has finished accessing the memory.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -EACCES The mapping policy doesn't allow the \a access
+ */
+int Plane::beginCpuAccess(unsigned int access)
+{
+	if (policy_ == MappingNone ||
+	    (policy_ == MappingReadOnly && (access & AccessWrite))) {
+		LOG(Buffer, Error)
+			<< "CPU access not allowed by the mapping policy";
+		return -EACCES;
+	}
+
+	int ret = mmap();
+	if (ret)
+		return ret;
+
+	uint64_t flags = DMA_BUF_SYNC_START;
+	if (access & AccessRead)
+		flags |= DMA_BUF_SYNC_READ;
+	if (access & AccessWrite)
+		flags |= DMA_BUF_SYNC_WRITE;
+
+	return sync(flags);
+}
+
+/**
+ * \brief Complete CPU access to the plane memory
+ * \param[in] access The type of access, as passed to beginCpuAccess()
+ *
+ * This method synchronises the CPU caches at the end of the \a access, making
+ * data written by the CPU visible to devices.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int Plane::endCpuAccess(unsigned int access)
+{
+	if (!mem_)
+		return -EINVAL;
+
+	uint64_t flags = DMA_BUF_SYNC_END;
+	if (access & AccessRead)
+		flags |= DMA_BUF_SYNC_READ;
+	if (access & AccessWrite)
+		flags |= DMA_BUF_SYNC_WRITE;
+
+	return sync(flags);
+}
+
 /**
  * \fn Plane::length()
  * \brief Retrieve the length of the memory region
@@ -251,6 +469,14 @@ void BufferPool::destroyBuffers()
  * Buffer instances are allocated dynamically for a stream through
  * Stream::createBuffer(), added to a request with Request::addBuffer() and
  * deleted automatically after the request complete handler returns.
+ *
+ * Buffers can carry sync_file fences to synchronise access to their memory
+ * with other devices without blocking the application. An acquire fence set
+ * with setAcquireFence() signals when the buffer memory is ready to be written
+ * by the camera. libcamera waits on the fence asynchronously and only queues
+ * the request to the device once all its acquire fences have signalled. A
+ * release fence, retrieved with releaseFence() when the buffer completes,
+ * signals when the buffer memory can be reused by the application.
  */
 
 /**
@@ -275,9 +501,8 @@ void BufferPool::destroyBuffers()
  * for a stream with Stream::createBuffer().
  */
 Buffer::Buffer(unsigned int index, const Buffer *metadata)
-	: index_(index), dmabuf_({ -1, -1, -1 }),
-	  status_(Buffer::BufferSuccess), request_(nullptr),
-	  stream_(nullptr)
+	: index_(index), acquireFence_(-1), releaseFence_(-1),
+	  status_(Buffer::BufferSuccess), request_(nullptr), stream_(nullptr)
 {
 	if (metadata) {
 		bytesused_ = metadata->bytesused_;
@@ -290,6 +515,14 @@ Buffer::Buffer(unsigned int index, const Buffer *metadata)
 	}
 }
 
+Buffer::~Buffer()
+{
+	if (acquireFence_ != -1)
+		close(acquireFence_);
+	if (releaseFence_ != -1)
+		close(releaseFence_);
+}
+
 /**
  * \fn Buffer::index()
  * \brief Retrieve the Buffer index
@@ -297,14 +530,35 @@ Buffer::Buffer(unsigned int index, const Buffer *metadata)
  */
 
 /**
- * \fn Buffer::dmabufs()
  * \brief Retrieve the dmabuf file descriptors for all buffer planes
  *
  * The dmabufs array contains one dmabuf file descriptor per plane. Unused
- * entries are set to -1.
+ * entries are set to -1. Planes stored in the same dmabuf report the same
+ * file descriptor.
  *
  * \return The dmabuf file descriptors
  */
+std::array<int, 3> Buffer::dmabufs() const
+{
+	std::array<int, 3> fds = { -1, -1, -1 };
+
+	for (unsigned int i = 0; i < dmabufPlanes_.size(); ++i)
+		fds[i] = dmabufPlanes_[i].fd;
+
+	return fds;
+}
+
+/**
+ * \fn Buffer::dmabufPlanes()
+ * \brief Retrieve the description of the planes of an external buffer
+ *
+ * Buffers created with Stream::createBuffer(const std::vector<DmabufPlane> &)
+ * store the application-provided description of their planes, with the dmabuf
+ * file descriptor, offset, length and stride of each plane. Buffers that use
+ * internal memory have no plane description.
+ *
+ * \return The plane descriptions
+ */
 
 /**
  * \fn Buffer::mem()
@@ -317,6 +571,109 @@ Buffer::Buffer(unsigned int index, const Buffer *metadata)
  * \return The BufferMemory this buffer is associated with
  */
 
+/**
+ * \brief Prepare all planes of the buffer memory for CPU access
+ * \param[in] access The type of access, as a bitmask of Plane::CpuAccess
+ *
+ * This method calls Plane::beginCpuAccess() for all planes of the buffer
+ * memory. It shall only be called while the buffer is associated with a
+ * BufferMemory, see mem().
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int Buffer::beginCpuAccess(unsigned int access)
+{
+	if (!mem_)
+		return -EINVAL;
+
+	std::vector<Plane> &planes = mem_->planes();
+	for (unsigned int i = 0; i < planes.size(); ++i) {
+		int ret = planes[i].beginCpuAccess(access);
+		if (ret < 0) {
+			while (i--)
+				planes[i].endCpuAccess(access);
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Complete CPU access to all planes of the buffer memory
+ * \param[in] access The type of access, as passed to beginCpuAccess()
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int Buffer::endCpuAccess(unsigned int access)
+{
+	if (!mem_)
+		return -EINVAL;
+
+	int ret = 0;
+	for (Plane &plane : mem_->planes()) {
+		int err = plane.endCpuAccess(access);
+		if (err < 0)
+			ret = err;
+	}
+
+	return ret;
+}
+
+/**
+ * \fn Buffer::acquireFence()
+ * \brief Retrieve the acquire fence
+ *
+ * The acquire fence is owned by the buffer. It is reset to -1 once libcamera
+ * has waited on it, or transferred to the release fence if the buffer
+ * completes before the fence is waited on.
+ *
+ * \return The acquire fence file descriptor, or -1 if the buffer has no
+ * acquire fence
+ */
+
+/**
+ * \brief Set the acquire fence
+ * \param[in] fence The sync_file fence file descriptor, or -1
+ *
+ * Set the fence that signals when the buffer memory is ready to be used by the
+ * camera. The buffer takes ownership of the \a fence file descriptor, and
+ * closes the previous acquire fence if any. The acquire fence shall only be
+ * set before the request containing the buffer is queued.
+ *
+ * When a request is queued with buffers that have an acquire fence, the
+ * request is held back without blocking the caller until all the fences have
+ * signalled. Requests are always queued to the device in the order they have
+ * been queued to the camera, a request waiting for a fence thus also delays
+ * all the requests queued after it.
+ */
+void Buffer::setAcquireFence(int fence)
+{
+	if (acquireFence_ != -1)
+		close(acquireFence_);
+
+	acquireFence_ = fence;
+}
+
+/**
+ * \fn Buffer::releaseFence()
+ * \brief Retrieve the release fence
+ *
+ * The release fence is valid after the buffer completes, and signals when the
+ * buffer memory can be reused by the application. As libcamera completes
+ * buffers only once the device has finished writing to them, the release
+ * fence is -1 for buffers that have been processed by the device. Buffers that
+ * complete before their acquire fence has been waited on, for instance when
+ * the request is cancelled, report the acquire fence as their release fence.
+ *
+ * The release fence is owned by the buffer and is closed when the buffer is
+ * destroyed or its request reused. Callers that need to keep the fence shall
+ * duplicate it.
+ *
+ * \return The release fence file descriptor, or -1 if the buffer memory can
+ * be reused immediately
+ */
+
 /**
  * \fn Buffer::bytesused()
  * \brief Retrieve the number of bytes occupied by the data in the buffer
@@ -391,6 +748,12 @@ void Buffer::cancel()
 	timestamp_ = 0;
 	sequence_ = 0;
 	status_ = BufferCancelled;
+
+	/* The acquire fence hasn't been waited on, hand it back. */
+	if (acquireFence_ != -1) {
+		setReleaseFence(acquireFence_);
+		acquireFence_ = -1;
+	}
 }
 
 /**
@@ -400,4 +763,19 @@ void Buffer::cancel()
  * The intended callers are Request::prepare() and Request::completeBuffer().
  */
 
+/**
+ * \brief Set the release fence
+ * \param[in] fence The sync_file fence file descriptor, or -1
+ *
+ * The buffer takes ownership of the \a fence file descriptor, and closes the
+ * previous release fence if any.
+ */
+void Buffer::setReleaseFence(int fence)
+{
+	if (releaseFence_ != -1)
+		close(releaseFence_);
+
+	releaseFence_ = fence;
+}
+
 } /* namespace libcamera */
@@ -0,0 +1,343 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * buffer_allocator.cpp - Device-independent buffer allocator
+ */
+
+#include <libcamera/buffer_allocator.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/dma-heap.h>
+#include <linux/udmabuf.h>
+#include <linux/videodev2.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <libcamera/stream.h>
+
+#include "log.h"
+#include "utils.h"
+
+/**
+ * \file buffer_allocator.h
+ * \brief Device-independent buffer allocator
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(BufferAllocator)
+
+/* Buffers larger than twice the requested size are not reused from the pool. */
+static constexpr unsigned int kMaxPoolWaste = 2;
+
+/**
+ * \class BufferAllocator
+ * \brief Allocate dmabuf-backed memory independently of any device
+ *
+ * Buffer memory for streams that use InternalMemory is exported by the video
+ * devices of the pipeline handler, and only exists between
+ * Camera::allocateBuffers() and Camera::freeBuffers(). The BufferAllocator
+ * instead allocates memory that isn't tied to a device or a camera
+ * configuration. Applications can allocate buffers before configuring the
+ * camera, and queue them to streams that use ExternalMemory with
+ * Stream::createBuffer(const std::vector<DmabufPlane> &), describing all
+ * planes of a frame within the single allocation. As the buffers are plain
+ * dmabufs, the same buffer memory can be used with multiple streams.
+ *
+ * The memory is allocated from the first available backend, in order of
+ * preference:
+ *
+ * - The DMA heap system heap (/dev/dma_heap/system)
+ * - The udmabuf driver (/dev/udmabuf), which wraps memfd memory in a dmabuf
+ * - A plain memfd
+ *
+ * Memory allocated from the memfd backend isn't a dmabuf, and can't be
+ * imported by video devices. It is only suitable for CPU access and for
+ * testing.
+ *
+ * Released buffers are kept in a pool, and reused by subsequent allocations
+ * of a similar size. This allows recycling buffers across camera
+ * configurations without reallocating memory. Pooled memory is freed by
+ * purge() or when the allocator is destroyed.
+ *
+ * All buffers allocated by the allocator contain a single plane, whose length
+ * is rounded up to a multiple of the page size.
+ */
+
+/**
+ * \enum BufferAllocator::Backend
+ * \brief The memory allocation backend
+ * \var BufferAllocator::DmaHeap
+ * Memory is allocated from the DMA heap system heap
+ * \var BufferAllocator::Udmabuf
+ * Memory is allocated from memfd and exported as dmabuf through udmabuf
+ * \var BufferAllocator::Memfd
+ * Memory is allocated from memfd
+ */
+
+/**
+ * \brief Construct a buffer allocator using the first available backend
+ */
+BufferAllocator::BufferAllocator()
+{
+	fd_ = open("/dev/dma_heap/system", O_RDWR | O_CLOEXEC);
+	if (fd_ >= 0) {
+		backend_ = DmaHeap;
+		LOG(BufferAllocator, Debug) << "Using DMA heap backend";
+		return;
+	}
+
+	fd_ = open("/dev/udmabuf", O_RDWR | O_CLOEXEC);
+	if (fd_ >= 0) {
+		backend_ = Udmabuf;
+		LOG(BufferAllocator, Debug) << "Using udmabuf backend";
+		return;
+	}
+
+	backend_ = Memfd;
+	LOG(BufferAllocator, Debug) << "Using memfd backend";
+}
+
+BufferAllocator::~BufferAllocator()
+{
+	purge();
+
+	if (fd_ >= 0)
+		close(fd_);
+}
+
+/**
+ * \fn BufferAllocator::backend()
+ * \brief Retrieve the memory allocation backend
+ * \return The memory allocation backend
+ */
+
+/**
+ * \brief Allocate a single buffer
+ * \param[in] size The minimum buffer size in bytes
+ *
+ * The buffer is taken from the pool if a released buffer of a suitable size is
+ * available, or allocated from the backend otherwise.
+ *
+ * \return The buffer memory on success, or nullptr otherwise
+ */
+std::unique_ptr<BufferMemory> BufferAllocator::allocate(unsigned int size)
+{
+	if (!size)
+		return nullptr;
+
+	unsigned int pageSize = sysconf(_SC_PAGESIZE);
+	size = (size + pageSize - 1) / pageSize * pageSize;
+
+	auto it = pool_.lower_bound(size);
+	if (it != pool_.end() && it->first / kMaxPoolWaste <= size) {
+		std::unique_ptr<BufferMemory> buffer = std::move(it->second);
+		pool_.erase(it);
+		return buffer;
+	}
+
+	int fd = allocateDmabuf(size);
+	if (fd < 0) {
+		LOG(BufferAllocator, Error)
+			<< "Failed to allocate " << size << " bytes: "
+			<< strerror(-fd);
+		return nullptr;
+	}
+
+	std::unique_ptr<BufferMemory> buffer = utils::make_unique<BufferMemory>();
+	buffer->planes().emplace_back();
+	int ret = buffer->planes().back().setDmabuf(fd, size);
+	close(fd);
+
+	if (ret < 0)
+		return nullptr;
+
+	return buffer;
+}
+
+/**
+ * \brief Allocate buffers for a stream configuration
+ * \param[in] cfg The stream configuration
+ * \param[out] buffers The vector to append the buffers to
+ *
+ * This method allocates cfg.bufferCount buffers, sized with frameSize(), and
+ * appends them to \a buffers. If any allocation fails, the buffers allocated
+ * by this call are returned to the pool and \a buffers is left unmodified.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -EINVAL The frame size can't be computed for the configuration
+ * \retval -ENOMEM Memory allocation failed
+ */
+int BufferAllocator::allocate(const StreamConfiguration &cfg,
+			      std::vector<std::unique_ptr<BufferMemory>> *buffers)
+{
+	unsigned int size = frameSize(cfg);
+	if (!size) {
+		LOG(BufferAllocator, Error)
+			<< "Can't compute frame size for " << cfg.toString();
+		return -EINVAL;
+	}
+
+	std::vector<std::unique_ptr<BufferMemory>> allocated;
+	for (unsigned int i = 0; i < cfg.bufferCount; ++i) {
+		std::unique_ptr<BufferMemory> buffer = allocate(size);
+		if (!buffer) {
+			release(&allocated);
+			return -ENOMEM;
+		}
+
+		allocated.push_back(std::move(buffer));
+	}
+
+	for (std::unique_ptr<BufferMemory> &buffer : allocated)
+		buffers->push_back(std::move(buffer));
+
+	return 0;
+}
+
+/**
+ * \brief Return a buffer to the pool
+ * \param[in] buffer The buffer
+ *
+ * The \a buffer shall have been allocated by this allocator. The application
+ * shall ensure the buffer isn't in use by any stream when releasing it.
+ */
+void BufferAllocator::release(std::unique_ptr<BufferMemory> buffer)
+{
+	if (!buffer || buffer->planes().size() != 1)
+		return;
+
+	unsigned int size = buffer->planes()[0].length();
+	pool_.emplace(size, std::move(buffer));
+}
+
+/**
+ * \brief Return buffers to the pool
+ * \param[inout] buffers The buffers
+ *
+ * This method releases all the \a buffers with release(), and clears the
+ * \a buffers vector.
+ */
+void BufferAllocator::release(std::vector<std::unique_ptr<BufferMemory>> *buffers)
+{
+	for (std::unique_ptr<BufferMemory> &buffer : *buffers)
+		release(std::move(buffer));
+
+	buffers->clear();
+}
+
+/**
+ * \brief Free all the buffers in the pool
+ */
+void BufferAllocator::purge()
+{
+	pool_.clear();
+}
+
+/**
+ * \fn BufferAllocator::pooled()
+ * \brief Retrieve the number of buffers in the pool
+ * \return The number of released buffers available for reuse
+ */
+
+/**
+ * \brief Compute the frame size for a stream configuration
+ * \param[in] cfg The stream configuration
+ *
+ * The frame size is computed from the pixel format and size of \a cfg,
+ * assuming lines are not padded. Devices that require padded lines need
+ * larger buffers, which can be allocated with allocate(unsigned int).
+ *
+ * \return The frame size in bytes, or 0 if the pixel format is not supported
+ */
+unsigned int BufferAllocator::frameSize(const StreamConfiguration &cfg)
+{
+	unsigned int pixels = cfg.size.width * cfg.size.height;
+
+	switch (cfg.pixelFormat) {
+	case V4L2_PIX_FMT_GREY:
+	case V4L2_PIX_FMT_SBGGR8:
+	case V4L2_PIX_FMT_SGBRG8:
+	case V4L2_PIX_FMT_SGRBG8:
+	case V4L2_PIX_FMT_SRGGB8:
+		return pixels;
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_NV21:
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+		return pixels * 3 / 2;
+	case V4L2_PIX_FMT_NV16:
+	case V4L2_PIX_FMT_NV61:
+	case V4L2_PIX_FMT_YUYV:
+	case V4L2_PIX_FMT_YVYU:
+	case V4L2_PIX_FMT_UYVY:
+	case V4L2_PIX_FMT_VYUY:
+		return pixels * 2;
+	case V4L2_PIX_FMT_NV24:
+	case V4L2_PIX_FMT_NV42:
+	case V4L2_PIX_FMT_RGB24:
+	case V4L2_PIX_FMT_BGR24:
+		return pixels * 3;
+	case V4L2_PIX_FMT_ARGB32:
+	case V4L2_PIX_FMT_ABGR32:
+		return pixels * 4;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Allocate a dmabuf of \a size bytes from the backend. Return the file
+ * descriptor on success, or a negative error code otherwise.
+ */
+int BufferAllocator::allocateDmabuf(unsigned int size)
+{
+	int ret;
+
+	if (backend_ == DmaHeap) {
+		struct dma_heap_allocation_data data = {};
+		data.len = size;
+		data.fd_flags = O_RDWR | O_CLOEXEC;
+
+		ret = ioctl(fd_, DMA_HEAP_IOCTL_ALLOC, &data);
+		if (ret < 0)
+			return -errno;
+
+		return data.fd;
+	}
+
+	int memfd = memfd_create("libcamera", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (memfd < 0)
+		return -errno;
+
+	/* udmabuf requires the memfd to be sealed against shrinking. */
+	if (ftruncate(memfd, size) < 0 ||
+	    fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK) < 0) {
+		ret = -errno;
+		close(memfd);
+		return ret;
+	}
+
+	if (backend_ == Memfd)
+		return memfd;
+
+	struct udmabuf_create create = {};
+	create.memfd = memfd;
+	create.flags = UDMABUF_FLAGS_CLOEXEC;
+	create.offset = 0;
+	create.size = size;
+
+	ret = ioctl(fd_, UDMABUF_CREATE, &create);
+	if (ret < 0)
+		ret = -errno;
+
+	close(memfd);
+
+	return ret;
+}
+
+} /* namespace libcamera */
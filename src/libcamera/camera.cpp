@@ -9,6 +9,7 @@
 
 #include <iomanip>
 
+#include <libcamera/camera_manager.h>
 #include <libcamera/request.h>
 #include <libcamera/stream.h>
 
@@ -342,6 +343,25 @@ std::size_t CameraConfiguration::size() const
  * The camera is running and ready to process requests queued by the
  * application. The camera remains in this state until it is stopped and moved
  * to the Prepared state.
+ *
+ * \section camera_threading Threading Model
+ *
+ * The pipeline handler that backs a camera runs in an internal thread of the
+ * camera manager, isolated from the application's event loop. Camera methods
+ * shall be called from the thread that created the camera manager, referred
+ * to as the application thread. Methods that need to access the pipeline
+ * handler invoke it synchronously in the internal thread and return once the
+ * operation has completed.
+ *
+ * The #bufferCompleted, #requestCompleted and #disconnected signals are
+ * emitted in the application thread. Completion events are queued by the
+ * internal thread and delivered to the application through the message queue
+ * of the application thread, which the camera manager's event dispatcher
+ * processes. A slow signal handler thus doesn't delay the processing of
+ * buffers by the pipeline handler, but completed requests accumulate until
+ * the application processes them. The number of completed requests waiting to
+ * be delivered can be monitored with completionBacklog() and
+ * maxCompletionBacklog().
  */
 
 /**
@@ -399,13 +419,15 @@ const std::string &Camera::name() const
  * removed from the system. For hot-pluggable devices this is usually caused by
  * physical device disconnection. The media device is passed as a parameter.
  *
- * As soon as this signal is emitted the camera instance will refuse all new
- * application API calls by returning errors immediately.
+ * The camera instance refuses all new application API calls by returning
+ * errors immediately as soon as the disconnection is detected, which may
+ * happen slightly before this signal is emitted in the application thread.
  */
 
 Camera::Camera(PipelineHandler *pipe, const std::string &name)
 	: pipe_(pipe->shared_from_this()), name_(name), disconnected_(false),
-	  state_(CameraAvailable)
+	  state_(CameraAvailable), completionHead_(0), backlog_(0),
+	  maxBacklog_(0)
 {
 }
 
@@ -413,6 +435,17 @@ Camera::~Camera()
 {
 	if (!stateIs(CameraAvailable))
 		LOG(Camera, Error) << "Removing camera while still in use";
+
+	/*
+	 * Single-use requests that haven't been delivered are owned by the
+	 * camera.
+	 */
+	for (unsigned int i = completionHead_; i < completions_.size(); ++i) {
+		const Completion &completion = completions_[i];
+		if (completion.type == Completion::RequestCompleted &&
+		    !completion.request->reusable())
+			delete completion.request;
+	}
 }
 
 static const char *const camera_state_names[] = {
@@ -458,9 +491,9 @@ bool Camera::stateIs(State state) const
  *
  * This method is used to notify the camera instance that the underlying
  * hardware has been unplugged. In response to the disconnection the camera
- * instance notifies the application by emitting the #disconnected signal, and
- * ensures that all new calls to the application-facing Camera API return an
- * error immediately.
+ * instance ensures that all new calls to the application-facing Camera API
+ * return an error immediately, and notifies the application by emitting the
+ * #disconnected signal in the application thread.
  *
  * \todo Deal with pending requests if the camera is disconnected in a
  * running state.
@@ -471,16 +504,8 @@ void Camera::disconnect()
 {
 	LOG(Camera, Debug) << "Disconnecting camera " << name_;
 
-	/*
-	 * If the camera was running when the hardware was removed force the
-	 * state to Prepared to allow applications to call freeBuffers() and
-	 * release() before deleting the camera.
-	 */
-	if (state_ == CameraRunning)
-		state_ = CameraPrepared;
-
 	disconnected_ = true;
-	disconnected.emit(this);
+	postCompletion({ Completion::Disconnected, nullptr, nullptr });
 }
 
 /**
@@ -593,7 +618,9 @@ std::unique_ptr<CameraConfiguration> Camera::generateConfiguration(const StreamR
 	if (disconnected_ || roles.size() > streams_.size())
 		return nullptr;
 
-	CameraConfiguration *config = pipe_->generateConfiguration(this, roles);
+	CameraConfiguration *config =
+		pipe_->invokeMethod(&PipelineHandler::generateConfiguration,
+				    ConnectionTypeBlocking, this, roles);
 	if (!config) {
 		LOG(Camera, Debug)
 			<< "Pipeline handler failed to generate configuration";
@@ -665,7 +692,8 @@ int Camera::configure(CameraConfiguration *config)
 
 	LOG(Camera, Info) << msg.str();
 
-	ret = pipe_->configure(this, config);
+	ret = pipe_->invokeMethod(&PipelineHandler::configure,
+				  ConnectionTypeBlocking, this, config);
 	if (ret)
 		return ret;
 
@@ -715,12 +743,17 @@ int Camera::allocateBuffers()
 		return -EINVAL;
 	}
 
-	int ret = pipe_->allocateBuffers(this, activeStreams_);
+	int ret = pipe_->invokeMethod(&PipelineHandler::allocateBuffers,
+				      ConnectionTypeBlocking, this,
+				      activeStreams_);
 	if (ret) {
 		LOG(Camera, Error) << "Failed to allocate buffers";
 		return ret;
 	}
 
+	for (Stream *stream : activeStreams_)
+		stream->applyMappingPolicy();
+
 	state_ = CameraPrepared;
 
 	return 0;
@@ -749,7 +782,8 @@ int Camera::freeBuffers()
 
 	state_ = CameraConfigured;
 
-	return pipe_->freeBuffers(this, activeStreams_);
+	return pipe_->invokeMethod(&PipelineHandler::freeBuffers,
+				   ConnectionTypeBlocking, this, activeStreams_);
 }
 
 /**
@@ -780,25 +814,62 @@ Request *Camera::createRequest(uint64_t cookie)
 	return new Request(this, cookie);
 }
 
+/**
+ * \brief Create a reusable request object for the camera
+ * \param[in] cookie Opaque cookie for application use
+ *
+ * This method creates an empty reusable request for the application to fill
+ * with buffers and parameters, and queue for capture. Unlike requests created
+ * with createRequest(), reusable requests stay owned by the application when
+ * queued, and are not deleted when they complete. Once completed, a reusable
+ * request can be reset with Request::reuse() and queued again with the same
+ * buffers. This allows capturing frames without allocating any Request or
+ * Buffer in steady state.
+ *
+ * The application shall not delete a reusable request while it is queued to
+ * the camera. All queued requests complete before stop() returns.
+ *
+ * This function shall only be called when the camera is in the Prepared
+ * or Running state, see \ref camera_operation.
+ *
+ * \return A pointer to the newly created request, or nullptr on error
+ */
+std::unique_ptr<Request> Camera::createReusableRequest(uint64_t cookie)
+{
+	if (disconnected_ || !stateBetween(CameraPrepared, CameraRunning))
+		return nullptr;
+
+	return utils::make_unique<Request>(this, cookie, true);
+}
+
 /**
  * \brief Queue a request to the camera
  * \param[in] request The request to queue to the camera
  *
  * This method queues a \a request to the camera for capture.
  *
- * After allocating the request with createRequest(), the application shall
- * fill it with at least one capture buffer before queuing it. Requests that
- * contain no buffers are invalid and are rejected without being queued.
+ * After allocating the request with createRequest() or createReusableRequest(),
+ * the application shall fill it with at least one capture buffer before
+ * queuing it. Requests that contain no buffers are invalid and are rejected
+ * without being queued. Reusable requests that have completed shall be reset
+ * with Request::reuse() before being queued again.
  *
  * Once the request has been queued, the camera will notify its completion
  * through the \ref requestCompleted signal.
  *
- * Ownership of the request is transferred to the camera. It will be deleted
- * automatically after it completes.
+ * Buffers may carry acquire fences, set with Buffer::setAcquireFence(). This
+ * method doesn't wait for the fences to signal. The request is held back
+ * until then, and is cancelled if the camera is stopped before it could be
+ * processed.
+ *
+ * Ownership of single-use requests is transferred to the camera. They will be
+ * deleted automatically after they complete. Reusable requests stay owned by
+ * the application.
  *
  * \return 0 on success or a negative error code otherwise
  * \retval -ENODEV The camera has been disconnected from the system
  * \retval -EACCES The camera is not running so requests can't be queued
+ * \retval -EBUSY The request is already queued
  * \retval -EINVAL The request is invalid
  * \retval -ENOMEM No buffer memory was available to handle the request
  */
@@ -810,6 +881,16 @@ int Camera::queueRequest(Request *request)
 	if (!stateIs(CameraRunning))
 		return -EACCES;
 
+	if (request->hasPendingBuffers()) {
+		LOG(Camera, Error) << "Request already queued";
+		return -EBUSY;
+	}
+
+	if (request->status() != Request::RequestPending) {
+		LOG(Camera, Error) << "Completed request queued without reuse";
+		return -EINVAL;
+	}
+
 	for (auto const &it : request->buffers()) {
 		Stream *stream = it.first;
 		Buffer *buffer = it.second;
@@ -838,7 +919,8 @@ int Camera::queueRequest(Request *request)
 		return ret;
 	}
 
-	return pipe_->queueRequest(this, request);
+	return pipe_->invokeMethod(&PipelineHandler::submitRequest,
+				   ConnectionTypeBlocking, this, request);
 }
 
 /**
@@ -864,7 +946,13 @@ int Camera::start()
 
 	LOG(Camera, Debug) << "Starting capture";
 
-	int ret = pipe_->start(this);
+	{
+		std::lock_guard<std::mutex> locker(completionMutex_);
+		maxBacklog_ = backlog_;
+	}
+
+	int ret = pipe_->invokeMethod(&PipelineHandler::start,
+				      ConnectionTypeBlocking, this);
 	if (ret)
 		return ret;
 
@@ -877,7 +965,10 @@ int Camera::start()
  * \brief Stop capture from camera
  *
  * This method stops capturing and processing requests immediately. All pending
- * requests are cancelled and complete synchronously in an error state.
+ * requests are cancelled and complete synchronously in an error state. The
+ * #requestCompleted signal is emitted for all of them, as well as for the
+ * completed requests that haven't been delivered to the application yet,
+ * before this method returns.
  *
  * This function affects the state of the camera, see \ref camera_operation.
  *
@@ -897,30 +988,183 @@ int Camera::stop()
 
 	state_ = CameraPrepared;
 
-	pipe_->stop(this);
+	pipe_->invokeMethod(&PipelineHandler::stopCapture,
+			    ConnectionTypeBlocking, this);
+
+	deliverCompletions();
 
 	return 0;
 }
 
+/**
+ * \brief Retrieve the number of completed requests not delivered yet
+ *
+ * Completed requests are queued by the pipeline handler thread and delivered
+ * to the application thread asynchronously. This method returns the number of
+ * requests that have completed but for which the #requestCompleted signal
+ * hasn't been emitted yet. A backlog that keeps growing indicates that the
+ * application doesn't process completed requests as fast as the camera
+ * produces them.
+ *
+ * \return The number of completed requests waiting to be delivered
+ */
+unsigned int Camera::completionBacklog() const
+{
+	std::lock_guard<std::mutex> locker(completionMutex_);
+	return backlog_;
+}
+
+/**
+ * \brief Retrieve the largest backlog of completed requests
+ *
+ * This method returns the largest value of completionBacklog() reached since
+ * the camera was last started.
+ *
+ * \return The maximum number of completed requests waiting to be delivered
+ */
+unsigned int Camera::maxCompletionBacklog() const
+{
+	std::lock_guard<std::mutex> locker(completionMutex_);
+	return maxBacklog_;
+}
+
+/**
+ * \brief Handle buffer completion and notify application
+ * \param[in] request The request the buffer belongs to
+ * \param[in] buffer The buffer that has completed
+ *
+ * This function is called by the pipeline handler to notify the camera that
+ * the \a buffer has completed. The bufferCompleted signal is emitted in the
+ * application thread.
+ */
+void Camera::bufferComplete(Request *request, Buffer *buffer)
+{
+	postCompletion({ Completion::BufferCompleted, request, buffer });
+}
+
 /**
  * \brief Handle request completion and notify application
  * \param[in] request The request that has completed
  *
  * This function is called by the pipeline handler to notify the camera that
- * the request has completed. It emits the requestCompleted signal and deletes
- * the request.
+ * the request has completed. The requestCompleted signal is emitted and the
+ * request deleted, unless it is reusable, in the application thread.
  */
 void Camera::requestComplete(Request *request)
 {
-	for (auto it : request->buffers()) {
-		Stream *stream = it.first;
-		Buffer *buffer = it.second;
-		if (stream->memoryType() == ExternalMemory)
-			stream->unmapBuffer(buffer);
+	postCompletion({ Completion::RequestCompleted, request, nullptr });
+}
+
+/**
+ * \brief Queue a completion event for delivery to the application thread
+ * \param[in] completion The completion event
+ *
+ * Completion events are queued in order. When the queue becomes non-empty, a
+ * delivery is scheduled in the application thread through the camera manager.
+ */
+void Camera::postCompletion(const Completion &completion)
+{
+	bool schedule;
+
+	{
+		std::lock_guard<std::mutex> locker(completionMutex_);
+
+		schedule = completionHead_ == completions_.size();
+		completions_.push_back(completion);
+
+		if (completion.type == Completion::RequestCompleted) {
+			backlog_++;
+			maxBacklog_ = std::max(maxBacklog_, backlog_);
+		}
 	}
 
-	requestCompleted.emit(request, request->buffers());
-	delete request;
+	if (!schedule)
+		return;
+
+	CameraManager *manager = pipe_->manager();
+	manager->invokeMethod(&CameraManager::deliverCompletions,
+			      ConnectionTypeQueued,
+			      std::weak_ptr<Camera>(shared_from_this()));
+}
+
+/**
+ * \brief Deliver queued completion events to the application
+ *
+ * This function is called in the application thread to emit the signals
+ * corresponding to all queued completion events.
+ */
+void Camera::deliverCompletions()
+{
+	while (true) {
+		Completion completion;
+
+		{
+			std::lock_guard<std::mutex> locker(completionMutex_);
+
+			if (completionHead_ == completions_.size()) {
+				/*
+				 * Reset the queue when drained, keeping its
+				 * storage to avoid reallocation.
+				 */
+				completions_.clear();
+				completionHead_ = 0;
+				return;
+			}
+
+			completion = completions_[completionHead_++];
+
+			if (completion.type == Completion::RequestCompleted)
+				backlog_--;
+
+			/*
+			 * The queue may never drain if completions keep being
+			 * posted while they're delivered. Drop the delivered
+			 * entries once they make up half of the queue, to
+			 * bound its size without reallocating.
+			 */
+			if (completionHead_ * 2 >= completions_.size()) {
+				completions_.erase(completions_.begin(),
+						   completions_.begin() + completionHead_);
+				completionHead_ = 0;
+			}
+		}
+
+		switch (completion.type) {
+		case Completion::BufferCompleted:
+			bufferCompleted.emit(completion.request,
+					     completion.buffer);
+			break;
+
+		case Completion::RequestCompleted: {
+			Request *request = completion.request;
+
+			for (auto it : request->buffers()) {
+				Stream *stream = it.first;
+				Buffer *buffer = it.second;
+				if (stream->memoryType() == ExternalMemory)
+					stream->unmapBuffer(buffer);
+			}
+
+			requestCompleted.emit(request, request->buffers());
+			if (!request->reusable())
+				delete request;
+			break;
+		}
+
+		case Completion::Disconnected:
+			/*
+			 * If the camera was running when the hardware was
+			 * removed force the state to Prepared to allow
+			 * applications to call freeBuffers() and release()
+			 * before deleting the camera.
+			 */
+			if (state_ == CameraRunning)
+				state_ = CameraPrepared;
+
+			disconnected.emit(this);
+			break;
+		}
+	}
 }
 
 } /* namespace libcamera */
@@ -7,13 +7,16 @@
 
 #include <libcamera/camera_manager.h>
 
+#include <string.h>
+
 #include <libcamera/camera.h>
 #include <libcamera/event_dispatcher.h>
 
 #include "device_enumerator.h"
-#include "event_dispatcher_poll.h"
+#include "ipa_manager.h"
 #include "log.h"
 #include "pipeline_handler.h"
+#include "semaphore.h"
 #include "thread.h"
 #include "utils.h"
 
@@ -42,12 +45,21 @@ LOG_DEFINE_CATEGORY(Camera)
  *
  * The manager is initially stopped, and shall be configured before being
  * started. In particular a custom event dispatcher shall be installed if
- * needed with CameraManager::setEventDispatcher().
+ * needed with CameraManager::setEventDispatcher(), and the scheduling
+ * parameters of the threads that handle cameras may be set with
+ * CameraManager::setScheduling().
  *
  * Once the camera manager is configured, it shall be started with start().
  * This will enumerate all the cameras present in the system, which can then be
  * listed with list() and retrieved with get().
  *
+ * The camera manager runs the pipeline handlers, and the devices and IPA
+ * modules they control, in an internal thread. The thread that creates the
+ * camera manager is referred to as the application thread. Camera events are
+ * delivered to the application thread through its event dispatcher, which
+ * shall thus process events for the application to receive them, see
+ * \ref camera_threading for more information.
+ *
  * Cameras are shared through std::shared_ptr<>, ensuring that a camera will
  * stay valid until the last reference is released without requiring any special
  * action from the application. Once the application has released all the
@@ -59,10 +71,66 @@ LOG_DEFINE_CATEGORY(Camera)
  * removed due to hot-unplug.
  */
 
+class CameraManager::CameraThread : public Thread
+{
+public:
+	CameraThread(CameraManager *manager)
+		: manager_(manager), status_(0)
+	{
+	}
+
+	int startAndEnumerate();
+
+protected:
+	void run() override;
+
+private:
+	CameraManager *manager_;
+	Semaphore ready_;
+	int status_;
+};
+
+/*
+ * Start the thread and wait until it has enumerated the cameras. The thread
+ * stops immediately if enumeration fails.
+ */
+int CameraManager::CameraThread::startAndEnumerate()
+{
+	start();
+	ready_.acquire();
+
+	if (status_ < 0)
+		wait();
+
+	return status_;
+}
+
+void CameraManager::CameraThread::run()
+{
+	/*
+	 * Pipeline handlers, and all the objects they create, are bound to the
+	 * thread they're created in. Enumerate cameras in this thread to bind
+	 * them to it, and destroy them in this thread as well when stopping.
+	 */
+	status_ = manager_->enumerate();
+	if (status_ < 0) {
+		manager_->cleanup();
+		ready_.release();
+		return;
+	}
+
+	ready_.release();
+
+	exec();
+
+	manager_->cleanup();
+}
+
 CameraManager *CameraManager::self_ = nullptr;
 
 CameraManager::CameraManager()
-	: enumerator_(nullptr)
+	: cameraThread_(utils::make_unique<CameraThread>(this)),
+	  enumerator_(nullptr)
 {
 	if (self_)
 		LOG(Camera, Fatal)
@@ -73,6 +141,8 @@ CameraManager::CameraManager()
 
 CameraManager::~CameraManager()
 {
+	stop();
+
 	self_ = nullptr;
 }
 
@@ -84,19 +154,37 @@ CameraManager::~CameraManager()
  * interact with cameras in the system until either the camera manager
  * is stopped or the camera is unplugged from the system.
  *
+ * The internal thread that handles cameras is started, and devices are
+ * enumerated in that thread. This function blocks until enumeration completes.
+ *
  * \return 0 on success or a negative error code otherwise
  */
 int CameraManager::start()
 {
-	if (enumerator_)
+	if (cameraThread_->isRunning())
 		return -EBUSY;
 
 	LOG(Camera, Info) << "libcamera " << version_;
 
+	applyScheduling();
+
+	return cameraThread_->startAndEnumerate();
+}
+
+/*
+ * Enumerate devices and match pipeline handlers. This runs in the internal
+ * thread.
+ */
+int CameraManager::enumerate()
+{
+	utils::time_point start = utils::clock::now();
+
 	enumerator_ = DeviceEnumerator::create();
 	if (!enumerator_ || enumerator_->enumerate())
 		return -ENODEV;
 
+	utils::time_point matchStart = utils::clock::now();
+
 	/*
 	 * TODO: Try to read handlers and order from configuration
 	 * file and only fallback on all handlers if there is no
@@ -121,6 +209,18 @@ int CameraManager::start()
 		}
 	}
 
+	utils::time_point end = utils::clock::now();
+	const DeviceEnumerator::Timings &timings = enumerator_->timings();
+	auto us = [](utils::duration duration) {
+		return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+	};
+
+	LOG(Camera, Debug)
+		<< "Enumeration completed in " << us(end - start) << "us (scan "
+		<< us(timings.scan) << "us, populate " << us(timings.populate)
+		<< "us, merge " << us(timings.merge) << "us, match "
+		<< us(end - matchStart) << "us)";
+
 	/* TODO: register hot-plug callback here */
 
 	return 0;
@@ -135,8 +235,21 @@ int CameraManager::start()
  * After the manager has been stopped no resource provided by the camera
  * manager should be consider valid or functional even if they for one
  * reason or another have yet to be deleted.
+ *
+ * The internal thread that handles cameras is stopped, and this function
+ * blocks until it has released all its resources.
  */
 void CameraManager::stop()
+{
+	cameraThread_->exit();
+	cameraThread_->wait();
+}
+
+/*
+ * Release the pipeline handlers and the device enumerator. This runs in the
+ * internal thread when it stops.
+ */
+void CameraManager::cleanup()
 {
 	/* TODO: unregister hot-plug callback here */
 
@@ -146,20 +259,51 @@ void CameraManager::stop()
 	 * media devices.
 	 */
 	pipes_.clear();
-	cameras_.clear();
+
+	std::vector<std::shared_ptr<Camera>> cameras;
+	{
+		std::lock_guard<std::mutex> locker(mutex_);
+		cameras.swap(cameras_);
+	}
+	cameras.clear();
 
 	enumerator_.reset(nullptr);
 }
 
+void CameraManager::applyScheduling()
+{
+	auto iter = scheduling_.find(PipelineThread);
+	if (iter != scheduling_.end()) {
+		int ret = cameraThread_->setScheduling(iter->second);
+		if (ret < 0)
+			LOG(Camera, Warning)
+				<< "Failed to set pipeline thread scheduling "
+				<< iter->second.toString() << ": "
+				<< strerror(-ret);
+	}
+
+	iter = scheduling_.find(IPAThread);
+	if (iter != scheduling_.end())
+		IPAManager::instance()->setProxyScheduling(iter->second);
+}
+
 /**
- * \fn CameraManager::cameras()
  * \brief Retrieve all available cameras
  *
  * Before calling this function the caller is responsible for ensuring that
  * the camera manager is running.
  *
+ * As cameras may be added or removed by the internal thread at any time, this
+ * function returns a copy of the list of cameras at the time of the call.
+ *
  * \return List of all available cameras
  */
+std::vector<std::shared_ptr<Camera>> CameraManager::cameras() const
+{
+	std::lock_guard<std::mutex> locker(mutex_);
+
+	return cameras_;
+}
 
 /**
  * \brief Get a camera based on name
@@ -172,6 +316,8 @@ void CameraManager::stop()
  */
 std::shared_ptr<Camera> CameraManager::get(const std::string &name)
 {
+	std::lock_guard<std::mutex> locker(mutex_);
+
 	for (std::shared_ptr<Camera> camera : cameras_) {
 		if (camera->name() == name)
 			return camera;
@@ -190,6 +336,8 @@ std::shared_ptr<Camera> CameraManager::get(const std::string &name)
  */
 void CameraManager::addCamera(std::shared_ptr<Camera> camera)
 {
+	std::lock_guard<std::mutex> locker(mutex_);
+
 	for (std::shared_ptr<Camera> c : cameras_) {
 		if (c->name() == camera->name()) {
 			LOG(Camera, Warning)
@@ -212,6 +360,8 @@ void CameraManager::addCamera(std::shared_ptr<Camera> camera)
  */
 void CameraManager::removeCamera(Camera *camera)
 {
+	std::lock_guard<std::mutex> locker(mutex_);
+
 	for (auto iter = cameras_.begin(); iter != cameras_.end(); ++iter) {
 		if (iter->get() == camera) {
 			LOG(Camera, Debug)
@@ -234,10 +384,14 @@ void CameraManager::removeCamera(Camera *camera)
  * \param[in] dispatcher Pointer to the event dispatcher
  *
  * libcamera requires an event dispatcher to integrate event notification and
- * timers with the application event loop. Applications that want to provide
- * their own event dispatcher shall call this function once and only once before
- * the camera manager is started with start(). If no event dispatcher is
- * provided, a default poll-based implementation will be used.
+ * timers with the application event loop, and to deliver camera events to the
+ * application thread. Applications that want to provide their own event
+ * dispatcher shall call this function once and only once before the camera
+ * manager is started with start(). If no event dispatcher is provided, a
+ * default implementation will be used.
+ *
+ * The event dispatcher is only used in the application thread. The internal
+ * thread that handles cameras always uses a default implementation.
  *
  * The CameraManager takes ownership of the event dispatcher and will delete it
  * when the application terminates.
@@ -247,12 +401,75 @@ void CameraManager::setEventDispatcher(std::unique_ptr<EventDispatcher> dispatch
 	thread()->setEventDispatcher(std::move(dispatcher));
 }
 
+/**
+ * \enum CameraManager::ThreadRole
+ * \brief The role of a thread used to handle cameras
+ * \var CameraManager::PipelineThread
+ * \brief The thread in which pipeline handlers process device events, such as
+ * buffer completion
+ * \var CameraManager::IPAThread
+ * \brief The threads or processes running the IPA modules in isolation
+ */
+
+/**
+ * \brief Set the scheduling parameters for threads with a given role
+ * \param[in] role The thread role
+ * \param[in] scheduling The scheduling parameters
+ *
+ * Applications that need to reduce frame delivery jitter can use this function
+ * to run the camera handling threads with a real-time scheduling policy, or to
+ * pin them to isolated CPU cores. The scheduling parameters shall be set before
+ * the camera manager is started with start(), and are applied when it starts.
+ *
+ * The PipelineThread parameters are applied to the camera manager's internal
+ * thread, in which pipeline handlers run, and don't affect the application
+ * thread. The IPAThread parameters are applied to the processes of the IPA
+ * modules that run in isolation, and don't affect the IPA modules running in
+ * the pipeline handler's thread.
+ *
+ * Failures to apply the scheduling parameters, typically due to insufficient
+ * privileges for real-time policies, are logged but don't prevent the camera
+ * manager from starting.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -EBUSY The camera manager is already started
+ * \retval -EINVAL The scheduling parameters or the role are invalid
+ */
+int CameraManager::setScheduling(ThreadRole role,
+				 const ThreadScheduling &scheduling)
+{
+	if (cameraThread_->isRunning())
+		return -EBUSY;
+
+	if (role != PipelineThread && role != IPAThread)
+		return -EINVAL;
+
+	int ret = scheduling.validate();
+	if (ret < 0)
+		return ret;
+
+	scheduling_[role] = scheduling;
+	return 0;
+}
+
+/*
+ * Deliver the completion events queued by a camera in the application thread.
+ * The camera may have been destroyed by the time this function is called.
+ */
+void CameraManager::deliverCompletions(std::weak_ptr<Camera> camera)
+{
+	std::shared_ptr<Camera> ptr = camera.lock();
+	if (ptr)
+		ptr->deliverCompletions();
+}
+
 /**
  * \brief Retrieve the event dispatcher
  *
  * This function retrieves the event dispatcher set with setEventDispatcher().
- * If no dispatcher has been set, a default poll-based implementation is created
- * and returned, and no custom event dispatcher may be installed anymore.
+ * If no dispatcher has been set, a default implementation is created and
+ * returned, and no custom event dispatcher may be installed anymore. The
+ * default implementation is selected as documented in the Thread class.
  *
  * The returned event dispatcher is valid until the camera manager is destroyed.
  *
@@ -0,0 +1,389 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * device_cache.cpp - Persistent cache of device enumeration data
+ */
+
+#include "device_cache.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sstream>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#include "formats.h"
+#include "log.h"
+#include "utils.h"
+
+/**
+ * \file device_cache.h
+ * \brief Persistent cache of device enumeration data
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(DeviceCache)
+
+namespace {
+
+constexpr uint32_t kCacheMagic = 0x4344434c; /* "LCDC" */
+constexpr uint32_t kCacheVersion = 1;
+
+} /* namespace */
+
+/**
+ * \class DeviceCacheData
+ * \brief Serialized data stored in the DeviceCache
+ *
+ * The DeviceCacheData class stores a sequence of values in a byte array.
+ * Values are appended with the append() methods, and extracted in the same
+ * order with the extract() methods. Only plain old data types, vectors of
+ * plain old data types, strings and ImageFormats are supported. The data is
+ * stored in native byte order, and is thus not portable across systems.
+ */
+
+/**
+ * \fn DeviceCacheData::append(const T &value)
+ * \brief Append a plain old data \a value
+ * \param[in] value The value
+ */
+
+/**
+ * \fn DeviceCacheData::append(const std::vector<T> &values)
+ * \brief Append a vector of plain old data \a values
+ * \param[in] values The values
+ */
+
+/**
+ * \brief Append a string
+ * \param[in] value The string
+ */
+void DeviceCacheData::append(const std::string &value)
+{
+	append<uint32_t>(value.size());
+	data_.insert(data_.end(), value.begin(), value.end());
+}
+
+/**
+ * \brief Append image formats
+ * \param[in] formats The image formats
+ */
+void DeviceCacheData::append(const ImageFormats &formats)
+{
+	append<uint32_t>(formats.data().size());
+
+	for (const auto &format : formats.data()) {
+		append<uint32_t>(format.first);
+		append<uint32_t>(format.second.size());
+
+		for (const SizeRange &range : format.second) {
+			append<uint32_t>(range.min.width);
+			append<uint32_t>(range.min.height);
+			append<uint32_t>(range.max.width);
+			append<uint32_t>(range.max.height);
+			append<uint32_t>(range.hStep);
+			append<uint32_t>(range.vStep);
+		}
+	}
+}
+
+/**
+ * \fn DeviceCacheData::extract(T *value)
+ * \brief Extract a plain old data value
+ * \param[out] value The value
+ * \return True on success, false if the data is truncated
+ */
+
+/**
+ * \fn DeviceCacheData::extract(std::vector<T> *values)
+ * \brief Extract a vector of plain old data values
+ * \param[out] values The values
+ * \return True on success, false if the data is truncated
+ */
+
+/**
+ * \brief Extract a string
+ * \param[out] value The string
+ * \return True on success, false if the data is truncated
+ */
+bool DeviceCacheData::extract(std::string *value)
+{
+	uint32_t size;
+	if (!extract(&size) || data_.size() - offset_ < size)
+		return false;
+
+	value->assign(reinterpret_cast<const char *>(&data_[offset_]), size);
+	offset_ += size;
+	return true;
+}
+
+/**
+ * \brief Extract image formats
+ * \param[out] formats The image formats
+ * \return True on success, false if the data is truncated or invalid
+ */
+bool DeviceCacheData::extract(ImageFormats *formats)
+{
+	uint32_t count;
+	if (!extract(&count))
+		return false;
+
+	for (uint32_t i = 0; i < count; ++i) {
+		uint32_t format;
+		uint32_t numRanges;
+		if (!extract(&format) || !extract(&numRanges))
+			return false;
+
+		std::vector<SizeRange> ranges;
+		for (uint32_t j = 0; j < numRanges; ++j) {
+			uint32_t values[6];
+			for (uint32_t &value : values) {
+				if (!extract(&value))
+					return false;
+			}
+
+			ranges.emplace_back(values[0], values[1], values[2],
+					    values[3], values[4], values[5]);
+		}
+
+		if (formats->addFormat(format, ranges))
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * \fn DeviceCacheData::data()
+ * \brief Retrieve the serialized data
+ * \return The serialized data
+ */
+
+/**
+ * \class DeviceCache
+ * \brief Persistent cache of device enumeration data
+ *
+ * Enumerating media devices, V4L2 controls and formats requires a large number
+ * of ioctl calls, whose cost is paid every time a process starts a
+ * CameraManager. The DeviceCache stores the results of those enumerations on
+ * disk, to speed up enumeration in short-lived processes.
+ *
+ * The cache is disabled by default. It is enabled by setting the
+ * LIBCAMERA_DEVICE_CACHE environment variable to the path of a directory where
+ * the cache files will be stored. The directory is created if it doesn't
+ * exist.
+ *
+ * Each cache entry is identified by a key, and stored along with a tag that
+ * identifies the device state the data was retrieved from. Entries whose tag
+ * doesn't match the tag of the device being enumerated are invalidated and
+ * removed from the cache. Tags are built from deviceTag(), which identifies
+ * the kernel and the device node instance, and from device-specific
+ * information such as the driver name, bus information and model.
+ *
+ * Only data that doesn't depend on the device configuration shall be cached,
+ * unless its users detect changes and remove() the entry.
+ */
+
+DeviceCache::DeviceCache()
+{
+	const char *path = utils::secure_getenv("LIBCAMERA_DEVICE_CACHE");
+	if (!path || !*path)
+		return;
+
+	if (mkdir(path, 0700) < 0 && errno != EEXIST) {
+		LOG(DeviceCache, Warning)
+			<< "Failed to create cache directory " << path
+			<< ": " << strerror(errno);
+		return;
+	}
+
+	struct utsname uts;
+	if (uname(&uts) < 0)
+		return;
+
+	path_ = path;
+	kernelRelease_ = std::string(uts.release) + " " + uts.version;
+
+	LOG(DeviceCache, Debug) << "Using device cache in " << path_;
+}
+
+/**
+ * \brief Retrieve the device cache instance
+ * \return The device cache instance
+ */
+DeviceCache *DeviceCache::instance()
+{
+	static DeviceCache deviceCache;
+	return &deviceCache;
+}
+
+/**
+ * \fn DeviceCache::enabled()
+ * \brief Check if the device cache is enabled
+ * \return True if the cache has been enabled, false otherwise
+ */
+
+/**
+ * \brief Create a tag identifying a device node instance
+ * \param[in] fd File descriptor of the device node
+ *
+ * The tag contains the kernel release and version, the device number, and the
+ * time at which the device node has been created. It changes when the kernel
+ * is updated, the system is rebooted or the device is registered again.
+ *
+ * \return The device tag, or an empty string if the cache is disabled or an
+ * error occurred
+ */
+std::string DeviceCache::deviceTag(int fd) const
+{
+	if (!enabled())
+		return {};
+
+	struct stat st;
+	if (fstat(fd, &st) < 0)
+		return {};
+
+	std::ostringstream tag;
+	tag << kernelRelease_ << " " << major(st.st_rdev) << ":"
+	    << minor(st.st_rdev) << " " << st.st_ctim.tv_sec << "."
+	    << st.st_ctim.tv_nsec;
+
+	return tag.str();
+}
+
+/**
+ * \brief Load a cache entry
+ * \param[in] key The entry key
+ * \param[in] tag The expected entry tag
+ * \param[out] data The entry data
+ *
+ * If the entry exists but its tag doesn't match \a tag, the entry is
+ * invalidated.
+ *
+ * \return True if the entry has been loaded, false otherwise
+ */
+bool DeviceCache::load(const std::string &key, const std::string &tag,
+		       DeviceCacheData *data)
+{
+	if (!enabled() || tag.empty())
+		return false;
+
+	std::string file = fileName(key);
+	int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	DeviceCacheData contents;
+	struct stat st;
+	if (fstat(fd, &st) == 0) {
+		contents.data_.resize(st.st_size);
+		if (read(fd, contents.data_.data(), st.st_size) != st.st_size)
+			contents.data_.clear();
+	}
+
+	::close(fd);
+
+	uint32_t magic;
+	uint32_t version;
+	std::string entryTag;
+	std::string entryKey;
+
+	if (!contents.extract(&magic) || magic != kCacheMagic ||
+	    !contents.extract(&version) || version != kCacheVersion ||
+	    !contents.extract(&entryKey) || entryKey != key ||
+	    !contents.extract(&entryTag) || entryTag != tag) {
+		LOG(DeviceCache, Debug) << "Invalidating entry " << key;
+		unlink(file.c_str());
+		return false;
+	}
+
+	data->data_.assign(contents.data_.begin() + contents.offset_,
+			   contents.data_.end());
+	data->offset_ = 0;
+
+	LOG(DeviceCache, Debug) << "Loaded entry " << key;
+
+	return true;
+}
+
+/**
+ * \brief Store a cache entry
+ * \param[in] key The entry key
+ * \param[in] tag The entry tag
+ * \param[in] data The entry data
+ *
+ * The entry is written atomically, concurrent processes will either load the
+ * previous or the new entry.
+ */
+void DeviceCache::store(const std::string &key, const std::string &tag,
+			const DeviceCacheData &data)
+{
+	if (!enabled() || tag.empty())
+		return;
+
+	DeviceCacheData contents;
+	contents.append(kCacheMagic);
+	contents.append(kCacheVersion);
+	contents.append(key);
+	contents.append(tag);
+	contents.data_.insert(contents.data_.end(), data.data_.begin(),
+			      data.data_.end());
+
+	std::string file = fileName(key);
+	std::string tmpFile = file + "." + std::to_string(getpid());
+
+	int fd = ::open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+			0600);
+	if (fd < 0) {
+		LOG(DeviceCache, Warning)
+			<< "Failed to create cache file " << tmpFile << ": "
+			<< strerror(errno);
+		return;
+	}
+
+	ssize_t size = contents.data_.size();
+	bool written = write(fd, contents.data_.data(), size) == size;
+	::close(fd);
+
+	if (!written || rename(tmpFile.c_str(), file.c_str()) < 0) {
+		LOG(DeviceCache, Warning)
+			<< "Failed to write cache entry " << key;
+		unlink(tmpFile.c_str());
+	}
+}
+
+/**
+ * \brief Remove a cache entry
+ * \param[in] key The entry key
+ *
+ * This method shall be called when the data stored in the entry is known to be
+ * out of date.
+ */
+void DeviceCache::remove(const std::string &key)
+{
+	if (!enabled())
+		return;
+
+	if (unlink(fileName(key).c_str()) == 0)
+		LOG(DeviceCache, Debug) << "Removed entry " << key;
+}
+
+std::string DeviceCache::fileName(const std::string &key) const
+{
+	std::string name = key;
+
+	for (char &c : name) {
+		if (!isalnum(c) && c != '-' && c != '.')
+			c = '_';
+	}
+
+	return path_ + "/" + name;
+}
+
+} /* namespace libcamera */
@@ -9,10 +9,12 @@
 #include "device_enumerator_sysfs.h"
 #include "device_enumerator_udev.h"
 
+#include <algorithm>
 #include <string.h>
 
 #include "log.h"
 #include "media_device.h"
+#include "thread_pool.h"
 #include "utils.h"
 
 /**
@@ -42,6 +44,9 @@ namespace libcamera {
 
 LOG_DEFINE_CATEGORY(DeviceEnumerator)
 
+/* Media devices population is I/O bound, don't limit workers to CPU cores. */
+static constexpr unsigned int kMaxPopulateWorkers = 8;
+
 /**
  * \class DeviceMatch
  * \brief Description of a media device search pattern
@@ -228,6 +233,66 @@ std::shared_ptr<MediaDevice> DeviceEnumerator::createDevice(const std::string &d
 	return media;
 }
 
+/**
+ * \typedef DeviceEnumerator::PopulateFunction
+ * \brief A function that associates device nodes with the entities of a media
+ * device
+ *
+ * The function returns 0 on success or a negative error code otherwise.
+ */
+
+/**
+ * \brief Create media device instances concurrently
+ * \param[in] deviceNodes Paths to the media devices to create
+ * \param[in] populate Function to further populate each media device
+ *
+ * Create and populate a media device for each entry in \a deviceNodes with
+ * createDevice(). If a \a populate function is given, it is then called for
+ * each media device successfully created.
+ *
+ * Populating a media device requires many ioctl calls, whose cost adds up on
+ * systems with many media devices. The media devices are thus created
+ * concurrently on a thread pool. The \a populate function is called in the
+ * thread pool workers, and shall be thread-safe. The caller is responsible for
+ * adding the media devices to the enumerator with addDevice() once this method
+ * returns.
+ *
+ * The time spent in this method is recorded as the populate phase in
+ * timings().
+ *
+ * \return The media devices, in the order of \a deviceNodes, with a nullptr
+ * entry for each media device that failed to be created or populated
+ */
+std::vector<std::shared_ptr<MediaDevice>>
+DeviceEnumerator::createDevices(const std::vector<std::string> &deviceNodes,
+				PopulateFunction populate)
+{
+	std::vector<std::shared_ptr<MediaDevice>> devices(deviceNodes.size());
+	utils::time_point start = utils::clock::now();
+
+	auto kernel = [&](unsigned int index) {
+		std::shared_ptr<MediaDevice> media = createDevice(deviceNodes[index]);
+		if (media && populate && populate(media) < 0)
+			media = nullptr;
+
+		devices[index] = std::move(media);
+	};
+
+	if (deviceNodes.size() > 1) {
+		/* The calling thread takes part in the processing. */
+		unsigned int workers = std::min<unsigned int>(deviceNodes.size() - 1,
+							      kMaxPopulateWorkers);
+		ThreadPool pool(workers);
+		pool.runBatch(deviceNodes.size(), kernel);
+	} else if (!deviceNodes.empty()) {
+		kernel(0);
+	}
+
+	timings_.populate = utils::clock::now() - start;
+
+	return devices;
+}
+
 /**
  * \brief Add a media device to the enumerator
  * \param[in] media media device instance to add
@@ -278,6 +343,33 @@ void DeviceEnumerator::removeDevice(const std::string &deviceNode)
 	media->disconnected.emit(media.get());
 }
 
+/**
+ * \struct DeviceEnumerator::Timings
+ * \brief Time spent in the phases of the last enumeration
+ *
+ * \var DeviceEnumerator::Timings::scan
+ * \brief Time spent listing the media and V4L2 devices in the system
+ *
+ * \var DeviceEnumerator::Timings::populate
+ * \brief Time spent creating and populating the MediaDevice instances
+ *
+ * \var DeviceEnumerator::Timings::merge
+ * \brief Time spent associating device nodes with entities and adding the
+ * media devices to the enumerator
+ */
+
+/**
+ * \fn DeviceEnumerator::timings()
+ * \brief Retrieve the time spent in each phase of the last enumeration
+ * \return The enumeration phases timings
+ */
+
+/**
+ * \var DeviceEnumerator::timings_
+ * \brief Time spent in the phases of the last enumeration, to be recorded by
+ * the enumerate() implementations
+ */
+
 /**
  * \brief Search available media devices for a pattern match
  * \param[in] dm Search pattern
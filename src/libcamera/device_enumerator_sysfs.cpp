@@ -19,6 +19,7 @@
 
 #include "log.h"
 #include "media_device.h"
+#include "utils.h"
 
 namespace libcamera {
 
@@ -31,10 +32,13 @@ int DeviceEnumeratorSysfs::init()
 
 int DeviceEnumeratorSysfs::enumerate()
 {
+	std::vector<std::string> deviceNodes;
 	struct dirent *ent;
 	DIR *dir;
 	int ret = 0;
 
+	utils::time_point start = utils::clock::now();
+
 	static const char * const sysfs_dirs[] = {
 		"/sys/subsystem/media/devices",
 		"/sys/bus/media/devices",
@@ -73,13 +77,27 @@ int DeviceEnumeratorSysfs::enumerate()
 			continue;
 		}
 
-		std::shared_ptr<MediaDevice> media = createDevice(devnode);
-		if (!media) {
-			ret = -ENODEV;
-			break;
-		}
+		deviceNodes.push_back(devnode);
+	}
 
-		if (populateMediaDevice(media) < 0) {
+	closedir(dir);
+
+	timings_.scan = utils::clock::now() - start;
+
+	/*
+	 * Create and populate the media devices concurrently. Device node
+	 * lookups only access sysfs and are thread-safe.
+	 */
+	std::vector<std::shared_ptr<MediaDevice>> devices =
+		createDevices(deviceNodes,
+			      [this](const std::shared_ptr<MediaDevice> &media) {
+				      return populateMediaDevice(media);
+			      });
+
+	start = utils::clock::now();
+
+	for (const std::shared_ptr<MediaDevice> &media : devices) {
+		if (!media) {
 			ret = -ENODEV;
 			break;
 		}
@@ -87,7 +105,7 @@ int DeviceEnumeratorSysfs::enumerate()
 		addDevice(media);
 	}
 
-	closedir(dir);
+	timings_.merge = utils::clock::now() - start;
 
 	return ret;
 }
@@ -22,6 +22,7 @@
 
 #include "log.h"
 #include "media_device.h"
+#include "utils.h"
 
 namespace libcamera {
 
@@ -100,8 +101,12 @@ int DeviceEnumeratorUdev::enumerate()
 {
 	struct udev_enumerate *udev_enum = nullptr;
 	struct udev_list_entry *ents, *ent;
+	std::vector<std::string> mediaNodes;
+	std::vector<dev_t> v4l2Devices;
 	int ret;
 
+	utils::time_point start = utils::clock::now();
+
 	udev_enum = udev_enumerate_new(udev_);
 	if (!udev_enum)
 		return -ENOMEM;
@@ -146,10 +151,22 @@ int DeviceEnumeratorUdev::enumerate()
 			goto done;
 		}
 
-		ret = addUdevDevice(dev);
-		udev_device_unref(dev);
-		if (ret < 0)
+		/*
+		 * Collect the devices, media devices are created concurrently
+		 * once all devices have been listed.
+		 */
+		const char *subsystem = udev_device_get_subsystem(dev);
+		if (subsystem && !strcmp(subsystem, "media")) {
+			mediaNodes.push_back(devnode);
+		} else if (subsystem && !strcmp(subsystem, "video4linux")) {
+			v4l2Devices.push_back(udev_device_get_devnum(dev));
+		} else {
+			udev_device_unref(dev);
+			ret = -ENODEV;
 			break;
+		}
+
+		udev_device_unref(dev);
 	}
 
 done:
@@ -157,6 +174,33 @@ done:
 	if (ret < 0)
 		return ret;
 
+	timings_.scan = utils::clock::now() - start;
+
+	std::vector<std::shared_ptr<MediaDevice>> devices = createDevices(mediaNodes);
+
+	/*
+	 * Associate device nodes with entities. This accesses the udev context
+	 * and isn't thread-safe. Record the V4L2 devices first, to add media
+	 * devices to the enumerator as soon as their dependencies are met.
+	 */
+	start = utils::clock::now();
+
+	for (dev_t devnum : v4l2Devices) {
+		ret = addV4L2Device(devnum);
+		if (ret < 0)
+			return ret;
+	}
+
+	for (const std::shared_ptr<MediaDevice> &media : devices) {
+		if (!media)
+			return -ENODEV;
+
+		if (populateMediaDevice(media) == 0)
+			addDevice(media);
+	}
+
+	timings_.merge = utils::clock::now() - start;
+
 	ret = udev_monitor_enable_receiving(monitor_);
 	if (ret < 0)
 		return ret;
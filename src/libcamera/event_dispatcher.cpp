@@ -8,6 +8,7 @@
 #include <libcamera/event_dispatcher.h>
 
 #include "log.h"
+#include "thread.h"
 
 /**
  * \file event_dispatcher.h
@@ -33,6 +34,12 @@ LOG_DEFINE_CATEGORY(Event)
  * To set timers, libcamera creates Timer instances and registers them with the
  * dispatcher with registerTimer(). The timer \ref Timer::timeout signal is then
  * emitted by the dispatcher when the timer times out.
+ *
+ * The dispatcher is also responsible for delivering messages posted to the
+ * thread it runs in, such as the camera events sent to the application
+ * thread. Messages are delivered by calling dispatchMessages(), which the
+ * dispatcher shall do when it is interrupted with interrupt(), as messages
+ * posted to the thread interrupt the dispatcher.
  */
 
 EventDispatcher::~EventDispatcher()
@@ -112,6 +119,21 @@ EventDispatcher::~EventDispatcher()
  * progress. The processEvents() function will return as soon as possible,
  * after processing pending timers and events. If processEvents() isn't in
  * progress, it will be interrupted immediately the next time it gets called.
+ *
+ * This function may be called from any thread.
+ */
+
+/**
+ * \brief Deliver the messages posted to the current thread
+ *
+ * Event dispatcher implementations shall call this function to deliver the
+ * messages posted to the thread they run in, in response to an interrupt()
+ * call or when processEvents() is called. It shall be called in the thread the
+ * dispatcher runs in.
  */
+void EventDispatcher::dispatchMessages()
+{
+	Thread::current()->dispatchMessages();
+}
 
 } /* namespace libcamera */
@@ -0,0 +1,503 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * event_dispatcher_epoll.cpp - Epoll-based event dispatcher
+ */
+
+#include "event_dispatcher_epoll.h"
+
+#include <chrono>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <libcamera/event_notifier.h>
+#include <libcamera/timer.h>
+
+#include "log.h"
+#include "thread.h"
+#include "utils.h"
+
+/**
+ * \file event_dispatcher_epoll.h
+ */
+
+namespace libcamera {
+
+LOG_DECLARE_CATEGORY(Event)
+
+/* Maximum number of ready file descriptors retrieved per epoll_wait() call. */
+static constexpr unsigned int kMaxEvents = 32;
+
+static const char *notifierType(EventNotifier::Type type)
+{
+	if (type == EventNotifier::Read)
+		return "read";
+	if (type == EventNotifier::Write)
+		return "write";
+	if (type == EventNotifier::Exception)
+		return "exception";
+
+	return "";
+}
+
+/**
+ * \class EventDispatcherEpoll
+ * \brief An epoll-based event dispatcher
+ *
+ * Unlike the EventDispatcherPoll, this dispatcher keeps the set of monitored
+ * file descriptors registered with the kernel across event processing
+ * iterations. Registering, unregistering, enabling or disabling an event
+ * notifier updates the epoll set incrementally, and processEvents() only
+ * touches the file descriptors that are reported as ready, without any lookup.
+ *
+ * Timers are stored in a TimerQueue. By default their expiration is signalled
+ * by a timerfd armed with the absolute CLOCK_MONOTONIC deadline of the next
+ * timer, which provides timer precision independent of the millisecond
+ * resolution of the epoll_wait() timeout. The timeout-based implementation can
+ * be selected at construction time, and is used as a fallback if the timerfd
+ * can't be created.
+ *
+ * The dispatcher may fail to initialize if the epoll instance can't be
+ * created, in which case isValid() returns false and the instance shall not be
+ * used.
+ */
+
+/**
+ * \enum EventDispatcherEpoll::TimerSource
+ * \brief Mechanism used to wake up the dispatcher when timers expire
+ * \var EventDispatcherEpoll::TimerSourceTimeout
+ * \brief Use the epoll_wait() timeout, with a millisecond resolution
+ * \var EventDispatcherEpoll::TimerSourceTimerfd
+ * \brief Use a timerfd armed with absolute CLOCK_MONOTONIC deadlines
+ */
+
+/**
+ * \brief Construct an epoll-based event dispatcher
+ * \param[in] source The mechanism used to wake up the dispatcher for timers
+ */
+EventDispatcherEpoll::EventDispatcherEpoll(TimerSource source)
+	: events_(kMaxEvents), eventfd_(-1), timerfd_(-1),
+	  timerfdDeadline_(utils::time_point::max()), processingEvents_(false)
+{
+	epollfd_ = epoll_create1(EPOLL_CLOEXEC);
+	if (epollfd_ < 0) {
+		int ret = -errno;
+		LOG(Event, Error)
+			<< "Unable to create epoll instance: " << strerror(-ret);
+		return;
+	}
+
+	/*
+	 * Create the event fd. Failures are fatal as we can't implement an
+	 * interruptible dispatcher without the fd.
+	 */
+	eventfd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (eventfd_ < 0)
+		LOG(Event, Fatal) << "Unable to create eventfd";
+
+	/*
+	 * The interrupt and timer events are identified by a data pointer to
+	 * the corresponding file descriptor member.
+	 */
+	struct epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.ptr = &eventfd_;
+
+	if (epoll_ctl(epollfd_, EPOLL_CTL_ADD, eventfd_, &event) < 0)
+		LOG(Event, Fatal) << "Unable to monitor eventfd";
+
+	if (source != TimerSourceTimerfd)
+		return;
+
+	timerfd_ = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+	if (timerfd_ < 0) {
+		LOG(Event, Warning)
+			<< "Unable to create timerfd, using epoll timeout";
+		return;
+	}
+
+	event.data.ptr = &timerfd_;
+
+	if (epoll_ctl(epollfd_, EPOLL_CTL_ADD, timerfd_, &event) < 0) {
+		LOG(Event, Warning)
+			<< "Unable to monitor timerfd, using epoll timeout";
+		close(timerfd_);
+		timerfd_ = -1;
+	}
+}
+
+EventDispatcherEpoll::~EventDispatcherEpoll()
+{
+	if (timerfd_ >= 0)
+		close(timerfd_);
+	if (eventfd_ >= 0)
+		close(eventfd_);
+	if (epollfd_ >= 0)
+		close(epollfd_);
+}
+
+/**
+ * \fn EventDispatcherEpoll::isValid()
+ * \brief Check if the dispatcher has been successfully initialized
+ * \return True if the epoll instance has been created, false otherwise
+ */
+
+void EventDispatcherEpoll::registerEventNotifier(EventNotifier *notifier)
+{
+	int fd = notifier->fd();
+	EventNotifierSetEpoll &set = notifiers_[fd];
+	EventNotifier::Type type = notifier->type();
+
+	set.fd = fd;
+
+	if (set.notifiers[type] && set.notifiers[type] != notifier) {
+		LOG(Event, Warning)
+			<< "Ignoring duplicate " << notifierType(type)
+			<< " notifier for fd " << fd;
+		return;
+	}
+
+	set.notifiers[type] = notifier;
+
+	if (updateNotifierSet(&set) < 0) {
+		set.notifiers[type] = nullptr;
+		if (set.empty())
+			eraseNotifierSet(fd);
+	}
+}
+
+void EventDispatcherEpoll::unregisterEventNotifier(EventNotifier *notifier)
+{
+	auto iter = notifiers_.find(notifier->fd());
+	if (iter == notifiers_.end())
+		return;
+
+	EventNotifierSetEpoll &set = iter->second;
+	EventNotifier::Type type = notifier->type();
+
+	if (!set.notifiers[type])
+		return;
+
+	if (set.notifiers[type] != notifier) {
+		LOG(Event, Warning)
+			<< notifierType(type) << " notifier for fd "
+			<< notifier->fd() << " is not registered";
+		return;
+	}
+
+	set.notifiers[type] = nullptr;
+	updateNotifierSet(&set);
+
+	if (set.empty())
+		eraseNotifierSet(set.fd);
+}
+
+void EventDispatcherEpoll::registerTimer(Timer *timer)
+{
+	timers_.insert(timer);
+}
+
+void EventDispatcherEpoll::unregisterTimer(Timer *timer)
+{
+	timers_.remove(timer);
+}
+
+void EventDispatcherEpoll::processEvents()
+{
+	Thread *thread = Thread::current();
+	int ret;
+
+	thread->dispatchMessages();
+
+	/* Wait for events and process notifiers and timers. */
+	do {
+		ret = wait();
+	} while (ret == -1 && errno == EINTR);
+
+	if (ret < 0) {
+		ret = -errno;
+		LOG(Event, Warning) << "epoll_wait() failed with " << strerror(-ret);
+	} else if (ret > 0) {
+		/* Record the wakeup time to measure the notifier latencies. */
+		utils::time_point wakeup = thread->latencyTracking()
+					 ? utils::clock::now() : utils::time_point();
+
+		processingEvents_ = true;
+
+		for (int i = 0; i < ret; ++i) {
+			const struct epoll_event &event = events_[i];
+
+			if (event.data.ptr == &eventfd_)
+				processInterrupt();
+			else if (event.data.ptr == &timerfd_)
+				processTimerfd();
+			else
+				processNotifiers(static_cast<EventNotifierSetEpoll *>(event.data.ptr),
+						 event.events, wakeup);
+		}
+
+		processingEvents_ = false;
+
+		/* Erase the notifier sets that have been emptied. */
+		for (int fd : staleNotifiers_) {
+			auto iter = notifiers_.find(fd);
+			if (iter != notifiers_.end() && iter->second.empty())
+				notifiers_.erase(iter);
+		}
+
+		staleNotifiers_.clear();
+	}
+
+	processTimers();
+}
+
+void EventDispatcherEpoll::interrupt()
+{
+	uint64_t value = 1;
+	ssize_t ret = write(eventfd_, &value, sizeof(value));
+	if (ret != sizeof(value)) {
+		if (ret < 0)
+			ret = -errno;
+		LOG(Event, Error)
+			<< "Failed to interrupt event dispatcher ("
+			<< ret << ")";
+	}
+}
+
+uint32_t EventDispatcherEpoll::EventNotifierSetEpoll::events() const
+{
+	uint32_t events = 0;
+
+	if (notifiers[EventNotifier::Read])
+		events |= EPOLLIN;
+	if (notifiers[EventNotifier::Write])
+		events |= EPOLLOUT;
+	if (notifiers[EventNotifier::Exception])
+		events |= EPOLLPRI;
+
+	return events;
+}
+
+bool EventDispatcherEpoll::EventNotifierSetEpoll::empty() const
+{
+	return !notifiers[0] && !notifiers[1] && !notifiers[2];
+}
+
+/**
+ * \brief Synchronize the epoll set with the notifiers of a file descriptor
+ * \param[in] set The notifier set for the file descriptor
+ *
+ * Add, modify or remove the file descriptor in the epoll set to match the
+ * events requested by the registered notifiers. No system call is issued if
+ * the events are unchanged.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int EventDispatcherEpoll::updateNotifierSet(EventNotifierSetEpoll *set)
+{
+	uint32_t events = set->events();
+	if (events == set->registered)
+		return 0;
+
+	int op;
+	if (!set->registered)
+		op = EPOLL_CTL_ADD;
+	else if (events)
+		op = EPOLL_CTL_MOD;
+	else
+		op = EPOLL_CTL_DEL;
+
+	struct epoll_event event = {};
+	event.events = events;
+	event.data.ptr = set;
+
+	int ret = epoll_ctl(epollfd_, op, set->fd, &event);
+
+	/*
+	 * The kernel removes file descriptors from the epoll set automatically
+	 * when they're closed. Re-add the file descriptor if it has been
+	 * closed and reopened, and ignore removal errors for file descriptors
+	 * that have already been closed.
+	 */
+	if (ret < 0 && errno == ENOENT && op == EPOLL_CTL_MOD)
+		ret = epoll_ctl(epollfd_, EPOLL_CTL_ADD, set->fd, &event);
+
+	if (ret < 0) {
+		ret = -errno;
+		if (op != EPOLL_CTL_DEL || (ret != -ENOENT && ret != -EBADF)) {
+			LOG(Event, Warning)
+				<< "Failed to update epoll set for fd " << set->fd
+				<< ": " << strerror(-ret);
+			return ret;
+		}
+	}
+
+	set->registered = events;
+	return 0;
+}
+
+void EventDispatcherEpoll::eraseNotifierSet(int fd)
+{
+	/*
+	 * Don't race with event processing if this method is called from an
+	 * event notifier, as pending events may still reference the set. The
+	 * notifiers_ entry will be erased by processEvents().
+	 */
+	if (processingEvents_) {
+		staleNotifiers_.push_back(fd);
+		return;
+	}
+
+	notifiers_.erase(fd);
+}
+
+int EventDispatcherEpoll::wait()
+{
+	int timeout = -1;
+
+	if (timers_.empty())
+		return epoll_wait(epollfd_, events_.data(), events_.size(), timeout);
+
+	if (timerfd_ >= 0) {
+		armTimerfd();
+		return epoll_wait(epollfd_, events_.data(), events_.size(), timeout);
+	}
+
+	/* Compute the timeout, rounded up to avoid waking up too early. */
+	utils::time_point deadline = timers_.nextDeadline();
+	utils::time_point now = utils::clock::now();
+
+	if (deadline > now) {
+		int64_t nsecs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			deadline - now).count();
+		int64_t msecs = (nsecs + 999999) / 1000000;
+		timeout = msecs > INT_MAX ? INT_MAX : msecs;
+	} else {
+		timeout = 0;
+	}
+
+	LOG(Event, Debug) << "timeout " << timeout << "ms";
+
+	return epoll_wait(epollfd_, events_.data(), events_.size(), timeout);
+}
+
+/**
+ * \brief Arm the timerfd with the deadline of the next timer
+ *
+ * The timerfd is only reprogrammed when the next deadline differs from the
+ * one it is currently armed with. A timerfd left armed for a timer that has
+ * since been unregistered results in a spurious wakeup at most.
+ */
+void EventDispatcherEpoll::armTimerfd()
+{
+	utils::time_point deadline = timers_.nextDeadline();
+	if (deadline == timerfdDeadline_)
+		return;
+
+	/*
+	 * The utils::clock steady clock is based on CLOCK_MONOTONIC, its time
+	 * points can thus be used directly as absolute timerfd deadlines. A
+	 * zero it_value would disarm the timer, make sure to avoid it.
+	 */
+	struct itimerspec spec = {};
+	spec.it_value = utils::duration_to_timespec(deadline.time_since_epoch());
+	if (!spec.it_value.tv_sec && !spec.it_value.tv_nsec)
+		spec.it_value.tv_nsec = 1;
+
+	if (timerfd_settime(timerfd_, TFD_TIMER_ABSTIME, &spec, nullptr) < 0) {
+		int ret = -errno;
+		LOG(Event, Error)
+			<< "Failed to arm timerfd: " << strerror(-ret);
+		return;
+	}
+
+	LOG(Event, Debug)
+		<< "timerfd armed for " << utils::time_point_to_string(deadline);
+
+	timerfdDeadline_ = deadline;
+}
+
+void EventDispatcherEpoll::processInterrupt()
+{
+	uint64_t value;
+	ssize_t ret = read(eventfd_, &value, sizeof(value));
+	if (ret != sizeof(value)) {
+		if (ret < 0)
+			ret = -errno;
+		LOG(Event, Error)
+			<< "Failed to process interrupt (" << ret << ")";
+	}
+}
+
+void EventDispatcherEpoll::processTimerfd()
+{
+	uint64_t expirations;
+	ssize_t ret = read(timerfd_, &expirations, sizeof(expirations));
+	if (ret != sizeof(expirations)) {
+		if (ret < 0)
+			ret = -errno;
+		if (ret != -EAGAIN)
+			LOG(Event, Error)
+				<< "Failed to process timerfd (" << ret << ")";
+	}
+
+	timerfdDeadline_ = utils::time_point::max();
+}
+
+void EventDispatcherEpoll::processNotifiers(EventNotifierSetEpoll *set,
+					    uint32_t revents,
+					    const utils::time_point &wakeup)
+{
+	static const struct {
+		EventNotifier::Type type;
+		uint32_t events;
+	} events[] = {
+		{ EventNotifier::Read, EPOLLIN },
+		{ EventNotifier::Write, EPOLLOUT },
+		{ EventNotifier::Exception, EPOLLPRI },
+	};
+
+	for (const auto &event : events) {
+		EventNotifier *notifier = set->notifiers[event.type];
+
+		if (!notifier || !(revents & event.events))
+			continue;
+
+		if (wakeup != utils::time_point())
+			Thread::current()->recordLatency(Thread::NotifierLatency,
+							 utils::clock::now() - wakeup,
+							 notifier);
+
+		notifier->activated.emit(notifier);
+	}
+}
+
+void EventDispatcherEpoll::processTimers()
+{
+	Thread *thread = Thread::current();
+	bool tracking = thread->latencyTracking();
+	utils::time_point now = utils::clock::now();
+
+	while (!timers_.empty()) {
+		if (timers_.nextDeadline() > now)
+			break;
+
+		Timer *timer = timers_.pop();
+		if (tracking)
+			thread->recordLatency(Thread::TimerLatency,
+					      utils::clock::now() - timer->deadline(),
+					      timer);
+
+		timer->stop();
+		timer->timeout.emit(timer);
+	}
+}
+
+} /* namespace libcamera */
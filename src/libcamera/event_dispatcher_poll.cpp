@@ -115,38 +115,20 @@ void EventDispatcherPoll::unregisterEventNotifier(EventNotifier *notifier)
 
 void EventDispatcherPoll::registerTimer(Timer *timer)
 {
-	for (auto iter = timers_.begin(); iter != timers_.end(); ++iter) {
-		if ((*iter)->deadline() > timer->deadline()) {
-			timers_.insert(iter, timer);
-			return;
-		}
-	}
-
-	timers_.push_back(timer);
+	timers_.insert(timer);
 }
 
 void EventDispatcherPoll::unregisterTimer(Timer *timer)
 {
-	for (auto iter = timers_.begin(); iter != timers_.end(); ++iter) {
-		if (*iter == timer) {
-			timers_.erase(iter);
-			return;
-		}
-
-		/*
-		 * As the timers list is ordered, we can stop as soon as we go
-		 * past the deadline.
-		 */
-		if ((*iter)->deadline() > timer->deadline())
-			break;
-	}
+	timers_.remove(timer);
 }
 
 void EventDispatcherPoll::processEvents()
 {
+	Thread *thread = Thread::current();
 	int ret;
 
-	Thread::current()->dispatchMessages();
+	thread->dispatchMessages();
 
 	/* Create the pollfd array. */
 	std::vector<struct pollfd> pollfds;
@@ -166,9 +148,13 @@ void EventDispatcherPoll::processEvents()
 		ret = -errno;
 		LOG(Event, Warning) << "poll() failed with " << strerror(-ret);
 	} else if (ret > 0) {
+		/* Record the wakeup time to measure the notifier latencies. */
+		utils::time_point wakeup = thread->latencyTracking()
+					 ? utils::clock::now() : utils::time_point();
+
 		processInterrupt(pollfds.back());
 		pollfds.pop_back();
-		processNotifiers(pollfds);
+		processNotifiers(pollfds, wakeup);
 	}
 
 	processTimers();
@@ -204,14 +190,15 @@ short EventDispatcherPoll::EventNotifierSetPoll::events() const
 int EventDispatcherPoll::poll(std::vector<struct pollfd> *pollfds)
 {
 	/* Compute the timeout. */
-	Timer *nextTimer = !timers_.empty() ? timers_.front() : nullptr;
+	bool hasTimer = !timers_.empty();
 	struct timespec timeout;
 
-	if (nextTimer) {
+	if (hasTimer) {
+		utils::time_point deadline = timers_.nextDeadline();
 		utils::time_point now = utils::clock::now();
 
-		if (nextTimer->deadline() > now)
-			timeout = utils::duration_to_timespec(nextTimer->deadline() - now);
+		if (deadline > now)
+			timeout = utils::duration_to_timespec(deadline - now);
 		else
 			timeout = { 0, 0 };
 
@@ -222,7 +209,7 @@ int EventDispatcherPoll::poll(std::vector<struct pollfd> *pollfds)
 	}
 
 	return ppoll(pollfds->data(), pollfds->size(),
-		     nextTimer ? &timeout : nullptr, nullptr);
+		     hasTimer ? &timeout : nullptr, nullptr);
 }
 
 void EventDispatcherPoll::processInterrupt(const struct pollfd &pfd)
@@ -240,7 +227,8 @@ void EventDispatcherPoll::processInterrupt(const struct pollfd &pfd)
 	}
 }
 
-void EventDispatcherPoll::processNotifiers(const std::vector<struct pollfd> &pollfds)
+void EventDispatcherPoll::processNotifiers(const std::vector<struct pollfd> &pollfds,
+					   const utils::time_point &wakeup)
 {
 	static const struct {
 		EventNotifier::Type type;
@@ -278,8 +266,15 @@ void EventDispatcherPoll::processNotifiers(const std::vector<struct pollfd> &pol
 				continue;
 			}
 
-			if (pfd.revents & event.events)
-				notifier->activated.emit(notifier);
+			if (!(pfd.revents & event.events))
+				continue;
+
+			if (wakeup != utils::time_point())
+				Thread::current()->recordLatency(Thread::NotifierLatency,
+								 utils::clock::now() - wakeup,
+								 notifier);
+
+			notifier->activated.emit(notifier);
 		}
 
 		/* Erase the notifiers_ entry if it is now empty. */
@@ -292,14 +287,20 @@ void EventDispatcherPoll::processNotifiers(const std::vector<struct pollfd> &pol
 
 void EventDispatcherPoll::processTimers()
 {
+	Thread *thread = Thread::current();
+	bool tracking = thread->latencyTracking();
 	utils::time_point now = utils::clock::now();
 
 	while (!timers_.empty()) {
-		Timer *timer = timers_.front();
-		if (timer->deadline() > now)
+		if (timers_.nextDeadline() > now)
 			break;
 
-		timers_.pop_front();
+		Timer *timer = timers_.pop();
+		if (tracking)
+			thread->recordLatency(Thread::TimerLatency,
+					      utils::clock::now() - timer->deadline(),
+					      timer);
+
 		timer->stop();
 		timer->timeout.emit(timer);
 	}
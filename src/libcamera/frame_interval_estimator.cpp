@@ -0,0 +1,226 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * frame_interval_estimator.cpp - Frame interval estimation from frame timestamps
+ */
+
+#include "frame_interval_estimator.h"
+
+#include <algorithm>
+#include <cmath>
+
+/**
+ * \file frame_interval_estimator.h
+ * \brief Frame interval estimation from frame timestamps
+ */
+
+namespace libcamera {
+
+static double toNanoseconds(const utils::duration &value)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(value).count();
+}
+
+/**
+ * \class FrameIntervalEstimator
+ * \brief Estimate the frame interval and frame times of a video stream
+ *
+ * The FrameIntervalEstimator keeps a history of the timestamps of the most
+ * recent frames of a video stream, and estimates the frame interval and the
+ * time of past and future frames from that history.
+ *
+ * Timestamps reported by the kernel are affected by interrupt and scheduling
+ * latencies. Instead of extrapolating from the last timestamp, the estimator
+ * fits a line through all the samples in the history using a least squares
+ * regression of the timestamps against the frame sequence numbers. Samples
+ * that deviate from the fitted line by more than a quarter of the frame
+ * interval are considered as outliers, and are excluded from a second fit.
+ * Using sequence numbers makes the estimation robust against dropped frames.
+ *
+ * The estimate is considered valid once the history is more than half full.
+ * Until then, estimations are extrapolated from the last sample using the
+ * previous frame interval estimate.
+ */
+
+/**
+ * \brief Construct a frame interval estimator
+ * \param[in] depth The number of samples to keep in the history
+ */
+FrameIntervalEstimator::FrameIntervalEstimator(unsigned int depth)
+	: depth_(std::max(depth, 3U)), valid_(false), refFrame_(0),
+	  interval_(0)
+{
+}
+
+/**
+ * \brief Clear the samples history
+ *
+ * The frame interval estimate is retained, and used for estimations until
+ * enough new samples are added to the history.
+ */
+void FrameIntervalEstimator::reset()
+{
+	samples_.clear();
+	valid_ = false;
+}
+
+/**
+ * \brief Add a frame timestamp to the history
+ * \param[in] frame The frame sequence number
+ * \param[in] time The frame timestamp
+ *
+ * Frame sequence numbers are expected to increase monotonically. If \a frame
+ * isn't more recent than the last sample, the stream is considered to have
+ * been restarted and the history is cleared.
+ */
+void FrameIntervalEstimator::addSample(unsigned int frame, utils::time_point time)
+{
+	if (!samples_.empty() &&
+	    static_cast<int>(frame - samples_.back().first) <= 0)
+		reset();
+
+	samples_.emplace_back(frame, time);
+	while (samples_.size() > depth_)
+		samples_.pop_front();
+
+	update();
+}
+
+/**
+ * \fn FrameIntervalEstimator::empty()
+ * \brief Check if the samples history is empty
+ * \return True if no sample has been added since the last reset, false
+ * otherwise
+ */
+
+/**
+ * \fn FrameIntervalEstimator::valid()
+ * \brief Check if the estimate is computed from the samples history
+ * \return True if the history contains enough samples for the estimation,
+ * false otherwise
+ */
+
+/**
+ * \fn FrameIntervalEstimator::interval()
+ * \brief Retrieve the estimated frame interval
+ * \return The estimated frame interval, or zero if no estimate has ever been
+ * computed
+ */
+
+/**
+ * \brief Estimate the time of a frame
+ * \param[in] frame The frame sequence number
+ *
+ * The \a frame can be in the past or the future. This method shall not be
+ * called when the history is empty.
+ *
+ * \return The estimated time of \a frame
+ */
+utils::time_point FrameIntervalEstimator::estimate(unsigned int frame) const
+{
+	int frames = static_cast<int>(frame - refFrame_);
+	return refTime_ + frames * interval_;
+}
+
+/*
+ * \brief Fit a line through the samples flagged in \a inliers
+ * \param[in] inliers Flags selecting the samples to use, in history order
+ * \param[out] origin The fitted time of the first sample, in nanoseconds
+ * relative to its timestamp
+ * \param[out] slope The fitted frame interval, in nanoseconds
+ * \return True if the fit succeeded, false otherwise
+ */
+bool FrameIntervalEstimator::fit(const std::vector<bool> &inliers,
+				 double *origin, double *slope) const
+{
+	const auto &first = samples_.front();
+	double sumX = 0.0;
+	double sumY = 0.0;
+	unsigned int count = 0;
+
+	for (unsigned int i = 0; i < samples_.size(); ++i) {
+		if (!inliers[i])
+			continue;
+
+		sumX += samples_[i].first - first.first;
+		sumY += toNanoseconds(samples_[i].second - first.second);
+		count++;
+	}
+
+	if (count < 2)
+		return false;
+
+	double meanX = sumX / count;
+	double meanY = sumY / count;
+	double sumXX = 0.0;
+	double sumXY = 0.0;
+
+	for (unsigned int i = 0; i < samples_.size(); ++i) {
+		if (!inliers[i])
+			continue;
+
+		double x = samples_[i].first - first.first;
+		double y = toNanoseconds(samples_[i].second - first.second);
+
+		sumXX += (x - meanX) * (x - meanX);
+		sumXY += (x - meanX) * (y - meanY);
+	}
+
+	if (sumXX == 0.0 || sumXY <= 0.0)
+		return false;
+
+	*slope = sumXY / sumXX;
+	*origin = meanY - *slope * meanX;
+
+	return true;
+}
+
+void FrameIntervalEstimator::update()
+{
+	const auto &first = samples_.front();
+	const auto &last = samples_.back();
+
+	refFrame_ = last.first;
+	refTime_ = last.second;
+	valid_ = false;
+
+	if (samples_.size() <= depth_ / 2)
+		return;
+
+	std::vector<bool> inliers(samples_.size(), true);
+	double origin;
+	double slope;
+
+	if (!fit(inliers, &origin, &slope))
+		return;
+
+	/* Reject the outliers and fit again if enough samples remain. */
+	unsigned int count = 0;
+	for (unsigned int i = 0; i < samples_.size(); ++i) {
+		double x = samples_[i].first - first.first;
+		double y = toNanoseconds(samples_[i].second - first.second);
+
+		inliers[i] = std::abs(y - origin - slope * x) <= slope / 4;
+		if (inliers[i])
+			count++;
+	}
+
+	if (count < samples_.size() && count * 2 >= samples_.size()) {
+		double refitOrigin;
+		double refitSlope;
+
+		if (fit(inliers, &refitOrigin, &refitSlope)) {
+			origin = refitOrigin;
+			slope = refitSlope;
+		}
+	}
+
+	double x = last.first - first.first;
+	refTime_ = first.second
+		 + std::chrono::nanoseconds(std::llround(origin + slope * x));
+	interval_ = std::chrono::nanoseconds(std::llround(slope));
+	valid_ = true;
+}
+
+} /* namespace libcamera */
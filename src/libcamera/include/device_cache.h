@@ -0,0 +1,118 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * device_cache.h - Persistent cache of device enumeration data
+ */
+#ifndef __LIBCAMERA_DEVICE_CACHE_H__
+#define __LIBCAMERA_DEVICE_CACHE_H__
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace libcamera {
+
+class ImageFormats;
+
+class DeviceCacheData
+{
+public:
+	DeviceCacheData()
+		: offset_(0)
+	{
+	}
+
+	template<typename T>
+	void append(const T &value)
+	{
+		static_assert(std::is_pod<T>::value, "Only POD types can be cached");
+
+		const uint8_t *ptr = reinterpret_cast<const uint8_t *>(&value);
+		data_.insert(data_.end(), ptr, ptr + sizeof(value));
+	}
+
+	template<typename T>
+	void append(const std::vector<T> &values)
+	{
+		static_assert(std::is_pod<T>::value, "Only POD types can be cached");
+
+		append<uint32_t>(values.size());
+
+		const uint8_t *ptr = reinterpret_cast<const uint8_t *>(values.data());
+		data_.insert(data_.end(), ptr, ptr + values.size() * sizeof(T));
+	}
+
+	void append(const std::string &value);
+	void append(const ImageFormats &formats);
+
+	template<typename T>
+	bool extract(T *value)
+	{
+		static_assert(std::is_pod<T>::value, "Only POD types can be cached");
+
+		if (data_.size() - offset_ < sizeof(*value))
+			return false;
+
+		memcpy(value, &data_[offset_], sizeof(*value));
+		offset_ += sizeof(*value);
+		return true;
+	}
+
+	template<typename T>
+	bool extract(std::vector<T> *values)
+	{
+		static_assert(std::is_pod<T>::value, "Only POD types can be cached");
+
+		uint32_t count;
+		if (!extract(&count) ||
+		    (data_.size() - offset_) / sizeof(T) < count)
+			return false;
+
+		values->resize(count);
+		memcpy(values->data(), &data_[offset_], count * sizeof(T));
+		offset_ += count * sizeof(T);
+		return true;
+	}
+
+	bool extract(std::string *value);
+	bool extract(ImageFormats *formats);
+
+	const std::vector<uint8_t> &data() const { return data_; }
+
+private:
+	friend class DeviceCache;
+
+	std::vector<uint8_t> data_;
+	size_t offset_;
+};
+
+class DeviceCache
+{
+public:
+	static DeviceCache *instance();
+
+	bool enabled() const { return !path_.empty(); }
+
+	std::string deviceTag(int fd) const;
+
+	bool load(const std::string &key, const std::string &tag,
+		  DeviceCacheData *data);
+	void store(const std::string &key, const std::string &tag,
+		   const DeviceCacheData &data);
+	void remove(const std::string &key);
+
+private:
+	DeviceCache();
+
+	std::string fileName(const std::string &key) const;
+
+	std::string path_;
+	std::string kernelRelease_;
+};
+
+} /* namespace libcamera */
+
+#endif /* __LIBCAMERA_DEVICE_CACHE_H__ */
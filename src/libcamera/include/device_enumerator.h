@@ -7,12 +7,15 @@
 #ifndef __LIBCAMERA_DEVICE_ENUMERATOR_H__
 #define __LIBCAMERA_DEVICE_ENUMERATOR_H__
 
+#include <functional>
 #include <memory>
 #include <string>
 #include <vector>
 
 #include <linux/media.h>
 
+#include "utils.h"
+
 namespace libcamera {
 
 class MediaDevice;
@@ -34,6 +37,17 @@ private:
 class DeviceEnumerator
 {
 public:
+	struct Timings {
+		Timings()
+			: scan(0), populate(0), merge(0)
+		{
+		}
+
+		utils::duration scan;
+		utils::duration populate;
+		utils::duration merge;
+	};
+
 	static std::unique_ptr<DeviceEnumerator> create();
 
 	virtual ~DeviceEnumerator();
@@ -43,11 +57,20 @@ public:
 
 	std::shared_ptr<MediaDevice> search(const DeviceMatch &dm);
 
+	const Timings &timings() const { return timings_; }
+
 protected:
+	using PopulateFunction = std::function<int(const std::shared_ptr<MediaDevice> &)>;
+
 	std::shared_ptr<MediaDevice> createDevice(const std::string &deviceNode);
+	std::vector<std::shared_ptr<MediaDevice>>
+	createDevices(const std::vector<std::string> &deviceNodes,
+		      PopulateFunction populate = nullptr);
 	void addDevice(const std::shared_ptr<MediaDevice> &media);
 	void removeDevice(const std::string &deviceNode);
 
+	Timings timings_;
+
 private:
 	std::vector<std::shared_ptr<MediaDevice>> devices_;
 };
@@ -0,0 +1,83 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * event_dispatcher_epoll.h - Epoll-based event dispatcher
+ */
+#ifndef __LIBCAMERA_EVENT_DISPATCHER_EPOLL_H__
+#define __LIBCAMERA_EVENT_DISPATCHER_EPOLL_H__
+
+#include <libcamera/event_dispatcher.h>
+
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+#include "timer_queue.h"
+#include "utils.h"
+
+struct epoll_event;
+
+namespace libcamera {
+
+class EventNotifier;
+class Timer;
+
+class EventDispatcherEpoll final : public EventDispatcher
+{
+public:
+	enum TimerSource {
+		TimerSourceTimeout,
+		TimerSourceTimerfd,
+	};
+
+	EventDispatcherEpoll(TimerSource source = TimerSourceTimerfd);
+	~EventDispatcherEpoll();
+
+	bool isValid() const { return epollfd_ >= 0; }
+
+	void registerEventNotifier(EventNotifier *notifier);
+	void unregisterEventNotifier(EventNotifier *notifier);
+
+	void registerTimer(Timer *timer);
+	void unregisterTimer(Timer *timer);
+
+	void processEvents();
+	void interrupt();
+
+private:
+	struct EventNotifierSetEpoll {
+		uint32_t events() const;
+		bool empty() const;
+
+		int fd;
+		uint32_t registered;
+		EventNotifier *notifiers[3];
+	};
+
+	std::map<int, EventNotifierSetEpoll> notifiers_;
+	std::vector<int> staleNotifiers_;
+	TimerQueue timers_;
+	std::vector<struct epoll_event> events_;
+	int epollfd_;
+	int eventfd_;
+	int timerfd_;
+	utils::time_point timerfdDeadline_;
+
+	bool processingEvents_;
+
+	int updateNotifierSet(EventNotifierSetEpoll *set);
+	void eraseNotifierSet(int fd);
+
+	int wait();
+	void armTimerfd();
+	void processInterrupt();
+	void processTimerfd();
+	void processNotifiers(EventNotifierSetEpoll *set, uint32_t revents,
+			      const utils::time_point &wakeup);
+	void processTimers();
+};
+
+} /* namespace libcamera */
+
+#endif /* __LIBCAMERA_EVENT_DISPATCHER_EPOLL_H__ */
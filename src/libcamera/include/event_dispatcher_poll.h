@@ -9,10 +9,12 @@
 
 #include <libcamera/event_dispatcher.h>
 
-#include <list>
 #include <map>
 #include <vector>
 
+#include "timer_queue.h"
+#include "utils.h"
+
 struct pollfd;
 
 namespace libcamera {
@@ -42,14 +44,15 @@ private:
 	};
 
 	std::map<int, EventNotifierSetPoll> notifiers_;
-	std::list<Timer *> timers_;
+	TimerQueue timers_;
 	int eventfd_;
 
 	bool processingEvents_;
 
 	int poll(std::vector<struct pollfd> *pollfds);
 	void processInterrupt(const struct pollfd &pfd);
-	void processNotifiers(const std::vector<struct pollfd> &pollfds);
+	void processNotifiers(const std::vector<struct pollfd> &pollfds,
+			      const utils::time_point &wakeup);
 	void processTimers();
 };
 
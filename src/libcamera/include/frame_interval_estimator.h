@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * frame_interval_estimator.h - Frame interval estimation from frame timestamps
+ */
+#ifndef __LIBCAMERA_FRAME_INTERVAL_ESTIMATOR_H__
+#define __LIBCAMERA_FRAME_INTERVAL_ESTIMATOR_H__
+
+#include <deque>
+#include <utility>
+#include <vector>
+
+#include "utils.h"
+
+namespace libcamera {
+
+class FrameIntervalEstimator
+{
+public:
+	explicit FrameIntervalEstimator(unsigned int depth);
+
+	void reset();
+	void addSample(unsigned int frame, utils::time_point time);
+
+	bool empty() const { return samples_.empty(); }
+	bool valid() const { return valid_; }
+
+	utils::duration interval() const { return interval_; }
+	utils::time_point estimate(unsigned int frame) const;
+
+private:
+	bool fit(const std::vector<bool> &inliers, double *origin,
+		 double *slope) const;
+	void update();
+
+	unsigned int depth_;
+	std::deque<std::pair<unsigned int, utils::time_point>> samples_;
+
+	bool valid_;
+	unsigned int refFrame_;
+	utils::time_point refTime_;
+	utils::duration interval_;
+};
+
+} /* namespace libcamera */
+
+#endif /* __LIBCAMERA_FRAME_INTERVAL_ESTIMATOR_H__ */
@@ -7,10 +7,12 @@
 #ifndef __LIBCAMERA_IPA_MANAGER_H__
 #define __LIBCAMERA_IPA_MANAGER_H__
 
+#include <memory>
 #include <vector>
 
 #include <ipa/ipa_interface.h>
 #include <ipa/ipa_module_info.h>
+#include <libcamera/scheduling.h>
 
 #include "ipa_module.h"
 #include "pipeline_handler.h"
@@ -26,8 +28,11 @@ public:
 						uint32_t maxVersion,
 						uint32_t minVersion);
 
+	void setProxyScheduling(const ThreadScheduling &scheduling);
+
 private:
 	std::vector<IPAModule *> modules_;
+	std::unique_ptr<ThreadScheduling> proxyScheduling_;
 
 	IPAManager();
 	~IPAManager();
@@ -12,6 +12,7 @@
 #include <vector>
 
 #include <ipa/ipa_interface.h>
+#include <libcamera/scheduling.h>
 
 #include "ipa_module.h"
 #include "utils.h"
@@ -26,6 +27,8 @@ public:
 
 	bool isValid() const { return valid_; }
 
+	virtual int setScheduling(const ThreadScheduling &scheduling);
+
 protected:
 	std::string resolvePath(const std::string &file) const;
 
@@ -38,7 +41,8 @@ public:
 	IPAProxyFactory(const char *name);
 	virtual ~IPAProxyFactory(){};
 
-	virtual std::unique_ptr<IPAProxy> create(IPAModule *ipam) = 0;
+	virtual std::unique_ptr<IPAProxy> create(IPAModule *ipam,
+						 const ThreadScheduling *scheduling) = 0;
 
 	const std::string &name() const { return name_; }
 
@@ -49,16 +53,17 @@ private:
 	std::string name_;
 };
 
-#define REGISTER_IPA_PROXY(proxy)			\
-class proxy##Factory final : public IPAProxyFactory	\
-{							\
-public:							\
-	proxy##Factory() : IPAProxyFactory(#proxy) {}	\
-	std::unique_ptr<IPAProxy> create(IPAModule *ipam)	\
-	{						\
-		return utils::make_unique<proxy>(ipam);	\
-	}						\
-};							\
+#define REGISTER_IPA_PROXY(proxy)					\
+class proxy##Factory final : public IPAProxyFactory			\
+{									\
+public:									\
+	proxy##Factory() : IPAProxyFactory(#proxy) {}			\
+	std::unique_ptr<IPAProxy> create(IPAModule *ipam,		\
+					 const ThreadScheduling *scheduling) \
+	{								\
+		return utils::make_unique<proxy>(ipam, scheduling);	\
+	}								\
+};									\
 static proxy##Factory global_##proxy##Factory;
 
 } /* namespace libcamera */
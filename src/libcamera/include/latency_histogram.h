@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * latency_histogram.h - Fixed-size latency histogram
+ */
+#ifndef __LIBCAMERA_LATENCY_HISTOGRAM_H__
+#define __LIBCAMERA_LATENCY_HISTOGRAM_H__
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+#include "utils.h"
+
+namespace libcamera {
+
+class LatencyHistogram
+{
+public:
+	static constexpr unsigned int NumBuckets = 24;
+
+	LatencyHistogram();
+	LatencyHistogram(const LatencyHistogram &other);
+	LatencyHistogram &operator=(const LatencyHistogram &other);
+
+	void record(utils::duration latency);
+	void merge(const LatencyHistogram &other);
+	void reset();
+
+	uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+	uint64_t bucket(unsigned int index) const;
+	utils::duration mean() const;
+	utils::duration max() const;
+	utils::duration percentile(unsigned int percent) const;
+
+	std::string toString() const;
+
+	static utils::duration bucketLimit(unsigned int index);
+
+private:
+	std::atomic<uint64_t> buckets_[NumBuckets];
+	std::atomic<uint64_t> count_;
+	std::atomic<uint64_t> total_;
+	std::atomic<uint64_t> max_;
+};
+
+} /* namespace libcamera */
+
+#endif /* __LIBCAMERA_LATENCY_HISTOGRAM_H__ */
@@ -101,10 +101,23 @@ LogMessage _log(const char *file, unsigned int line,
 #ifndef __DOXYGEN__
 #define _LOG_CATEGORY(name) logCategory##name
 
-#define _LOG1(severity) \
-	_log(__FILE__, __LINE__, Log##severity).stream()
-#define _LOG2(category, severity) \
-	_log(__FILE__, __LINE__, _LOG_CATEGORY(category)(), Log##severity).stream()
+/*
+ * Messages below the severity threshold of their category are neither
+ * constructed nor formatted. The operator&() has a lower precedence than
+ * operator<<(), and thus only consumes the stream once the whole message has
+ * been formatted.
+ */
+struct _LogVoidify {
+	void operator&(std::ostream &) {}
+};
+
+#define _LOG1(level) \
+	Log##level < LogCategory::defaultCategory().severity() ? (void)0 : \
+	_LogVoidify() & _log(__FILE__, __LINE__, Log##level).stream()
+#define _LOG2(category, level) \
+	Log##level < _LOG_CATEGORY(category)().severity() ? (void)0 : \
+	_LogVoidify() & _log(__FILE__, __LINE__, _LOG_CATEGORY(category)(), \
+			     Log##level).stream()
 
 /*
  * Expand the LOG() macro to _LOG1() or _LOG2() based on the number of
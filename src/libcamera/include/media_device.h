@@ -8,8 +8,10 @@
 #define __LIBCAMERA_MEDIA_DEVICE_H__
 
 #include <map>
+#include <memory>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <linux/media.h>
@@ -17,6 +19,7 @@
 #include <libcamera/signal.h>
 
 #include "media_object.h"
+#include "media_request.h"
 
 namespace libcamera {
 
@@ -50,6 +53,11 @@ public:
 	MediaLink *link(const MediaPad *source, const MediaPad *sink);
 	int disableLinks();
 
+	std::vector<MediaLink *> route(const MediaEntity *source,
+				       const MediaEntity *sink) const;
+
+	std::unique_ptr<MediaRequest> allocateRequest();
+
 	Signal<MediaDevice *> disconnected;
 
 private:
@@ -66,12 +74,19 @@ private:
 	int open();
 	void close();
 
-	std::map<unsigned int, MediaObject *> objects_;
+	std::unordered_map<unsigned int, MediaObject *> objects_;
 	MediaObject *object(unsigned int id);
 	bool addObject(MediaObject *object);
 	void clear();
 
 	std::vector<MediaEntity *> entities_;
+	std::unordered_map<std::string, MediaEntity *> entitiesByName_;
+	std::unordered_map<uint64_t, MediaLink *> linksByPads_;
+
+	static uint64_t linkKey(unsigned int sourceId, unsigned int sinkId)
+	{
+		return (static_cast<uint64_t>(sourceId) << 32) | sinkId;
+	}
 
 	struct media_v2_interface *findInterface(const struct media_v2_topology &topology,
 						 unsigned int entityId);
@@ -84,6 +99,20 @@ private:
 	int setupLink(const MediaLink *link, unsigned int flags);
 };
 
+class MediaLinkTransaction
+{
+public:
+	explicit MediaLinkTransaction(MediaDevice *media);
+
+	void disableAll();
+	void setEnabled(MediaLink *link, bool enable);
+	int commit();
+
+private:
+	MediaDevice *media_;
+	std::map<MediaLink *, bool> staged_;
+};
+
 } /* namespace libcamera */
 
 #endif /* __LIBCAMERA_MEDIA_DEVICE_H__ */
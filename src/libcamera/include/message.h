@@ -8,13 +8,18 @@
 #define __LIBCAMERA_MESSAGE_H__
 
 #include <atomic>
+#include <stddef.h>
 
 #include <libcamera/bound_method.h>
 
+#include "utils.h"
+
 namespace libcamera {
 
 class BoundMethodBase;
+class BoundMethodPackBase;
 class Object;
+class Semaphore;
 class Thread;
 
 class Message
@@ -35,27 +40,39 @@ public:
 
 	static Type registerMessageType();
 
+	static void *operator new(size_t size);
+	static void operator delete(void *ptr);
+
 private:
+	friend class MessageQueue;
 	friend class Thread;
 
 	Type type_;
 	Object *receiver_;
 
+	Message *next_;
+	std::atomic<bool> queued_;
+	bool delivering_;
+	utils::time_point timestamp_;
+
 	static std::atomic_uint nextUserType_;
 };
 
 class InvokeMessage : public Message
 {
 public:
-	InvokeMessage(BoundMethodBase *method, void *pack,
+	InvokeMessage(BoundMethodBase *method, BoundMethodPackBase *pack,
+		      Semaphore *semaphore = nullptr,
 		      bool deleteMethod = false);
 	~InvokeMessage();
 
 	void invoke();
+	void release();
 
 private:
 	BoundMethodBase *method_;
-	void *pack_;
+	BoundMethodPackBase *pack_;
+	Semaphore *semaphore_;
 	bool deleteMethod_;
 };
 
@@ -0,0 +1,64 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * message_allocator.h - Per-thread recycling allocator for messages
+ */
+#ifndef __LIBCAMERA_MESSAGE_ALLOCATOR_H__
+#define __LIBCAMERA_MESSAGE_ALLOCATOR_H__
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace libcamera {
+
+class MessageAllocator
+{
+public:
+	struct Stats {
+		uint64_t hits;
+		uint64_t misses;
+		uint64_t remoteFrees;
+	};
+
+	static MessageAllocator *current();
+
+	static void *allocate(size_t size);
+	static void free(void *ptr);
+
+	Stats stats() const;
+	void resetStats();
+
+	void ref();
+	void unref();
+
+private:
+	struct Block;
+
+	static constexpr unsigned int NumSizeClasses = 4;
+
+	struct SizeClass {
+		Block *free;
+		unsigned int count;
+		std::atomic<Block *> remote;
+	};
+
+	MessageAllocator();
+	~MessageAllocator();
+
+	void *allocateBlock(unsigned int index);
+	void freeLocal(Block *block);
+	void freeRemote(Block *block);
+
+	SizeClass classes_[NumSizeClasses];
+	std::atomic<unsigned int> refs_;
+
+	std::atomic<uint64_t> hits_;
+	std::atomic<uint64_t> misses_;
+	std::atomic<uint64_t> remoteFrees_;
+};
+
+} /* namespace libcamera */
+
+#endif /* __LIBCAMERA_MESSAGE_ALLOCATOR_H__ */
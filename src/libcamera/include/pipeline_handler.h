@@ -16,6 +16,8 @@
 
 #include <ipa/ipa_interface.h>
 #include <libcamera/controls.h>
+#include <libcamera/event_notifier.h>
+#include <libcamera/object.h>
 #include <libcamera/stream.h>
 
 namespace libcamera {
@@ -42,7 +44,8 @@ public:
 
 	Camera *camera_;
 	PipelineHandler *pipe_;
-	std::list<Request *> queuedRequests_;
+	std::vector<Request *> queuedRequests_;
+	std::list<Request *> waitingRequests_;
 	ControlInfoMap controlInfo_;
 	std::unique_ptr<IPAInterface> ipa_;
 
@@ -51,7 +54,8 @@ private:
 	CameraData &operator=(const CameraData &) = delete;
 };
 
-class PipelineHandler : public std::enable_shared_from_this<PipelineHandler>
+class PipelineHandler : public std::enable_shared_from_this<PipelineHandler>,
+			public Object
 {
 public:
 	PipelineHandler(CameraManager *manager);
@@ -79,10 +83,13 @@ public:
 	virtual void stop(Camera *camera) = 0;
 
 	virtual int queueRequest(Camera *camera, Request *request);
+	int submitRequest(Camera *camera, Request *request);
+	void stopCapture(Camera *camera);
 
 	bool completeBuffer(Camera *camera, Request *request, Buffer *buffer);
 	void completeRequest(Camera *camera, Request *request);
 
+	CameraManager *manager() const { return manager_; }
 	const char *name() const { return name_; }
 
 protected:
@@ -95,13 +102,27 @@ protected:
 	CameraManager *manager_;
 
 private:
+	struct FenceWait {
+		std::unique_ptr<EventNotifier> notifier;
+		Camera *camera;
+		Buffer *buffer;
+	};
+
 	void mediaDeviceDisconnected(MediaDevice *media);
 	virtual void disconnect();
 
+	void cancelWaitingRequests(Camera *camera);
+	void fenceSignalled(EventNotifier *notifier);
+	void queueWaitingRequests(Camera *camera);
+	void cancelRequest(Camera *camera, Request *request);
+
 	std::vector<std::shared_ptr<MediaDevice>> mediaDevices_;
 	std::vector<std::weak_ptr<Camera>> cameras_;
 	std::map<const Camera *, std::unique_ptr<CameraData>> cameraData_;
 
+	std::list<FenceWait> fenceWaits_;
+	std::vector<std::unique_ptr<EventNotifier>> expiredNotifiers_;
+
 	const char *name_;
 
 	friend class PipelineHandlerFactory;
@@ -7,10 +7,12 @@
 #ifndef __LIBCAMERA_PROCESS_H__
 #define __LIBCAMERA_PROCESS_H__
 
+#include <memory>
 #include <string>
 #include <vector>
 
 #include <libcamera/event_notifier.h>
+#include <libcamera/scheduling.h>
 
 namespace libcamera {
 
@@ -33,6 +35,8 @@ public:
 	ExitStatus exitStatus() const { return exitStatus_; }
 	int exitCode() const { return exitCode_; }
 
+	int setScheduling(const ThreadScheduling &scheduling);
+
 	void kill();
 
 	Signal<Process *, enum ExitStatus, int> finished;
@@ -47,6 +51,8 @@ private:
 	enum ExitStatus exitStatus_;
 	int exitCode_;
 
+	std::unique_ptr<ThreadScheduling> scheduling_;
+
 	friend class ProcessManager;
 };
 
@@ -9,10 +9,17 @@
 
 #include <memory>
 #include <mutex>
+#include <sys/types.h>
 #include <thread>
+#include <vector>
 
+#include <libcamera/scheduling.h>
 #include <libcamera/signal.h>
 
+#include "latency_histogram.h"
+#include "message_allocator.h"
+#include "utils.h"
+
 namespace libcamera {
 
 class EventDispatcher;
@@ -27,6 +34,12 @@ using MutexLocker = std::unique_lock<std::mutex>;
 class Thread
 {
 public:
+	enum LatencyType {
+		NotifierLatency,
+		TimerLatency,
+		MessageLatency,
+	};
+
 	Thread();
 	virtual ~Thread();
 
@@ -36,6 +49,8 @@ public:
 
 	bool isRunning();
 
+	int setScheduling(const ThreadScheduling &scheduling);
+
 	Signal<Thread *> finished;
 
 	static Thread *current();
@@ -45,6 +60,19 @@ public:
 
 	void dispatchMessages();
 
+	MessageAllocator::Stats messageAllocatorStats();
+	void resetMessageAllocatorStats();
+
+	void setLatencyTracking(bool enable);
+	bool latencyTracking() const;
+	void recordLatency(LatencyType type, utils::duration latency,
+			   Object *source = nullptr);
+	LatencyHistogram latencyHistogram(LatencyType type) const;
+	LatencyHistogram latencyHistogram(LatencyType type,
+					  const Object *source) const;
+	std::vector<const Object *> latencySources(LatencyType type) const;
+	void resetLatencyHistograms();
+
 protected:
 	int exec();
 	virtual void run();
@@ -55,6 +83,7 @@ private:
 
 	void postMessage(std::unique_ptr<Message> msg, Object *receiver);
 	void removeMessages(Object *receiver);
+	void removeLatencyHistograms(Object *source);
 
 	friend class Object;
 	friend class ThreadData;
@@ -68,6 +97,8 @@ private:
 	ThreadData *data_;
 };
 
+int applyScheduling(pid_t tid, const ThreadScheduling &scheduling);
+
 } /* namespace libcamera */
 
 #endif /* __LIBCAMERA_THREAD_H__ */
@@ -0,0 +1,99 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * thread_pool.h - Work-stealing thread pool
+ */
+#ifndef __LIBCAMERA_THREAD_POOL_H__
+#define __LIBCAMERA_THREAD_POOL_H__
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <libcamera/bound_method.h>
+#include <libcamera/object.h>
+
+#include "semaphore.h"
+
+namespace libcamera {
+
+class BufferMemory;
+
+class ThreadPool
+{
+public:
+	using Task = std::function<void()>;
+	using Kernel = std::function<void(unsigned int index)>;
+
+	struct PlaneSlice {
+		unsigned int plane;
+		void *mem;
+		unsigned int length;
+		unsigned int slice;
+		unsigned int slices;
+	};
+
+	using PlaneKernel = std::function<void(const PlaneSlice &slice)>;
+
+	ThreadPool(unsigned int workers = 0);
+	~ThreadPool();
+
+	unsigned int workers() const { return workers_.size(); }
+
+	void run(Task task);
+
+	template<typename T, typename... Args>
+	void run(Task task, T *obj, void (T::*func)(Args...), Args... args)
+	{
+		run([=]() {
+			task();
+			obj->invokeMethod(func, ConnectionTypeQueued, args...);
+		});
+	}
+
+	void runBatch(unsigned int count, Kernel kernel);
+
+	template<typename T, typename... Args>
+	void runBatch(unsigned int count, Kernel kernel, T *obj,
+		      void (T::*func)(Args...), Args... args)
+	{
+		runBatch(count, kernel, [=]() {
+			obj->invokeMethod(func, ConnectionTypeQueued, args...);
+		});
+	}
+
+	template<typename T, typename... Args>
+	int processPlanes(BufferMemory *mem, unsigned int slices,
+			  PlaneKernel kernel, T *obj,
+			  void (T::*func)(Args...), Args... args)
+	{
+		return processPlanes(mem, slices, kernel, [=]() {
+			obj->invokeMethod(func, ConnectionTypeQueued, args...);
+		});
+	}
+
+private:
+	class Worker;
+	struct Batch;
+
+	void push(Task task);
+	bool pop(Worker *worker, Task *task);
+	void workerMain(Worker *worker);
+
+	void runBatch(unsigned int count, Kernel kernel, Task completion);
+	int processPlanes(BufferMemory *mem, unsigned int slices,
+			  PlaneKernel kernel, Task completion);
+
+	static void runBatchKernels(const std::shared_ptr<Batch> &batch);
+
+	std::vector<std::unique_ptr<Worker>> workers_;
+	std::atomic<unsigned int> nextWorker_;
+	std::atomic<bool> stopping_;
+	Semaphore pending_;
+};
+
+} /* namespace libcamera */
+
+#endif /* __LIBCAMERA_THREAD_POOL_H__ */
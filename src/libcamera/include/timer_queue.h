@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * timer_queue.h - Priority queue of timers
+ */
+#ifndef __LIBCAMERA_TIMER_QUEUE_H__
+#define __LIBCAMERA_TIMER_QUEUE_H__
+
+#include <stdint.h>
+#include <vector>
+
+#include <libcamera/timer.h>
+
+#include "utils.h"
+
+namespace libcamera {
+
+class TimerQueue
+{
+public:
+	static constexpr unsigned int InvalidIndex = ~0U;
+
+	TimerQueue();
+
+	bool empty() const { return heap_.empty(); }
+	std::size_t size() const { return heap_.size(); }
+
+	const utils::time_point &nextDeadline() const { return heap_.front().deadline; }
+
+	void insert(Timer *timer);
+	void remove(Timer *timer);
+	Timer *pop();
+
+private:
+	struct Entry {
+		bool operator<(const Entry &other) const;
+
+		utils::time_point deadline;
+		uint64_t sequence;
+		Timer *timer;
+	};
+
+	void place(unsigned int index, const Entry &entry);
+	void removeAt(unsigned int index);
+	void siftUp(unsigned int index);
+	void siftDown(unsigned int index);
+
+	std::vector<Entry> heap_;
+	uint64_t sequence_;
+};
+
+class Timer::Private
+{
+public:
+	Private()
+		: queueIndex(TimerQueue::InvalidIndex)
+	{
+	}
+
+	unsigned int queueIndex;
+};
+
+} /* namespace libcamera */
+
+#endif /* __LIBCAMERA_TIMER_QUEUE_H__ */
@@ -13,11 +13,17 @@
 
 #include <linux/videodev2.h>
 
+#include <libcamera/signal.h>
+
 #include "log.h"
+#include "utils.h"
 #include "v4l2_controls.h"
 
 namespace libcamera {
 
+class EventNotifier;
+class MediaRequest;
+
 class V4L2Device : protected Loggable
 {
 public:
@@ -26,11 +32,14 @@ public:
 
 	const ControlInfoMap &controls() const { return controls_; }
 
-	int getControls(ControlList *ctrls);
-	int setControls(ControlList *ctrls);
+	int getControls(ControlList *ctrls, MediaRequest *request = nullptr);
+	int setControls(ControlList *ctrls, MediaRequest *request = nullptr);
 
 	const std::string &deviceNode() const { return deviceNode_; }
 
+	int setFrameStartEnabled(bool enable);
+	Signal<uint32_t, utils::time_point> frameStart;
+
 protected:
 	V4L2Device(const std::string &deviceNode);
 	~V4L2Device();
@@ -43,15 +52,31 @@ protected:
 	int fd() { return fd_; }
 
 private:
+	struct ControlShadow {
+		int64_t value;
+		bool cacheable;
+		bool valid;
+		bool update;
+	};
+
 	void listControls();
+	std::string controlsCacheKey() const;
+	std::vector<struct v4l2_query_ext_ctrl> queryControls();
+	void subscribeControlEvents();
+	void enableEvents();
+	void eventAvailable(EventNotifier *notifier);
 	void updateControls(ControlList *ctrls,
 			    const struct v4l2_ext_control *v4l2Ctrls,
-			    unsigned int count);
+			    unsigned int count, bool cache);
 
 	std::vector<std::unique_ptr<V4L2ControlId>> controlIds_;
 	ControlInfoMap controls_;
+	std::map<unsigned int, ControlShadow> shadow_;
 	std::string deviceNode_;
 	int fd_;
+
+	EventNotifier *fdEvent_;
+	bool frameStartEnabled_;
 };
 
 } /* namespace libcamera */
@@ -12,6 +12,7 @@
 
 #include <linux/videodev2.h>
 
+#include <libcamera/buffer.h>
 #include <libcamera/geometry.h>
 #include <libcamera/signal.h>
 
@@ -21,12 +22,10 @@
 
 namespace libcamera {
 
-class Buffer;
-class BufferMemory;
-class BufferPool;
 class EventNotifier;
 class MediaDevice;
 class MediaEntity;
+class MediaRequest;
 
 struct V4L2Capability final : v4l2_capability {
 	const char *driver() const
@@ -144,10 +143,15 @@ public:
 	int exportBuffers(BufferPool *pool);
 	int importBuffers(BufferPool *pool);
 	int releaseBuffers();
+	bool supportsRequests() const
+	{
+		return bufferCaps_ & V4L2_BUF_CAP_SUPPORTS_REQUESTS;
+	}
 
-	int queueBuffer(Buffer *buffer);
+	int queueBuffer(Buffer *buffer, MediaRequest *request = nullptr);
 	std::vector<std::unique_ptr<Buffer>> queueAllBuffers();
 	Signal<Buffer *> bufferReady;
+	Signal<const std::vector<Buffer *> &> buffersReady;
 
 	int streamOn();
 	int streamOff();
@@ -159,6 +163,12 @@ protected:
 	std::string logPrefix() const;
 
 private:
+	struct BufferTemplate {
+		struct v4l2_buffer buf;
+		struct v4l2_plane planes[VIDEO_MAX_PLANES];
+		std::vector<DmabufPlane> layout;
+	};
+
 	int getFormatMeta(V4L2DeviceFormat *format);
 	int setFormatMeta(V4L2DeviceFormat *format);
 
@@ -172,20 +182,28 @@ private:
 	std::vector<SizeRange> enumSizes(unsigned int pixelFormat);
 
 	int requestBuffers(unsigned int count);
+	void createTemplates(unsigned int count);
 	int createPlane(BufferMemory *buffer, unsigned int index,
 			unsigned int plane, unsigned int length);
 
+	int updateTemplate(unsigned int index, unsigned int numPlanes);
 	Buffer *dequeueBuffer();
 	void bufferAvailable(EventNotifier *notifier);
+	void emitBuffers(const std::vector<Buffer *> &buffers);
 
 	V4L2Capability caps_;
 
 	enum v4l2_buf_type bufferType_;
 	enum v4l2_memory memoryType_;
 	bool multiPlanar_;
+	unsigned int planesCount_;
+	unsigned int bufferCaps_;
 
 	BufferPool *bufferPool_;
-	std::map<unsigned int, Buffer *> queuedBuffers_;
+	std::vector<BufferTemplate> templates_;
+	std::vector<Buffer *> queuedBuffers_;
+	unsigned int queuedCount_;
+	std::vector<Buffer *> readyBuffers_;
 
 	EventNotifier *fdEvent_;
 
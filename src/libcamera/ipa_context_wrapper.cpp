@@ -102,7 +102,9 @@ void IPAContextWrapper::mapBuffers(const std::vector<IPABuffer> &buffers)
 		for (unsigned int j = 0; j < planes.size(); ++j) {
 			const Plane &plane = planes[j];
 			c_buffer.planes[j].dmabuf = plane.dmabuf();
+			c_buffer.planes[j].offset = plane.offset();
 			c_buffer.planes[j].length = plane.length();
+			c_buffer.planes[j].stride = plane.stride();
 		}
 	}
 
@@ -99,8 +99,14 @@
  * \var ipa_buffer_plane::dmabuf
  * \brief The dmabuf file descriptor for the plane
  *
+ * \var ipa_buffer_plane::offset
+ * \brief The offset of the plane within the dmabuf in bytes
+ *
  * \var ipa_buffer_plane::length
  * \brief The plane length in bytes
+ *
+ * \var ipa_buffer_plane::stride
+ * \brief The plane line stride in bytes, or 0 if unknown
  */
 
 /**
@@ -218,6 +218,19 @@ int IPAManager::addDir(const char *libDir)
 	return count;
 }
 
+/**
+ * \brief Set the scheduling parameters for isolated IPA modules
+ * \param[in] scheduling The scheduling parameters
+ *
+ * The scheduling parameters are applied to the proxy workers of all IPA
+ * modules that are subsequently created in isolation by createIPA(). IPA
+ * modules that run in the pipeline handler's thread are not affected.
+ */
+void IPAManager::setProxyScheduling(const ThreadScheduling &scheduling)
+{
+	proxyScheduling_ = utils::make_unique<ThreadScheduling>(scheduling);
+}
+
 /**
  * \brief Create an IPA interface that matches a given pipeline handler
  * \param[in] pipe The pipeline handler that wants a matching IPA interface
@@ -260,7 +273,7 @@ std::unique_ptr<IPAInterface> IPAManager::createIPA(PipelineHandler *pipe,
 			return nullptr;
 		}
 
-		std::unique_ptr<IPAProxy> proxy = pf->create(m);
+		std::unique_ptr<IPAProxy> proxy = pf->create(m, proxyScheduling_.get());
 		if (!proxy->isValid()) {
 			LOG(IPAManager, Error) << "Failed to load proxy";
 			return nullptr;
@@ -187,8 +187,9 @@ elfLoadSymbol(void *map, size_t soSize, const char *symbol)
  * \brief The IPA module API version
  *
  * This version number specifies the version for the layout of
- * struct IPAModuleInfo. The IPA module shall use this macro to
- * set its moduleAPIVersion field.
+ * struct IPAModuleInfo and of the structures of the IPA C interface defined in
+ * ipa_interface.h. The IPA module shall use this macro to set its
+ * moduleAPIVersion field. Modules built for a different version are rejected.
  *
  * \sa IPAModuleInfo::moduleAPIVersion
  */
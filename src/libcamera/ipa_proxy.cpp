@@ -7,6 +7,7 @@
 
 #include "ipa_proxy.h"
 
+#include <errno.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -59,6 +60,21 @@ IPAProxy::~IPAProxy()
  * \return True if the IPAProxy is valid, false otherwise
  */
 
+/**
+ * \brief Set the scheduling parameters of the IPA execution context
+ * \param[in] scheduling The scheduling parameters
+ *
+ * Proxies that run the IPA in a separate thread or process shall reimplement
+ * this method to apply the scheduling parameters to that thread or process.
+ * The default implementation returns -ENOTSUP.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int IPAProxy::setScheduling(const ThreadScheduling &scheduling)
+{
+	return -ENOTSUP;
+}
+
 /**
  * \brief Find a valid full path for a proxy worker for a given executable name
  * \param[in] file File name of proxy worker executable
@@ -147,10 +163,14 @@ IPAProxyFactory::IPAProxyFactory(const char *name)
  * \fn IPAProxyFactory::create()
  * \brief Create an instance of the IPAProxy corresponding to the factory
  * \param[in] ipam The IPA module
+ * \param[in] scheduling The scheduling parameters of the IPA execution context
+ * (may be null)
  *
  * This virtual function is implemented by the REGISTER_IPA_PROXY() macro.
  * It creates a IPAProxy instance that isolates an IPA interface designated
- * by the IPA module \a ipam.
+ * by the IPA module \a ipam. When \a scheduling is not null, the scheduling
+ * parameters are applied to the IPA execution context before it starts, so
+ * that they are inherited by all the threads it creates.
  *
  * \return A pointer to a newly constructed instance of the IPAProxy subclass
  * corresponding to the factory
@@ -0,0 +1,251 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * latency_histogram.cpp - Fixed-size latency histogram
+ */
+
+#include "latency_histogram.h"
+
+#include <algorithm>
+#include <sstream>
+
+/**
+ * \file latency_histogram.h
+ * \brief Fixed-size latency histogram
+ */
+
+namespace libcamera {
+
+/**
+ * \class LatencyHistogram
+ * \brief A histogram of latencies with logarithmic buckets
+ *
+ * The LatencyHistogram accumulates latency samples in a fixed number of
+ * buckets of exponentially increasing widths. Bucket 0 counts latencies
+ * shorter than 1µs, bucket \a n counts latencies in the [2^(n-1), 2^n[ µs
+ * range, and the last bucket counts all latencies of 2^(NumBuckets-2) µs
+ * (about 4 seconds) and above. The histogram additionally tracks the number
+ * of samples, their sum and their maximum.
+ *
+ * Recording a sample doesn't allocate memory and doesn't take any lock.
+ * Samples are meant to be recorded from a single thread, while the histogram
+ * may be read and reset from any thread. Reading a histogram while samples are
+ * being recorded may return slightly inconsistent values, for instance a
+ * sample may be accounted for in its bucket but not yet in the total count.
+ */
+
+/**
+ * \var LatencyHistogram::NumBuckets
+ * \brief The number of buckets in the histogram
+ */
+
+/**
+ * \brief Construct an empty histogram
+ */
+LatencyHistogram::LatencyHistogram()
+{
+	reset();
+}
+
+/**
+ * \brief Construct a histogram with a snapshot of the \a other histogram
+ * \param[in] other The histogram to copy
+ */
+LatencyHistogram::LatencyHistogram(const LatencyHistogram &other)
+{
+	*this = other;
+}
+
+/**
+ * \brief Replace the histogram contents with a snapshot of \a other
+ * \param[in] other The histogram to copy
+ * \return A reference to this histogram
+ */
+LatencyHistogram &LatencyHistogram::operator=(const LatencyHistogram &other)
+{
+	for (unsigned int i = 0; i < NumBuckets; ++i)
+		buckets_[i].store(other.buckets_[i].load(std::memory_order_relaxed),
+				  std::memory_order_relaxed);
+
+	count_.store(other.count_.load(std::memory_order_relaxed),
+		     std::memory_order_relaxed);
+	total_.store(other.total_.load(std::memory_order_relaxed),
+		     std::memory_order_relaxed);
+	max_.store(other.max_.load(std::memory_order_relaxed),
+		   std::memory_order_relaxed);
+
+	return *this;
+}
+
+/**
+ * \brief Record a latency sample
+ * \param[in] latency The latency
+ *
+ * Negative latencies are accounted for as zero.
+ */
+void LatencyHistogram::record(utils::duration latency)
+{
+	int64_t nsecs = std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count();
+	uint64_t value = std::max<int64_t>(nsecs, 0);
+	uint64_t usecs = value / 1000;
+
+	/* Bucket n holds the values whose most significant bit is bit n-1. */
+	unsigned int index = usecs ? 64 - __builtin_clzll(usecs) : 0;
+	index = std::min(index, NumBuckets - 1);
+
+	buckets_[index].fetch_add(1, std::memory_order_relaxed);
+	count_.fetch_add(1, std::memory_order_relaxed);
+	total_.fetch_add(value, std::memory_order_relaxed);
+
+	/* Only the recording thread updates the maximum, no need for a CAS. */
+	if (value > max_.load(std::memory_order_relaxed))
+		max_.store(value, std::memory_order_relaxed);
+}
+
+/**
+ * \brief Accumulate the samples of \a other in the histogram
+ * \param[in] other The histogram to merge
+ *
+ * This method shall only be called from the thread that records samples in
+ * the histogram, or on a histogram no thread records samples in.
+ */
+void LatencyHistogram::merge(const LatencyHistogram &other)
+{
+	for (unsigned int i = 0; i < NumBuckets; ++i)
+		buckets_[i].fetch_add(other.buckets_[i].load(std::memory_order_relaxed),
+				      std::memory_order_relaxed);
+
+	count_.fetch_add(other.count_.load(std::memory_order_relaxed),
+			 std::memory_order_relaxed);
+	total_.fetch_add(other.total_.load(std::memory_order_relaxed),
+			 std::memory_order_relaxed);
+
+	uint64_t max = other.max_.load(std::memory_order_relaxed);
+	if (max > max_.load(std::memory_order_relaxed))
+		max_.store(max, std::memory_order_relaxed);
+}
+
+/**
+ * \brief Reset the histogram to its empty state
+ */
+void LatencyHistogram::reset()
+{
+	for (std::atomic<uint64_t> &bucket : buckets_)
+		bucket.store(0, std::memory_order_relaxed);
+
+	count_.store(0, std::memory_order_relaxed);
+	total_.store(0, std::memory_order_relaxed);
+	max_.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * \fn LatencyHistogram::count()
+ * \brief Retrieve the number of recorded samples
+ * \return The number of recorded samples
+ */
+
+/**
+ * \brief Retrieve the number of samples in a bucket
+ * \param[in] index The bucket index
+ * \return The number of samples in bucket \a index, or 0 if the index is out
+ * of range
+ */
+uint64_t LatencyHistogram::bucket(unsigned int index) const
+{
+	if (index >= NumBuckets)
+		return 0;
+
+	return buckets_[index].load(std::memory_order_relaxed);
+}
+
+/**
+ * \brief Retrieve the mean latency of the recorded samples
+ * \return The mean latency, or 0 if no sample has been recorded
+ */
+utils::duration LatencyHistogram::mean() const
+{
+	uint64_t count = count_.load(std::memory_order_relaxed);
+	if (!count)
+		return utils::duration::zero();
+
+	return std::chrono::nanoseconds(total_.load(std::memory_order_relaxed) / count);
+}
+
+/**
+ * \brief Retrieve the maximum latency of the recorded samples
+ * \return The maximum latency, or 0 if no sample has been recorded
+ */
+utils::duration LatencyHistogram::max() const
+{
+	return std::chrono::nanoseconds(max_.load(std::memory_order_relaxed));
+}
+
+/**
+ * \brief Estimate a percentile of the recorded latencies
+ * \param[in] percent The percentile, in the range [0, 100]
+ *
+ * The estimate is the upper limit of the bucket containing the percentile,
+ * capped to the maximum recorded latency.
+ *
+ * \return The estimated percentile, or 0 if no sample has been recorded
+ */
+utils::duration LatencyHistogram::percentile(unsigned int percent) const
+{
+	uint64_t count = count_.load(std::memory_order_relaxed);
+	if (!count)
+		return utils::duration::zero();
+
+	uint64_t target = (count * std::min(percent, 100U) + 99) / 100;
+	uint64_t cumulative = 0;
+	unsigned int index;
+
+	for (index = 0; index < NumBuckets - 1; ++index) {
+		cumulative += buckets_[index].load(std::memory_order_relaxed);
+		if (cumulative >= target)
+			break;
+	}
+
+	return std::min(bucketLimit(index), max());
+}
+
+/**
+ * \brief Assemble and return a summary of the histogram
+ *
+ * The summary reports the number of samples, the mean and maximum latencies
+ * and the 50th and 99th percentiles, in microseconds.
+ *
+ * \return A string describing the histogram
+ */
+std::string LatencyHistogram::toString() const
+{
+	auto usecs = [](utils::duration value) {
+		return std::chrono::duration_cast<std::chrono::microseconds>(value).count();
+	};
+
+	std::stringstream ss;
+	ss << "count " << count()
+	   << ", mean " << usecs(mean()) << "us"
+	   << ", p50 " << usecs(percentile(50)) << "us"
+	   << ", p99 " << usecs(percentile(99)) << "us"
+	   << ", max " << usecs(max()) << "us";
+
+	return ss.str();
+}
+
+/**
+ * \brief Retrieve the upper limit of a bucket
+ * \param[in] index The bucket index
+ *
+ * \return The exclusive upper limit of latencies counted in bucket \a index,
+ * or utils::duration::max() for the last bucket
+ */
+utils::duration LatencyHistogram::bucketLimit(unsigned int index)
+{
+	if (index >= NumBuckets - 1)
+		return utils::duration::max();
+
+	return std::chrono::microseconds(1ULL << index);
+}
+
+} /* namespace libcamera */
@@ -13,12 +13,16 @@
 #include <sys/ioctl.h>
 #include <unistd.h>
 
+#include <queue>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <linux/media.h>
 
+#include "device_cache.h"
 #include "log.h"
+#include "utils.h"
 
 /**
  * \file media_device.h
@@ -48,7 +52,9 @@ LOG_DEFINE_CATEGORY(MediaDevice)
  * function. It can be queried to list all entities(), or entities can be
  * looked up by name with getEntityByName(). The graph can be traversed from
  * entity to entity through pads and links as exposed by the corresponding
- * classes.
+ * classes, and the links connecting two entities can be found with route().
+ * Entities are indexed by name and links by the pads they connect, lookups
+ * by name or pads thus don't scan the media graph.
  *
  * Media device can be claimed for exclusive use with acquire(), released with
  * release() and tested with busy(). This mechanism is aimed at pipeline
@@ -196,6 +202,11 @@ void MediaDevice::unlock()
  * while pads are accessible from the entity they belong to and links from the
  * pads they connect.
  *
+ * When the DeviceCache is enabled, the size of the media graph is stored in the
+ * cache, to retrieve the graph with a single MEDIA_IOC_G_TOPOLOGY call. The
+ * graph itself is always retrieved from the device, as the state of the links
+ * isn't persistent.
+ *
  * \return 0 on success or a negative error code otherwise
  */
 int MediaDevice::populate()
@@ -206,6 +217,11 @@ int MediaDevice::populate()
 	struct media_v2_link *links = nullptr;
 	struct media_v2_pad *pads = nullptr;
 	__u64 version = -1;
+	DeviceCache *cache = DeviceCache::instance();
+	DeviceCacheData cacheData;
+	std::string cacheKey;
+	std::string cacheTag;
+	bool cached = false;
 	int ret;
 
 	clear();
@@ -227,6 +243,29 @@ int MediaDevice::populate()
 	model_ = info.model;
 	version_ = info.media_version;
 
+	/*
+	 * If the topology size is known from the device cache, allocate the
+	 * objects arrays upfront to retrieve the topology with a single call.
+	 */
+	cacheKey = std::string("media:") + info.driver + ":" + info.bus_info;
+	cacheTag = cache->deviceTag(fd_) + " " + info.model + " " + info.serial
+		 + " " + std::to_string(info.media_version)
+		 + " " + std::to_string(info.hw_revision)
+		 + " " + std::to_string(info.driver_version);
+
+	if (cache->load(cacheKey, cacheTag, &cacheData) &&
+	    cacheData.extract(&topology)) {
+		version = topology.topology_version;
+		ents = new struct media_v2_entity[topology.num_entities]();
+		interfaces = new struct media_v2_interface[topology.num_interfaces]();
+		links = new struct media_v2_link[topology.num_links]();
+		pads = new struct media_v2_pad[topology.num_pads]();
+		cached = true;
+	} else {
+		topology = {};
+		version = -1;
+	}
+
 	/*
 	 * Keep calling G_TOPOLOGY until the version number stays stable.
 	 */
@@ -238,6 +277,24 @@ int MediaDevice::populate()
 		topology.ptr_pads = reinterpret_cast<__u64>(pads);
 
 		ret = ioctl(fd_, MEDIA_IOC_G_TOPOLOGY, &topology);
+		if (ret < 0 && errno == ENOSPC && cached) {
+			/* The topology has grown, drop the cached size. */
+			cached = false;
+			version = -1;
+			topology = {};
+
+			delete[] ents;
+			delete[] interfaces;
+			delete[] pads;
+			delete[] links;
+
+			ents = nullptr;
+			interfaces = nullptr;
+			pads = nullptr;
+			links = nullptr;
+			continue;
+		}
+
 		if (ret < 0) {
 			ret = -errno;
 			LOG(MediaDevice, Error)
@@ -249,6 +306,8 @@ int MediaDevice::populate()
 		if (version == topology.topology_version)
 			break;
 
+		cached = false;
+
 		delete[] ents;
 		delete[] interfaces;
 		delete[] pads;
@@ -268,6 +327,18 @@ int MediaDevice::populate()
 	    populateLinks(topology))
 		valid_ = true;
 
+	if (valid_ && !cached) {
+		struct media_v2_topology size = topology;
+		size.ptr_entities = 0;
+		size.ptr_interfaces = 0;
+		size.ptr_links = 0;
+		size.ptr_pads = 0;
+
+		cacheData = DeviceCacheData();
+		cacheData.append(size);
+		cache->store(cacheKey, cacheTag, cacheData);
+	}
+
 	ret = 0;
 done:
 	close();
@@ -322,11 +393,8 @@ done:
  */
 MediaEntity *MediaDevice::getEntityByName(const std::string &name) const
 {
-	for (MediaEntity *e : entities_)
-		if (e->name() == name)
-			return e;
-
-	return nullptr;
+	auto it = entitiesByName_.find(name);
+	return it != entitiesByName_.end() ? it->second : nullptr;
 }
 
 /**
@@ -401,41 +469,118 @@ MediaLink *MediaDevice::link(const MediaEntity *source, unsigned int sourceIdx,
  */
 MediaLink *MediaDevice::link(const MediaPad *source, const MediaPad *sink)
 {
-	for (MediaLink *link : source->links()) {
-		if (link->sink()->id() == sink->id())
-			return link;
-	}
-
-	return nullptr;
+	auto it = linksByPads_.find(linkKey(source->id(), sink->id()));
+	return it != linksByPads_.end() ? it->second : nullptr;
 }
 
 /**
- * \brief Disable all links in the media device
+ * \brief Find the chain of links connecting two entities
+ * \param[in] source The entity the route starts from
+ * \param[in] sink The entity the route ends at
  *
- * Disable all the media device links, clearing the MEDIA_LNK_FL_ENABLED flag
- * on links which are not flagged as IMMUTABLE.
+ * Search the media graph for a route from \a source to \a sink, following
+ * links from source pads to sink pads. Links are considered regardless of
+ * their state, the route can thus be enabled with MediaLink::setEnabled() on
+ * each of its links. When multiple routes exist the one with the fewest links
+ * is returned. Routes through the pads of an entity are not modelled by the
+ * media graph, and every sink pad of an entity is assumed to be routable to
+ * all its source pads.
  *
- * \return 0 on success or a negative error code otherwise
+ * This is typically used to find the links between a camera sensor and a
+ * video node.
+ *
+ * \return The links from \a source to \a sink in order, or an empty vector
+ * if the entities are not connected or are identical
  */
-int MediaDevice::disableLinks()
+std::vector<MediaLink *> MediaDevice::route(const MediaEntity *source,
+					    const MediaEntity *sink) const
 {
-	for (MediaEntity *entity : entities_) {
-		for (MediaPad *pad : entity->pads()) {
+	std::unordered_map<const MediaEntity *, MediaLink *> visited;
+	std::queue<const MediaEntity *> pending;
+
+	visited[source] = nullptr;
+	pending.push(source);
+
+	while (!pending.empty() && !visited.count(sink)) {
+		const MediaEntity *entity = pending.front();
+		pending.pop();
+
+		for (const MediaPad *pad : entity->pads()) {
 			if (!(pad->flags() & MEDIA_PAD_FL_SOURCE))
 				continue;
 
 			for (MediaLink *link : pad->links()) {
-				if (link->flags() & MEDIA_LNK_FL_IMMUTABLE)
+				const MediaEntity *next = link->sink()->entity();
+				if (visited.count(next))
 					continue;
 
-				int ret = link->setEnabled(false);
-				if (ret)
-					return ret;
+				visited[next] = link;
+				pending.push(next);
 			}
 		}
 	}
 
-	return 0;
+	std::vector<MediaLink *> links;
+	if (source == sink || !visited.count(sink))
+		return links;
+
+	for (const MediaEntity *entity = sink; entity != source;) {
+		MediaLink *link = visited[entity];
+		links.insert(links.begin(), link);
+		entity = link->source()->entity();
+	}
+
+	return links;
+}
+
+/**
+ * \brief Disable all links in the media device
+ *
+ * Disable all the media device links, clearing the MEDIA_LNK_FL_ENABLED flag
+ * on links which are not flagged as IMMUTABLE. Links that are already disabled
+ * are left untouched. If any link fails to be disabled, the links disabled by
+ * this call are enabled again.
+ *
+ * \sa MediaLinkTransaction
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int MediaDevice::disableLinks()
+{
+	MediaLinkTransaction transaction(this);
+	transaction.disableAll();
+	return transaction.commit();
+}
+
+/**
+ * \brief Allocate a request for the Request API
+ *
+ * Allocate a new MediaRequest to bundle controls and buffers of devices in the
+ * media graph. The media device shall be acquired. Requests can only be used
+ * with devices that support the Request API, see
+ * V4L2VideoDevice::supportsRequests().
+ *
+ * \return The new request on success, or nullptr if the media device doesn't
+ * support requests or an error occurred
+ */
+std::unique_ptr<MediaRequest> MediaDevice::allocateRequest()
+{
+	if (fd_ == -1) {
+		LOG(MediaDevice, Error)
+			<< "Media device must be acquired to allocate requests";
+		return nullptr;
+	}
+
+	int fd;
+	int ret = ioctl(fd_, MEDIA_IOC_REQUEST_ALLOC, &fd);
+	if (ret < 0) {
+		ret = -errno;
+		LOG(MediaDevice, Error)
+			<< "Failed to allocate request: " << strerror(-ret);
+		return nullptr;
+	}
+
+	return utils::make_unique<MediaRequest>(fd);
 }
 
 /**
@@ -556,6 +701,8 @@ void MediaDevice::clear()
 
 	objects_.clear();
 	entities_.clear();
+	entitiesByName_.clear();
+	linksByPads_.clear();
 	valid_ = false;
 }
 
@@ -564,6 +711,27 @@ void MediaDevice::clear()
  * \brief Global list of media entities in the media graph
  */
 
+/**
+ * \var MediaDevice::entitiesByName_
+ * \brief Index of the media entities keyed by name
+ *
+ * When multiple entities share the same name, only the first one is indexed.
+ */
+
+/**
+ * \var MediaDevice::linksByPads_
+ * \brief Index of the media links keyed by the ids of their source and sink
+ * pads, as computed by linkKey()
+ */
+
+/**
+ * \fn MediaDevice::linkKey()
+ * \brief Compute the linksByPads_ key for a link
+ * \param[in] sourceId The id of the link source pad
+ * \param[in] sinkId The id of the link sink pad
+ * \return The key identifying the link between the two pads
+ */
+
 /**
  * \brief Find the interface associated with an entity
  * \param[in] topology The media topology as returned by MEDIA_IOC_G_TOPOLOGY
@@ -643,6 +811,7 @@ bool MediaDevice::populateEntities(const struct media_v2_topology &topology)
 		}
 
 		entities_.push_back(entity);
+		entitiesByName_.emplace(entity->name(), entity);
 	}
 
 	return true;
@@ -721,6 +890,7 @@ bool MediaDevice::populateLinks(const struct media_v2_topology &topology)
 
 		source->addLink(link);
 		sink->addLink(link);
+		linksByPads_.emplace(linkKey(source_id, sink_id), link);
 	}
 
 	return true;
@@ -800,4 +970,145 @@ int MediaDevice::setupLink(const MediaLink *link, unsigned int flags)
 	return 0;
 }
 
+/**
+ * \class MediaLinkTransaction
+ * \brief Apply a set of link changes to a media device atomically
+ *
+ * Reconfiguring a media graph usually requires disabling the links of the
+ * previous configuration and enabling the ones of the new configuration.
+ * Doing so link by link with MediaLink::setEnabled() issues one ioctl per
+ * link, even when most links don't change state, and leaves the graph in an
+ * intermediate state when one of the changes fails.
+ *
+ * The MediaLinkTransaction instead stages the desired state of links with
+ * setEnabled() and disableAll(), and applies them with commit(). Only the
+ * links whose state differs from the cached state of the media graph are
+ * modified, all links being disabled before any link is enabled, to avoid
+ * transiently connecting multiple sources to a sink pad. If any change fails,
+ * the links modified by the transaction are restored to their original state.
+ *
+ * The cached state of the media graph is only accurate if the media device
+ * isn't modified by other processes, the media device should thus be acquired
+ * and locked when committing a transaction.
+ */
+
+/**
+ * \brief Construct an empty transaction for a media device
+ * \param[in] media The media device whose links are configured
+ */
+MediaLinkTransaction::MediaLinkTransaction(MediaDevice *media)
+	: media_(media)
+{
+}
+
+/**
+ * \brief Stage disabling all links in the media device
+ *
+ * Stage all links of the media device that are not flagged as IMMUTABLE to be
+ * disabled, replacing any change previously staged for those links. Links can
+ * then be selectively enabled with setEnabled(), making the transaction
+ * describe the complete set of enabled links.
+ */
+void MediaLinkTransaction::disableAll()
+{
+	for (MediaEntity *entity : media_->entities()) {
+		for (MediaPad *pad : entity->pads()) {
+			if (!(pad->flags() & MEDIA_PAD_FL_SOURCE))
+				continue;
+
+			for (MediaLink *link : pad->links()) {
+				if (link->flags() & MEDIA_LNK_FL_IMMUTABLE)
+					continue;
+
+				staged_[link] = false;
+			}
+		}
+	}
+}
+
+/**
+ * \brief Stage enabling or disabling a link
+ * \param[in] link The link
+ * \param[in] enable True to enable the link, false to disable it
+ *
+ * The change replaces any change previously staged for \a link.
+ */
+void MediaLinkTransaction::setEnabled(MediaLink *link, bool enable)
+{
+	staged_[link] = enable;
+}
+
+/**
+ * \brief Apply the staged link changes to the media device
+ *
+ * Compare the staged link states with the cached state of the media graph,
+ * and setup the links that need to change, disabling links first and enabling
+ * links last. On failure, the links already modified by this call are
+ * restored to their original state.
+ *
+ * The staged changes are cleared once the transaction is committed,
+ * successfully or not.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -EINVAL A change to an IMMUTABLE link has been staged
+ */
+int MediaLinkTransaction::commit()
+{
+	std::vector<MediaLink *> changes;
+	int ret = 0;
+
+	/* Sort the changes to disable links before enabling others. */
+	for (bool enable : { false, true }) {
+		for (const auto &staged : staged_) {
+			MediaLink *link = staged.first;
+			bool enabled = link->flags() & MEDIA_LNK_FL_ENABLED;
+
+			if (staged.second != enable || enabled == enable)
+				continue;
+
+			if (link->flags() & MEDIA_LNK_FL_IMMUTABLE) {
+				LOG(MediaDevice, Error)
+					<< "Can't change immutable link "
+					<< link->source()->entity()->name() << "["
+					<< link->source()->index() << "] -> "
+					<< link->sink()->entity()->name() << "["
+					<< link->sink()->index() << "]";
+				ret = -EINVAL;
+			}
+
+			changes.push_back(link);
+		}
+	}
+
+	staged_.clear();
+
+	if (ret)
+		return ret;
+
+	unsigned int applied;
+	for (applied = 0; applied < changes.size(); ++applied) {
+		MediaLink *link = changes[applied];
+		ret = link->setEnabled(!(link->flags() & MEDIA_LNK_FL_ENABLED));
+		if (ret)
+			break;
+	}
+
+	if (!ret)
+		return 0;
+
+	/* Roll back in reverse order, disabling the enabled links first. */
+	while (applied--) {
+		MediaLink *link = changes[applied];
+		if (link->setEnabled(!(link->flags() & MEDIA_LNK_FL_ENABLED)))
+			LOG(MediaDevice, Error)
+				<< "Failed to roll back link "
+				<< link->source()->entity()->name() << "["
+				<< link->source()->index() << "] -> "
+				<< link->sink()->entity()->name() << "["
+				<< link->sink()->index() << "]";
+	}
+
+	return ret;
+}
+
 } /* namespace libcamera */
@@ -0,0 +1,158 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * media_request.cpp - Media Controller request
+ */
+
+#include "media_request.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <linux/media.h>
+
+#include <libcamera/event_notifier.h>
+
+#include "log.h"
+
+/**
+ * \file media_request.h
+ * \brief Media Controller requests for atomic control and buffer application
+ */
+
+namespace libcamera {
+
+LOG_DECLARE_CATEGORY(MediaDevice)
+
+/**
+ * \class MediaRequest
+ * \brief A Media Controller request
+ *
+ * The V4L2 Request API allows bundling control values and buffers for
+ * multiple devices of a media graph, and applying them atomically to the same
+ * frame. A MediaRequest wraps a request file descriptor allocated from a media
+ * device with MediaDevice::allocateRequest().
+ *
+ * Controls are added to a request with V4L2Device::setControls() and buffers
+ * with V4L2VideoDevice::queueBuffer(), both passing the request as an
+ * argument. The request is then submitted with queue(). When the device has
+ * processed the request, the completed signal is emitted from the event
+ * dispatcher of the thread the request was created in. Completed requests can
+ * be recycled with reinit().
+ *
+ * Devices that support the Request API report it through
+ * V4L2VideoDevice::supportsRequests().
+ */
+
+/**
+ * \brief Construct a MediaRequest from a request file descriptor
+ * \param[in] fd The request file descriptor
+ *
+ * The MediaRequest takes ownership of the \a fd and closes it when destroyed.
+ * Instances shall be created with MediaDevice::allocateRequest().
+ */
+MediaRequest::MediaRequest(int fd)
+	: fd_(fd), queued_(false)
+{
+	/* Requests signal their completion with POLLPRI. */
+	notifier_ = new EventNotifier(fd_, EventNotifier::Exception);
+	notifier_->activated.connect(this, &MediaRequest::requestComplete);
+	notifier_->setEnabled(false);
+}
+
+MediaRequest::~MediaRequest()
+{
+	delete notifier_;
+	close(fd_);
+}
+
+/**
+ * \fn MediaRequest::fd()
+ * \brief Retrieve the request file descriptor
+ * \return The request file descriptor
+ */
+
+/**
+ * \fn MediaRequest::queued()
+ * \brief Check if the request has been queued and hasn't completed yet
+ * \return True if the request is queued, false otherwise
+ */
+
+/**
+ * \brief Queue the request
+ *
+ * Queue the request to the media device. All the controls and buffers added to
+ * the request are validated and applied together. The completed signal is
+ * emitted when the request completes.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -EBUSY The request is already queued
+ * \retval -ENOENT The request contains no buffer
+ */
+int MediaRequest::queue()
+{
+	if (queued_)
+		return -EBUSY;
+
+	int ret = ioctl(fd_, MEDIA_REQUEST_IOC_QUEUE);
+	if (ret < 0) {
+		ret = -errno;
+		LOG(MediaDevice, Error)
+			<< "Failed to queue request: " << strerror(-ret);
+		return ret;
+	}
+
+	queued_ = true;
+	notifier_->setEnabled(true);
+
+	return 0;
+}
+
+/**
+ * \brief Reinitialise a completed request for reuse
+ *
+ * Remove all controls and buffers from the request, and make it ready to be
+ * filled and queued again. Reusing requests avoids allocating a new request
+ * file descriptor for every frame.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -EBUSY The request is queued and hasn't completed yet
+ */
+int MediaRequest::reinit()
+{
+	if (queued_)
+		return -EBUSY;
+
+	int ret = ioctl(fd_, MEDIA_REQUEST_IOC_REINIT);
+	if (ret < 0) {
+		ret = -errno;
+		LOG(MediaDevice, Error)
+			<< "Failed to reinit request: " << strerror(-ret);
+		return ret;
+	}
+
+	return 0;
+}
+
+/**
+ * \var MediaRequest::completed
+ * \brief A Signal emitted when the request completes
+ *
+ * The signal is emitted once all the buffers of the request have been
+ * processed. Controls set in the request can then be read back with
+ * V4L2Device::getControls() to retrieve the values applied to the frame.
+ */
+
+void MediaRequest::requestComplete(EventNotifier *notifier)
+{
+	/* The request stays signalled until reinitialised. */
+	notifier_->setEnabled(false);
+	queued_ = false;
+
+	completed.emit(this);
+}
+
+} /* namespace libcamera */
@@ -10,6 +10,8 @@
 #include <libcamera/signal.h>
 
 #include "log.h"
+#include "message_allocator.h"
+#include "semaphore.h"
 
 /**
  * \file message.h
@@ -58,7 +60,8 @@ std::atomic_uint Message::nextUserType_{ Message::UserMessage };
  * \param[in] type The message type
  */
 Message::Message(Message::Type type)
-	: type_(type)
+	: type_(type), receiver_(nullptr), next_(nullptr), queued_(false),
+	  delivering_(false)
 {
 }
 
@@ -110,6 +113,29 @@ Message::Type Message::registerMessageType()
 	return static_cast<Message::Type>(nextUserType_++);
 }
 
+/**
+ * \brief Allocate memory for a message
+ * \param[in] size The allocation size in bytes
+ *
+ * Messages are allocated from the MessageAllocator of the calling thread,
+ * which recycles the memory of delivered messages.
+ *
+ * \return A pointer to the allocated memory
+ */
+void *Message::operator new(size_t size)
+{
+	return MessageAllocator::allocate(size);
+}
+
+/**
+ * \brief Free memory allocated for a message
+ * \param[in] ptr The memory to free
+ */
+void Message::operator delete(void *ptr)
+{
+	MessageAllocator::free(ptr);
+}
+
 /**
  * \class InvokeMessage
  * \brief A message carrying a method invocation across threads
@@ -119,18 +145,37 @@ Message::Type Message::registerMessageType()
  * \brief Construct an InvokeMessage for method invocation on an Object
  * \param[in] method The bound method
  * \param[in] pack The packed method arguments
+ * \param[in] semaphore The semaphore used to signal message delivery
  * \param[in] deleteMethod True to delete the \a method when the message is
  * destroyed
+ *
+ * When a \a semaphore is given, the sender waits for the invocation to
+ * complete, and retains ownership of the \a pack and \a method. Otherwise the
+ * message takes ownership of the \a pack, and of the \a method if
+ * \a deleteMethod is true.
  */
-InvokeMessage::InvokeMessage(BoundMethodBase *method, void *pack,
-			     bool deleteMethod)
+InvokeMessage::InvokeMessage(BoundMethodBase *method,
+			     BoundMethodPackBase *pack,
+			     Semaphore *semaphore, bool deleteMethod)
 	: Message(Message::InvokeMessage), method_(method), pack_(pack),
-	  deleteMethod_(deleteMethod)
+	  semaphore_(semaphore), deleteMethod_(deleteMethod)
 {
 }
 
 InvokeMessage::~InvokeMessage()
 {
+	/*
+	 * Release the sender if the message is destroyed without being
+	 * delivered, for instance when the receiver is deleted. The sender
+	 * owns the pack and method in that case.
+	 */
+	if (semaphore_) {
+		semaphore_->release();
+		return;
+	}
+
+	delete pack_;
+
 	if (deleteMethod_)
 		delete method_;
 }
@@ -142,6 +187,33 @@ InvokeMessage::~InvokeMessage()
 void InvokeMessage::invoke()
 {
 	method_->invokePack(pack_);
+
+	/*
+	 * Messages are destroyed asynchronously after delivery. Release the
+	 * semaphore right away to avoid delaying the sender, and free the
+	 * arguments of queued invocations early.
+	 */
+	release();
+}
+
+/**
+ * \brief Release the sender and the invocation arguments
+ *
+ * This method releases the sender of a blocking invocation, or frees the
+ * arguments of a queued invocation. It is called after delivery, and when the
+ * message is removed from the message queue without being delivered, as the
+ * message itself may only be destroyed later.
+ */
+void InvokeMessage::release()
+{
+	if (semaphore_) {
+		semaphore_->release();
+		semaphore_ = nullptr;
+	} else {
+		delete pack_;
+	}
+
+	pack_ = nullptr;
 }
 
 /**
@@ -154,4 +226,9 @@ void InvokeMessage::invoke()
  * \brief The packed method invocation arguments
  */
 
+/**
+ * \var InvokeMessage::semaphore_
+ * \brief The semaphore to release after delivery, if any
+ */
+
 }; /* namespace libcamera */
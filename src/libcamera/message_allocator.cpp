@@ -0,0 +1,304 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * message_allocator.cpp - Per-thread recycling allocator for messages
+ */
+
+#include "message_allocator.h"
+
+#include <new>
+
+/**
+ * \file message_allocator.h
+ * \brief Per-thread recycling allocator for messages
+ */
+
+namespace libcamera {
+
+/* Maximum number of free blocks cached per size class. */
+static constexpr unsigned int kMaxCachedBlocks = 256;
+
+/* Payload size of the blocks of each size class. */
+static constexpr size_t kSizeClasses[] = { 64, 128, 256, 512 };
+
+/*
+ * The block header precedes the memory returned to the caller. The alignment
+ * guarantees that the payload is suitably aligned for any fundamental type.
+ * When the block is free, the first bytes of the payload store the pointer to
+ * the next free block.
+ */
+struct alignas(16) MessageAllocator::Block {
+	Block *&next() { return *reinterpret_cast<Block **>(this + 1); }
+
+	MessageAllocator *allocator;
+	unsigned int sizeClass;
+};
+
+static thread_local MessageAllocator *currentAllocator = nullptr;
+static thread_local bool currentAllocatorReleased = false;
+
+/**
+ * \class MessageAllocator
+ * \brief Recycling allocator for messages and method invocation data
+ *
+ * Queued method invocations allocate a Message, a bound method argument pack
+ * and possibly a bound method for every call. The MessageAllocator recycles
+ * that memory to avoid calling the system allocator in steady state.
+ *
+ * Each thread owns a MessageAllocator, created on first use and retrieved
+ * with current(). Allocations are served from size-segregated free lists
+ * local to the allocating thread, without any locking. Memory is usually
+ * freed by the thread that receives the message. Blocks freed by the thread
+ * that allocated them are returned to the local free lists directly, while
+ * blocks freed by other threads are pushed to a lock-free stack per size
+ * class, and reclaimed by the owning thread when its local free list runs
+ * empty. Allocations larger than the biggest size class are forwarded to the
+ * system allocator.
+ *
+ * The allocator is reference-counted. The thread that owns it holds a
+ * reference until it exits, and every outstanding block holds a reference,
+ * allowing blocks to outlive the thread that allocated them.
+ */
+
+/**
+ * \struct MessageAllocator::Stats
+ * \brief Allocation statistics
+ * \var MessageAllocator::Stats::hits
+ * \brief Number of allocations served from recycled memory
+ * \var MessageAllocator::Stats::misses
+ * \brief Number of allocations that required the system allocator
+ * \var MessageAllocator::Stats::remoteFrees
+ * \brief Number of blocks freed by a different thread than their owner
+ */
+
+MessageAllocator::MessageAllocator()
+	: refs_(1), hits_(0), misses_(0), remoteFrees_(0)
+{
+	for (SizeClass &cls : classes_) {
+		cls.free = nullptr;
+		cls.count = 0;
+		cls.remote.store(nullptr, std::memory_order_relaxed);
+	}
+}
+
+MessageAllocator::~MessageAllocator()
+{
+	for (SizeClass &cls : classes_) {
+		Block *lists[] = {
+			cls.free,
+			cls.remote.load(std::memory_order_acquire)
+		};
+
+		for (Block *block : lists) {
+			while (block) {
+				Block *next = block->next();
+				::operator delete(block);
+				block = next;
+			}
+		}
+	}
+}
+
+/**
+ * \brief Retrieve the allocator for the current thread
+ *
+ * The allocator is created the first time this function is called in a
+ * thread. Once the thread has started exiting, this function returns nullptr.
+ *
+ * \return The allocator for the current thread
+ */
+MessageAllocator *MessageAllocator::current()
+{
+	struct AllocatorCleaner {
+		~AllocatorCleaner()
+		{
+			MessageAllocator *allocator = currentAllocator;
+			currentAllocator = nullptr;
+			currentAllocatorReleased = true;
+
+			if (allocator)
+				allocator->unref();
+		}
+	};
+
+	if (currentAllocator || currentAllocatorReleased)
+		return currentAllocator;
+
+	thread_local AllocatorCleaner cleaner;
+	(void)cleaner;
+
+	currentAllocator = new MessageAllocator();
+	return currentAllocator;
+}
+
+/**
+ * \brief Allocate memory from the current thread's allocator
+ * \param[in] size The allocation size in bytes
+ *
+ * The memory shall be freed with free(), from any thread.
+ *
+ * \return A pointer to the allocated memory
+ */
+void *MessageAllocator::allocate(size_t size)
+{
+	MessageAllocator *allocator = current();
+	unsigned int index;
+
+	for (index = 0; index < NumSizeClasses; ++index) {
+		if (size <= kSizeClasses[index])
+			break;
+	}
+
+	if (allocator && index < NumSizeClasses)
+		return allocator->allocateBlock(index);
+
+	if (allocator)
+		allocator->misses_.store(allocator->misses_.load(std::memory_order_relaxed) + 1,
+					 std::memory_order_relaxed);
+
+	Block *block = static_cast<Block *>(::operator new(sizeof(Block) + size));
+	block->allocator = nullptr;
+	block->sizeClass = NumSizeClasses;
+
+	return block + 1;
+}
+
+/**
+ * \brief Free memory allocated with allocate()
+ * \param[in] ptr The memory to free
+ *
+ * This function may be called from any thread. If \a ptr is nullptr, no
+ * operation is performed.
+ */
+void MessageAllocator::free(void *ptr)
+{
+	if (!ptr)
+		return;
+
+	Block *block = static_cast<Block *>(ptr) - 1;
+	MessageAllocator *allocator = block->allocator;
+
+	if (!allocator) {
+		::operator delete(block);
+		return;
+	}
+
+	if (allocator == currentAllocator)
+		allocator->freeLocal(block);
+	else
+		allocator->freeRemote(block);
+
+	allocator->unref();
+}
+
+/**
+ * \brief Retrieve the allocation statistics
+ *
+ * The statistics may be retrieved from any thread.
+ *
+ * \return The allocation statistics
+ */
+MessageAllocator::Stats MessageAllocator::stats() const
+{
+	return {
+		hits_.load(std::memory_order_relaxed),
+		misses_.load(std::memory_order_relaxed),
+		remoteFrees_.load(std::memory_order_relaxed),
+	};
+}
+
+/**
+ * \brief Reset the allocation statistics
+ */
+void MessageAllocator::resetStats()
+{
+	hits_.store(0, std::memory_order_relaxed);
+	misses_.store(0, std::memory_order_relaxed);
+	remoteFrees_.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * \brief Acquire a reference to the allocator
+ */
+void MessageAllocator::ref()
+{
+	refs_.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * \brief Release a reference to the allocator
+ *
+ * The allocator is destroyed when the last reference is released.
+ */
+void MessageAllocator::unref()
+{
+	if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		delete this;
+}
+
+void *MessageAllocator::allocateBlock(unsigned int index)
+{
+	SizeClass &cls = classes_[index];
+	Block *block;
+
+	/* Reclaim the blocks freed by other threads. */
+	if (!cls.free) {
+		block = cls.remote.exchange(nullptr, std::memory_order_acquire);
+		while (block) {
+			Block *next = block->next();
+			freeLocal(block);
+			block = next;
+		}
+	}
+
+	if (cls.free) {
+		block = cls.free;
+		cls.free = block->next();
+		cls.count--;
+
+		hits_.store(hits_.load(std::memory_order_relaxed) + 1,
+			    std::memory_order_relaxed);
+	} else {
+		block = static_cast<Block *>(::operator new(sizeof(Block) + kSizeClasses[index]));
+		block->allocator = this;
+		block->sizeClass = index;
+
+		misses_.store(misses_.load(std::memory_order_relaxed) + 1,
+			      std::memory_order_relaxed);
+	}
+
+	ref();
+
+	return block + 1;
+}
+
+void MessageAllocator::freeLocal(Block *block)
+{
+	SizeClass &cls = classes_[block->sizeClass];
+
+	if (cls.count >= kMaxCachedBlocks) {
+		::operator delete(block);
+		return;
+	}
+
+	block->next() = cls.free;
+	cls.free = block;
+	cls.count++;
+}
+
+void MessageAllocator::freeRemote(Block *block)
+{
+	SizeClass &cls = classes_[block->sizeClass];
+	Block *head = cls.remote.load(std::memory_order_relaxed);
+
+	do {
+		block->next() = head;
+	} while (!cls.remote.compare_exchange_weak(head, block,
+						   std::memory_order_release,
+						   std::memory_order_relaxed));
+
+	remoteFrees_.fetch_add(1, std::memory_order_relaxed);
+}
+
+} /* namespace libcamera */
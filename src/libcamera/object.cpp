@@ -54,7 +54,7 @@ LOG_DEFINE_CATEGORY(Object)
  * current thread if the \a parent is nullptr.
  */
 Object::Object(Object *parent)
-	: parent_(parent), pendingMessages_(0)
+	: parent_(parent), pendingMessages_(0), latencyRecorded_(false)
 {
 	thread_ = parent ? parent->thread() : Thread::current();
 
@@ -77,6 +77,9 @@ Object::~Object()
 	if (pendingMessages_)
 		thread()->removeMessages(this);
 
+	if (latencyRecorded_.load(std::memory_order_relaxed))
+		thread()->removeLatencyHistograms(this);
+
 	if (parent_) {
 		auto it = std::find(parent_->children_.begin(),
 				    parent_->children_.end(), this);
@@ -133,27 +136,33 @@ void Object::message(Message *msg)
 }
 
 /**
- * \fn void Object::invokeMethod(void (T::*func)(Args...), Args... args)
+ * \fn R Object::invokeMethod(R (T::*func)(FuncArgs...), ConnectionType type, Args... args)
  * \brief Invoke a method asynchronously on an Object instance
  * \param[in] func The object method to invoke
+ * \param[in] type Connection type for method invocation
  * \param[in] args The method arguments
  *
- * This method invokes the member method \a func when control returns to the
- * event loop of the object's thread. The method is executed in the object's
- * thread with arguments \a args.
+ * This method invokes the member method \a func with arguments \a args, based
+ * on the connection \a type. Depending on the type, the method will be called
+ * synchronously in the same thread or asynchronously in the object's thread.
+ *
+ * With ConnectionTypeBlocking, the caller is suspended until the method
+ * returns. The handoff between the threads is based on a futex-backed
+ * Semaphore, and the method is invoked synchronously if the caller runs in the
+ * object's thread. The object's thread shall run its event loop, otherwise the
+ * caller will block forever.
  *
  * Arguments \a args passed by value or reference are copied, while pointers
  * are passed untouched. The caller shall ensure that any pointer argument
  * remains valid until the method is invoked.
+ *
+ * \return For connection types ConnectionTypeDirect and
+ * ConnectionTypeBlocking, or when the method is invoked synchronously, the
+ * return value of the invoked method. For connection type ConnectionTypeQueued,
+ * a default-constructed value. If a blocking invocation is cancelled because
+ * the object is deleted, a default-constructed value is returned too.
  */
 
-void Object::invokeMethod(BoundMethodBase *method, void *args)
-{
-	std::unique_ptr<Message> msg =
-		utils::make_unique<InvokeMessage>(method, args, true);
-	postMessage(std::move(msg));
-}
-
 /**
  * \fn Object::thread()
  * \brief Retrieve the thread the object is bound to
@@ -77,10 +77,11 @@ public:
 	int start();
 	int stop();
 
-	int linkSetup(const std::string &source, unsigned int sourcePad,
+	int linkSetup(MediaLinkTransaction *transaction,
+		      const std::string &source, unsigned int sourcePad,
 		      const std::string &sink, unsigned int sinkPad,
 		      bool enable);
-	int enableLinks(bool enable);
+	int enableLinks(MediaLinkTransaction *transaction, bool enable);
 
 	unsigned int index_;
 	std::string name_;
@@ -519,7 +520,8 @@ int PipelineHandlerIPU3::configure(Camera *camera, CameraConfiguration *c)
 	 *
 	 * As of now, disable all links in the ImgU media graph before
 	 * configuring the device, to allow alternate the usage of the two
-	 * ImgU pipes.
+	 * ImgU pipes. The changes are applied as a single transaction, which
+	 * leaves the links of a reconfigured pipe untouched.
 	 *
 	 * As a consequence, a Camera using an ImgU shall be configured before
 	 * any start()/stop() sequence. An application that wants to
@@ -527,15 +529,18 @@ int PipelineHandlerIPU3::configure(Camera *camera, CameraConfiguration *c)
 	 * without going through any re-configuration (a sequence that is
 	 * allowed by the Camera state machine) would now fail on the IPU3.
 	 */
-	ret = imguMediaDev_->disableLinks();
-	if (ret)
-		return ret;
+	MediaLinkTransaction links(imguMediaDev_);
+	links.disableAll();
 
 	/*
 	 * \todo: Enable links selectively based on the requested streams.
 	 * As of now, enable all links unconditionally.
 	 */
-	ret = data->imgu_->enableLinks(true);
+	ret = data->imgu_->enableLinks(&links, true);
+	if (ret)
+		return ret;
+
+	ret = links.commit();
 	if (ret)
 		return ret;
 
@@ -1265,14 +1270,15 @@ int ImgUDevice::stop()
 }
 
 /**
- * \brief Enable or disable a single link on the ImgU instance
+ * \brief Stage enabling or disabling a single link on the ImgU instance
  *
- * This method assumes the media device associated with the ImgU instance
- * is open.
+ * The link change is staged in \a transaction, and applied when the
+ * transaction is committed.
  *
  * \return 0 on success or a negative error code otherwise
  */
-int ImgUDevice::linkSetup(const std::string &source, unsigned int sourcePad,
+int ImgUDevice::linkSetup(MediaLinkTransaction *transaction,
+			  const std::string &source, unsigned int sourcePad,
 			  const std::string &sink, unsigned int sinkPad,
 			  bool enable)
 {
@@ -1284,19 +1290,21 @@ int ImgUDevice::linkSetup(const std::string &source, unsigned int sourcePad,
 		return -ENODEV;
 	}
 
-	return link->setEnabled(enable);
+	transaction->setEnabled(link, enable);
+
+	return 0;
 }
 
 /**
- * \brief Enable or disable all media links in the ImgU instance to prepare
- * for capture operations
+ * \brief Stage enabling or disabling all media links in the ImgU instance to
+ * prepare for capture operations
  *
  * \todo This method will probably be removed or changed once links will be
  * enabled or disabled selectively.
  *
  * \return 0 on success or a negative error code otherwise
  */
-int ImgUDevice::enableLinks(bool enable)
+int ImgUDevice::enableLinks(MediaLinkTransaction *transaction, bool enable)
 {
 	std::string viewfinderName = name_ + " viewfinder";
 	std::string outputName = name_ + " output";
@@ -1304,19 +1312,19 @@ int ImgUDevice::enableLinks(bool enable)
 	std::string inputName = name_ + " input";
 	int ret;
 
-	ret = linkSetup(inputName, 0, name_, PAD_INPUT, enable);
+	ret = linkSetup(transaction, inputName, 0, name_, PAD_INPUT, enable);
 	if (ret)
 		return ret;
 
-	ret = linkSetup(name_, PAD_OUTPUT, outputName, 0, enable);
+	ret = linkSetup(transaction, name_, PAD_OUTPUT, outputName, 0, enable);
 	if (ret)
 		return ret;
 
-	ret = linkSetup(name_, PAD_VF, viewfinderName, 0, enable);
+	ret = linkSetup(transaction, name_, PAD_VF, viewfinderName, 0, enable);
 	if (ret)
 		return ret;
 
-	return linkSetup(name_, PAD_STAT, statName, 0, enable);
+	return linkSetup(transaction, name_, PAD_STAT, statName, 0, enable);
 }
 
 /*------------------------------------------------------------------------------
@@ -81,15 +81,33 @@ class RkISP1Timeline : public Timeline
 {
 public:
 	RkISP1Timeline()
-		: Timeline()
+		: Timeline(), frameStartEnabled_(false)
 	{
 		setDelay(SetSensor, -1, 5);
 		setDelay(SOE, 0, -1);
 		setDelay(QueueBuffers, -1, 10);
 	}
 
+	void setFrameStartEnabled(bool enable)
+	{
+		frameStartEnabled_ = enable;
+	}
+
+	void frameStart(uint32_t sequence, utils::time_point time)
+	{
+		/*
+		 * The frame start event is timestamped by the kernel when the
+		 * ISP starts receiving the frame, use it as the SOE reference.
+		 */
+		notifyStartOfExposure(sequence, time);
+	}
+
 	void bufferReady(Buffer *buffer)
 	{
+		/* Prefer frame start events when available. */
+		if (frameStartEnabled_)
+			return;
+
 		/*
 		 * Calculate SOE by taking the end of DMA set by the kernel and applying
 		 * the time offsets provideprovided by the IPA to find the best estimate
@@ -110,6 +128,9 @@ public:
 		utils::duration delay = std::chrono::milliseconds(msdelay);
 		setRawDelay(type, frame, delay);
 	}
+
+private:
+	bool frameStartEnabled_;
 };
 
 class RkISP1CameraData : public CameraData
@@ -201,6 +222,7 @@ private:
 	int initLinks();
 	int createCamera(MediaEntity *sensor);
 	void tryCompleteRequest(Request *request);
+	void frameStart(uint32_t sequence, utils::time_point time);
 	void bufferReady(Buffer *buffer);
 	void paramReady(Buffer *buffer);
 	void statReady(Buffer *buffer);
@@ -562,26 +584,18 @@ int PipelineHandlerRkISP1::configure(Camera *camera, CameraConfiguration *c)
 
 	/*
 	 * Configure the sensor links: enable the link corresponding to this
-	 * camera and disable all the other sensor links.
+	 * camera and disable all the other sensor links. Links already in the
+	 * right state are left untouched.
 	 */
 	const MediaPad *pad = dphy_->entity()->getPadByIndex(0);
+	MediaLinkTransaction links(media_);
 
-	for (MediaLink *link : pad->links()) {
-		bool enable = link->source()->entity() == sensor->entity();
-
-		if (!!(link->flags() & MEDIA_LNK_FL_ENABLED) == enable)
-			continue;
+	for (MediaLink *link : pad->links())
+		links.setEnabled(link, link->source()->entity() == sensor->entity());
 
-		LOG(RkISP1, Debug)
-			<< (enable ? "Enabling" : "Disabling")
-			<< " link from sensor '"
-			<< link->source()->entity()->name()
-			<< "' to CSI-2 receiver";
-
-		ret = link->setEnabled(enable);
-		if (ret < 0)
-			return ret;
-	}
+	ret = links.commit();
+	if (ret < 0)
+		return ret;
 
 	/*
 	 * Configure the format on the sensor output and propagate it through
@@ -743,8 +757,16 @@ int PipelineHandlerRkISP1::start(Camera *camera)
 
 	data->frame_ = 0;
 
+	/*
+	 * Drive the timeline from the ISP frame start events if supported,
+	 * and fall back to the buffer completion timestamps otherwise.
+	 */
+	ret = isp_->setFrameStartEnabled(true);
+	data->timeline_.setFrameStartEnabled(!ret);
+
 	ret = param_->streamOn();
 	if (ret) {
+		isp_->setFrameStartEnabled(false);
 		LOG(RkISP1, Error)
 			<< "Failed to start parameters " << camera->name();
 		return ret;
@@ -753,6 +775,7 @@ int PipelineHandlerRkISP1::start(Camera *camera)
 	ret = stat_->streamOn();
 	if (ret) {
 		param_->streamOff();
+		isp_->setFrameStartEnabled(false);
 		LOG(RkISP1, Error)
 			<< "Failed to start statistics " << camera->name();
 		return ret;
@@ -806,6 +829,8 @@ void PipelineHandlerRkISP1::stop(Camera *camera)
 
 	data->timeline_.reset();
 
+	isp_->setFrameStartEnabled(false);
+
 	activeCamera_ = nullptr;
 }
 
@@ -842,30 +867,24 @@ int PipelineHandlerRkISP1::queueRequest(Camera *camera, Request *request)
 
 int PipelineHandlerRkISP1::initLinks()
 {
+	MediaLinkTransaction links(media_);
 	MediaLink *link;
-	int ret;
 
-	ret = media_->disableLinks();
-	if (ret < 0)
-		return ret;
+	links.disableAll();
 
 	link = media_->link("rockchip-sy-mipi-dphy", 1, "rkisp1-isp-subdev", 0);
 	if (!link)
 		return -ENODEV;
 
-	ret = link->setEnabled(true);
-	if (ret < 0)
-		return ret;
+	links.setEnabled(link, true);
 
 	link = media_->link("rkisp1-isp-subdev", 2, "rkisp1_mainpath", 0);
 	if (!link)
 		return -ENODEV;
 
-	ret = link->setEnabled(true);
-	if (ret < 0)
-		return ret;
+	links.setEnabled(link, true);
 
-	return 0;
+	return links.commit();
 }
 
 int PipelineHandlerRkISP1::createCamera(MediaEntity *sensor)
@@ -937,6 +956,7 @@ bool PipelineHandlerRkISP1::match(DeviceEnumerator *enumerator)
 	if (param_->open() < 0)
 		return false;
 
+	isp_->frameStart.connect(this, &PipelineHandlerRkISP1::frameStart);
 	video_->bufferReady.connect(this, &PipelineHandlerRkISP1::bufferReady);
 	stat_->bufferReady.connect(this, &PipelineHandlerRkISP1::statReady);
 	param_->bufferReady.connect(this, &PipelineHandlerRkISP1::paramReady);
@@ -986,6 +1006,15 @@ void PipelineHandlerRkISP1::tryCompleteRequest(Request *request)
 	data->frameInfo_.destroy(info->frame);
 }
 
+void PipelineHandlerRkISP1::frameStart(uint32_t sequence, utils::time_point time)
+{
+	if (!activeCamera_)
+		return;
+
+	RkISP1CameraData *data = cameraData(activeCamera_);
+	data->timeline_.frameStart(sequence, time);
+}
+
 void PipelineHandlerRkISP1::bufferReady(Buffer *buffer)
 {
 	ASSERT(activeCamera_);
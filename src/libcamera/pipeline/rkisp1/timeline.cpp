@@ -42,8 +42,8 @@ LOG_DEFINE_CATEGORY(Timeline)
  *
  *    The estimated frame interval together with recorded SOE events are the
  *    foundation for how the timeline schedule FrameAction at specific points
- *    in time.
- *    \todo Improve the frame interval estimation algorithm.
+ *    in time. The estimation is performed by a FrameIntervalEstimator, which
+ *    filters the jitter of the SOE events.
  *
  * 2. Keep track of current delays for different types of actions. The delays
  *    for different actions might differ during a capture session. Exposure time
@@ -60,7 +60,7 @@ LOG_DEFINE_CATEGORY(Timeline)
  */
 
 Timeline::Timeline()
-	: frameInterval_(0)
+	: estimator_(HISTORY_DEPTH)
 {
 	timer_.timeout.connect(this, &Timeline::timeout);
 }
@@ -77,7 +77,7 @@ void Timeline::reset()
 	timer_.stop();
 
 	actions_.clear();
-	history_.clear();
+	estimator_.reset();
 }
 
 /**
@@ -92,28 +92,26 @@ void Timeline::reset()
  */
 void Timeline::scheduleAction(std::unique_ptr<FrameAction> action)
 {
-	unsigned int lastFrame;
-	utils::time_point lastTime;
-
-	if (history_.empty()) {
-		lastFrame = 0;
-		lastTime = std::chrono::steady_clock::now();
-	} else {
-		lastFrame = history_.back().first;
-		lastTime = history_.back().second;
-	}
-
 	/*
-	 * Calculate when the action shall be schedule by first finding out how
-	 * many frames in the future the action acts on and then add the actions
-	 * frame offset. After the spatial frame offset is found out translate
-	 * that to a time point by using the last estimated start of exposure
-	 * (SOE) as the fixed offset. Lastly add the action time offset to the
+	 * Calculate when the action shall be schedule by first finding out
+	 * which frame the action acts on by adding the action frame offset.
+	 * Translate that frame to a time point by using the estimated start of
+	 * exposure (SOE) of the frame. Lastly add the action time offset to the
 	 * time point.
+	 *
+	 * Without any recorded SOE, assume the current time is the SOE of the
+	 * first frame.
 	 */
-	int frame = action->frame() - lastFrame + frameOffset(action->type());
-	utils::time_point deadline = lastTime + frame * frameInterval_
-		+ timeOffset(action->type());
+	int frame = action->frame() + frameOffset(action->type());
+	utils::time_point soe;
+
+	if (estimator_.empty())
+		soe = std::chrono::steady_clock::now()
+		    + frame * estimator_.interval();
+	else
+		soe = estimator_.estimate(frame);
+
+	utils::time_point deadline = soe + timeOffset(action->type());
 
 	utils::time_point now = std::chrono::steady_clock::now();
 	if (deadline < now) {
@@ -128,33 +126,14 @@ void Timeline::scheduleAction(std::unique_ptr<FrameAction> action)
 	}
 }
 
+/**
+ * \brief Record the start of exposure of a frame
+ * \param[in] frame The frame sequence number
+ * \param[in] time The start of exposure time
+ */
 void Timeline::notifyStartOfExposure(unsigned int frame, utils::time_point time)
 {
-	history_.push_back(std::make_pair(frame, time));
-
-	if (history_.size() <= HISTORY_DEPTH / 2)
-		return;
-
-	while (history_.size() > HISTORY_DEPTH)
-		history_.pop_front();
-
-	/* Update esitmated time between two start of exposures. */
-	utils::duration sumExposures(0);
-	unsigned int numExposures = 0;
-
-	utils::time_point lastTime;
-	for (auto it = history_.begin(); it != history_.end(); it++) {
-		if (it != history_.begin()) {
-			sumExposures += it->second - lastTime;
-			numExposures++;
-		}
-
-		lastTime = it->second;
-	}
-
-	frameInterval_ = sumExposures;
-	if (numExposures)
-		frameInterval_ /= numExposures;
+	estimator_.addSample(frame, time);
 }
 
 int Timeline::frameOffset(unsigned int type) const
@@ -7,11 +7,11 @@
 #ifndef __LIBCAMERA_TIMELINE_H__
 #define __LIBCAMERA_TIMELINE_H__
 
-#include <list>
 #include <map>
 
 #include <libcamera/timer.h>
 
+#include "frame_interval_estimator.h"
 #include "utils.h"
 
 namespace libcamera {
@@ -44,7 +44,7 @@ public:
 	virtual void scheduleAction(std::unique_ptr<FrameAction> action);
 	virtual void notifyStartOfExposure(unsigned int frame, utils::time_point time);
 
-	utils::duration frameInterval() const { return frameInterval_; }
+	utils::duration frameInterval() const { return estimator_.interval(); }
 
 protected:
 	int frameOffset(unsigned int type) const;
@@ -60,9 +60,8 @@ private:
 	void timeout(Timer *timer);
 	void updateDeadline();
 
-	std::list<std::pair<unsigned int, utils::time_point>> history_;
+	FrameIntervalEstimator estimator_;
 	std::multimap<utils::time_point, std::unique_ptr<FrameAction>> actions_;
-	utils::duration frameInterval_;
 
 	Timer timer_;
 };
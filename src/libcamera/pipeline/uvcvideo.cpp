@@ -41,7 +41,7 @@ public:
 	}
 
 	int init(MediaEntity *entity);
-	void bufferReady(Buffer *buffer);
+	void buffersReady(const std::vector<Buffer *> &buffers);
 
 	V4L2VideoDevice *video_;
 	Stream stream_;
@@ -332,7 +332,7 @@ int UVCCameraData::init(MediaEntity *entity)
 	if (ret)
 		return ret;
 
-	video_->bufferReady.connect(this, &UVCCameraData::bufferReady);
+	video_->buffersReady.connect(this, &UVCCameraData::buffersReady);
 
 	/* Initialise the supported controls. */
 	const ControlInfoMap &controls = video_->controls();
@@ -372,12 +372,14 @@ int UVCCameraData::init(MediaEntity *entity)
 	return 0;
 }
 
-void UVCCameraData::bufferReady(Buffer *buffer)
+void UVCCameraData::buffersReady(const std::vector<Buffer *> &buffers)
 {
-	Request *request = buffer->request();
+	for (Buffer *buffer : buffers) {
+		Request *request = buffer->request();
 
-	pipe_->completeBuffer(camera_, request, buffer);
-	pipe_->completeRequest(camera_, request);
+		pipe_->completeBuffer(camera_, request, buffer);
+		pipe_->completeRequest(camera_, request);
+	}
 }
 
 REGISTER_PIPELINE_HANDLER(PipelineHandlerUVC);
@@ -54,7 +54,7 @@ public:
 	}
 
 	int init(MediaDevice *media);
-	void bufferReady(Buffer *buffer);
+	void buffersReady(const std::vector<Buffer *> &buffers);
 
 	CameraSensor *sensor_;
 	V4L2Subdevice *debayer_;
@@ -404,7 +404,7 @@ int VimcCameraData::init(MediaDevice *media)
 	if (video_->open())
 		return -ENODEV;
 
-	video_->bufferReady.connect(this, &VimcCameraData::bufferReady);
+	video_->buffersReady.connect(this, &VimcCameraData::buffersReady);
 
 	raw_ = new V4L2VideoDevice(media->getEntityByName("Raw Capture 1"));
 	if (raw_->open())
@@ -441,12 +441,14 @@ int VimcCameraData::init(MediaDevice *media)
 	return 0;
 }
 
-void VimcCameraData::bufferReady(Buffer *buffer)
+void VimcCameraData::buffersReady(const std::vector<Buffer *> &buffers)
 {
-	Request *request = buffer->request();
+	for (Buffer *buffer : buffers) {
+		Request *request = buffer->request();
 
-	pipe_->completeBuffer(camera_, request, buffer);
-	pipe_->completeRequest(camera_, request);
+		pipe_->completeBuffer(camera_, request, buffer);
+		pipe_->completeRequest(camera_, request);
+	}
 }
 
 REGISTER_PIPELINE_HANDLER(PipelineHandlerVimc);
@@ -7,9 +7,13 @@
 
 #include "pipeline_handler.h"
 
+#include <algorithm>
+#include <string.h>
+
 #include <libcamera/buffer.h>
 #include <libcamera/camera.h>
 #include <libcamera/camera_manager.h>
+#include <libcamera/request.h>
 
 #include "device_enumerator.h"
 #include "log.h"
@@ -82,12 +86,27 @@ LOG_DEFINE_CATEGORY(Pipeline)
  * \brief The list of queued and not yet completed request
  *
  * The list of queued request is used to track requests queued in order to
- * ensure completion of all requests when the pipeline handler is stopped.
+ * ensure completion of all requests when the pipeline handler is stopped. It
+ * only holds the requests in flight, and is stored in a vector whose capacity
+ * is retained, so that queuing requests doesn't allocate memory in steady
+ * state.
  *
  * \sa PipelineHandler::queueRequest(), PipelineHandler::stop(),
  * PipelineHandler::completeRequest()
  */
 
+/**
+ * \var CameraData::waitingRequests_
+ * \brief The list of requests waiting for acquire fences
+ *
+ * Requests submitted with buffers that have acquire fences are stored in this
+ * list, in submission order, until all their fences have signalled. Requests
+ * submitted while the list isn't empty are stored in the list as well to
+ * preserve ordering, even if they have no fence.
+ *
+ * \sa PipelineHandler::submitRequest()
+ */
+
 /**
  * \var CameraData::controlInfo_
  * \brief The set of controls supported by the camera
@@ -115,6 +134,12 @@ LOG_DEFINE_CATEGORY(Pipeline)
  * They implement std::enable_shared_from_this<> in order to create new
  * std::shared_ptr<> in code paths originating from member functions of the
  * PipelineHandler class where only the 'this' pointer is available.
+ *
+ * Pipeline handlers are created by the camera manager in its internal thread,
+ * and all their methods, as well as the V4L2 devices and IPA modules they
+ * own, run in that thread. The Camera class invokes the pipeline handler
+ * operations synchronously across threads, and completion of buffers and
+ * requests is delivered to the application thread by the Camera.
  */
 
 /**
@@ -366,6 +391,102 @@ int PipelineHandler::queueRequest(Camera *camera, Request *request)
 	return 0;
 }
 
+/**
+ * \brief Submit a request to the pipeline handler
+ * \param[in] camera The camera to queue the request to
+ * \param[in] request The request to queue
+ *
+ * This method is called by the Camera class to queue requests. It queues the
+ * \a request to the pipeline handler with queueRequest() once the acquire
+ * fences of all its buffers have signalled. Fences are waited on
+ * asynchronously in the pipeline handler thread's event dispatcher. Requests
+ * without fences are queued immediately, unless earlier requests are still
+ * waiting for their fences, in which case they wait for those requests to be
+ * queued first.
+ *
+ * When the \a request is queued immediately, errors from queueRequest() are
+ * returned to the caller. Otherwise they are reported asynchronously by
+ * completing the request with all its buffers cancelled.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int PipelineHandler::submitRequest(Camera *camera, Request *request)
+{
+	CameraData *data = cameraData(camera);
+
+	expiredNotifiers_.clear();
+
+	bool fenced = false;
+	for (auto const &it : request->buffers()) {
+		Buffer *buffer = it.second;
+		if (buffer->acquireFence() == -1)
+			continue;
+
+		FenceWait wait;
+		wait.notifier = utils::make_unique<EventNotifier>(buffer->acquireFence(),
+								   EventNotifier::Read);
+		wait.notifier->activated.connect(this, &PipelineHandler::fenceSignalled);
+		wait.camera = camera;
+		wait.buffer = buffer;
+		fenceWaits_.push_back(std::move(wait));
+
+		fenced = true;
+	}
+
+	if (!fenced && data->waitingRequests_.empty())
+		return queueRequest(camera, request);
+
+	LOG(Pipeline, Debug)
+		<< "Request " << request->cookie() << " waiting for fences";
+
+	data->waitingRequests_.push_back(request);
+
+	return 0;
+}
+
+/**
+ * \brief Stop capture and cancel all pending requests
+ * \param[in] camera The camera to stop
+ *
+ * This method is called by the Camera class to stop the \a camera. It first
+ * cancels the requests waiting for acquire fences, and then stops the pipeline
+ * handler with stop(). As both operations run in a single invocation in the
+ * pipeline handler thread, no fence can signal in-between and queue a request
+ * to a stopped pipeline handler.
+ */
+void PipelineHandler::stopCapture(Camera *camera)
+{
+	cancelWaitingRequests(camera);
+	stop(camera);
+}
+
+/*
+ * Stop waiting on the acquire fences and complete all the requests submitted
+ * with submitRequest() that haven't been queued yet, with their buffers
+ * cancelled. The acquire fences that haven't signalled are returned to the
+ * application as the release fences of the buffers.
+ */
+void PipelineHandler::cancelWaitingRequests(Camera *camera)
+{
+	CameraData *data = cameraData(camera);
+
+	for (auto it = fenceWaits_.begin(); it != fenceWaits_.end();) {
+		if (it->camera != camera) {
+			++it;
+			continue;
+		}
+
+		it->notifier->setEnabled(false);
+		it = fenceWaits_.erase(it);
+	}
+
+	while (!data->waitingRequests_.empty()) {
+		Request *request = data->waitingRequests_.front();
+		data->waitingRequests_.pop_front();
+		cancelRequest(camera, request);
+	}
+}
+
 /**
  * \brief Complete a buffer for a request
  * \param[in] camera The camera the request belongs to
@@ -385,7 +506,7 @@ int PipelineHandler::queueRequest(Camera *camera, Request *request)
 bool PipelineHandler::completeBuffer(Camera *camera, Request *request,
 				     Buffer *buffer)
 {
-	camera->bufferCompleted.emit(request, buffer);
+	camera->bufferComplete(request, buffer);
 	return request->completeBuffer(buffer);
 }
 
@@ -414,11 +535,83 @@ void PipelineHandler::completeRequest(Camera *camera, Request *request)
 			break;
 
 		ASSERT(!request->hasPendingBuffers());
-		data->queuedRequests_.pop_front();
+		data->queuedRequests_.erase(data->queuedRequests_.begin());
 		camera->requestComplete(request);
 	}
 }
 
+/*
+ * Handle the signalling of an acquire fence. The notifier is disabled and
+ * kept alive until the next fence is processed, as it can't be deleted from
+ * within its own activated signal.
+ */
+void PipelineHandler::fenceSignalled(EventNotifier *notifier)
+{
+	expiredNotifiers_.clear();
+
+	auto it = std::find_if(fenceWaits_.begin(), fenceWaits_.end(),
+			       [notifier](const FenceWait &wait) {
+				       return wait.notifier.get() == notifier;
+			       });
+	if (it == fenceWaits_.end())
+		return;
+
+	Camera *camera = it->camera;
+
+	notifier->setEnabled(false);
+	it->buffer->setAcquireFence(-1);
+	expiredNotifiers_.push_back(std::move(it->notifier));
+	fenceWaits_.erase(it);
+
+	queueWaitingRequests(camera);
+}
+
+/*
+ * Queue the requests waiting at the front of the camera's waiting list whose
+ * acquire fences have all signalled.
+ */
+void PipelineHandler::queueWaitingRequests(Camera *camera)
+{
+	CameraData *data = cameraData(camera);
+
+	while (!data->waitingRequests_.empty()) {
+		Request *request = data->waitingRequests_.front();
+
+		for (auto const &it : request->buffers()) {
+			if (it.second->acquireFence() != -1)
+				return;
+		}
+
+		data->waitingRequests_.pop_front();
+
+		int ret = queueRequest(camera, request);
+		if (ret < 0) {
+			LOG(Pipeline, Error)
+				<< "Failed to queue request " << request->cookie()
+				<< ": " << strerror(-ret);
+			cancelRequest(camera, request);
+		}
+	}
+}
+
+/*
+ * Complete a request that hasn't been queued with queueRequest(), with all its
+ * buffers cancelled.
+ */
+void PipelineHandler::cancelRequest(Camera *camera, Request *request)
+{
+	CameraData *data = cameraData(camera);
+	data->queuedRequests_.push_back(request);
+
+	for (auto const &it : request->buffers()) {
+		Buffer *buffer = it.second;
+		buffer->cancel();
+		completeBuffer(camera, request, buffer);
+	}
+
+	completeRequest(camera, request);
+}
+
 /**
  * \brief Register a camera to the camera manager and pipeline handler
  * \param[in] camera The camera to be added
@@ -487,6 +680,7 @@ void PipelineHandler::disconnect()
 		if (!camera)
 			continue;
 
+		cancelWaitingRequests(camera.get());
 		camera->disconnect();
 		manager_->removeCamera(camera.get());
 	}
@@ -517,6 +711,12 @@ CameraData *PipelineHandler::cameraData(const Camera *camera)
  * constant for the whole lifetime of the pipeline handler.
  */
 
+/**
+ * \fn PipelineHandler::manager()
+ * \brief Retrieve the camera manager associated with the pipeline handler
+ * \return The camera manager
+ */
+
 /**
  * \fn PipelineHandler::name()
  * \brief Retrieve the pipeline handler name
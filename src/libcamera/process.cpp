@@ -23,6 +23,7 @@
 #include <libcamera/event_notifier.h>
 
 #include "log.h"
+#include "thread.h"
 #include "utils.h"
 
 /**
@@ -232,7 +233,8 @@ Process::~Process()
  * \param[in] fds Vector of file descriptors to keep open (optional)
  *
  * Fork a process, and exec the executable specified by path. Prior to
- * exec'ing, but after forking, all file descriptors except for those
+ * exec'ing, but after forking, the scheduling parameters set with
+ * setScheduling() are applied, and all file descriptors except for those
  * specified in fds will be closed.
  *
  * All indexes of args will be incremented by 1 before being fed to exec(),
@@ -263,6 +265,21 @@ int Process::start(const std::string &path,
 
 		return 0;
 	} else {
+		/*
+		 * Apply the scheduling parameters before isolating the process,
+		 * as the capabilities required to select a real-time policy are
+		 * lost when entering the new user namespace. The parameters are
+		 * applied before exec'ing to be inherited by all threads.
+		 */
+		if (scheduling_) {
+			ret = applyScheduling(getpid(), *scheduling_);
+			if (ret < 0)
+				LOG(Process, Warning)
+					<< "Failed to apply scheduling parameters "
+					<< scheduling_->toString() << ": "
+					<< strerror(-ret);
+		}
+
 		if (isolate())
 			_exit(EXIT_FAILURE);
 
@@ -366,6 +383,33 @@ void Process::died(int wstatus)
  * Signal that is emitted when the process is confirmed to have terminated.
  */
 
+/**
+ * \brief Set the scheduling parameters of the process
+ * \param[in] scheduling The scheduling parameters
+ *
+ * If the process is running, the scheduling parameters are applied to its main
+ * thread immediately, and only threads created by the process afterwards
+ * inherit them. Otherwise they are stored and applied by start() in the child
+ * process before exec'ing, in which case they are inherited by all threads of
+ * the process, and failures are logged but don't prevent the process from
+ * running.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int Process::setScheduling(const ThreadScheduling &scheduling)
+{
+	int ret = scheduling.validate();
+	if (ret < 0)
+		return ret;
+
+	scheduling_ = utils::make_unique<ThreadScheduling>(scheduling);
+
+	if (!running_)
+		return 0;
+
+	return applyScheduling(pid_, scheduling);
+}
+
 /**
  * \brief Kill the process
  *
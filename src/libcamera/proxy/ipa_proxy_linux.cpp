@@ -5,6 +5,7 @@
  * ipa_proxy_linux.cpp - Default Image Processing Algorithm proxy for Linux
  */
 
+#include <errno.h>
 #include <string.h>
 #include <vector>
 
@@ -28,7 +29,7 @@ namespace IPAProxyLinux {
 class Proxy : public IPAProxy
 {
 public:
-	Proxy(IPAModule *ipam);
+	Proxy(IPAModule *ipam, const ThreadScheduling *scheduling);
 	~Proxy();
 
 	int init() override { return 0; }
@@ -38,6 +39,8 @@ public:
 	void unmapBuffers(const std::vector<unsigned int> &ids) override {}
 	void processEvent(const IPAOperationData &event) override {}
 
+	int setScheduling(const ThreadScheduling &scheduling) override;
+
 private:
 	int sendMessage(const Message &msg);
 	void readyRead(IPCUnixSocket *ipc);
@@ -47,7 +50,7 @@ private:
 	IPCUnixSocket *socket_;
 };
 
-Proxy::Proxy(IPAModule *ipam)
+Proxy::Proxy(IPAModule *ipam, const ThreadScheduling *scheduling)
 	: proc_(nullptr), socket_(nullptr)
 {
 	LOG(IPAProxy, Debug)
@@ -76,6 +79,15 @@ Proxy::Proxy(IPAModule *ipam)
 	fds.push_back(fd);
 
 	proc_ = new Process();
+	if (scheduling) {
+		int ret = proc_->setScheduling(*scheduling);
+		if (ret < 0)
+			LOG(IPAProxy, Warning)
+				<< "Invalid scheduling parameters "
+				<< scheduling->toString() << ": "
+				<< strerror(-ret);
+	}
+
 	int ret = proc_->start(path, args, fds);
 	if (ret) {
 		LOG(IPAProxy, Error)
@@ -92,6 +104,14 @@ Proxy::~Proxy()
 	delete socket_;
 }
 
+int Proxy::setScheduling(const ThreadScheduling &scheduling)
+{
+	if (!proc_)
+		return -ENODEV;
+
+	return proc_->setScheduling(scheduling);
+}
+
 int Proxy::sendMessage(const Message &msg)
 {
 	struct IPCUnixSocket::Payload payload;
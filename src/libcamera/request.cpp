@@ -43,22 +43,33 @@ LOG_DEFINE_CATEGORY(Request)
  *
  * A Request allows an application to associate buffers and controls on a
  * per-frame basis to be queued to the camera device for processing.
+ *
+ * Requests are either single-use or reusable. Single-use requests are owned
+ * by the camera once queued, and are deleted automatically after they
+ * complete. Reusable requests are owned by the application, which shall
+ * delete them when they're not needed anymore. Once a reusable request has
+ * completed, the application can reset it with reuse() and queue it again
+ * with the same buffers. Reusing requests avoids allocating a Request and its
+ * Buffer instances for every frame.
  */
 
 /**
  * \brief Create a capture request for a camera
  * \param[in] camera The camera that creates the request
  * \param[in] cookie Opaque cookie for application use
+ * \param[in] reusable True to create a reusable request owned by the caller
  *
  * The \a cookie is stored in the request and is accessible through the
  * cookie() method at any time. It is typically used by applications to map the
  * request to an external resource in the request completion handler, and is
  * completely opaque to libcamera.
  *
+ * Applications shall create requests with Camera::createRequest() or
+ * Camera::createReusableRequest().
  */
-Request::Request(Camera *camera, uint64_t cookie)
-	: camera_(camera), cookie_(cookie), status_(RequestPending),
-	  cancelled_(false)
+Request::Request(Camera *camera, uint64_t cookie, bool reusable)
+	: camera_(camera), pendingBuffers_(0), cookie_(cookie),
+	  reusable_(reusable), status_(RequestPending), cancelled_(false)
 {
 	/**
 	 * \todo Should the Camera expose a validator instance, to avoid
@@ -85,6 +96,53 @@ Request::~Request()
 	delete validator_;
 }
 
+/**
+ * \brief Reset a completed request to queue it again
+ *
+ * This method resets the status of a completed reusable request to
+ * RequestPending and clears its controls and metadata. The buffers added to
+ * the request are kept, and the request can be queued again to the camera
+ * with Camera::queueRequest(). The release fences of the buffers are closed,
+ * applications that need to wait on them shall do so before reusing the
+ * request.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -EINVAL The request isn't reusable
+ * \retval -EBUSY The request hasn't completed yet
+ */
+int Request::reuse()
+{
+	if (!reusable_) {
+		LOG(Request, Error) << "Request isn't reusable";
+		return -EINVAL;
+	}
+
+	if (status_ == RequestPending) {
+		LOG(Request, Error) << "Request hasn't completed";
+		return -EBUSY;
+	}
+
+	status_ = RequestPending;
+	cancelled_ = false;
+	controls_->clear();
+	metadata_->clear();
+
+	for (auto const &pair : bufferMap_)
+		pair.second->setReleaseFence(-1);
+
+	return 0;
+}
+
+/**
+ * \fn Request::reusable()
+ * \brief Check if the request is reusable
+ *
+ * Reusable requests are owned by the application and aren't deleted when
+ * they complete.
+ *
+ * \return True if the request is reusable, false otherwise
+ */
+
 /**
  * \fn Request::controls()
  * \brief Retrieve the request's ControlList
@@ -116,7 +174,8 @@ Request::~Request()
  * \param[in] buffer The Buffer to store in the request
  *
  * Ownership of the buffer is passed to the request. It will be deleted when
- * the request is destroyed after completing.
+ * the request is destroyed, either after completing for single-use requests,
+ * or when deleted by the application for reusable requests.
  *
  * A request can only contain one buffer per stream. If a buffer has already
  * been added to the request for the same stream, this method returns -EEXIST.
@@ -221,9 +280,10 @@ int Request::prepare()
 	for (auto const &pair : bufferMap_) {
 		Buffer *buffer = pair.second;
 		buffer->setRequest(this);
-		pending_.insert(buffer);
 	}
 
+	pendingBuffers_ = bufferMap_.size();
+
 	return 0;
 }
 
@@ -244,8 +304,9 @@ void Request::complete()
  * \brief Complete a buffer for the request
  * \param[in] buffer The buffer that has completed
  *
- * A request tracks the status of all buffers it contains through a set of
- * pending buffers. This function removes the \a buffer from the set to mark it
+ * A request tracks the status of all buffers it contains through a count of
+ * pending buffers, and the association of each pending buffer with the
+ * request. This function dissociates the \a buffer from the request to mark it
  * as complete. All buffers associate with the request shall be marked as
  * complete by calling this function once and once only before reporting the
  * request as complete with the complete() method.
@@ -255,10 +316,10 @@ void Request::complete()
  */
 bool Request::completeBuffer(Buffer *buffer)
 {
-	int ret = pending_.erase(buffer);
-	ASSERT(ret == 1);
+	ASSERT(buffer->request() == this && pendingBuffers_);
 
 	buffer->setRequest(nullptr);
+	pendingBuffers_--;
 
 	if (buffer->status() == Buffer::BufferCancelled)
 		cancelled_ = true;
@@ -0,0 +1,141 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * scheduling.cpp - Thread scheduling parameters
+ */
+
+#include <libcamera/scheduling.h>
+
+#include <errno.h>
+#include <sched.h>
+#include <sstream>
+
+/**
+ * \file scheduling.h
+ * \brief Thread scheduling parameters
+ */
+
+namespace libcamera {
+
+/**
+ * \struct ThreadScheduling
+ * \brief Scheduling parameters for a thread or process
+ *
+ * The ThreadScheduling structure groups the parameters that control how the
+ * system schedules a thread: the scheduling policy and its real-time priority,
+ * the nice value, and the set of CPUs the thread is allowed to run on.
+ *
+ * The default-constructed parameters select the normal time-sharing policy
+ * with a nice value of 0, and leave the CPU affinity unchanged.
+ *
+ * Selecting a real-time policy or lowering the nice value below its current
+ * value usually requires the CAP_SYS_NICE capability or an appropriate
+ * RLIMIT_RTPRIO or RLIMIT_NICE resource limit.
+ */
+
+/**
+ * \enum ThreadScheduling::Policy
+ * \brief Scheduling policy
+ * \var ThreadScheduling::PolicyOther
+ * \brief The default time-sharing policy (SCHED_OTHER)
+ * \var ThreadScheduling::PolicyFifo
+ * \brief The first-in, first-out real-time policy (SCHED_FIFO)
+ * \var ThreadScheduling::PolicyRoundRobin
+ * \brief The round-robin real-time policy (SCHED_RR)
+ */
+
+/**
+ * \fn ThreadScheduling::ThreadScheduling()
+ * \brief Construct default scheduling parameters
+ */
+
+/**
+ * \var ThreadScheduling::policy
+ * \brief The scheduling policy
+ */
+
+/**
+ * \var ThreadScheduling::priority
+ * \brief The static priority for real-time policies
+ *
+ * The priority shall be in the range supported by the system for the
+ * real-time policy, typically [1, 99], and shall be 0 for PolicyOther.
+ */
+
+/**
+ * \var ThreadScheduling::nice
+ * \brief The nice value, in the range [-20, 19]
+ *
+ * The nice value only affects threads scheduled with PolicyOther.
+ */
+
+/**
+ * \var ThreadScheduling::cpus
+ * \brief The CPUs the thread is allowed to run on
+ *
+ * If the list is empty the CPU affinity of the thread is left unchanged.
+ */
+
+/**
+ * \brief Validate the scheduling parameters
+ * \return 0 if the parameters are valid, or -EINVAL otherwise
+ */
+int ThreadScheduling::validate() const
+{
+	switch (policy) {
+	case PolicyOther:
+		if (priority)
+			return -EINVAL;
+		break;
+
+	case PolicyFifo:
+	case PolicyRoundRobin: {
+		int sched = policy == PolicyFifo ? SCHED_FIFO : SCHED_RR;
+		int min = sched_get_priority_min(sched);
+		int max = sched_get_priority_max(sched);
+		if (static_cast<int>(priority) < min ||
+		    static_cast<int>(priority) > max)
+			return -EINVAL;
+		break;
+	}
+
+	default:
+		return -EINVAL;
+	}
+
+	if (nice < -20 || nice > 19)
+		return -EINVAL;
+
+	for (unsigned int cpu : cpus) {
+		if (cpu >= CPU_SETSIZE)
+			return -EINVAL;
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Assemble and return a string describing the scheduling parameters
+ * \return A string describing the scheduling parameters
+ */
+const std::string ThreadScheduling::toString() const
+{
+	static const char *const policies[] = { "other", "fifo", "rr" };
+	std::stringstream ss;
+
+	ss << (policy <= PolicyRoundRobin ? policies[policy] : "invalid");
+	if (policy != PolicyOther)
+		ss << "/" << priority;
+	ss << " nice " << nice;
+
+	if (!cpus.empty()) {
+		ss << " cpus ";
+		for (unsigned int i = 0; i < cpus.size(); ++i)
+			ss << (i ? "," : "") << cpus[i];
+	}
+
+	return ss.str();
+}
+
+} /* namespace libcamera */
@@ -0,0 +1,162 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * semaphore.cpp - General-purpose counting semaphore
+ */
+
+#include "semaphore.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "log.h"
+
+/**
+ * \file semaphore.h
+ * \brief General-purpose counting semaphore
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(Semaphore)
+
+/*
+ * The semaphore value stores the number of available resources in the low
+ * bits, and a flag signalling that threads may be sleeping on the futex in the
+ * most significant bit.
+ */
+static constexpr unsigned int WaitersFlag = 1U << 31;
+
+static int futex(std::atomic<unsigned int> *addr, int op, unsigned int val)
+{
+	static_assert(sizeof(std::atomic<unsigned int>) == sizeof(int),
+		      "std::atomic<unsigned int> can't be used as a futex");
+
+	return syscall(SYS_futex, reinterpret_cast<int *>(addr),
+		       op | FUTEX_PRIVATE_FLAG, val, nullptr, nullptr, 0);
+}
+
+/**
+ * \class Semaphore
+ * \brief General-purpose counting semaphore
+ *
+ * A semaphore is a locking primitive that protects resources. It is created
+ * with an initial number of resources (which may be 0), and offers two
+ * primitives to acquire and release resources. The acquire() method tries to
+ * acquire a number of resources, and blocks if not enough resources are
+ * available until they get released. The release() method releases a number
+ * of resources, waking up any consumer blocked on an acquire() call.
+ *
+ * The semaphore is implemented on top of a futex. Acquiring and releasing
+ * resources doesn't involve any system call when no thread needs to be woken
+ * up or put to sleep.
+ */
+
+/**
+ * \brief Construct a semaphore with \a n resources
+ * \param[in] n The resource count
+ */
+Semaphore::Semaphore(unsigned int n)
+	: value_(n)
+{
+}
+
+/**
+ * \brief Retrieve the number of available resources
+ * \return The number of available resources
+ */
+unsigned int Semaphore::available()
+{
+	return value_.load(std::memory_order_relaxed) & ~WaitersFlag;
+}
+
+/**
+ * \brief Acquire \a n resources
+ * \param[in] n The resource count
+ *
+ * This method attempts to acquire \a n resources. If \a n is higher than the
+ * number of available resources, the call will block until enough resources
+ * become available.
+ */
+void Semaphore::acquire(unsigned int n)
+{
+	while (!tryAcquire(n)) {
+		unsigned int value = value_.load(std::memory_order_relaxed);
+		if ((value & ~WaitersFlag) >= n)
+			continue;
+
+		/*
+		 * Flag the presence of waiters before sleeping. The futex
+		 * wait returns immediately if the value has been modified by
+		 * a release() call in the meantime.
+		 */
+		if (!(value & WaitersFlag) &&
+		    !value_.compare_exchange_weak(value, value | WaitersFlag,
+						  std::memory_order_relaxed))
+			continue;
+
+		int ret = futex(&value_, FUTEX_WAIT, value | WaitersFlag);
+		if (ret < 0 && errno != EAGAIN && errno != EINTR)
+			LOG(Semaphore, Fatal)
+				<< "Failed to wait on futex: " << strerror(errno);
+	}
+}
+
+/**
+ * \brief Try to acquire \a n resources without blocking
+ * \param[in] n The resource count
+ *
+ * This method attempts to acquire \a n resources. If \a n is higher than the
+ * number of available resources, it returns false immediately without
+ * acquiring any resource. Otherwise it acquires the resources and returns
+ * true.
+ *
+ * \return True if the resources have been acquired, false otherwise
+ */
+bool Semaphore::tryAcquire(unsigned int n)
+{
+	unsigned int value = value_.load(std::memory_order_relaxed);
+
+	do {
+		if ((value & ~WaitersFlag) < n)
+			return false;
+	} while (!value_.compare_exchange_weak(value, value - n,
+					       std::memory_order_acquire,
+					       std::memory_order_relaxed));
+
+	return true;
+}
+
+/**
+ * \brief Release \a n resources
+ * \param[in] n The resource count
+ *
+ * This method releases \a n resources, increasing the available resource count
+ * by \a n. If the number of available resources becomes large enough for any
+ * consumer blocked on an acquire() call, those consumers get woken up.
+ *
+ * The semaphore is only accessed through a single atomic operation, followed
+ * by a wake up of the waiters if needed. The semaphore may thus be destroyed
+ * by a consumer as soon as its acquire() call returns, even if the release()
+ * call hasn't returned yet.
+ */
+void Semaphore::release(unsigned int n)
+{
+	unsigned int value = value_.load(std::memory_order_relaxed);
+
+	/* Clear the waiters flag, all waiters get woken up below. */
+	while (!value_.compare_exchange_weak(value, (value + n) & ~WaitersFlag,
+					     std::memory_order_release,
+					     std::memory_order_relaxed))
+		;
+
+	if (value & WaitersFlag)
+		futex(&value_, FUTEX_WAKE, INT_MAX);
+}
+
+} /* namespace libcamera */
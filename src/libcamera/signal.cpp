@@ -7,6 +7,8 @@
 
 #include <libcamera/signal.h>
 
+#include <algorithm>
+
 /**
  * \file signal.h
  * \brief Signal & slot implementation
@@ -14,6 +16,76 @@
 
 namespace libcamera {
 
+/*
+ * Slots are stored in a contiguous array, with inline storage for the common
+ * case of signals connected to a small number of slots. The array only grows,
+ * and switches to heap storage when the inline storage is exhausted.
+ *
+ * Disconnected slots are marked as such, and removed by release(). Removal is
+ * deferred while the signal is being emitted to keep the slot indices stable
+ * for the emission loop.
+ */
+SignalBase::SignalBase()
+	: slots_(inlineSlots_), size_(0), capacity_(InlineSlots), emitting_(0),
+	  dirty_(false)
+{
+}
+
+SignalBase::~SignalBase()
+{
+	for (unsigned int i = 0; i < size_; ++i)
+		delete slots_[i].method;
+
+	if (slots_ != inlineSlots_)
+		delete[] slots_;
+}
+
+void SignalBase::connectSlot(BoundMethodBase *method)
+{
+	if (size_ == capacity_) {
+		Slot *slots = new Slot[capacity_ * 2];
+		std::copy(slots_, slots_ + size_, slots);
+
+		if (slots_ != inlineSlots_)
+			delete[] slots_;
+
+		slots_ = slots;
+		capacity_ *= 2;
+	}
+
+	slots_[size_++] = { method, true };
+}
+
+void SignalBase::disconnectAll()
+{
+	for (unsigned int i = 0; i < size_; ++i)
+		slots_[i].connected = false;
+
+	dirty_ = size_ != 0;
+
+	if (dirty_ && !emitting_)
+		release();
+}
+
+void SignalBase::release()
+{
+	unsigned int size = 0;
+
+	for (unsigned int i = 0; i < size_; ++i) {
+		Slot &slot = slots_[i];
+
+		if (!slot.connected) {
+			delete slot.method;
+			continue;
+		}
+
+		slots_[size++] = slot;
+	}
+
+	size_ = size;
+	dirty_ = false;
+}
+
 /**
  * \class Signal
  * \brief Generic signal and slot communication mechanism
@@ -44,24 +116,30 @@ namespace libcamera {
  * signal emission.
  *
  * When a slot belongs to an instance of the Object class, the slot is called
- * in the context of the thread that the object is bound to. If the signal is
+ * in the context of the thread that the object is bound to, according to the
+ * connection type. With the default ConnectionTypeAuto, if the signal is
  * emitted from the same thread, the slot will be called synchronously, before
  * Signal::emit() returns. If the signal is emitted from a different thread,
  * the slot will be called asynchronously from the object's thread's event
  * loop, after the Signal::emit() method returns, with a copy of the signal's
  * arguments. The emitter shall thus ensure that any pointer or reference
  * passed through the signal will remain valid after the signal is emitted.
+ * With ConnectionTypeBlocking, Signal::emit() only returns once the slot has
+ * been called in the object's thread.
  */
 
 /**
- * \fn Signal::connect(T *object, void(T::*func)(Args...))
+ * \fn Signal::connect(T *object, void(T::*func)(Args...), ConnectionType type)
  * \brief Connect the signal to a member function slot
  * \param[in] object The slot object pointer
  * \param[in] func The slot member function
+ * \param[in] type The connection type
  *
  * If the typename T inherits from Object, the signal will be automatically
- * disconnected from the \a func slot of \a object when \a object is destroyed.
- * Otherwise the caller shall disconnect signals manually before destroying \a
+ * disconnected from the \a func slot of \a object when \a object is destroyed,
+ * and the slot will be invoked according to the connection \a type. Otherwise
+ * the connection type is ignored, the slot is always invoked synchronously,
+ * and the caller shall disconnect signals manually before destroying \a
  * object.
  */
 
@@ -105,6 +183,11 @@ namespace libcamera {
  * function are passed to the slot functions unchanged. If a slot modifies one
  * of the arguments (when passed by pointer or reference), the modification is
  * thus visible to all subsequently called slots.
+ *
+ * The slots connected to the signal may be modified during emission, including
+ * from the slots themselves. Slots disconnected during emission are not called
+ * anymore from the point they get disconnected, and slots connected during
+ * emission are only called by subsequent emissions.
  */
 
 } /* namespace libcamera */
@@ -11,7 +11,11 @@
 #include <array>
 #include <climits>
 #include <iomanip>
+#include <linux/magic.h>
 #include <sstream>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <unistd.h>
 
 #include <libcamera/request.h>
 
@@ -42,6 +46,30 @@ namespace libcamera {
 
 LOG_DEFINE_CATEGORY(Stream)
 
+/* Marks the end of the free buffer slots list. */
+static constexpr unsigned int kNoSlot = ~0U;
+
+/*
+ * Retrieve the size of a dmabuf. Kernels that don't report the size through
+ * fstat() only report it by seeking to the end of the dmabuf, in which case the
+ * file offset, shared with the application, is restored.
+ */
+static off_t dmabufSize(int fd)
+{
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size > 0)
+		return st.st_size;
+
+	off_t offset = lseek(fd, 0, SEEK_CUR);
+	if (offset < 0)
+		return -1;
+
+	off_t size = lseek(fd, 0, SEEK_END);
+	lseek(fd, offset, SEEK_SET);
+
+	return size;
+}
+
 /**
  * \class StreamFormats
  * \brief Hold information about supported stream formats
@@ -290,7 +318,8 @@ SizeRange StreamFormats::range(unsigned int pixelformat) const
  * handlers provied StreamFormats.
  */
 StreamConfiguration::StreamConfiguration()
-	: pixelFormat(0), memoryType(InternalMemory), stream_(nullptr)
+	: pixelFormat(0), memoryType(InternalMemory),
+	  mappingPolicy(MappingReadWrite), stream_(nullptr)
 {
 }
 
@@ -298,8 +327,8 @@ StreamConfiguration::StreamConfiguration()
  * \brief Construct a configuration with stream formats
  */
 StreamConfiguration::StreamConfiguration(const StreamFormats &formats)
-	: pixelFormat(0), memoryType(InternalMemory), stream_(nullptr),
-	  formats_(formats)
+	: pixelFormat(0), memoryType(InternalMemory),
+	  mappingPolicy(MappingReadWrite), stream_(nullptr), formats_(formats)
 {
 }
 
@@ -321,6 +350,15 @@ StreamConfiguration::StreamConfiguration(const StreamFormats &formats)
  * \brief The memory type the stream shall use
  */
 
+/**
+ * \var StreamConfiguration::mappingPolicy
+ * \brief The policy for mapping the stream buffers to the CPU
+ *
+ * Applications that don't access the buffer contents with the CPU should set
+ * the policy to MappingNone, and applications that only read the buffers
+ * should set it to MappingReadOnly. The default policy is MappingReadWrite.
+ */
+
 /**
  * \var StreamConfiguration::bufferCount
  * \brief Requested number of buffers to allocate for the stream
@@ -416,10 +454,27 @@ std::string StreamConfiguration::toString() const
  * optimal stream for the task.
  */
 
+/**
+ * \struct Stream::CacheStats
+ * \brief Statistics of the external buffer mapping cache
+ *
+ * Streams that use the ExternalMemory type associate the dmabufs of the
+ * buffers queued by the application with the stream's buffer memory. The
+ * association is cached, and the cache statistics count how many times a
+ * buffer has been found in the cache.
+ *
+ * \var Stream::CacheStats::hits
+ * \brief Number of buffers that reused the memory they were last mapped to
+ * \var Stream::CacheStats::misses
+ * \brief Number of buffers that had to be mapped to new memory
+ */
+
 /**
  * \brief Construct a stream with default parameters
  */
 Stream::Stream()
+	: freeHead_(kNoSlot), freeTail_(kNoSlot), identityChecked_(false),
+	  identityReliable_(false), cacheStats_({})
 {
 }
 
@@ -481,14 +536,61 @@ std::unique_ptr<Buffer> Stream::createBuffer(unsigned int index)
  * \return A newly created Buffer on success or nullptr otherwise
  */
 std::unique_ptr<Buffer> Stream::createBuffer(const std::array<int, 3> &fds)
+{
+	std::vector<DmabufPlane> planes;
+
+	for (int fd : fds) {
+		if (fd == -1)
+			break;
+
+		planes.push_back({ fd, 0, 0, 0 });
+	}
+
+	return createBuffer(planes);
+}
+
+/**
+ * \brief Create a Buffer instance that represents a memory area described by
+ * dmabuf planes
+ * \param[in] planes The description of each plane
+ *
+ * This method creates a Buffer instance that references buffer memory
+ * allocated outside of libcamera, described by one DmabufPlane per plane, up
+ * to three planes. Multiple planes may be stored in the same dmabuf at
+ * different offsets. A plane length of 0 extends the plane to the end of its
+ * dmabuf.
+ *
+ * Video devices can't always honour plane offsets. Devices that use a
+ * single-planar format store all planes contiguously in the memory of the
+ * first plane, which must then start at offset 0. Capture devices don't
+ * support plane offsets with multi-planar formats.
+ *
+ * This method is otherwise identical to
+ * createBuffer(const std::array<int, 3> &fds).
+ *
+ * \return A newly created Buffer on success or nullptr otherwise
+ */
+std::unique_ptr<Buffer> Stream::createBuffer(const std::vector<DmabufPlane> &planes)
 {
 	if (memoryType_ != ExternalMemory) {
 		LOG(Stream, Error) << "Invalid stream memory type";
 		return nullptr;
 	}
 
+	if (planes.empty() || planes.size() > 3) {
+		LOG(Stream, Error) << "Invalid number of planes " << planes.size();
+		return nullptr;
+	}
+
+	for (const DmabufPlane &plane : planes) {
+		if (plane.fd < 0) {
+			LOG(Stream, Error) << "Invalid dmabuf fd provided";
+			return nullptr;
+		}
+	}
+
 	Buffer *buffer = new Buffer();
-	buffer->dmabuf_ = fds;
+	buffer->dmabufPlanes_ = planes;
 	buffer->stream_ = this;
 
 	return std::unique_ptr<Buffer>(buffer);
@@ -523,6 +625,16 @@ std::unique_ptr<Buffer> Stream::createBuffer(const std::array<int, 3> &fds)
  * \return The memory type used by the stream
  */
 
+/**
+ * \fn Stream::cacheStats()
+ * \brief Retrieve the statistics of the external buffer mapping cache
+ *
+ * The statistics are reset when the buffers of the stream are created, and
+ * are only updated for streams that use the ExternalMemory type.
+ *
+ * \return The buffer mapping cache statistics
+ */
+
 /**
  * \brief Map a Buffer to a buffer memory index
  * \param[in] buffer The buffer to map to a buffer memory index
@@ -532,11 +644,17 @@ std::unique_ptr<Buffer> Stream::createBuffer(const std::array<int, 3> &fds)
  * and the associated buffer memory in the Stream's pool.
  *
  * The buffer memory to use, once the \a buffer reaches the video device,
- * is selected using the index assigned to the \a buffer and to minimize
- * relocations in the V4L2 back-end, this operation provides a best-effort
- * caching mechanism that associates to the dmabuf file descriptors contained
- * in the \a buffer the index of the buffer memory that was lastly queued with
- * those file descriptors set.
+ * is selected using the index assigned to the \a buffer. To minimize
+ * relocations in the V4L2 back-end, this operation caches the association
+ * between the dmabufs contained in the \a buffer and the index of the buffer
+ * memory they were last mapped to. Dmabufs are identified by their inode, not
+ * by their file descriptor numbers, so a dmabuf is found in the cache even if
+ * the application passes it through a different file descriptor. As long as
+ * its buffer memory is free, a dmabuf is always mapped to the same index,
+ * which lets the V4L2 back-end reuse the dmabuf import and memory mapping.
+ *
+ * If the dmabuf isn't found in the cache, or if its buffer memory is in use,
+ * the least recently released buffer memory is used.
  *
  * If the Stream uses internally allocated memory, the index of the memory
  * buffer to use will match the one request at Stream::createBuffer(unsigned int)
@@ -550,42 +668,74 @@ int Stream::mapBuffer(const Buffer *buffer)
 {
 	ASSERT(memoryType_ == ExternalMemory);
 
-	if (bufferCache_.empty())
+	if (freeHead_ == kNoSlot)
 		return -ENOMEM;
 
-	const std::array<int, 3> &dmabufs = buffer->dmabufs();
+	const std::vector<DmabufPlane> &planes = buffer->dmabufPlanes();
+	DmabufIdentity identity;
+	bool identified = identify(planes, &identity);
 
 	/*
-	 * Try to find a previously mapped buffer in the cache. If we miss, use
-	 * the oldest entry in the cache.
+	 * Look up the buffer memory the dmabufs were last mapped to. The
+	 * planes of the buffer memory hold duplicates of the dmabuf file
+	 * descriptors, which keep the dmabufs, and thus their inodes, alive.
+	 * A matching identity is thus guaranteed to refer to the same memory.
 	 */
-	auto map = std::find_if(bufferCache_.begin(), bufferCache_.end(),
-				[&](std::pair<std::array<int, 3>, unsigned int> &entry) {
-					return entry.first == dmabufs;
-				});
-	if (map == bufferCache_.end())
-		map = bufferCache_.begin();
+	if (identified) {
+		auto it = slotMap_.find(identity);
+		if (it != slotMap_.end()) {
+			BufferSlot &slot = bufferSlots_[it->second];
+			if (slot.free) {
+				removeFreeSlot(it->second);
+				cacheStats_.hits++;
+				return it->second;
+			}
+		}
+	}
+
+	/* Use the least recently released buffer memory. */
+	unsigned int index = freeHead_;
+	removeFreeSlot(index);
+	cacheStats_.misses++;
+
+	BufferSlot &slot = bufferSlots_[index];
+
+	if (slot.cached) {
+		slotMap_.erase(slot.identity);
+		slot.cached = false;
+	}
 
-	/*
-	 * Update the dmabuf file descriptors of the entry. We can't assume that
-	 * identical file descriptor numbers refer to the same dmabuf object as
-	 * it may have been closed and its file descriptor reused. We thus need
-	 * to update the plane's internally cached mmap()ed memory.
-	 */
-	unsigned int index = map->second;
 	BufferMemory *mem = &bufferPool_.buffers()[index];
 	mem->planes().clear();
+	mem->planes().reserve(planes.size());
 
-	for (unsigned int i = 0; i < dmabufs.size(); ++i) {
-		if (dmabufs[i] == -1)
-			break;
+	for (const DmabufPlane &desc : planes) {
+		unsigned int length = desc.length;
+
+		if (!length) {
+			off_t size = dmabufSize(desc.fd);
+			if (size > desc.offset)
+				length = size - desc.offset;
+		}
 
 		mem->planes().emplace_back();
-		mem->planes().back().setDmabuf(dmabufs[i], 0);
+		Plane &plane = mem->planes().back();
+		plane.setDmabuf(desc.fd, length, desc.offset);
+		plane.setStride(desc.stride);
+	}
+
+	for (Plane &plane : mem->planes())
+		plane.setMappingPolicy(configuration_.mappingPolicy);
+
+	/*
+	 * If the same dmabufs are already mapped to buffer memory in use, keep
+	 * the existing association to preserve its slot affinity.
+	 */
+	if (identified && slotMap_.emplace(identity, index).second) {
+		slot.identity = identity;
+		slot.cached = true;
 	}
 
-	/* Remove the buffer from the cache and return its index. */
-	bufferCache_.erase(map);
 	return index;
 }
 
@@ -594,13 +744,18 @@ int Stream::mapBuffer(const Buffer *buffer)
  * \param[in] buffer The buffer to unmap
  *
  * This method releases the buffer memory entry that was mapped by mapBuffer(),
- * making it available for new mappings.
+ * making it available for new mappings. The association between the buffer
+ * memory and the dmabufs is retained until the buffer memory is reused for
+ * different dmabufs.
  */
 void Stream::unmapBuffer(const Buffer *buffer)
 {
 	ASSERT(memoryType_ == ExternalMemory);
 
-	bufferCache_.emplace_back(buffer->dmabufs(), buffer->index());
+	if (bufferSlots_[buffer->index()].free)
+		return;
+
+	pushFreeSlot(buffer->index());
 }
 
 /**
@@ -624,12 +779,147 @@ void Stream::createBuffers(MemoryType memory, unsigned int count)
 		return;
 
 	/*
-	 * Prepare for buffer mapping by adding all buffer memory entries to the
-	 * cache.
+	 * Prepare for buffer mapping by marking all buffer memory entries as
+	 * free and unassociated.
 	 */
-	bufferCache_.clear();
-	for (unsigned int i = 0; i < bufferPool_.count(); ++i)
-		bufferCache_.emplace_back(std::array<int, 3>{ -1, -1, -1 }, i);
+	slotMap_.clear();
+	bufferSlots_.clear();
+	bufferSlots_.resize(bufferPool_.count());
+	freeHead_ = kNoSlot;
+	freeTail_ = kNoSlot;
+
+	for (unsigned int i = 0; i < bufferPool_.count(); ++i) {
+		bufferSlots_[i].cached = false;
+		bufferSlots_[i].free = false;
+		pushFreeSlot(i);
+	}
+
+	cacheStats_ = {};
+}
+
+/*
+ * Compute the identity of the planes from the device and inode numbers of
+ * their dmabufs, and from their layout. Return false if the dmabufs can't be
+ * identified reliably, in which case they are never found in the cache.
+ *
+ * Before Linux v5.3 dmabufs were anonymous inodes that all shared the same
+ * inode number, which prevents telling them apart. This is detected once per
+ * stream from the filesystem type of the first dmabuf.
+ */
+bool Stream::identify(const std::vector<DmabufPlane> &planes,
+		      DmabufIdentity *identity)
+{
+	identity->dev.fill(0);
+	identity->ino.fill(0);
+	identity->offset.fill(0);
+	identity->length.fill(0);
+	identity->stride.fill(0);
+
+	if (planes.empty())
+		return false;
+
+	if (!identityChecked_) {
+		struct statfs fs;
+		identityReliable_ = fstatfs(planes[0].fd, &fs) == 0 &&
+				    fs.f_type != ANON_INODE_FS_MAGIC;
+		identityChecked_ = true;
+
+		if (!identityReliable_)
+			LOG(Stream, Debug)
+				<< "Dmabufs can't be identified, disabling cache";
+	}
+
+	if (!identityReliable_)
+		return false;
+
+	for (unsigned int i = 0; i < planes.size(); ++i) {
+		struct stat st;
+		if (fstat(planes[i].fd, &st) < 0)
+			return false;
+
+		identity->dev[i] = st.st_dev;
+		identity->ino[i] = st.st_ino;
+		identity->offset[i] = planes[i].offset;
+		identity->length[i] = planes[i].length;
+		identity->stride[i] = planes[i].stride;
+	}
+
+	return true;
+}
+
+std::size_t Stream::DmabufIdentityHash::operator()(const DmabufIdentity &identity) const
+{
+	std::size_t hash = 0;
+
+	for (unsigned int i = 0; i < identity.ino.size(); ++i) {
+		hash ^= std::hash<uint64_t>()(identity.ino[i]) + 0x9e3779b9 +
+			(hash << 6) + (hash >> 2);
+		hash ^= std::hash<uint64_t>()(identity.dev[i]) + 0x9e3779b9 +
+			(hash << 6) + (hash >> 2);
+		hash ^= std::hash<unsigned int>()(identity.offset[i]) + 0x9e3779b9 +
+			(hash << 6) + (hash >> 2);
+	}
+
+	return hash;
+}
+
+/*
+ * The free buffer slots are linked in a list, in the order they have been
+ * released, through the slots' prevFree and nextFree indices. This allows
+ * taking the least recently released slot and removing a specific slot in
+ * constant time, without allocating memory when buffers are mapped and
+ * unmapped.
+ */
+void Stream::pushFreeSlot(unsigned int index)
+{
+	BufferSlot &slot = bufferSlots_[index];
+
+	slot.free = true;
+	slot.prevFree = freeTail_;
+	slot.nextFree = kNoSlot;
+
+	if (freeTail_ != kNoSlot)
+		bufferSlots_[freeTail_].nextFree = index;
+	else
+		freeHead_ = index;
+	freeTail_ = index;
+}
+
+void Stream::removeFreeSlot(unsigned int index)
+{
+	BufferSlot &slot = bufferSlots_[index];
+
+	if (slot.prevFree != kNoSlot)
+		bufferSlots_[slot.prevFree].nextFree = slot.nextFree;
+	else
+		freeHead_ = slot.nextFree;
+
+	if (slot.nextFree != kNoSlot)
+		bufferSlots_[slot.nextFree].prevFree = slot.prevFree;
+	else
+		freeTail_ = slot.prevFree;
+
+	slot.free = false;
+}
+
+/**
+ * \brief Apply the configured mapping policy to the stream buffer memory
+ *
+ * This method sets the mapping policy of the planes of all internally
+ * allocated buffers to the policy selected in the stream configuration. It
+ * shall be called once the buffer memory has been allocated. Planes of
+ * external buffers get the policy applied when they are mapped by
+ * mapBuffer().
+ */
+void Stream::applyMappingPolicy()
+{
+	if (memoryType_ != InternalMemory)
+		return;
+
+	for (BufferMemory &mem : bufferPool_.buffers()) {
+		for (Plane &plane : mem.planes())
+			plane.setMappingPolicy(configuration_.mappingPolicy);
+	}
 }
 
 /**
@@ -7,14 +7,23 @@
 
 #include "thread.h"
 
+#include <algorithm>
 #include <atomic>
-#include <list>
+#include <errno.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 #include <libcamera/event_dispatcher.h>
 
+#include "event_dispatcher_epoll.h"
 #include "event_dispatcher_poll.h"
 #include "log.h"
 #include "message.h"
+#include "message_allocator.h"
+#include "utils.h"
 
 /**
  * \file thread.h
@@ -29,31 +38,319 @@ class ThreadMain;
 
 /**
  * \brief A queue of posted messages
+ *
+ * The message queue is split in two parts. Messages are posted to a lock-free
+ * intrusive stack, linked through the Message::next_ field, by atomically
+ * swapping the stack head. This allows any number of producer threads to post
+ * messages without locking or allocating memory.
+ *
+ * The consumer, which is the thread owning the queue, takes the whole stack
+ * at once when it runs out of messages to dispatch, reverses it to restore the
+ * posting order, and appends it to the batch of messages being dispatched. It
+ * then iterates over the batch without any lock. Dispatched messages stay in
+ * the batch until the consumer runs out of messages, at which point they are
+ * deleted, except for the messages still being delivered by outer dispatch
+ * loops when dispatching is nested.
+ *
+ * Messages are removed by atomically clearing their Message::queued_ flag,
+ * which the consumer also clears before delivering a message. Exactly one of
+ * the removal and the delivery thus succeeds for any message. The \ref mutex_
+ * serializes the traversal of the queue for removal with the modification of
+ * the batch by the consumer, which only occurs once per batch. Removal from
+ * the consumer thread unlinks and deletes the messages immediately with
+ * extract(), while removal from other threads releases the resources held by
+ * the messages and leaves their deletion to the consumer.
  */
 class MessageQueue
 {
 public:
+	MessageQueue()
+		: head_(nullptr), batch_(nullptr), tail_(nullptr),
+		  cursor_(nullptr)
+	{
+	}
+
+	~MessageQueue()
+	{
+		deleteList(batch_);
+		deleteList(head_.load(std::memory_order_acquire));
+	}
+
 	/**
-	 * \brief List of queued Message instances
+	 * \brief Post a message to the queue
+	 * \param[in] msg The message
+	 *
+	 * This function may be called from any thread.
+	 *
+	 * \return True if the queue was empty, false otherwise
 	 */
-	std::list<std::unique_ptr<Message>> list_;
+	bool post(Message *msg)
+	{
+		Message *head = head_.load(std::memory_order_relaxed);
+
+		do {
+			msg->next_ = head;
+		} while (!head_.compare_exchange_weak(head, msg,
+						      std::memory_order_release,
+						      std::memory_order_relaxed));
+
+		return !head;
+	}
+
 	/**
-	 * \brief Protects the \ref list_
+	 * \brief Retrieve the next message to dispatch
+	 *
+	 * This function shall only be called from the thread owning the queue.
+	 *
+	 * \return The next message, or nullptr if the queue is empty
+	 */
+	Message *next()
+	{
+		if (!cursor_) {
+			refill();
+			if (!cursor_)
+				return nullptr;
+		}
+
+		Message *msg = cursor_;
+		cursor_ = msg->next_;
+		return msg;
+	}
+
+	/**
+	 * \brief Remove all messages for the \a receiver
+	 * \param[in] receiver The receiver
+	 *
+	 * This function may be called from any thread. The removed messages
+	 * are deleted by the consumer, but the senders of blocking invocations
+	 * are released and the invocation arguments freed immediately.
+	 *
+	 * \return The number of removed messages
+	 */
+	unsigned int remove(Object *receiver)
+	{
+		MutexLocker locker(mutex_);
+		unsigned int count = 0;
+
+		Message *lists[] = { batch_, head_.load(std::memory_order_acquire) };
+		for (Message *msg : lists) {
+			for (; msg; msg = msg->next_) {
+				if (msg->receiver_ != receiver ||
+				    !msg->queued_.exchange(false, std::memory_order_acq_rel))
+					continue;
+
+				if (msg->type() == Message::InvokeMessage)
+					static_cast<InvokeMessage *>(msg)->release();
+
+				count++;
+			}
+		}
+
+		return count;
+	}
+
+	/**
+	 * \brief Extract all messages for the \a receiver from the queue
+	 * \param[in] receiver The receiver
+	 *
+	 * This function shall only be called from the thread owning the queue.
+	 *
+	 * \return The list of extracted messages, linked through Message::next_
+	 */
+	Message *extract(Object *receiver)
+	{
+		MutexLocker locker(mutex_);
+		Message *first = nullptr;
+		Message *last = nullptr;
+
+		append(head_.exchange(nullptr, std::memory_order_acquire));
+
+		Message *prev = nullptr;
+		Message *msg = batch_;
+		while (msg) {
+			Message *next = msg->next_;
+
+			if (msg->receiver_ != receiver ||
+			    !msg->queued_.load(std::memory_order_relaxed)) {
+				prev = msg;
+				msg = next;
+				continue;
+			}
+
+			/* Unlink the message from the batch. */
+			if (prev)
+				prev->next_ = next;
+			else
+				batch_ = next;
+			if (tail_ == msg)
+				tail_ = prev;
+			if (cursor_ == msg)
+				cursor_ = next;
+
+			msg->next_ = nullptr;
+			if (last)
+				last->next_ = msg;
+			else
+				first = msg;
+			last = msg;
+
+			msg = next;
+		}
+
+		return first;
+	}
+
+	static void deleteList(Message *msg)
+	{
+		while (msg) {
+			Message *next = msg->next_;
+			delete msg;
+			msg = next;
+		}
+	}
+
+private:
+	void refill()
+	{
+		Message *stale = nullptr;
+
+		{
+			MutexLocker locker(mutex_);
+
+			/*
+			 * All messages in the batch have been dispatched.
+			 * Delete them, except for the ones outer dispatch
+			 * loops are still delivering.
+			 */
+			Message *msg = batch_;
+			batch_ = nullptr;
+			tail_ = nullptr;
+
+			while (msg) {
+				Message *next = msg->next_;
+
+				if (msg->delivering_) {
+					msg->next_ = nullptr;
+					if (tail_)
+						tail_->next_ = msg;
+					else
+						batch_ = msg;
+					tail_ = msg;
+				} else {
+					msg->next_ = stale;
+					stale = msg;
+				}
+
+				msg = next;
+			}
+
+			append(head_.exchange(nullptr, std::memory_order_acquire));
+		}
+
+		deleteList(stale);
+	}
+
+	void append(Message *stack)
+	{
+		if (!stack)
+			return;
+
+		/* Reverse the stack to restore the posting order. */
+		Message *first = nullptr;
+		Message *last = stack;
+
+		while (stack) {
+			Message *next = stack->next_;
+			stack->next_ = first;
+			first = stack;
+			stack = next;
+		}
+
+		if (tail_)
+			tail_->next_ = first;
+		else
+			batch_ = first;
+		tail_ = last;
+
+		if (!cursor_)
+			cursor_ = first;
+	}
+
+	std::atomic<Message *> head_;
+
+	Message *batch_;
+	Message *tail_;
+	Message *cursor_;
+
+	/**
+	 * \brief Protects the batch against concurrent removal
 	 */
 	Mutex mutex_;
 };
 
+/**
+ * \brief Latency histogram of an event source
+ *
+ * Latency sources are stored in fixed-size open addressing tables, one per
+ * latency type, allocated when latency tracking is enabled. Only the thread
+ * that owns the tables claims entries, other threads only read and release
+ * them, which is lock-free.
+ */
+struct LatencySource {
+	LatencySource()
+		: object(nullptr)
+	{
+	}
+
+	/**
+	 * \brief The event source, null if the entry has never been used,
+	 * or Released if the source has been released
+	 */
+	std::atomic<Object *> object;
+	LatencyHistogram histogram;
+
+	static Object *const Released;
+};
+
+Object *const LatencySource::Released = reinterpret_cast<Object *>(1);
+
 /**
  * \brief Thread-local internal data
  */
 class ThreadData
 {
 public:
+	/*
+	 * The maximum number of event sources tracked individually for each
+	 * latency type.
+	 */
+	static constexpr unsigned int MaxLatencySources = 32;
+
 	ThreadData()
-		: thread_(nullptr), running_(false), dispatcher_(nullptr)
+		: thread_(nullptr), running_(false), tid_(0), dispatcher_(nullptr),
+		  allocator_(nullptr), latencySources_(nullptr)
 	{
+		const char *tracking = utils::secure_getenv("LIBCAMERA_LATENCY_TRACKING");
+		latencyTracking_.store(tracking && !strcmp(tracking, "1"),
+				       std::memory_order_relaxed);
+		if (latencyTracking_.load(std::memory_order_relaxed))
+			allocateLatencySources();
 	}
 
+	~ThreadData()
+	{
+		if (allocator_)
+			allocator_->unref();
+
+		delete[] latencySources_.load(std::memory_order_relaxed);
+	}
+
+	void setAllocator(MessageAllocator *allocator);
+
+	void allocateLatencySources();
+	LatencySource *latencySources(Thread::LatencyType type) const;
+	LatencySource *claimLatencySource(Thread::LatencyType type, Object *object);
+
 	static ThreadData *current();
 
 private:
@@ -62,15 +359,23 @@ private:
 
 	Thread *thread_;
 	bool running_;
+	pid_t tid_;
 
 	Mutex mutex_;
 
+	std::unique_ptr<ThreadScheduling> scheduling_;
+
 	std::atomic<EventDispatcher *> dispatcher_;
 
 	std::atomic<bool> exit_;
 	int exitCode_;
 
 	MessageQueue messages_;
+	MessageAllocator *allocator_;
+
+	std::atomic<bool> latencyTracking_;
+	LatencyHistogram latency_[Thread::MessageLatency + 1];
+	std::atomic<LatencySource *> latencySources_;
 };
 
 /**
@@ -82,6 +387,8 @@ public:
 	ThreadMain()
 	{
 		data_->running_ = true;
+		data_->tid_ = syscall(SYS_gettid);
+		data_->setAllocator(MessageAllocator::current());
 	}
 
 protected:
@@ -112,6 +419,143 @@ ThreadData *ThreadData::current()
 	return data;
 }
 
+/**
+ * \brief Set the message allocator of the thread
+ * \param[in] allocator The message allocator
+ *
+ * The thread data holds a reference to the message allocator of the system
+ * thread it runs on, to keep the allocator statistics available after the
+ * system thread exits.
+ */
+void ThreadData::setAllocator(MessageAllocator *allocator)
+{
+	if (allocator)
+		allocator->ref();
+
+	MutexLocker locker(mutex_);
+	std::swap(allocator, allocator_);
+	locker.unlock();
+
+	if (allocator)
+		allocator->unref();
+}
+
+/**
+ * \brief Allocate the per-source latency histograms
+ *
+ * The histograms are allocated the first time latency tracking is enabled, and
+ * kept until the thread data is destroyed.
+ */
+void ThreadData::allocateLatencySources()
+{
+	if (latencySources_.load(std::memory_order_acquire))
+		return;
+
+	LatencySource *sources =
+		new LatencySource[(Thread::MessageLatency + 1) * MaxLatencySources];
+	LatencySource *expected = nullptr;
+	if (!latencySources_.compare_exchange_strong(expected, sources,
+						     std::memory_order_acq_rel))
+		delete[] sources;
+}
+
+/**
+ * \brief Retrieve the table of per-source latency histograms for \a type
+ * \param[in] type The latency type
+ * \return The table of MaxLatencySources entries, or nullptr if latency
+ * tracking has never been enabled
+ */
+LatencySource *ThreadData::latencySources(Thread::LatencyType type) const
+{
+	LatencySource *sources = latencySources_.load(std::memory_order_acquire);
+	if (!sources)
+		return nullptr;
+
+	return sources + type * MaxLatencySources;
+}
+
+/**
+ * \brief Find or create the latency histogram of an event source
+ * \param[in] type The latency type
+ * \param[in] object The event source
+ *
+ * This method shall only be called from the thread itself.
+ *
+ * \return The latency source entry for \a object, or nullptr if the table is
+ * full
+ */
+LatencySource *ThreadData::claimLatencySource(Thread::LatencyType type,
+					      Object *object)
+{
+	LatencySource *sources = latencySources(type);
+	if (!sources)
+		return nullptr;
+
+	unsigned int hash = (reinterpret_cast<uintptr_t>(object) >> 4) %
+			    MaxLatencySources;
+	LatencySource *entry = nullptr;
+
+	for (unsigned int i = 0; i < MaxLatencySources; ++i) {
+		LatencySource *source = &sources[(hash + i) % MaxLatencySources];
+		Object *key = source->object.load(std::memory_order_relaxed);
+
+		if (key == object)
+			return source;
+
+		if (key == LatencySource::Released) {
+			if (!entry)
+				entry = source;
+			continue;
+		}
+
+		if (!key) {
+			if (!entry)
+				entry = source;
+			break;
+		}
+	}
+
+	if (!entry)
+		return nullptr;
+
+	entry->histogram.reset();
+	entry->object.store(object, std::memory_order_release);
+
+	return entry;
+}
+
+/**
+ * \brief Create the default event dispatcher
+ *
+ * The dispatcher type is selected by the LIBCAMERA_EVENT_DISPATCHER
+ * environment variable, set to either "epoll" or "poll". The epoll-based
+ * dispatcher is used by default, with a fallback to the poll-based dispatcher
+ * if it fails to initialize.
+ *
+ * \return A new instance of the default event dispatcher
+ */
+static EventDispatcher *createEventDispatcher()
+{
+	const char *type = utils::secure_getenv("LIBCAMERA_EVENT_DISPATCHER");
+	if (type && !strcmp(type, "poll"))
+		return new EventDispatcherPoll();
+
+	if (type && strcmp(type, "epoll"))
+		LOG(Thread, Warning)
+			<< "Unknown event dispatcher type '" << type
+			<< "', using default";
+
+	EventDispatcherEpoll *dispatcher = new EventDispatcherEpoll();
+	if (dispatcher->isValid())
+		return dispatcher;
+
+	LOG(Thread, Warning)
+		<< "Falling back to poll-based event dispatcher";
+	delete dispatcher;
+
+	return new EventDispatcherPoll();
+}
+
 /**
  * \typedef Mutex
  * \brief An alias for std::mutex
@@ -131,8 +575,56 @@ ThreadData *ThreadData::current()
  *
  * Thread instances by default run an event loop until the exit() method is
  * called. A custom event dispatcher may be installed with
- * setEventDispatcher(), otherwise a poll-based event dispatcher is used. This
+ * setEventDispatcher(), otherwise a default event dispatcher is used. This
  * behaviour can be overriden by overloading the run() method.
+ *
+ * The default event dispatcher is based on epoll, and falls back to poll if
+ * the epoll instance can't be created. The poll-based dispatcher can also be
+ * selected explicitly by setting the LIBCAMERA_EVENT_DISPATCHER environment
+ * variable to "poll".
+ *
+ * \section thread-latency Latency Tracking
+ *
+ * To help locating stalls in event processing, the thread can measure the
+ * delays incurred by the events it dispatches, and accumulate them in
+ * histograms. Three latencies are measured:
+ *
+ * - The time between the event dispatcher waking up with a file descriptor
+ *   reported as ready and the emission of the corresponding
+ *   EventNotifier::activated signal (NotifierLatency)
+ * - The time between the deadline of a Timer and the emission of its
+ *   Timer::timeout signal (TimerLatency)
+ * - The time a message spends in the thread's message queue, from the moment
+ *   it is posted to its delivery to the receiver (MessageLatency)
+ *
+ * Each latency is accumulated both in a histogram for the whole thread, and in
+ * a histogram for the source of the event, that is the EventNotifier, the
+ * Timer or the message receiver. The per-source histograms make it possible to
+ * identify which object suffers from, or causes, delays. They are created on
+ * the first sample recorded for a source, and released when the source is
+ * destroyed or moved to a different thread. Up to 32 sources are tracked
+ * individually for each latency type, samples of additional sources are only
+ * accounted for in the thread histograms. Recording a sample doesn't allocate
+ * memory and doesn't take any lock.
+ *
+ * Latency tracking is disabled by default, as it requires reading the clock
+ * for every event. It can be enabled for a thread with setLatencyTracking(),
+ * or for all threads by setting the LIBCAMERA_LATENCY_TRACKING environment
+ * variable to "1". The histograms are retrieved with latencyHistogram(), the
+ * sources with recorded samples listed with latencySources(), and all
+ * histograms reset with resetLatencyHistograms(), from any thread.
+ */
+
+/**
+ * \enum Thread::LatencyType
+ * \brief The type of latency measured by the thread
+ * \var Thread::NotifierLatency
+ * \brief Delay between a file descriptor becoming ready and the notifier
+ * activation
+ * \var Thread::TimerLatency
+ * \brief Lateness of timer expiration
+ * \var Thread::MessageLatency
+ * \brief Residency time of messages in the message queue
  */
 
 /**
@@ -146,6 +638,12 @@ Thread::Thread()
 
 Thread::~Thread()
 {
+	/*
+	 * Event sources may outlive the thread, make sure they won't try to
+	 * remove their latency histograms.
+	 */
+	resetLatencyHistograms();
+
 	delete data_->dispatcher_.load(std::memory_order_relaxed);
 	delete data_;
 }
@@ -190,6 +688,26 @@ void Thread::startThread()
 	thread_local ThreadCleaner cleaner(this, &Thread::finishThread);
 
 	currentThreadData = data_;
+	data_->setAllocator(MessageAllocator::current());
+
+	/*
+	 * Apply the scheduling parameters with the lock held, to avoid racing
+	 * with a concurrent call to setScheduling().
+	 */
+	{
+		MutexLocker locker(data_->mutex_);
+
+		data_->tid_ = syscall(SYS_gettid);
+
+		if (data_->scheduling_) {
+			int ret = applyScheduling(data_->tid_, *data_->scheduling_);
+			if (ret < 0)
+				LOG(Thread, Warning)
+					<< "Failed to apply scheduling parameters "
+					<< data_->scheduling_->toString() << ": "
+					<< strerror(-ret);
+		}
+	}
 
 	run();
 }
@@ -239,6 +757,7 @@ void Thread::finishThread()
 {
 	data_->mutex_.lock();
 	data_->running_ = false;
+	data_->tid_ = 0;
 	data_->mutex_.unlock();
 
 	finished.emit(this);
@@ -293,6 +812,39 @@ bool Thread::isRunning()
 	return data_->running_;
 }
 
+/**
+ * \brief Set the scheduling parameters of the thread
+ * \param[in] scheduling The scheduling parameters
+ *
+ * If the thread is running, the scheduling parameters are applied immediately.
+ * Otherwise they are stored and applied when the thread starts. In both cases
+ * they are retained and applied again every time the thread is restarted.
+ *
+ * Failures to apply the parameters when the thread starts, typically due to
+ * insufficient privileges for real-time policies, are logged but don't prevent
+ * the thread from running.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -EINVAL The scheduling parameters are invalid
+ * \retval -EPERM The caller doesn't have the privileges required to apply the
+ * scheduling parameters to the running thread
+ */
+int Thread::setScheduling(const ThreadScheduling &scheduling)
+{
+	int ret = scheduling.validate();
+	if (ret < 0)
+		return ret;
+
+	MutexLocker locker(data_->mutex_);
+
+	data_->scheduling_ = utils::make_unique<ThreadScheduling>(scheduling);
+
+	if (!data_->tid_)
+		return 0;
+
+	return applyScheduling(data_->tid_, scheduling);
+}
+
 /**
  * \var Thread::finished
  * \brief Signal the end of thread execution
@@ -316,7 +868,7 @@ Thread *Thread::current()
  * event notification and timers with the loop. Users that want to provide
  * their own event dispatcher shall call this method once and only once before
  * the thread is started with start(). If no event dispatcher is provided, a
- * default poll-based implementation will be used.
+ * default implementation will be used.
  *
  * The Thread takes ownership of the event dispatcher and will delete it when
  * the thread is destroyed.
@@ -336,8 +888,8 @@ void Thread::setEventDispatcher(std::unique_ptr<EventDispatcher> dispatcher)
  * \brief Retrieve the event dispatcher
  *
  * This method retrieves the event dispatcher set with setEventDispatcher().
- * If no dispatcher has been set, a default poll-based implementation is created
- * and returned, and no custom event dispatcher may be installed anymore.
+ * If no dispatcher has been set, a default implementation is created and
+ * returned, and no custom event dispatcher may be installed anymore.
  *
  * The returned event dispatcher is valid until the thread is destroyed.
  *
@@ -346,12 +898,225 @@ void Thread::setEventDispatcher(std::unique_ptr<EventDispatcher> dispatcher)
 EventDispatcher *Thread::eventDispatcher()
 {
 	if (!data_->dispatcher_.load(std::memory_order_relaxed))
-		data_->dispatcher_.store(new EventDispatcherPoll(),
+		data_->dispatcher_.store(createEventDispatcher(),
 					 std::memory_order_release);
 
 	return data_->dispatcher_.load(std::memory_order_relaxed);
 }
 
+/**
+ * \brief Retrieve the statistics of the thread's message allocator
+ *
+ * Messages and method invocation data posted from a thread are allocated from
+ * the thread's MessageAllocator. This method retrieves the allocation
+ * statistics of the allocator, to monitor how often allocations are served
+ * from recycled memory. The statistics are preserved after the thread exits,
+ * and reset when the thread is restarted.
+ *
+ * \return The message allocator statistics
+ */
+MessageAllocator::Stats Thread::messageAllocatorStats()
+{
+	MutexLocker locker(data_->mutex_);
+
+	if (!data_->allocator_)
+		return {};
+
+	return data_->allocator_->stats();
+}
+
+/**
+ * \brief Reset the statistics of the thread's message allocator
+ */
+void Thread::resetMessageAllocatorStats()
+{
+	MutexLocker locker(data_->mutex_);
+
+	if (data_->allocator_)
+		data_->allocator_->resetStats();
+}
+
+/**
+ * \brief Enable or disable latency tracking for the thread
+ * \param[in] enable True to enable latency tracking, false to disable it
+ *
+ * Enabling latency tracking doesn't reset the latency histograms. Messages
+ * posted before latency tracking is enabled are not accounted for.
+ */
+void Thread::setLatencyTracking(bool enable)
+{
+	if (enable)
+		data_->allocateLatencySources();
+
+	data_->latencyTracking_.store(enable, std::memory_order_relaxed);
+}
+
+/**
+ * \brief Check if latency tracking is enabled for the thread
+ * \return True if latency tracking is enabled, false otherwise
+ */
+bool Thread::latencyTracking() const
+{
+	return data_->latencyTracking_.load(std::memory_order_relaxed);
+}
+
+/**
+ * \brief Record a latency sample for the thread
+ * \param[in] type The latency type
+ * \param[in] latency The latency
+ * \param[in] source The object that incurred the latency (optional)
+ *
+ * The sample is accumulated in the histogram of the thread, and, if \a source
+ * is not null, in the histogram of the \a source. This method is called by the
+ * event dispatchers to record the notifier and timer latencies, and shall only
+ * be called from the thread itself when latency tracking is enabled. It
+ * doesn't allocate memory and doesn't take any lock.
+ */
+void Thread::recordLatency(LatencyType type, utils::duration latency,
+			   Object *source)
+{
+	data_->latency_[type].record(latency);
+
+	if (!source)
+		return;
+
+	LatencySource *entry = data_->claimLatencySource(type, source);
+	if (!entry)
+		return;
+
+	entry->histogram.record(latency);
+	source->latencyRecorded_.store(true, std::memory_order_relaxed);
+}
+
+/**
+ * \brief Retrieve a latency histogram of the thread
+ * \param[in] type The latency type
+ *
+ * This method may be called from any thread. The histogram is a snapshot of
+ * the latencies recorded up to the time of the call.
+ *
+ * \return The histogram of the latencies of type \a type
+ */
+LatencyHistogram Thread::latencyHistogram(LatencyType type) const
+{
+	return data_->latency_[type];
+}
+
+/**
+ * \brief Retrieve the latency histogram of an event source
+ * \param[in] type The latency type
+ * \param[in] source The event source
+ *
+ * This method may be called from any thread. The histogram is a snapshot of
+ * the latencies recorded for \a source up to the time of the call. An empty
+ * histogram is returned if no latency of type \a type has been recorded for
+ * \a source by this thread.
+ *
+ * \return The histogram of the latencies of type \a type for \a source
+ */
+LatencyHistogram Thread::latencyHistogram(LatencyType type,
+					  const Object *source) const
+{
+	LatencyHistogram histogram;
+
+	LatencySource *sources = data_->latencySources(type);
+	if (!sources)
+		return histogram;
+
+	/*
+	 * A source may transiently be stored in multiple entries if the
+	 * histograms are reset concurrently, aggregate all of them.
+	 */
+	for (unsigned int i = 0; i < ThreadData::MaxLatencySources; ++i) {
+		if (sources[i].object.load(std::memory_order_acquire) == source)
+			histogram.merge(sources[i].histogram);
+	}
+
+	return histogram;
+}
+
+/**
+ * \brief Retrieve the event sources with recorded latencies
+ * \param[in] type The latency type
+ *
+ * This method may be called from any thread.
+ *
+ * \return The objects for which latencies of type \a type have been recorded
+ * by this thread
+ */
+std::vector<const Object *> Thread::latencySources(LatencyType type) const
+{
+	std::vector<const Object *> objects;
+
+	LatencySource *sources = data_->latencySources(type);
+	if (!sources)
+		return objects;
+
+	for (unsigned int i = 0; i < ThreadData::MaxLatencySources; ++i) {
+		Object *object = sources[i].object.load(std::memory_order_acquire);
+		if (!object || object == LatencySource::Released)
+			continue;
+
+		if (std::find(objects.begin(), objects.end(), object) == objects.end())
+			objects.push_back(object);
+	}
+
+	return objects;
+}
+
+/**
+ * \brief Reset all the latency histograms of the thread
+ *
+ * The histograms of all event sources are released. This method may be called
+ * from any thread.
+ */
+void Thread::resetLatencyHistograms()
+{
+	for (LatencyHistogram &histogram : data_->latency_)
+		histogram.reset();
+
+	for (unsigned int type = 0; type <= MessageLatency; ++type) {
+		LatencySource *sources =
+			data_->latencySources(static_cast<LatencyType>(type));
+		if (!sources)
+			break;
+
+		for (unsigned int i = 0; i < ThreadData::MaxLatencySources; ++i) {
+			Object *object = sources[i].object.exchange(nullptr,
+								    std::memory_order_acq_rel);
+			if (object && object != LatencySource::Released)
+				object->latencyRecorded_.store(false, std::memory_order_relaxed);
+		}
+	}
+}
+
+/**
+ * \brief Release the latency histograms of an event source
+ * \param[in] source The event source
+ *
+ * This method is called when \a source is destroyed or moved to a different
+ * thread, to ensure the histograms of the object won't be attributed to a new
+ * object allocated at the same address.
+ */
+void Thread::removeLatencyHistograms(Object *source)
+{
+	source->latencyRecorded_.store(false, std::memory_order_relaxed);
+
+	for (unsigned int type = 0; type <= MessageLatency; ++type) {
+		LatencySource *sources =
+			data_->latencySources(static_cast<LatencyType>(type));
+		if (!sources)
+			break;
+
+		for (unsigned int i = 0; i < ThreadData::MaxLatencySources; ++i) {
+			Object *object = source;
+			sources[i].object.compare_exchange_strong(object,
+								  LatencySource::Released,
+								  std::memory_order_acq_rel);
+		}
+	}
+}
+
 /**
  * \brief Post a message to the thread for the \a receiver
  * \param[in] msg The message
@@ -372,13 +1137,22 @@ EventDispatcher *Thread::eventDispatcher()
 void Thread::postMessage(std::unique_ptr<Message> msg, Object *receiver)
 {
 	msg->receiver_ = receiver;
+	msg->queued_.store(true, std::memory_order_relaxed);
+
+	if (data_->latencyTracking_.load(std::memory_order_relaxed))
+		msg->timestamp_ = utils::clock::now();
 
 	ASSERT(data_ == receiver->thread()->data_);
 
-	MutexLocker locker(data_->messages_.mutex_);
-	data_->messages_.list_.push_back(std::move(msg));
 	receiver->pendingMessages_++;
-	locker.unlock();
+
+	/*
+	 * Only interrupt the event dispatcher when the queue transitions from
+	 * empty to non-empty, as all messages posted in the meantime will be
+	 * dispatched in one go.
+	 */
+	if (!data_->messages_.post(msg.release()))
+		return;
 
 	EventDispatcher *dispatcher =
 		data_->dispatcher_.load(std::memory_order_acquire);
@@ -396,54 +1170,54 @@ void Thread::removeMessages(Object *receiver)
 {
 	ASSERT(data_ == receiver->thread()->data_);
 
-	MutexLocker locker(data_->messages_.mutex_);
 	if (!receiver->pendingMessages_)
 		return;
 
-	std::vector<std::unique_ptr<Message>> toDelete;
-	for (std::unique_ptr<Message> &msg : data_->messages_.list_) {
-		if (!msg)
-			continue;
-		if (msg->receiver_ != receiver)
-			continue;
+	if (Thread::current() != this) {
+		receiver->pendingMessages_ -= data_->messages_.remove(receiver);
+		return;
+	}
 
-		/*
-		 * Move the message to the pending deletion list to delete it
-		 * after releasing the lock. The messages list element will
-		 * contain a null pointer, and will be removed when dispatching
-		 * messages.
-		 */
-		toDelete.push_back(std::move(msg));
+	Message *msg = data_->messages_.extract(receiver);
+	while (msg) {
+		Message *next = msg->next_;
 		receiver->pendingMessages_--;
+		delete msg;
+		msg = next;
 	}
-
-	ASSERT(!receiver->pendingMessages_);
-	locker.unlock();
-
-	toDelete.clear();
 }
 
 /**
  * \brief Dispatch all posted messages for this thread
+ *
+ * This method shall only be called from the thread itself.
  */
 void Thread::dispatchMessages()
 {
-	MutexLocker locker(data_->messages_.mutex_);
+	MessageQueue &messages = data_->messages_;
 
-	while (!data_->messages_.list_.empty()) {
-		std::unique_ptr<Message> msg = std::move(data_->messages_.list_.front());
-		data_->messages_.list_.pop_front();
-		if (!msg)
+	while (Message *msg = messages.next()) {
+		/* Skip messages that have been removed. */
+		if (!msg->queued_.exchange(false, std::memory_order_acq_rel))
 			continue;
 
 		Object *receiver = msg->receiver_;
 		ASSERT(data_ == receiver->thread()->data_);
 
-		locker.unlock();
-		receiver->message(msg.get());
-		locker.lock();
-
+		/*
+		 * Account for the message before delivering it, as the
+		 * receiver may be deleted by its message handler.
+		 */
 		receiver->pendingMessages_--;
+
+		if (msg->timestamp_ != utils::time_point())
+			recordLatency(MessageLatency,
+				      utils::clock::now() - msg->timestamp_,
+				      receiver);
+
+		msg->delivering_ = true;
+		receiver->message(msg);
+		msg->delivering_ = false;
 	}
 }
 
@@ -466,21 +1240,24 @@ void Thread::moveObject(Object *object)
 void Thread::moveObject(Object *object, ThreadData *currentData,
 			ThreadData *targetData)
 {
-	/* Move pending messages to the message queue of the new thread. */
-	if (object->pendingMessages_) {
-		unsigned int movedMessages = 0;
+	object->thread_ = this;
 
-		for (std::unique_ptr<Message> &msg : currentData->messages_.list_) {
-			if (!msg)
-				continue;
-			if (msg->receiver_ != object)
-				continue;
+	/*
+	 * Move pending messages to the message queue of the new thread. This
+	 * must be done after updating the object's thread, as the messages
+	 * may be dispatched as soon as they are posted to the new thread.
+	 */
+	if (object->pendingMessages_) {
+		Message *msg = currentData->messages_.extract(object);
+		bool interrupt = false;
 
-			targetData->messages_.list_.push_back(std::move(msg));
-			movedMessages++;
+		while (msg) {
+			Message *next = msg->next_;
+			interrupt |= targetData->messages_.post(msg);
+			msg = next;
 		}
 
-		if (movedMessages) {
+		if (interrupt) {
 			EventDispatcher *dispatcher =
 				targetData->dispatcher_.load(std::memory_order_acquire);
 			if (dispatcher)
@@ -488,11 +1265,62 @@ void Thread::moveObject(Object *object, ThreadData *currentData,
 		}
 	}
 
-	object->thread_ = this;
+	/*
+	 * Latency histograms are recorded by the thread without locking, they
+	 * can't be moved to the new thread. Release them.
+	 */
+	if (object->latencyRecorded_.load(std::memory_order_relaxed))
+		currentData->thread_->removeLatencyHistograms(object);
 
 	/* Move all children. */
 	for (auto child : object->children_)
 		moveObject(child, currentData, targetData);
 }
 
+/**
+ * \brief Apply scheduling parameters to a thread or process
+ * \param[in] tid The system thread ID, or the process ID
+ * \param[in] scheduling The scheduling parameters
+ *
+ * The scheduling policy, nice value and CPU affinity are applied in that order.
+ * The function stops at the first failure. When \a tid is a process ID, the
+ * parameters only apply to the main thread of the process, and are inherited
+ * by the threads it creates afterwards.
+ *
+ * This function only issues system calls and doesn't allocate memory, it can
+ * thus be called in a child process between fork() and exec().
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int applyScheduling(pid_t tid, const ThreadScheduling &scheduling)
+{
+	static const int policies[] = {
+		SCHED_OTHER,		/* ThreadScheduling::PolicyOther */
+		SCHED_FIFO,		/* ThreadScheduling::PolicyFifo */
+		SCHED_RR,		/* ThreadScheduling::PolicyRoundRobin */
+	};
+
+	struct sched_param param = {};
+	param.sched_priority = scheduling.priority;
+
+	if (sched_setscheduler(tid, policies[scheduling.policy], &param) < 0)
+		return -errno;
+
+	if (setpriority(PRIO_PROCESS, tid, scheduling.nice) < 0)
+		return -errno;
+
+	if (scheduling.cpus.empty())
+		return 0;
+
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	for (unsigned int cpu : scheduling.cpus)
+		CPU_SET(cpu, &cpus);
+
+	if (sched_setaffinity(tid, sizeof(cpus), &cpus) < 0)
+		return -errno;
+
+	return 0;
+}
+
 }; /* namespace libcamera */
@@ -0,0 +1,409 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * thread_pool.cpp - Work-stealing thread pool
+ */
+
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <deque>
+#include <errno.h>
+#include <thread>
+
+#include <libcamera/buffer.h>
+
+#include "thread.h"
+
+/**
+ * \file thread_pool.h
+ * \brief Work-stealing thread pool
+ */
+
+namespace libcamera {
+
+/*
+ * A pool worker thread. Each worker owns a double-ended task queue. Tasks
+ * submitted from a worker are pushed to its own queue, and tasks submitted
+ * from other threads are distributed across the workers' queues in a
+ * round-robin fashion. Workers pop tasks from the back of their own queue,
+ * and steal tasks from the front of the other workers' queues when their
+ * queue is empty.
+ */
+class ThreadPool::Worker : public Thread
+{
+public:
+	Worker(ThreadPool *pool, unsigned int index)
+		: pool_(pool), index_(index)
+	{
+	}
+
+	unsigned int index() const { return index_; }
+
+protected:
+	void run() override
+	{
+		pool_->workerMain(this);
+	}
+
+private:
+	friend class ThreadPool;
+
+	ThreadPool *pool_;
+	unsigned int index_;
+
+	Mutex mutex_;
+	std::deque<Task> queue_;
+};
+
+struct ThreadPool::Batch {
+	Batch(unsigned int n, Kernel k, Task c)
+		: count(n), kernel(k), completion(c), next(0), done(0)
+	{
+	}
+
+	unsigned int count;
+	Kernel kernel;
+	Task completion;
+
+	std::atomic<unsigned int> next;
+	std::atomic<unsigned int> done;
+	Semaphore finished;
+};
+
+static thread_local ThreadPool *currentPool = nullptr;
+static thread_local unsigned int currentWorkerIndex = 0;
+
+/**
+ * \class ThreadPool
+ * \brief A pool of threads to run CPU-bound tasks
+ *
+ * The ThreadPool runs tasks on a fixed set of worker threads, to parallelize
+ * CPU-bound processing such as format conversion or software statistics
+ * computation. Tasks are arbitrary functions submitted with run(), and run
+ * asynchronously in one of the workers.
+ *
+ * Each worker owns a task queue. Workers process the tasks from their own
+ * queue first, and steal tasks from the other workers when their queue runs
+ * empty, balancing the load across workers without a global lock.
+ *
+ * Data-parallel processing is supported by runBatch(), which runs a kernel
+ * function for a range of indices, and by processPlanes(), which runs a kernel
+ * function on slices of the planes of a buffer.
+ *
+ * Completion of a task can be signalled to an Object by passing a member
+ * function of the object to the task submission functions. The function is
+ * invoked in the object's thread through a queued method invocation once the
+ * task completes, allowing results to be consumed without any additional
+ * synchronization.
+ */
+
+/**
+ * \typedef ThreadPool::Task
+ * \brief A task function run by the thread pool
+ */
+
+/**
+ * \typedef ThreadPool::Kernel
+ * \brief A kernel function run by runBatch() for each index in a batch
+ */
+
+/**
+ * \struct ThreadPool::PlaneSlice
+ * \brief A slice of a buffer plane processed by a PlaneKernel
+ *
+ * Planes are processed in \a slices slices. The slice describes the whole
+ * plane memory, and the kernel is responsible for processing the part of the
+ * plane corresponding to slice index \a slice, for instance a range of lines.
+ *
+ * \var ThreadPool::PlaneSlice::plane
+ * \brief The plane index in the buffer
+ * \var ThreadPool::PlaneSlice::mem
+ * \brief The CPU address of the plane memory
+ * \var ThreadPool::PlaneSlice::length
+ * \brief The plane length in bytes
+ * \var ThreadPool::PlaneSlice::slice
+ * \brief The slice index, in the range [0, slices[
+ * \var ThreadPool::PlaneSlice::slices
+ * \brief The number of slices per plane
+ */
+
+/**
+ * \typedef ThreadPool::PlaneKernel
+ * \brief A kernel function run by processPlanes() for each plane slice
+ */
+
+/**
+ * \brief Create a thread pool
+ * \param[in] workers The number of worker threads
+ *
+ * If \a workers is 0, one worker is created for each CPU core.
+ */
+ThreadPool::ThreadPool(unsigned int workers)
+	: nextWorker_(0), stopping_(false)
+{
+	if (!workers)
+		workers = std::max(std::thread::hardware_concurrency(), 1U);
+
+	for (unsigned int i = 0; i < workers; ++i)
+		workers_.emplace_back(new Worker(this, i));
+
+	for (std::unique_ptr<Worker> &worker : workers_)
+		worker->start();
+}
+
+/**
+ * \brief Destroy the thread pool
+ *
+ * All tasks queued to the pool are run before the worker threads are stopped.
+ * No new task shall be submitted once the pool starts being destroyed.
+ */
+ThreadPool::~ThreadPool()
+{
+	stopping_.store(true, std::memory_order_relaxed);
+	pending_.release(workers_.size());
+
+	for (std::unique_ptr<Worker> &worker : workers_)
+		worker->wait();
+}
+
+/**
+ * \fn ThreadPool::workers()
+ * \brief Retrieve the number of worker threads
+ * \return The number of worker threads
+ */
+
+/**
+ * \brief Run a task asynchronously
+ * \param[in] task The task
+ */
+void ThreadPool::run(Task task)
+{
+	push(std::move(task));
+}
+
+/**
+ * \fn ThreadPool::run(Task task, T *obj, void (T::*func)(Args...), Args... args)
+ * \brief Run a task asynchronously and signal completion to an object
+ * \param[in] task The task
+ * \param[in] obj The object to signal completion to
+ * \param[in] func The object member function to invoke on completion
+ * \param[in] args The arguments for \a func
+ *
+ * Once the \a task completes, the member function \a func of \a obj is invoked
+ * in the object's thread with arguments \a args.
+ */
+
+/**
+ * \brief Run a kernel for a range of indices and wait for completion
+ * \param[in] count The number of indices
+ * \param[in] kernel The kernel function
+ *
+ * The \a kernel is called once for each index in the range [0, \a count[,
+ * distributed across the worker threads and the calling thread. This function
+ * returns once all kernel calls have completed. It may be called from a task
+ * running in the thread pool.
+ */
+void ThreadPool::runBatch(unsigned int count, Kernel kernel)
+{
+	if (!count)
+		return;
+
+	std::shared_ptr<Batch> batch =
+		std::make_shared<Batch>(count, std::move(kernel), nullptr);
+
+	/*
+	 * The calling thread processes indices too, and only waits for the
+	 * kernel calls in progress in other threads. Helper tasks that start
+	 * after all indices have been claimed return immediately.
+	 */
+	unsigned int helpers = std::min<unsigned int>(count - 1, workers_.size());
+	for (unsigned int i = 0; i < helpers; ++i)
+		push([batch]() { runBatchKernels(batch); });
+
+	runBatchKernels(batch);
+
+	batch->finished.acquire();
+}
+
+/**
+ * \fn ThreadPool::runBatch(unsigned int count, Kernel kernel, T *obj, void (T::*func)(Args...), Args... args)
+ * \brief Run a kernel for a range of indices and signal completion to an object
+ * \param[in] count The number of indices
+ * \param[in] kernel The kernel function
+ * \param[in] obj The object to signal completion to
+ * \param[in] func The object member function to invoke on completion
+ * \param[in] args The arguments for \a func
+ *
+ * The \a kernel is called asynchronously once for each index in the range
+ * [0, \a count[, distributed across the worker threads. Once all kernel calls
+ * complete, the member function \a func of \a obj is invoked in the object's
+ * thread with arguments \a args.
+ */
+
+void ThreadPool::runBatch(unsigned int count, Kernel kernel, Task completion)
+{
+	if (!count) {
+		completion();
+		return;
+	}
+
+	std::shared_ptr<Batch> batch =
+		std::make_shared<Batch>(count, std::move(kernel),
+					std::move(completion));
+
+	unsigned int helpers = std::min<unsigned int>(count, workers_.size());
+	for (unsigned int i = 0; i < helpers; ++i)
+		push([batch]() { runBatchKernels(batch); });
+}
+
+/**
+ * \fn ThreadPool::processPlanes(BufferMemory *mem, unsigned int slices, PlaneKernel kernel, T *obj, void (T::*func)(Args...), Args... args)
+ * \brief Process the planes of a buffer and signal completion to an object
+ * \param[in] mem The buffer memory
+ * \param[in] slices The number of slices to split each plane in
+ * \param[in] kernel The kernel function
+ * \param[in] obj The object to signal completion to
+ * \param[in] func The object member function to invoke on completion
+ * \param[in] args The arguments for \a func
+ *
+ * The \a kernel is called asynchronously for each slice of each plane of the
+ * buffer \a mem, distributed across the worker threads. The planes are mapped
+ * to CPU memory by this function before processing starts. Once all slices
+ * have been processed, the member function \a func of \a obj is invoked in the
+ * object's thread with arguments \a args.
+ *
+ * \return 0 on success, or a negative error code if the planes can't be mapped
+ * or \a slices is 0, in which case \a func is not invoked
+ */
+
+int ThreadPool::processPlanes(BufferMemory *mem, unsigned int slices,
+			      PlaneKernel kernel, Task completion)
+{
+	if (!slices)
+		return -EINVAL;
+
+	/*
+	 * Map the planes upfront, as Plane::mem() isn't safe to call
+	 * concurrently from multiple workers.
+	 */
+	std::vector<PlaneSlice> planes;
+	for (Plane &plane : mem->planes()) {
+		void *addr = plane.mem();
+		if (!addr)
+			return -ENOMEM;
+
+		planes.push_back({ static_cast<unsigned int>(planes.size()),
+				   addr, plane.length(), 0, slices });
+	}
+
+	unsigned int count = planes.size() * slices;
+	runBatch(count, [planes, kernel, slices](unsigned int index) {
+			PlaneSlice slice = planes[index / slices];
+			slice.slice = index % slices;
+			kernel(slice);
+		}, std::move(completion));
+
+	return 0;
+}
+
+void ThreadPool::push(Task task)
+{
+	unsigned int index;
+
+	if (currentPool == this)
+		index = currentWorkerIndex;
+	else
+		index = nextWorker_.fetch_add(1, std::memory_order_relaxed) %
+			workers_.size();
+
+	Worker *worker = workers_[index].get();
+
+	{
+		MutexLocker locker(worker->mutex_);
+		worker->queue_.push_back(std::move(task));
+	}
+
+	pending_.release();
+}
+
+bool ThreadPool::pop(Worker *worker, Task *task)
+{
+	/* Process the most recent local task first for cache locality. */
+	{
+		MutexLocker locker(worker->mutex_);
+		if (!worker->queue_.empty()) {
+			*task = std::move(worker->queue_.back());
+			worker->queue_.pop_back();
+			return true;
+		}
+	}
+
+	/* Steal the oldest task from the other workers. */
+	for (unsigned int i = 1; i < workers_.size(); ++i) {
+		Worker *victim = workers_[(worker->index() + i) % workers_.size()].get();
+
+		MutexLocker locker(victim->mutex_);
+		if (!victim->queue_.empty()) {
+			*task = std::move(victim->queue_.front());
+			victim->queue_.pop_front();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void ThreadPool::workerMain(Worker *worker)
+{
+	currentPool = this;
+	currentWorkerIndex = worker->index();
+
+	/*
+	 * The pending semaphore counts the queued tasks, with one extra
+	 * resource per worker released at destruction time. The queues are
+	 * scanned one at a time, so a worker can miss a task pushed to a queue
+	 * it has already scanned while other workers empty the queues it
+	 * hasn't scanned yet. The resource it holds then accounts for the
+	 * missed task, and must be released for the task not to be stranded.
+	 * Only when stopping can a worker that finds all queues empty hold a
+	 * stop resource, in which case it exits.
+	 */
+	while (true) {
+		pending_.acquire();
+
+		Task task;
+		if (pop(worker, &task)) {
+			task();
+			continue;
+		}
+
+		if (stopping_.load(std::memory_order_relaxed))
+			break;
+
+		pending_.release();
+		std::this_thread::yield();
+	}
+
+	currentPool = nullptr;
+}
+
+void ThreadPool::runBatchKernels(const std::shared_ptr<Batch> &batch)
+{
+	unsigned int index;
+
+	while ((index = batch->next.fetch_add(1, std::memory_order_relaxed)) < batch->count) {
+		batch->kernel(index);
+
+		if (batch->done.fetch_add(1, std::memory_order_acq_rel) + 1 != batch->count)
+			continue;
+
+		if (batch->completion)
+			batch->completion();
+		else
+			batch->finished.release();
+	}
+}
+
+} /* namespace libcamera */
@@ -15,6 +15,7 @@
 #include "log.h"
 #include "message.h"
 #include "thread.h"
+#include "timer_queue.h"
 #include "utils.h"
 
 /**
@@ -53,7 +54,8 @@ LOG_DEFINE_CATEGORY(Timer)
  * \param[in] parent The parent Object
  */
 Timer::Timer(Object *parent)
-	: Object(parent), running_(false)
+	: Object(parent), running_(false),
+	  d_(utils::make_unique<Private>())
 {
 }
 
@@ -170,7 +172,7 @@ void Timer::message(Message *msg)
 	if (msg->type() == Message::ThreadMoveMessage) {
 		if (isRunning()) {
 			unregisterTimer();
-			invokeMethod(&Timer::registerTimer);
+			invokeMethod(&Timer::registerTimer, ConnectionTypeQueued);
 		}
 	}
 
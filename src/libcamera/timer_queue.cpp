@@ -0,0 +1,200 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * timer_queue.cpp - Priority queue of timers
+ */
+
+#include "timer_queue.h"
+
+#include "log.h"
+
+/**
+ * \file timer_queue.h
+ * \brief Priority queue of timers for event dispatchers
+ */
+
+namespace libcamera {
+
+LOG_DECLARE_CATEGORY(Timer)
+
+/**
+ * \class TimerQueue
+ * \brief A priority queue of Timer instances ordered by deadline
+ *
+ * The TimerQueue stores running timers in a binary min-heap ordered by
+ * deadline, and provides O(1) access to the timer with the earliest deadline
+ * and O(log n) insertion and removal of any timer. It is meant to be used by
+ * event dispatcher implementations to manage the timers registered with them.
+ *
+ * Each timer stores its position in the heap in its private data, which
+ * allows removing timers without searching the queue. A timer can thus only be
+ * stored in a single queue at a time.
+ *
+ * Timers with identical deadlines are ordered by insertion order, so that
+ * they time out in the order in which they have been registered.
+ */
+
+/**
+ * \var TimerQueue::InvalidIndex
+ * \brief Queue index of a timer not stored in any queue
+ */
+
+/**
+ * \class Timer::Private
+ * \brief Timer state private to the event dispatchers
+ *
+ * This class stores the Timer state managed by the TimerQueue, to keep it
+ * out of the public Timer API.
+ *
+ * \var Timer::Private::queueIndex
+ * \brief Position of the timer in the TimerQueue heap, or
+ * TimerQueue::InvalidIndex if the timer isn't queued
+ */
+
+TimerQueue::TimerQueue()
+	: sequence_(0)
+{
+}
+
+/**
+ * \fn TimerQueue::empty()
+ * \brief Check if the queue is empty
+ * \return True if the queue contains no timer, false otherwise
+ */
+
+/**
+ * \fn TimerQueue::size()
+ * \brief Retrieve the number of timers in the queue
+ * \return The number of timers in the queue
+ */
+
+/**
+ * \fn TimerQueue::nextDeadline()
+ * \brief Retrieve the earliest deadline of all timers in the queue
+ *
+ * The queue shall not be empty when calling this function.
+ *
+ * \return The deadline of the timer that will be returned by pop()
+ */
+
+/**
+ * \brief Insert a timer in the queue
+ * \param[in] timer The timer to insert
+ *
+ * The timer is ordered according to its current deadline. The deadline shall
+ * not be modified while the timer is stored in the queue.
+ */
+void TimerQueue::insert(Timer *timer)
+{
+	if (timer->d_->queueIndex != InvalidIndex) {
+		LOG(Timer, Error) << "Timer " << timer << " is already queued";
+		return;
+	}
+
+	heap_.push_back({ timer->deadline(), sequence_++, timer });
+	timer->d_->queueIndex = heap_.size() - 1;
+	siftUp(heap_.size() - 1);
+}
+
+/**
+ * \brief Remove a timer from the queue
+ * \param[in] timer The timer to remove
+ *
+ * If the timer isn't stored in the queue, this function performs no operation.
+ */
+void TimerQueue::remove(Timer *timer)
+{
+	unsigned int index = timer->d_->queueIndex;
+	if (index >= heap_.size() || heap_[index].timer != timer)
+		return;
+
+	removeAt(index);
+}
+
+/**
+ * \brief Remove the timer with the earliest deadline from the queue
+ *
+ * The queue shall not be empty when calling this function.
+ *
+ * \return The timer with the earliest deadline
+ */
+Timer *TimerQueue::pop()
+{
+	Timer *timer = heap_.front().timer;
+	removeAt(0);
+	return timer;
+}
+
+bool TimerQueue::Entry::operator<(const Entry &other) const
+{
+	if (deadline != other.deadline)
+		return deadline < other.deadline;
+
+	return sequence < other.sequence;
+}
+
+void TimerQueue::place(unsigned int index, const Entry &entry)
+{
+	heap_[index] = entry;
+	entry.timer->d_->queueIndex = index;
+}
+
+void TimerQueue::removeAt(unsigned int index)
+{
+	heap_[index].timer->d_->queueIndex = InvalidIndex;
+
+	Entry last = heap_.back();
+	heap_.pop_back();
+
+	if (index == heap_.size())
+		return;
+
+	place(index, last);
+
+	if (index > 0 && heap_[index] < heap_[(index - 1) / 2])
+		siftUp(index);
+	else
+		siftDown(index);
+}
+
+void TimerQueue::siftUp(unsigned int index)
+{
+	Entry entry = heap_[index];
+
+	while (index > 0) {
+		unsigned int parent = (index - 1) / 2;
+		if (!(entry < heap_[parent]))
+			break;
+
+		place(index, heap_[parent]);
+		index = parent;
+	}
+
+	place(index, entry);
+}
+
+void TimerQueue::siftDown(unsigned int index)
+{
+	Entry entry = heap_[index];
+	unsigned int size = heap_.size();
+
+	while (true) {
+		unsigned int child = index * 2 + 1;
+		if (child >= size)
+			break;
+
+		if (child + 1 < size && heap_[child + 1] < heap_[child])
+			child++;
+
+		if (!(heap_[child] < entry))
+			break;
+
+		place(index, heap_[child]);
+		index = child;
+	}
+
+	place(index, entry);
+}
+
+} /* namespace libcamera */
@@ -13,7 +13,11 @@
 #include <sys/ioctl.h>
 #include <unistd.h>
 
+#include <libcamera/event_notifier.h>
+
+#include "device_cache.h"
 #include "log.h"
+#include "media_request.h"
 #include "utils.h"
 #include "v4l2_controls.h"
 
@@ -38,6 +42,24 @@ LOG_DEFINE_CATEGORY(V4L2)
  * The V4L2Device class cannot be instantiated directly, as its constructor
  * is protected. Users should instead create instances of one the derived
  * classes to model either a V4L2 video device or a V4L2 subdevice.
+ *
+ * Devices opened with open() keep a shadow copy of the current value of their
+ * controls. Writing a control to the value it already has is skipped, and
+ * reading a control with a known value doesn't access the device. The shadow
+ * copy is kept coherent with changes made by the driver or by other users of
+ * the device through V4L2_EVENT_CTRL events. Volatile, write-only and
+ * execute-on-write controls are never cached.
+ *
+ * When the DeviceCache is enabled, the information about the controls
+ * supported by the device, including their range, default value and flags, is
+ * stored in the cache. Devices opened with open() subscribe to control events
+ * for all their controls, and remove the cache entry when the driver reports
+ * a change of the range or flags of a control. Changes that occur while no
+ * libcamera instance has the device open with open(), for instance ranges
+ * updated by the driver when another application changes the device format,
+ * are not detected. controls() then reports the ranges from the time the entry
+ * was stored, until the entry is removed by a range or flags change event, or
+ * invalidated by a change of the device tag.
  */
 
 /**
@@ -48,7 +70,8 @@ LOG_DEFINE_CATEGORY(V4L2)
  * at open() time, and the \a logTag to prefix log messages with.
  */
 V4L2Device::V4L2Device(const std::string &deviceNode)
-	: deviceNode_(deviceNode), fd_(-1)
+	: deviceNode_(deviceNode), fd_(-1), fdEvent_(nullptr),
+	  frameStartEnabled_(false)
 {
 }
 
@@ -57,6 +80,7 @@ V4L2Device::V4L2Device(const std::string &deviceNode)
  */
 V4L2Device::~V4L2Device()
 {
+	delete fdEvent_;
 }
 
 /**
@@ -86,6 +110,7 @@ int V4L2Device::open(unsigned int flags)
 	fd_ = ret;
 
 	listControls();
+	subscribeControlEvents();
 
 	return 0;
 }
@@ -104,6 +129,9 @@ int V4L2Device::open(unsigned int flags)
  * This method and the open() method are mutually exclusive, only one of the two
  * shall be used for a V4L2Device instance.
  *
+ * As the file descriptor may be shared with other V4L2Device instances, control
+ * values are not cached for devices set up with this method.
+ *
  * \return 0 on success or a negative error code otherwise
  */
 int V4L2Device::setFd(int fd)
@@ -113,6 +141,8 @@ int V4L2Device::setFd(int fd)
 
 	fd_ = fd;
 
+	listControls();
+
 	return 0;
 }
 
@@ -126,6 +156,11 @@ void V4L2Device::close()
 	if (!isOpen())
 		return;
 
+	delete fdEvent_;
+	fdEvent_ = nullptr;
+	frameStartEnabled_ = false;
+	shadow_.clear();
+
 	if (::close(fd_) < 0)
 		LOG(V4L2, Error) << "Failed to close V4L2 device: "
 				 << strerror(errno);
@@ -147,10 +182,18 @@ void V4L2Device::close()
 /**
  * \brief Read controls from the device
  * \param[inout] ctrls The list of controls to read
+ * \param[in] request The media request to read the controls from
  *
  * This method reads the value of all controls contained in \a ctrls, and stores
  * their values in the corresponding \a ctrls entry.
  *
+ * If a \a request is specified, the values are read from the request instead of
+ * the device. For completed requests, this retrieves the values that have been
+ * applied to the frame processed by the request.
+ *
+ * Controls whose current value is known from the shadow copy are not read from
+ * the device.
+ *
  * If any control in \a ctrls is not supported by the device, is disabled (i.e.
  * has the V4L2_CTRL_FLAG_DISABLED flag set), is a compound control, or if any
  * other error occurs during validation of the requested controls, no control is
@@ -165,7 +208,7 @@ void V4L2Device::close()
  * \retval -EINVAL One of the control is not supported or not accessible
  * \retval i The index of the control that failed
  */
-int V4L2Device::getControls(ControlList *ctrls)
+int V4L2Device::getControls(ControlList *ctrls, MediaRequest *request)
 {
 	unsigned int count = ctrls->size();
 	if (count == 0)
@@ -174,6 +217,11 @@ int V4L2Device::getControls(ControlList *ctrls)
 	struct v4l2_ext_control v4l2Ctrls[count];
 	memset(v4l2Ctrls, 0, sizeof(v4l2Ctrls));
 
+	/* Index in ctrls of each control passed to the device. */
+	unsigned int indices[count];
+	unsigned int index = 0;
+
+	/* Only read the controls whose value isn't known from the device. */
 	unsigned int i = 0;
 	for (const auto &ctrl : *ctrls) {
 		const ControlId *id = ctrl.first;
@@ -184,34 +232,68 @@ int V4L2Device::getControls(ControlList *ctrls)
 			return -EINVAL;
 		}
 
+		index++;
+
+		if (!request) {
+			auto shadow = shadow_.find(id->id());
+			if (shadow != shadow_.end() && shadow->second.valid)
+				continue;
+		}
+
 		v4l2Ctrls[i].id = id->id();
+		indices[i] = index - 1;
 		i++;
 	}
 
-	struct v4l2_ext_controls v4l2ExtCtrls = {};
-	v4l2ExtCtrls.which = V4L2_CTRL_WHICH_CUR_VAL;
-	v4l2ExtCtrls.controls = v4l2Ctrls;
-	v4l2ExtCtrls.count = count;
+	count = i;
+	int ret = 0;
 
-	int ret = ioctl(VIDIOC_G_EXT_CTRLS, &v4l2ExtCtrls);
-	if (ret) {
-		unsigned int errorIdx = v4l2ExtCtrls.error_idx;
+	if (count) {
+		struct v4l2_ext_controls v4l2ExtCtrls = {};
+		v4l2ExtCtrls.controls = v4l2Ctrls;
+		v4l2ExtCtrls.count = count;
 
-		/* Generic validation error. */
-		if (errorIdx == 0 || errorIdx >= count) {
-			LOG(V4L2, Error) << "Unable to read controls: "
-					 << strerror(ret);
-			return -EINVAL;
+		if (request) {
+			v4l2ExtCtrls.which = V4L2_CTRL_WHICH_REQUEST_VAL;
+			v4l2ExtCtrls.request_fd = request->fd();
+		} else {
+			v4l2ExtCtrls.which = V4L2_CTRL_WHICH_CUR_VAL;
 		}
 
-		/* A specific control failed. */
-		LOG(V4L2, Error) << "Unable to read control " << errorIdx
-				 << ": " << strerror(ret);
-		count = errorIdx - 1;
-		ret = errorIdx;
+		ret = ioctl(VIDIOC_G_EXT_CTRLS, &v4l2ExtCtrls);
+		if (ret) {
+			unsigned int errorIdx = v4l2ExtCtrls.error_idx;
+
+			/* Generic validation error. */
+			if (errorIdx == 0 || errorIdx >= count) {
+				LOG(V4L2, Error) << "Unable to read controls: "
+						 << strerror(ret);
+				return -EINVAL;
+			}
+
+			/* A specific control failed. */
+			LOG(V4L2, Error) << "Unable to read control " << errorIdx
+					 << ": " << strerror(ret);
+			count = errorIdx - 1;
+			ret = indices[errorIdx];
+		}
+	}
+
+	/* Fill the cached values and update the others from the device. */
+	if (!request) {
+		for (auto &ctrl : *ctrls) {
+			auto shadow = shadow_.find(ctrl.first->id());
+			if (shadow == shadow_.end() || !shadow->second.valid)
+				continue;
+
+			if (ctrl.first->type() == ControlTypeInteger64)
+				ctrl.second.set<int64_t>(shadow->second.value);
+			else
+				ctrl.second.set<int32_t>(shadow->second.value);
+		}
 	}
 
-	updateControls(ctrls, v4l2Ctrls, count);
+	updateControls(ctrls, v4l2Ctrls, count, !request);
 
 	return ret;
 }
@@ -219,11 +301,19 @@ int V4L2Device::getControls(ControlList *ctrls)
 /**
  * \brief Write controls to the device
  * \param[in] ctrls The list of controls to write
+ * \param[in] request The media request to store the controls in
  *
  * This method writes the value of all controls contained in \a ctrls, and
  * stores the values actually applied to the device in the corresponding
  * \a ctrls entry.
  *
+ * If a \a request is specified, the controls are stored in the request instead
+ * of being applied immediately. They will be applied atomically with the
+ * buffers of the request when it is queued with MediaRequest::queue().
+ *
+ * Controls whose current value is known from the shadow copy and equal to the
+ * value in \a ctrls are not written to the device.
+ *
  * If any control in \a ctrls is not supported by the device, is disabled (i.e.
  * has the V4L2_CTRL_FLAG_DISABLED flag set), is read-only, is a
  * compound control, or if any other error occurs during validation of
@@ -239,7 +329,7 @@ int V4L2Device::getControls(ControlList *ctrls)
  * \retval -EINVAL One of the control is not supported or not accessible
  * \retval i The index of the control that failed
  */
-int V4L2Device::setControls(ControlList *ctrls)
+int V4L2Device::setControls(ControlList *ctrls, MediaRequest *request)
 {
 	unsigned int count = ctrls->size();
 	if (count == 0)
@@ -248,6 +338,11 @@ int V4L2Device::setControls(ControlList *ctrls)
 	struct v4l2_ext_control v4l2Ctrls[count];
 	memset(v4l2Ctrls, 0, sizeof(v4l2Ctrls));
 
+	/* Index in ctrls of each control passed to the device. */
+	unsigned int indices[count];
+	unsigned int index = 0;
+
+	bool invalidate = false;
 	unsigned int i = 0;
 	for (const auto &ctrl : *ctrls) {
 		const ControlId *id = ctrl.first;
@@ -258,31 +353,59 @@ int V4L2Device::setControls(ControlList *ctrls)
 			return -EINVAL;
 		}
 
-		v4l2Ctrls[i].id = id->id();
-
 		/* Set the v4l2_ext_control value for the write operation. */
 		const ControlValue &value = ctrl.second;
+		int64_t val;
 		switch (id->type()) {
 		case ControlTypeInteger64:
-			v4l2Ctrls[i].value64 = value.get<int64_t>();
+			val = value.get<int64_t>();
 			break;
 		default:
 			/*
 			 * \todo To be changed when support for string and
 			 * compound controls will be added.
 			 */
-			v4l2Ctrls[i].value = value.get<int32_t>();
+			val = value.get<int32_t>();
 			break;
 		}
 
+		index++;
+
+		/* Skip controls that already have the requested value. */
+		auto shadow = shadow_.find(id->id());
+		if (shadow != shadow_.end()) {
+			if (!request && shadow->second.valid &&
+			    shadow->second.value == val)
+				continue;
+
+			invalidate |= shadow->second.update;
+		}
+
+		v4l2Ctrls[i].id = id->id();
+		if (id->type() == ControlTypeInteger64)
+			v4l2Ctrls[i].value64 = val;
+		else
+			v4l2Ctrls[i].value = val;
+
+		indices[i] = index - 1;
 		i++;
 	}
 
+	count = i;
+	if (count == 0)
+		return 0;
+
 	struct v4l2_ext_controls v4l2ExtCtrls = {};
-	v4l2ExtCtrls.which = V4L2_CTRL_WHICH_CUR_VAL;
 	v4l2ExtCtrls.controls = v4l2Ctrls;
 	v4l2ExtCtrls.count = count;
 
+	if (request) {
+		v4l2ExtCtrls.which = V4L2_CTRL_WHICH_REQUEST_VAL;
+		v4l2ExtCtrls.request_fd = request->fd();
+	} else {
+		v4l2ExtCtrls.which = V4L2_CTRL_WHICH_CUR_VAL;
+	}
+
 	int ret = ioctl(VIDIOC_S_EXT_CTRLS, &v4l2ExtCtrls);
 	if (ret) {
 		unsigned int errorIdx = v4l2ExtCtrls.error_idx;
@@ -298,14 +421,72 @@ int V4L2Device::setControls(ControlList *ctrls)
 		LOG(V4L2, Error) << "Unable to set control " << errorIdx
 				 << ": " << strerror(ret);
 		count = errorIdx - 1;
-		ret = errorIdx;
+		ret = indices[errorIdx];
+	}
+
+	/*
+	 * Controls flagged with V4L2_CTRL_FLAG_UPDATE may change the value of
+	 * other controls, without notifying us as we caused the change.
+	 * Controls stored in a request are applied later. Drop the cached
+	 * values in both cases.
+	 */
+	if (invalidate || request) {
+		for (auto &shadow : shadow_)
+			shadow.second.valid = false;
+	}
+
+	updateControls(ctrls, v4l2Ctrls, count, !request);
+
+	return ret;
+}
+
+/**
+ * \brief Enable or disable frame start event notification
+ * \param[in] enable True to enable frame start events, false to disable them
+ *
+ * This method subscribes to or unsubscribes from the V4L2_EVENT_FRAME_SYNC
+ * event. When enabled, the frameStart signal is emitted every time the device
+ * starts receiving a frame. Frame start events are typically supported by
+ * camera sensor and CSI-2 receiver subdevices.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int V4L2Device::setFrameStartEnabled(bool enable)
+{
+	if (frameStartEnabled_ == enable)
+		return 0;
+
+	struct v4l2_event_subscription event = {};
+	event.type = V4L2_EVENT_FRAME_SYNC;
+
+	unsigned long request = enable ? VIDIOC_SUBSCRIBE_EVENT
+				       : VIDIOC_UNSUBSCRIBE_EVENT;
+	int ret = ioctl(request, &event);
+	if (enable && ret) {
+		LOG(V4L2, Debug)
+			<< "Unable to subscribe to frame start events: "
+			<< strerror(-ret);
+		return ret;
 	}
 
-	updateControls(ctrls, v4l2Ctrls, count);
+	if (enable)
+		enableEvents();
+
+	frameStartEnabled_ = enable;
 
 	return ret;
 }
 
+/**
+ * \var V4L2Device::frameStart
+ * \brief A Signal emitted when capture of a frame starts
+ *
+ * This signal is emitted for every V4L2_EVENT_FRAME_SYNC event when frame
+ * start events have been enabled with setFrameStartEnabled(). The signal
+ * carries the frame sequence number and the time at which the event was
+ * generated by the kernel, expressed in the utils::clock time base.
+ */
+
 /**
  * \brief Perform an IOCTL system call on the device node
  * \param[in] request The IOCTL request code
@@ -343,14 +524,9 @@ int V4L2Device::ioctl(unsigned long request, void *argp)
 void V4L2Device::listControls()
 {
 	ControlInfoMap::Map ctrls;
-	struct v4l2_query_ext_ctrl ctrl = {};
 
 	/* \todo Add support for menu and compound controls. */
-	while (1) {
-		ctrl.id |= V4L2_CTRL_FLAG_NEXT_CTRL;
-		if (ioctl(VIDIOC_QUERY_EXT_CTRL, &ctrl))
-			break;
-
+	for (const struct v4l2_query_ext_ctrl &ctrl : queryControls()) {
 		if (ctrl.type == V4L2_CTRL_TYPE_CTRL_CLASS ||
 		    ctrl.flags & V4L2_CTRL_FLAG_DISABLED)
 			continue;
@@ -381,45 +557,201 @@ void V4L2Device::listControls()
 
 		controlIds_.emplace_back(utils::make_unique<V4L2ControlId>(ctrl));
 		ctrls.emplace(controlIds_.back().get(), V4L2ControlRange(ctrl));
+
+		ControlShadow &shadow = shadow_[ctrl.id];
+		shadow.value = 0;
+		shadow.cacheable = false;
+		shadow.valid = false;
+		shadow.update = ctrl.flags & V4L2_CTRL_FLAG_UPDATE;
+
+		if (ctrl.type != V4L2_CTRL_TYPE_BUTTON &&
+		    !(ctrl.flags & (V4L2_CTRL_FLAG_VOLATILE |
+				    V4L2_CTRL_FLAG_WRITE_ONLY |
+				    V4L2_CTRL_FLAG_EXECUTE_ON_WRITE)))
+			shadow.cacheable = true;
 	}
 
 	controls_ = std::move(ctrls);
 }
 
 /*
- * \brief Update the value of the first \a count V4L2 controls in \a ctrls using
+ * \brief Retrieve the DeviceCache key of the controls of the device
+ */
+std::string V4L2Device::controlsCacheKey() const
+{
+	return deviceNode_ + ":controls";
+}
+
+/*
+ * \brief Query all the controls supported by the device
+ *
+ * The list of controls is retrieved from the DeviceCache if available, and
+ * stored in the cache otherwise. The cached ranges, default values and flags
+ * may be out of date, see the V4L2Device class documentation.
+ *
+ * \return The list of controls
+ */
+std::vector<struct v4l2_query_ext_ctrl> V4L2Device::queryControls()
+{
+	DeviceCache *cache = DeviceCache::instance();
+	std::vector<struct v4l2_query_ext_ctrl> ctrls;
+	std::string key = controlsCacheKey();
+	std::string tag = cache->deviceTag(fd_);
+	DeviceCacheData data;
+
+	if (cache->load(key, tag, &data) && data.extract(&ctrls))
+		return ctrls;
+
+	ctrls.clear();
+
+	struct v4l2_query_ext_ctrl ctrl = {};
+	while (1) {
+		ctrl.id |= V4L2_CTRL_FLAG_NEXT_CTRL;
+		if (ioctl(VIDIOC_QUERY_EXT_CTRL, &ctrl))
+			break;
+
+		ctrls.push_back(ctrl);
+	}
+
+	data = DeviceCacheData();
+	data.append(ctrls);
+	cache->store(key, tag, data);
+
+	return ctrls;
+}
+
+/*
+ * \brief Subscribe to control change events for all cacheable controls
+ *
+ * Values of controls that can't be subscribed to are never cached. When the
+ * DeviceCache is enabled, all controls are subscribed to, in order to detect
+ * range and flags changes.
+ */
+void V4L2Device::subscribeControlEvents()
+{
+	bool deviceCache = DeviceCache::instance()->enabled();
+	bool subscribed = false;
+
+	for (auto &it : shadow_) {
+		ControlShadow &shadow = it.second;
+		if (!shadow.cacheable && !deviceCache)
+			continue;
+
+		struct v4l2_event_subscription sub = {};
+		sub.type = V4L2_EVENT_CTRL;
+		sub.id = it.first;
+
+		if (ioctl(VIDIOC_SUBSCRIBE_EVENT, &sub)) {
+			if (shadow.cacheable)
+				LOG(V4L2, Debug)
+					<< "Control " << utils::hex(it.first)
+					<< " doesn't support events, not caching";
+			shadow.cacheable = false;
+			continue;
+		}
+
+		subscribed = true;
+	}
+
+	if (subscribed)
+		enableEvents();
+}
+
+/*
+ * \brief Start monitoring the device for V4L2 events
+ */
+void V4L2Device::enableEvents()
+{
+	if (fdEvent_)
+		return;
+
+	fdEvent_ = new EventNotifier(fd_, EventNotifier::Exception);
+	fdEvent_->activated.connect(this, &V4L2Device::eventAvailable);
+}
+
+/*
+ * \brief Slot to handle V4L2 events
+ *
+ * Control change events invalidate the cached value of the control. The new
+ * value is not taken from the event, as it may be older than a value written
+ * by this instance since the event was queued. Range and flags change events
+ * invalidate the controls stored in the DeviceCache. Frame synchronisation
+ * events are reported through the frameStart signal.
+ */
+void V4L2Device::eventAvailable(EventNotifier *notifier)
+{
+	struct v4l2_event event;
+
+	do {
+		event = {};
+		if (ioctl(VIDIOC_DQEVENT, &event))
+			return;
+
+		if (event.type == V4L2_EVENT_FRAME_SYNC) {
+			utils::time_point time = utils::time_point()
+				+ std::chrono::seconds(event.timestamp.tv_sec)
+				+ std::chrono::nanoseconds(event.timestamp.tv_nsec);
+			frameStart.emit(event.u.frame_sync.frame_sequence, time);
+			continue;
+		}
+
+		if (event.type != V4L2_EVENT_CTRL)
+			continue;
+
+		auto shadow = shadow_.find(event.id);
+		if (shadow == shadow_.end())
+			continue;
+
+		if (event.u.ctrl.changes & V4L2_EVENT_CTRL_CH_VALUE)
+			shadow->second.valid = false;
+
+		if (event.u.ctrl.changes & (V4L2_EVENT_CTRL_CH_RANGE |
+					    V4L2_EVENT_CTRL_CH_FLAGS))
+			DeviceCache::instance()->remove(controlsCacheKey());
+	} while (event.pending);
+}
+
+/*
+ * \brief Update the value of V4L2 controls in \a ctrls using the first \a count
  * values in \a v4l2Ctrls
  * \param[inout] ctrls List of V4L2 controls to update
  * \param[in] v4l2Ctrls List of V4L2 extended controls as returned by the driver
  * \param[in] count The number of controls to update
+ * \param[in] cache Whether to store the values in the shadow copy
  */
 void V4L2Device::updateControls(ControlList *ctrls,
 				const struct v4l2_ext_control *v4l2Ctrls,
-				unsigned int count)
+				unsigned int count, bool cache)
 {
-	unsigned int i = 0;
-	for (auto &ctrl : *ctrls) {
-		if (i == count)
-			break;
-
+	for (unsigned int i = 0; i < count; ++i) {
 		const struct v4l2_ext_control *v4l2Ctrl = &v4l2Ctrls[i];
-		const ControlId *id = ctrl.first;
-		ControlValue &value = ctrl.second;
+		const ControlId *id = controls_.find(v4l2Ctrl->id)->first;
+		int64_t value;
 
 		switch (id->type()) {
 		case ControlTypeInteger64:
-			value.set<int64_t>(v4l2Ctrl->value64);
+			value = v4l2Ctrl->value64;
+			ctrls->set(v4l2Ctrl->id, ControlValue(value));
 			break;
 		default:
 			/*
 			 * \todo To be changed when support for string and
 			 * compound controls will be added.
 			 */
-			value.set<int32_t>(v4l2Ctrl->value);
+			value = v4l2Ctrl->value;
+			ctrls->set(v4l2Ctrl->id, ControlValue(v4l2Ctrl->value));
 			break;
 		}
 
-		i++;
+		if (!cache || !fdEvent_)
+			continue;
+
+		ControlShadow &shadow = shadow_[v4l2Ctrl->id];
+		if (!shadow.cacheable)
+			continue;
+
+		shadow.value = value;
+		shadow.valid = true;
 	}
 }
 
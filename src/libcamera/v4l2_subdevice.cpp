@@ -7,6 +7,7 @@
 
 #include "v4l2_subdevice.h"
 
+#include <algorithm>
 #include <fcntl.h>
 #include <iomanip>
 #include <sstream>
@@ -18,6 +19,7 @@
 
 #include <libcamera/geometry.h>
 
+#include "device_cache.h"
 #include "log.h"
 #include "media_device.h"
 #include "media_object.h"
@@ -153,17 +155,42 @@ int V4L2Subdevice::setCompose(unsigned int pad, Rectangle *rect)
  * Enumerate all media bus codes and frame sizes supported by the subdevice on
  * a \a pad.
  *
+ * The formats supported by subdevices that have sink pads may depend on the
+ * formats configured on the sink pads. The formats of subdevices without any
+ * sink pad, such as camera sensors, are retrieved from the DeviceCache if
+ * available, and stored in the cache otherwise.
+ *
  * \return A list of the supported device formats
  */
 ImageFormats V4L2Subdevice::formats(unsigned int pad)
 {
+	DeviceCache *cache = DeviceCache::instance();
+	std::string key = deviceNode() + ":formats:" + std::to_string(pad);
+	std::string tag;
 	ImageFormats formats;
+	DeviceCacheData data;
 
 	if (pad >= entity_->pads().size()) {
 		LOG(V4L2, Error) << "Invalid pad: " << pad;
 		return {};
 	}
 
+	bool cacheable = std::none_of(entity_->pads().begin(),
+				      entity_->pads().end(),
+				      [](const MediaPad *p) {
+					      return p->flags() & MEDIA_PAD_FL_SINK;
+				      });
+	if (cacheable) {
+		tag = cache->deviceTag(fd());
+		if (!tag.empty())
+			tag += " " + entity_->name();
+	}
+
+	if (cache->load(key, tag, &data) && data.extract(&formats))
+		return formats;
+
+	formats = ImageFormats();
+
 	for (unsigned int code : enumPadCodes(pad)) {
 		std::vector<SizeRange> sizes = enumPadSizes(pad, code);
 		if (sizes.empty())
@@ -177,6 +204,10 @@ ImageFormats V4L2Subdevice::formats(unsigned int pad)
 		}
 	}
 
+	data = DeviceCacheData();
+	data.append(formats);
+	cache->store(key, tag, data);
+
 	return formats;
 }
 
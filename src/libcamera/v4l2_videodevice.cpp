@@ -7,6 +7,7 @@
 
 #include "v4l2_videodevice.h"
 
+#include <algorithm>
 #include <fcntl.h>
 #include <iomanip>
 #include <sstream>
@@ -20,9 +21,11 @@
 #include <libcamera/buffer.h>
 #include <libcamera/event_notifier.h>
 
+#include "device_cache.h"
 #include "log.h"
 #include "media_device.h"
 #include "media_object.h"
+#include "media_request.h"
 #include "utils.h"
 
 /**
@@ -272,7 +275,8 @@ const std::string V4L2DeviceFormat::toString() const
  * \param[in] deviceNode The file-system path to the video device node
  */
 V4L2VideoDevice::V4L2VideoDevice(const std::string &deviceNode)
-	: V4L2Device(deviceNode), multiPlanar_(false), bufferPool_(nullptr),
+	: V4L2Device(deviceNode), multiPlanar_(false), planesCount_(0),
+	  bufferCaps_(0), bufferPool_(nullptr), queuedCount_(0),
 	  fdEvent_(nullptr), streaming_(false)
 {
 	/*
@@ -591,6 +595,7 @@ int V4L2VideoDevice::getFormatMultiplane(V4L2DeviceFormat *format)
 	format->size.height = pix->height;
 	format->fourcc = pix->pixelformat;
 	format->planesCount = pix->num_planes;
+	planesCount_ = pix->num_planes;
 
 	for (unsigned int i = 0; i < format->planesCount; ++i) {
 		format->planes[i].bpl = pix->plane_fmt[i].bytesperline;
@@ -632,6 +637,7 @@ int V4L2VideoDevice::setFormatMultiplane(V4L2DeviceFormat *format)
 	format->size.height = pix->height;
 	format->fourcc = pix->pixelformat;
 	format->planesCount = pix->num_planes;
+	planesCount_ = pix->num_planes;
 	for (unsigned int i = 0; i < format->planesCount; ++i) {
 		format->planes[i].bpl = pix->plane_fmt[i].bytesperline;
 		format->planes[i].size = pix->plane_fmt[i].sizeimage;
@@ -699,12 +705,27 @@ int V4L2VideoDevice::setFormatSingleplane(V4L2DeviceFormat *format)
  * \brief Enumerate all pixel formats and frame sizes
  *
  * Enumerate all pixel formats and frame sizes supported by the video device.
+ * The formats are retrieved from the DeviceCache if available, and stored in
+ * the cache otherwise.
  *
  * \return A list of the supported video device formats
  */
 ImageFormats V4L2VideoDevice::formats()
 {
+	DeviceCache *cache = DeviceCache::instance();
+	std::string key = deviceNode() + ":formats:" + std::to_string(bufferType_);
+	std::string tag = cache->deviceTag(fd());
 	ImageFormats formats;
+	DeviceCacheData data;
+
+	if (!tag.empty())
+		tag += std::string(" ") + caps_.driver() + " " + caps_.card()
+		     + " " + caps_.bus_info() + " " + std::to_string(caps_.version);
+
+	if (cache->load(key, tag, &data) && data.extract(&formats))
+		return formats;
+
+	formats = ImageFormats();
 
 	for (unsigned int pixelformat : enumPixelformats()) {
 		std::vector<SizeRange> sizes = enumSizes(pixelformat);
@@ -719,6 +740,10 @@ ImageFormats V4L2VideoDevice::formats()
 		}
 	}
 
+	data = DeviceCacheData();
+	data.append(formats);
+	cache->store(key, tag, data);
+
 	return formats;
 }
 
@@ -826,6 +851,8 @@ int V4L2VideoDevice::requestBuffers(unsigned int count)
 
 	LOG(V4L2, Debug) << rb.count << " buffers requested.";
 
+	bufferCaps_ = rb.capabilities;
+
 	return rb.count;
 }
 
@@ -855,6 +882,11 @@ int V4L2VideoDevice::exportBuffers(BufferPool *pool)
 		return -ENOMEM;
 	}
 
+	/* Retrieve the line strides to record them in the planes. */
+	V4L2DeviceFormat format = {};
+	if (getFormat(&format) < 0)
+		format.planesCount = 0;
+
 	/* Map the buffers. */
 	for (i = 0; i < pool->count(); ++i) {
 		struct v4l2_plane planes[VIDEO_MAX_PLANES] = {};
@@ -890,6 +922,11 @@ int V4L2VideoDevice::exportBuffers(BufferPool *pool)
 			LOG(V4L2, Error) << "Failed to create plane";
 			break;
 		}
+
+		for (unsigned int p = 0; p < buffer.planes().size(); ++p) {
+			if (p < format.planesCount)
+				buffer.planes()[p].setStride(format.planes[p].bpl);
+		}
 	}
 
 	if (ret) {
@@ -898,6 +935,7 @@ int V4L2VideoDevice::exportBuffers(BufferPool *pool)
 		return ret;
 	}
 
+	createTemplates(pool->count());
 	bufferPool_ = pool;
 
 	return 0;
@@ -959,6 +997,7 @@ int V4L2VideoDevice::importBuffers(BufferPool *pool)
 	}
 
 	LOG(V4L2, Debug) << "provided pool of " << pool->count() << " buffers";
+	createTemplates(pool->count());
 	bufferPool_ = pool;
 
 	return 0;
@@ -972,63 +1011,98 @@ int V4L2VideoDevice::releaseBuffers()
 	LOG(V4L2, Debug) << "Releasing bufferPool";
 
 	bufferPool_ = nullptr;
+	templates_.clear();
+	queuedBuffers_.clear();
+
+	/* Releasing the buffers also drops the ones still queued. */
+	if (queuedCount_) {
+		fdEvent_->setEnabled(false);
+		queuedCount_ = 0;
+	}
 
 	return requestBuffers(0);
 }
 
+/**
+ * \fn V4L2VideoDevice::supportsRequests()
+ * \brief Check if the device supports the Request API
+ *
+ * Support for the Request API is reported by the driver when allocating
+ * buffers. This method shall thus only be called after buffers have been
+ * exported or imported.
+ *
+ * \return True if buffers can be queued to a MediaRequest, false otherwise
+ */
+
 /**
  * \brief Queue a buffer into the video device
  * \param[in] buffer The buffer to be queued
+ * \param[in] request The media request to add the buffer to
  *
  * For capture video devices the \a buffer will be filled with data by the
  * device. For output video devices the \a buffer shall contain valid data and
  * will be processed by the device. Once the device has finished processing the
  * buffer, it will be available for dequeue.
  *
+ * If a \a request is specified, the buffer is added to the request and will
+ * only be processed by the device once the request is queued with
+ * MediaRequest::queue(), together with the controls stored in the request.
+ * The device shall support requests, see supportsRequests().
+ *
  * \return 0 on success or a negative error code otherwise
  */
-int V4L2VideoDevice::queueBuffer(Buffer *buffer)
+int V4L2VideoDevice::queueBuffer(Buffer *buffer, MediaRequest *request)
 {
-	struct v4l2_plane v4l2Planes[VIDEO_MAX_PLANES] = {};
-	struct v4l2_buffer buf = {};
+	unsigned int index = buffer->index();
 	int ret;
 
-	buf.index = buffer->index();
-	buf.type = bufferType_;
-	buf.memory = memoryType_;
-	buf.field = V4L2_FIELD_NONE;
+	if (index >= templates_.size()) {
+		LOG(V4L2, Error) << "Invalid buffer index " << index;
+		return -EINVAL;
+	}
 
-	BufferMemory *mem = &bufferPool_->buffers()[buf.index];
-	const std::vector<Plane> &planes = mem->planes();
+	const std::vector<Plane> &planes = bufferPool_->buffers()[index].planes();
 
-	if (buf.memory == V4L2_MEMORY_DMABUF) {
-		if (multiPlanar_) {
-			for (unsigned int p = 0; p < planes.size(); ++p)
-				v4l2Planes[p].m.fd = planes[p].dmabuf();
-		} else {
-			buf.m.fd = planes[0].dmabuf();
-		}
+	/*
+	 * Buffers may describe more planes than the format uses, when planes
+	 * are stored contiguously in the memory of the last format plane. The
+	 * additional planes only describe the memory layout, and are not
+	 * passed to the device.
+	 */
+	unsigned int numPlanes = multiPlanar_ ? planes.size() : 1;
+	if (multiPlanar_ && planesCount_ && planesCount_ < numPlanes)
+		numPlanes = planesCount_;
+
+	if (planes.size() < numPlanes) {
+		LOG(V4L2, Error) << "Buffer " << index << " has no memory";
+		return -EINVAL;
 	}
 
+	ret = updateTemplate(index, numPlanes);
+	if (ret < 0)
+		return ret;
+
+	/*
+	 * The device updates the v4l2_buffer and v4l2_plane structures, queue
+	 * a copy of the template.
+	 */
+	const BufferTemplate &tmpl = templates_[index];
+	struct v4l2_plane v4l2Planes[VIDEO_MAX_PLANES];
+	struct v4l2_buffer buf = tmpl.buf;
+
 	if (multiPlanar_) {
-		buf.length = planes.size();
+		std::copy(tmpl.planes, tmpl.planes + numPlanes, v4l2Planes);
 		buf.m.planes = v4l2Planes;
 	}
 
+	if (request) {
+		buf.flags |= V4L2_BUF_FLAG_REQUEST_FD;
+		buf.request_fd = request->fd();
+	}
+
 	if (V4L2_TYPE_IS_OUTPUT(bufferType_)) {
-		if (multiPlanar_) {
-			/*
-			 * V4L2 "should" set the planes bytesused fields for us,
-			 * but let's be good citizens and do it ourselves to
-			 * prevent ambiguity.
-			 */
-			for (unsigned int p = 0; p < planes.size(); ++p) {
-				v4l2Planes[p].length = planes[p].length();
-				v4l2Planes[p].bytesused = planes[p].length();
-			}
-		} else {
+		if (!multiPlanar_)
 			buf.bytesused = buffer->bytesused_;
-		}
 
 		buf.sequence = buffer->sequence_;
 		buf.timestamp.tv_sec = buffer->timestamp_ / 1000000000;
@@ -1045,10 +1119,120 @@ int V4L2VideoDevice::queueBuffer(Buffer *buffer)
 		return ret;
 	}
 
-	if (queuedBuffers_.empty())
+	if (!queuedCount_)
 		fdEvent_->setEnabled(true);
 
-	queuedBuffers_[buf.index] = buffer;
+	queuedBuffers_[index] = buffer;
+	queuedCount_++;
+
+	return 0;
+}
+
+/*
+ * Create the v4l2_buffer templates for \a count buffers. The templates store
+ * the fields that don't depend on the buffer memory layout, the layout
+ * dependent fields are filled by updateTemplate() when the buffers are
+ * queued.
+ */
+void V4L2VideoDevice::createTemplates(unsigned int count)
+{
+	templates_.clear();
+	templates_.resize(count);
+
+	queuedBuffers_.assign(count, nullptr);
+	queuedCount_ = 0;
+
+	for (unsigned int i = 0; i < count; ++i) {
+		BufferTemplate &tmpl = templates_[i];
+
+		memset(&tmpl.buf, 0, sizeof(tmpl.buf));
+		memset(tmpl.planes, 0, sizeof(tmpl.planes));
+
+		tmpl.buf.index = i;
+		tmpl.buf.type = bufferType_;
+		tmpl.buf.memory = memoryType_;
+		tmpl.buf.field = V4L2_FIELD_NONE;
+	}
+}
+
+/*
+ * Update the template of buffer \a index with the memory layout of its
+ * planes. The planes of exported buffers never change, while imported buffers
+ * are remapped to different dmabufs when the application queues new external
+ * buffers. The template is only rebuilt when the layout differs from the one
+ * it has been built for.
+ */
+int V4L2VideoDevice::updateTemplate(unsigned int index, unsigned int numPlanes)
+{
+	BufferTemplate &tmpl = templates_[index];
+	const std::vector<Plane> &planes = bufferPool_->buffers()[index].planes();
+
+	if (tmpl.layout.size() == numPlanes) {
+		bool changed = false;
+
+		for (unsigned int p = 0; p < numPlanes; ++p) {
+			const DmabufPlane &layout = tmpl.layout[p];
+			if (layout.fd != planes[p].dmabuf() ||
+			    layout.offset != planes[p].offset() ||
+			    layout.length != planes[p].length()) {
+				changed = true;
+				break;
+			}
+		}
+
+		if (!changed)
+			return 0;
+	}
+
+	/*
+	 * V4L2 only supports plane offsets for multi-planar output buffers,
+	 * through the data_offset field.
+	 */
+	if (memoryType_ == V4L2_MEMORY_DMABUF) {
+		for (unsigned int p = 0; p < numPlanes; ++p) {
+			if (planes[p].offset() &&
+			    (!multiPlanar_ || !V4L2_TYPE_IS_OUTPUT(bufferType_))) {
+				LOG(V4L2, Error)
+					<< "Plane offsets not supported by the device";
+				return -EINVAL;
+			}
+		}
+	}
+
+	tmpl.layout.clear();
+	memset(tmpl.planes, 0, sizeof(tmpl.planes));
+
+	for (unsigned int p = 0; p < numPlanes; ++p) {
+		const Plane &plane = planes[p];
+		tmpl.layout.push_back({ plane.dmabuf(), plane.offset(),
+					plane.length(), plane.stride() });
+
+		if (!multiPlanar_)
+			break;
+
+		struct v4l2_plane &v4l2Plane = tmpl.planes[p];
+
+		if (memoryType_ == V4L2_MEMORY_DMABUF) {
+			v4l2Plane.m.fd = plane.dmabuf();
+			v4l2Plane.data_offset = plane.offset();
+		}
+
+		/*
+		 * V4L2 "should" set the planes bytesused fields for us, but
+		 * let's be good citizens and do it ourselves to prevent
+		 * ambiguity.
+		 */
+		if (V4L2_TYPE_IS_OUTPUT(bufferType_)) {
+			unsigned int size = plane.offset() + plane.length();
+			v4l2Plane.length = size;
+			v4l2Plane.bytesused = size;
+		}
+	}
+
+	if (multiPlanar_)
+		tmpl.buf.length = numPlanes;
+	else if (memoryType_ == V4L2_MEMORY_DMABUF)
+		tmpl.buf.m.fd = planes[0].dmabuf();
 
 	return 0;
 }
@@ -1080,7 +1264,7 @@ std::vector<std::unique_ptr<Buffer>> V4L2VideoDevice::queueAllBuffers()
 {
 	int ret;
 
-	if (!queuedBuffers_.empty())
+	if (queuedCount_)
 		return {};
 
 	if (V4L2_TYPE_IS_OUTPUT(bufferType_))
@@ -1103,7 +1287,8 @@ std::vector<std::unique_ptr<Buffer>> V4L2VideoDevice::queueAllBuffers()
  * \brief Dequeue the next available buffer from the video device
  *
  * This method dequeues the next available buffer from the device. If no buffer
- * is available to be dequeued it will return nullptr immediately.
+ * is available to be dequeued it will return nullptr immediately, without
+ * logging an error.
  *
  * \return A pointer to the dequeued buffer on success, or nullptr otherwise
  */
@@ -1123,18 +1308,19 @@ Buffer *V4L2VideoDevice::dequeueBuffer()
 
 	ret = ioctl(VIDIOC_DQBUF, &buf);
 	if (ret < 0) {
-		LOG(V4L2, Error)
-			<< "Failed to dequeue buffer: " << strerror(-ret);
+		if (ret != -EAGAIN)
+			LOG(V4L2, Error)
+				<< "Failed to dequeue buffer: " << strerror(-ret);
 		return nullptr;
 	}
 
-	ASSERT(buf.index < bufferPool_->count());
+	ASSERT(buf.index < queuedBuffers_.size());
 
-	auto it = queuedBuffers_.find(buf.index);
-	Buffer *buffer = it->second;
-	queuedBuffers_.erase(it);
+	Buffer *buffer = queuedBuffers_[buf.index];
+	ASSERT(buffer);
 
-	if (queuedBuffers_.empty())
+	queuedBuffers_[buf.index] = nullptr;
+	if (!--queuedCount_)
 		fdEvent_->setEnabled(false);
 
 	buffer->index_ = buf.index;
@@ -1159,27 +1345,63 @@ Buffer *V4L2VideoDevice::dequeueBuffer()
  * \brief Slot to handle completed buffer events from the V4L2 video device
  * \param[in] notifier The event notifier
  *
- * When this slot is called, a Buffer has become available from the device, and
- * will be emitted through the bufferReady Signal.
+ * When this slot is called, one or more Buffers have become available from the
+ * device. All of them are dequeued in a single pass, in the order in which the
+ * device completed them, and emitted through the bufferReady and buffersReady
+ * signals.
  *
- * For Capture video devices the Buffer will contain valid data.
- * For Output video devices the Buffer can be considered empty.
+ * For Capture video devices the Buffers will contain valid data.
+ * For Output video devices the Buffers can be considered empty.
  */
 void V4L2VideoDevice::bufferAvailable(EventNotifier *notifier)
 {
-	Buffer *buffer = dequeueBuffer();
-	if (!buffer)
+	readyBuffers_.clear();
+
+	while (queuedCount_) {
+		Buffer *buffer = dequeueBuffer();
+		if (!buffer)
+			break;
+
+		LOG(V4L2, Debug) << "Buffer " << buffer->index() << " is available";
+
+		readyBuffers_.push_back(buffer);
+	}
+
+	emitBuffers(readyBuffers_);
+}
+
+/*
+ * Notify anyone listening to the device of completed buffers, individually
+ * and then as a batch.
+ */
+void V4L2VideoDevice::emitBuffers(const std::vector<Buffer *> &buffers)
+{
+	if (buffers.empty())
 		return;
 
-	LOG(V4L2, Debug) << "Buffer " << buffer->index() << " is available";
+	for (Buffer *buffer : buffers)
+		bufferReady.emit(buffer);
 
-	/* Notify anyone listening to the device. */
-	bufferReady.emit(buffer);
+	buffersReady.emit(buffers);
 }
 
 /**
  * \var V4L2VideoDevice::bufferReady
  * \brief A Signal emitted when a buffer completes
+ *
+ * When multiple buffers complete at the same time, the signal is emitted once
+ * for each of them, in completion order, before the buffersReady signal.
+ */
+
+/**
+ * \var V4L2VideoDevice::buffersReady
+ * \brief A Signal emitted when a batch of buffers completes
+ *
+ * This signal carries all the buffers dequeued in one pass, in completion
+ * order. It allows users to process bursts of completed buffers at once. It is
+ * emitted after the bufferReady signal has been emitted for all the buffers in
+ * the batch, users shall thus connect to one of the two signals only. The
+ * vector is only valid for the duration of the signal emission.
  */
 
 /**
@@ -1206,9 +1428,9 @@ int V4L2VideoDevice::streamOn()
  * \brief Stop the video stream
  *
  * Buffers that are still queued when the video stream is stopped are
- * immediately dequeued with their status set to Buffer::BufferError,
- * and the bufferReady signal is emitted for them. The order in which those
- * buffers are dequeued is not specified.
+ * immediately dequeued with their status set to Buffer::BufferCancelled,
+ * and the bufferReady and buffersReady signals are emitted for them. The order
+ * in which those buffers are dequeued is not specified.
  *
  * \return 0 on success or a negative error code otherwise
  */
@@ -1227,18 +1449,25 @@ int V4L2VideoDevice::streamOff()
 	}
 
 	/* Send back all queued buffers. */
-	for (auto it : queuedBuffers_) {
-		unsigned int index = it.first;
-		Buffer *buffer = it.second;
+	std::vector<Buffer *> buffers;
+	buffers.reserve(queuedCount_);
+
+	for (unsigned int index = 0; index < queuedBuffers_.size(); ++index) {
+		Buffer *buffer = queuedBuffers_[index];
+		if (!buffer)
+			continue;
 
 		buffer->index_ = index;
 		buffer->cancel();
-		bufferReady.emit(buffer);
+		buffers.push_back(buffer);
+		queuedBuffers_[index] = nullptr;
 	}
 
-	queuedBuffers_.clear();
+	queuedCount_ = 0;
 	fdEvent_->setEnabled(false);
 
+	emitBuffers(buffers);
+
 	streaming_ = false;
 
 	return 0;
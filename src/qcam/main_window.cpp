@@ -8,6 +8,7 @@
 #include <iomanip>
 #include <iostream>
 #include <string>
+#include <string.h>
 
 #include <QCoreApplication>
 #include <QInputDialog>
@@ -131,6 +132,9 @@ int MainWindow::startCapture()
 		}
 	}
 
+	/* The viewfinder only reads the buffers. */
+	cfg.mappingPolicy = MappingReadOnly;
+
 	CameraConfiguration::Status validation = config_->validate();
 	if (validation == CameraConfiguration::Invalid) {
 		std::cerr << "Failed to create valid camera configuration";
@@ -165,9 +169,8 @@ int MainWindow::startCapture()
 		return ret;
 	}
 
-	std::vector<Request *> requests;
 	for (unsigned int i = 0; i < cfg.bufferCount; ++i) {
-		Request *request = camera_->createRequest();
+		std::unique_ptr<Request> request = camera_->createReusableRequest();
 		if (!request) {
 			std::cerr << "Can't create request" << std::endl;
 			ret = -ENOMEM;
@@ -186,7 +189,7 @@ int MainWindow::startCapture()
 			goto error;
 		}
 
-		requests.push_back(request);
+		requests_.push_back(std::move(request));
 	}
 
 	titleTimer_.start(2000);
@@ -201,10 +204,11 @@ int MainWindow::startCapture()
 		goto error;
 	}
 
-	for (Request *request : requests) {
-		ret = camera_->queueRequest(request);
+	for (std::unique_ptr<Request> &request : requests_) {
+		ret = camera_->queueRequest(request.get());
 		if (ret < 0) {
 			std::cerr << "Can't queue request" << std::endl;
+			camera_->stop();
 			goto error;
 		}
 	}
@@ -213,8 +217,7 @@ int MainWindow::startCapture()
 	return 0;
 
 error:
-	for (Request *request : requests)
-		delete request;
+	requests_.clear();
 
 	camera_->freeBuffers();
 	return ret;
@@ -229,6 +232,7 @@ void MainWindow::stopCapture()
 	if (ret)
 		std::cout << "Failed to stop capture" << std::endl;
 
+	requests_.clear();
 	camera_->freeBuffers();
 	isCapturing_ = false;
 
@@ -261,26 +265,14 @@ void MainWindow::requestComplete(Request *request,
 
 	display(buffer);
 
-	request = camera_->createRequest();
-	if (!request) {
-		std::cerr << "Can't create request" << std::endl;
+	/* Requeue the request with the same buffers. */
+	int ret = request->reuse();
+	if (ret) {
+		std::cerr << "Can't reuse request: " << strerror(-ret)
+			  << std::endl;
 		return;
 	}
 
-	for (auto it = buffers.begin(); it != buffers.end(); ++it) {
-		Stream *stream = it->first;
-		Buffer *buffer = it->second;
-		unsigned int index = buffer->index();
-
-		std::unique_ptr<Buffer> newBuffer = stream->createBuffer(index);
-		if (!newBuffer) {
-			std::cerr << "Can't create buffer " << index << std::endl;
-			return;
-		}
-
-		request->addBuffer(std::move(newBuffer));
-	}
-
 	camera_->queueRequest(request);
 }
 
@@ -291,8 +283,14 @@ int MainWindow::display(Buffer *buffer)
 		return -EINVAL;
 
 	Plane &plane = mem->planes().front();
+	int ret = plane.beginCpuAccess(Plane::AccessRead);
+	if (ret < 0)
+		return ret;
+
 	unsigned char *raw = static_cast<unsigned char *>(plane.mem());
 	viewfinder_->display(raw, buffer->bytesused());
 
+	plane.endCpuAccess(Plane::AccessRead);
+
 	return 0;
 }
@@ -9,6 +9,7 @@
 
 #include <map>
 #include <memory>
+#include <vector>
 
 #include <QElapsedTimer>
 #include <QMainWindow>
@@ -60,6 +61,7 @@ private:
 	std::shared_ptr<Camera> camera_;
 	bool isCapturing_;
 	std::unique_ptr<CameraConfiguration> config_;
+	std::vector<std::unique_ptr<Request>> requests_;
 
 	uint64_t lastBufferTime_;
 
@@ -8,7 +8,6 @@
 #include <chrono>
 #include <iostream>
 
-#include <QAbstractEventDispatcher>
 #include <QCoreApplication>
 #include <QSocketNotifier>
 #include <QTimerEvent>
@@ -148,5 +147,15 @@ void QtEventDispatcher::processEvents()
 
 void QtEventDispatcher::interrupt()
 {
-	QCoreApplication::eventDispatcher()->interrupt();
+	/*
+	 * This may be called from any thread, when a message is posted to the
+	 * main thread. Post an event to deliver the message from the Qt event
+	 * loop.
+	 */
+	QCoreApplication::postEvent(this, new QEvent(QEvent::User));
+}
+
+void QtEventDispatcher::customEvent(QEvent *event)
+{
+	dispatchMessages();
 }
@@ -32,6 +32,7 @@ public:
 	void interrupt();
 
 protected:
+	void customEvent(QEvent *event);
 	void timerEvent(QTimerEvent *event);
 
 private:
@@ -0,0 +1,160 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * buffer-allocator.cpp - Device-independent buffer allocator test
+ */
+
+#include <iostream>
+#include <linux/videodev2.h>
+#include <set>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <libcamera/buffer_allocator.h>
+#include <libcamera/stream.h>
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+class BufferAllocatorTest : public Test
+{
+protected:
+	static ino_t inode(const BufferMemory &buffer)
+	{
+		struct stat st;
+		if (fstat(buffer.planes()[0].dmabuf(), &st) < 0)
+			return 0;
+
+		return st.st_ino;
+	}
+
+	int run()
+	{
+		BufferAllocator allocator;
+		std::vector<std::unique_ptr<BufferMemory>> buffers;
+
+		StreamConfiguration cfg;
+		cfg.pixelFormat = V4L2_PIX_FMT_NV12;
+		cfg.size = { 640, 480 };
+		cfg.bufferCount = 4;
+
+		unsigned int size = BufferAllocator::frameSize(cfg);
+		if (size != 640 * 480 * 3 / 2) {
+			cout << "Invalid frame size " << size << endl;
+			return TestFail;
+		}
+
+		/* Allocate buffers and check their size and CPU access. */
+		if (allocator.allocate(cfg, &buffers) || buffers.size() != 4) {
+			cout << "Failed to allocate buffers" << endl;
+			return TestFail;
+		}
+
+		std::set<ino_t> inodes;
+		for (std::unique_ptr<BufferMemory> &buffer : buffers) {
+			if (buffer->planes().size() != 1) {
+				cout << "Invalid number of planes" << endl;
+				return TestFail;
+			}
+
+			Plane &plane = buffer->planes()[0];
+			if (plane.length() < size ||
+			    plane.length() % sysconf(_SC_PAGESIZE)) {
+				cout << "Invalid buffer length " << plane.length()
+				     << endl;
+				return TestFail;
+			}
+
+			if (plane.beginCpuAccess(Plane::AccessWrite)) {
+				cout << "Failed to access buffer memory" << endl;
+				return TestFail;
+			}
+
+			memset(plane.mem(), 0x5a, plane.length());
+			plane.endCpuAccess(Plane::AccessWrite);
+
+			inodes.insert(inode(*buffer));
+		}
+
+		/*
+		 * Describe the chroma plane of the single-allocation NV12
+		 * buffer at an offset that isn't page-aligned, and verify it
+		 * maps to the right memory.
+		 */
+		Plane &luma = buffers[0]->planes()[0];
+		Plane chroma;
+		unsigned int offset = 640 * 480 + 64;
+		if (chroma.setDmabuf(luma.dmabuf(), 4096, offset)) {
+			cout << "Failed to describe chroma plane" << endl;
+			return TestFail;
+		}
+
+		chroma.setStride(640);
+		if (chroma.offset() != offset || chroma.stride() != 640) {
+			cout << "Invalid chroma plane description" << endl;
+			return TestFail;
+		}
+
+		luma.beginCpuAccess(Plane::AccessWrite);
+		static_cast<uint8_t *>(luma.mem())[offset] = 0xa5;
+		luma.endCpuAccess(Plane::AccessWrite);
+
+		if (chroma.beginCpuAccess(Plane::AccessRead) ||
+		    *static_cast<uint8_t *>(chroma.mem()) != 0xa5) {
+			cout << "Chroma plane mapped at wrong offset" << endl;
+			return TestFail;
+		}
+
+		chroma.endCpuAccess(Plane::AccessRead);
+
+		/* Release the buffers and verify they're recycled. */
+		allocator.release(&buffers);
+		if (!buffers.empty() || allocator.pooled() != 4) {
+			cout << "Failed to release buffers to the pool" << endl;
+			return TestFail;
+		}
+
+		if (allocator.allocate(cfg, &buffers) || allocator.pooled() != 0) {
+			cout << "Failed to reuse pooled buffers" << endl;
+			return TestFail;
+		}
+
+		for (std::unique_ptr<BufferMemory> &buffer : buffers) {
+			if (!inodes.count(inode(*buffer))) {
+				cout << "Pooled buffer not reused" << endl;
+				return TestFail;
+			}
+		}
+
+		/* Much larger buffers shall not be served from small ones. */
+		allocator.release(&buffers);
+		std::unique_ptr<BufferMemory> large = allocator.allocate(size * 4);
+		if (!large || large->planes()[0].length() < size * 4 ||
+		    allocator.pooled() != 4) {
+			cout << "Large buffer allocated from the pool" << endl;
+			return TestFail;
+		}
+
+		allocator.purge();
+		if (allocator.pooled() != 0) {
+			cout << "Failed to purge the pool" << endl;
+			return TestFail;
+		}
+
+		/* Unsupported formats shall be rejected. */
+		cfg.pixelFormat = V4L2_PIX_FMT_MJPEG;
+		if (allocator.allocate(cfg, &buffers) != -EINVAL ||
+		    !buffers.empty()) {
+			cout << "Unsupported format not rejected" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(BufferAllocatorTest)
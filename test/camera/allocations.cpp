@@ -0,0 +1,241 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * libcamera Camera API tests
+ *
+ * Count the heap allocations performed by all threads while capturing with
+ * reusable requests, and verify that none occur in steady state, both when the
+ * application keeps up with the camera and when completions accumulate.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <new>
+#include <stdlib.h>
+#include <thread>
+
+#include <libcamera/buffer_allocator.h>
+
+#include "camera_test.h"
+
+using namespace std;
+
+static std::atomic<unsigned long> allocations{ 0 };
+
+void *operator new(size_t size)
+{
+	allocations.fetch_add(1, std::memory_order_relaxed);
+
+	void *ptr = malloc(size ? size : 1);
+	if (!ptr)
+		throw std::bad_alloc();
+
+	return ptr;
+}
+
+void operator delete(void *ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+	free(ptr);
+}
+
+namespace {
+
+class AllocationsTest : public CameraTest
+{
+protected:
+	/* Number of frames captured before measuring allocations. */
+	static constexpr unsigned int kWarmupFrames = 30;
+	/* Number of frames captured while measuring allocations. */
+	static constexpr unsigned int kMeasuredFrames = 60;
+	/* Processing time of a slow application, longer than a frame. */
+	static constexpr std::chrono::milliseconds kSlowProcessing{ 50 };
+
+	bool slow_;
+	unsigned int completeRequestsCount_;
+	unsigned int reuseErrors_;
+	unsigned long warmupAllocations_;
+	unsigned long measuredAllocations_;
+
+	void requestComplete(Request *request, const std::map<Stream *, Buffer *> &buffers)
+	{
+		if (request->status() != Request::RequestComplete)
+			return;
+
+		completeRequestsCount_++;
+
+		if (completeRequestsCount_ == kWarmupFrames)
+			warmupAllocations_ = allocations.load();
+		else if (completeRequestsCount_ == kWarmupFrames + kMeasuredFrames)
+			measuredAllocations_ = allocations.load() - warmupAllocations_;
+
+		/*
+		 * Stop requeuing when done, completions may otherwise never
+		 * stop being delivered to a slow application.
+		 */
+		if (completeRequestsCount_ >= kWarmupFrames + kMeasuredFrames)
+			return;
+
+		/*
+		 * Stall the application thread to make completions accumulate
+		 * while they're being delivered.
+		 */
+		if (slow_)
+			std::this_thread::sleep_for(kSlowProcessing);
+
+		if (request->reuse() || camera_->queueRequest(request))
+			reuseErrors_++;
+	}
+
+	int init() override
+	{
+		int ret = CameraTest::init();
+		if (ret)
+			return ret;
+
+		config_ = camera_->generateConfiguration({ StreamRole::VideoRecording });
+		if (!config_ || config_->size() != 1) {
+			cout << "Failed to generate default configuration" << endl;
+			CameraTest::cleanup();
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int capture(bool slow)
+	{
+		StreamConfiguration &cfg = config_->at(0);
+
+		/*
+		 * Capture to dmabufs from the buffer allocator when available,
+		 * to exercise the external buffer mapping.
+		 */
+		std::vector<std::unique_ptr<BufferMemory>> memory;
+		if (allocator_.backend() != BufferAllocator::Memfd) {
+			if (allocator_.allocate(cfg, &memory)) {
+				cout << "Failed to allocate buffers" << endl;
+				return TestFail;
+			}
+
+			cfg.memoryType = ExternalMemory;
+		}
+
+		if (camera_->configure(config_.get()) ||
+		    camera_->allocateBuffers()) {
+			cout << "Failed to configure camera" << endl;
+			return TestFail;
+		}
+
+		Stream *stream = cfg.stream();
+		unsigned int count = cfg.memoryType == ExternalMemory
+				   ? memory.size() : cfg.bufferCount;
+		std::vector<std::unique_ptr<Request>> requests;
+		for (unsigned int i = 0; i < count; ++i) {
+			std::unique_ptr<Request> request = camera_->createReusableRequest();
+			std::unique_ptr<Buffer> buffer;
+
+			if (cfg.memoryType == ExternalMemory) {
+				int dmabuf = memory[i]->planes()[0].dmabuf();
+				buffer = stream->createBuffer({ dmabuf, -1, -1 });
+			} else {
+				buffer = stream->createBuffer(i);
+			}
+
+			if (!request || !buffer || request->addBuffer(std::move(buffer))) {
+				cout << "Failed to create request " << i << endl;
+				return TestFail;
+			}
+
+			requests.push_back(std::move(request));
+		}
+
+		completeRequestsCount_ = 0;
+		reuseErrors_ = 0;
+		measuredAllocations_ = 0;
+		slow_ = slow;
+
+		if (camera_->start()) {
+			cout << "Failed to start camera" << endl;
+			return TestFail;
+		}
+
+		for (std::unique_ptr<Request> &request : requests) {
+			if (camera_->queueRequest(request.get())) {
+				cout << "Failed to queue request" << endl;
+				return TestFail;
+			}
+		}
+
+		EventDispatcher *dispatcher = cm_->eventDispatcher();
+
+		Timer timer;
+		timer.start(slow ? 20000 : 10000);
+		while (timer.isRunning() &&
+		       completeRequestsCount_ < kWarmupFrames + kMeasuredFrames)
+			dispatcher->processEvents();
+
+		if (camera_->stop() || camera_->freeBuffers()) {
+			cout << "Failed to stop camera" << endl;
+			return TestFail;
+		}
+
+		if (completeRequestsCount_ < kWarmupFrames + kMeasuredFrames) {
+			cout << "Failed to capture enough frames (got "
+			     << completeRequestsCount_ << ")" << endl;
+			return TestFail;
+		}
+
+		if (reuseErrors_) {
+			cout << "Failed to requeue " << reuseErrors_ << " requests"
+			     << endl;
+			return TestFail;
+		}
+
+		if (slow && camera_->maxCompletionBacklog() < 2) {
+			cout << "Completions didn't accumulate" << endl;
+			return TestFail;
+		}
+
+		if (measuredAllocations_) {
+			cout << measuredAllocations_ << " allocations in "
+			     << kMeasuredFrames << " frames"
+			     << (slow ? " with a slow application" : "") << endl;
+			return TestFail;
+		}
+
+		requests.clear();
+		allocator_.release(&memory);
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		if (camera_->acquire()) {
+			cout << "Failed to acquire the camera" << endl;
+			return TestFail;
+		}
+
+		camera_->requestCompleted.connect(this, &AllocationsTest::requestComplete);
+
+		int ret = capture(false);
+		if (ret != TestPass)
+			return ret;
+
+		return capture(true);
+	}
+
+	std::unique_ptr<CameraConfiguration> config_;
+	BufferAllocator allocator_;
+};
+
+} /* namespace */
+
+TEST_REGISTER(AllocationsTest);
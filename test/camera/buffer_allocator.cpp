@@ -0,0 +1,165 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * libcamera Camera API tests
+ *
+ * Test capturing to buffers allocated by the BufferAllocator before the camera
+ * is configured, and recycling them across configurations
+ */
+
+#include <iostream>
+#include <vector>
+
+#include "camera_test.h"
+
+using namespace std;
+
+namespace {
+
+class BufferAllocatorTest : public CameraTest
+{
+protected:
+	unsigned int completeRequestsCount_;
+	unsigned int requeueErrors_;
+
+	void requestComplete(Request *request, const std::map<Stream *, Buffer *> &buffers)
+	{
+		if (request->status() != Request::RequestComplete)
+			return;
+
+		completeRequestsCount_++;
+
+		if (request->reuse() || camera_->queueRequest(request))
+			requeueErrors_++;
+	}
+
+	int init() override
+	{
+		int ret = CameraTest::init();
+		if (ret)
+			return ret;
+
+		if (allocator_.backend() == BufferAllocator::Memfd) {
+			cout << "No dmabuf allocation backend available" << endl;
+			CameraTest::cleanup();
+			return TestSkip;
+		}
+
+		if (camera_->acquire()) {
+			cout << "Failed to acquire the camera" << endl;
+			CameraTest::cleanup();
+			return TestFail;
+		}
+
+		camera_->requestCompleted.connect(this, &BufferAllocatorTest::requestComplete);
+
+		return TestPass;
+	}
+
+	int capture()
+	{
+		std::unique_ptr<CameraConfiguration> config =
+			camera_->generateConfiguration({ StreamRole::VideoRecording });
+		if (!config || config->size() != 1) {
+			cout << "Failed to generate configuration" << endl;
+			return TestFail;
+		}
+
+		/* Allocate the buffers before configuring the camera. */
+		StreamConfiguration &cfg = config->at(0);
+		std::vector<std::unique_ptr<BufferMemory>> buffers;
+		if (allocator_.allocate(cfg, &buffers)) {
+			cout << "Failed to allocate buffers" << endl;
+			return TestFail;
+		}
+
+		cfg.memoryType = ExternalMemory;
+		if (camera_->configure(config.get()) ||
+		    camera_->allocateBuffers()) {
+			cout << "Failed to configure camera" << endl;
+			return TestFail;
+		}
+
+		Stream *stream = cfg.stream();
+		std::vector<std::unique_ptr<Request>> requests;
+		for (std::unique_ptr<BufferMemory> &mem : buffers) {
+			int dmabuf = mem->planes()[0].dmabuf();
+			std::unique_ptr<Request> request = camera_->createReusableRequest();
+			request->addBuffer(stream->createBuffer({ dmabuf, -1, -1 }));
+			requests.push_back(std::move(request));
+		}
+
+		completeRequestsCount_ = 0;
+		requeueErrors_ = 0;
+
+		if (camera_->start()) {
+			cout << "Failed to start camera" << endl;
+			return TestFail;
+		}
+
+		for (std::unique_ptr<Request> &request : requests) {
+			if (camera_->queueRequest(request.get())) {
+				cout << "Failed to queue request" << endl;
+				return TestFail;
+			}
+		}
+
+		EventDispatcher *dispatcher = cm_->eventDispatcher();
+
+		Timer timer;
+		timer.start(1000);
+		while (timer.isRunning())
+			dispatcher->processEvents();
+
+		if (camera_->stop() || camera_->freeBuffers()) {
+			cout << "Failed to stop camera" << endl;
+			return TestFail;
+		}
+
+		if (completeRequestsCount_ <= buffers.size() * 2) {
+			cout << "Failed to capture enough frames (got "
+			     << completeRequestsCount_ << ")" << endl;
+			return TestFail;
+		}
+
+		if (requeueErrors_) {
+			cout << "Failed to requeue requests" << endl;
+			return TestFail;
+		}
+
+		requests.clear();
+		allocator_.release(&buffers);
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		if (capture() != TestPass)
+			return TestFail;
+
+		unsigned int pooled = allocator_.pooled();
+		if (!pooled) {
+			cout << "Buffers not returned to the pool" << endl;
+			return TestFail;
+		}
+
+		/* The second capture shall recycle the pooled buffers. */
+		if (capture() != TestPass)
+			return TestFail;
+
+		if (allocator_.pooled() != pooled) {
+			cout << "Pooled buffers not recycled" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	BufferAllocator allocator_;
+};
+
+} /* namespace */
+
+TEST_REGISTER(BufferAllocatorTest);
@@ -406,6 +406,15 @@ protected:
 			return TestFail;
 		}
 
+		const Stream::CacheStats &stats = stream_->cacheStats();
+		std::cout << stats.hits << " buffer mapping cache hits, "
+			  << stats.misses << " misses" << std::endl;
+
+		if (!stats.hits) {
+			std::cout << "No buffer mapping cache hit" << std::endl;
+			return TestFail;
+		}
+
 		return TestPass;
 	}
 
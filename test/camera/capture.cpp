@@ -18,6 +18,8 @@ class Capture : public CameraTest
 protected:
 	unsigned int completeBuffersCount_;
 	unsigned int completeRequestsCount_;
+	unsigned int cpuAccessErrors_;
+	unsigned int requeueErrors_;
 
 	void bufferComplete(Request *request, Buffer *buffer)
 	{
@@ -34,14 +36,17 @@ protected:
 
 		completeRequestsCount_++;
 
-		/* Create a new request. */
-		Stream *stream = buffers.begin()->first;
+		/* Buffers are mapped read-only, writing shall be rejected. */
 		Buffer *buffer = buffers.begin()->second;
-		std::unique_ptr<Buffer> newBuffer = stream->createBuffer(buffer->index());
-
-		request = camera_->createRequest();
-		request->addBuffer(std::move(newBuffer));
-		camera_->queueRequest(request);
+		if (buffer->beginCpuAccess(Plane::AccessRead) ||
+		    !buffer->mem()->planes()[0].mem() ||
+		    buffer->endCpuAccess(Plane::AccessRead) ||
+		    buffer->beginCpuAccess(Plane::AccessWrite) != -EACCES)
+			cpuAccessErrors_++;
+
+		/* Requeue the request with the same buffers. */
+		if (request->reuse() || camera_->queueRequest(request))
+			requeueErrors_++;
 	}
 
 	int init() override
@@ -63,6 +68,7 @@ protected:
 	int run() override
 	{
 		StreamConfiguration &cfg = config_->at(0);
+		cfg.mappingPolicy = MappingReadOnly;
 
 		if (camera_->acquire()) {
 			cout << "Failed to acquire the camera" << endl;
@@ -80,9 +86,9 @@ protected:
 		}
 
 		Stream *stream = cfg.stream();
-		std::vector<Request *> requests;
+		std::vector<std::unique_ptr<Request>> requests;
 		for (unsigned int i = 0; i < cfg.bufferCount; ++i) {
-			Request *request = camera_->createRequest();
+			std::unique_ptr<Request> request = camera_->createReusableRequest();
 			if (!request) {
 				cout << "Failed to create request" << endl;
 				return TestFail;
@@ -99,11 +105,13 @@ protected:
 				return TestFail;
 			}
 
-			requests.push_back(request);
+			requests.push_back(std::move(request));
 		}
 
 		completeRequestsCount_ = 0;
 		completeBuffersCount_ = 0;
+		cpuAccessErrors_ = 0;
+		requeueErrors_ = 0;
 
 		camera_->bufferCompleted.connect(this, &Capture::bufferComplete);
 		camera_->requestCompleted.connect(this, &Capture::requestComplete);
@@ -113,8 +121,8 @@ protected:
 			return TestFail;
 		}
 
-		for (Request *request : requests) {
-			if (camera_->queueRequest(request)) {
+		for (std::unique_ptr<Request> &request : requests) {
+			if (camera_->queueRequest(request.get())) {
 				cout << "Failed to queue request" << endl;
 				return TestFail;
 			}
@@ -139,11 +147,26 @@ protected:
 			return TestFail;
 		}
 
+		if (cpuAccessErrors_) {
+			cout << "CPU access to buffers failed" << endl;
+			return TestFail;
+		}
+
+		if (requeueErrors_) {
+			cout << "Failed to requeue requests" << endl;
+			return TestFail;
+		}
+
 		if (camera_->stop()) {
 			cout << "Failed to stop camera" << endl;
 			return TestFail;
 		}
 
+		if (camera_->completionBacklog()) {
+			cout << "Completed requests not delivered after stop" << endl;
+			return TestFail;
+		}
+
 		if (camera_->freeBuffers()) {
 			cout << "Failed to free buffers" << endl;
 			return TestFail;
@@ -0,0 +1,194 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * libcamera Camera API tests
+ *
+ * Test that requests with acquire fences are held back until the fences
+ * signal, and that unsignalled fences are returned when the camera is stopped
+ */
+
+#include <iostream>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <vector>
+
+#include "camera_test.h"
+
+using namespace std;
+
+namespace {
+
+class FencesTest : public CameraTest
+{
+protected:
+	std::vector<Request *> completed_;
+	std::vector<int> releaseFences_;
+
+	void requestComplete(Request *request, const std::map<Stream *, Buffer *> &buffers)
+	{
+		completed_.push_back(request);
+		releaseFences_.push_back(buffers.begin()->second->releaseFence());
+	}
+
+	void processEvents(unsigned int msecs)
+	{
+		EventDispatcher *dispatcher = cm_->eventDispatcher();
+
+		Timer timer;
+		timer.start(msecs);
+		while (timer.isRunning())
+			dispatcher->processEvents();
+	}
+
+	int init() override
+	{
+		int ret = CameraTest::init();
+		if (ret)
+			return ret;
+
+		config_ = camera_->generateConfiguration({ StreamRole::VideoRecording });
+		if (!config_ || config_->size() != 1) {
+			cout << "Failed to generate default configuration" << endl;
+			CameraTest::cleanup();
+			return TestFail;
+		}
+
+		fence_ = eventfd(0, EFD_CLOEXEC);
+		if (fence_ < 0) {
+			cout << "Failed to create fence" << endl;
+			CameraTest::cleanup();
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	void cleanup() override
+	{
+		close(fence_);
+		CameraTest::cleanup();
+	}
+
+	int run() override
+	{
+		StreamConfiguration &cfg = config_->at(0);
+
+		if (camera_->acquire() || camera_->configure(config_.get()) ||
+		    camera_->allocateBuffers()) {
+			cout << "Failed to configure camera" << endl;
+			return TestFail;
+		}
+
+		if (cfg.bufferCount < 3) {
+			cout << "Not enough buffers" << endl;
+			return TestFail;
+		}
+
+		Stream *stream = cfg.stream();
+		std::vector<std::unique_ptr<Request>> requests;
+		for (unsigned int i = 0; i < 3; ++i) {
+			std::unique_ptr<Request> request = camera_->createReusableRequest(i);
+			request->addBuffer(stream->createBuffer(i));
+			requests.push_back(std::move(request));
+		}
+
+		camera_->requestCompleted.connect(this, &FencesTest::requestComplete);
+
+		if (camera_->start()) {
+			cout << "Failed to start camera" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * Queue a request with an unsignalled acquire fence, followed
+		 * by a request without fence. Both shall be held back.
+		 */
+		Buffer *buffer = requests[0]->findBuffer(stream);
+		buffer->setAcquireFence(dup(fence_));
+
+		if (camera_->queueRequest(requests[0].get()) ||
+		    camera_->queueRequest(requests[1].get())) {
+			cout << "Failed to queue requests" << endl;
+			return TestFail;
+		}
+
+		processEvents(200);
+
+		if (!completed_.empty()) {
+			cout << "Request completed before its fence signalled" << endl;
+			return TestFail;
+		}
+
+		/* Signal the fence, both requests shall complete in order. */
+		uint64_t value = 1;
+		if (write(fence_, &value, sizeof(value)) != sizeof(value)) {
+			cout << "Failed to signal fence" << endl;
+			return TestFail;
+		}
+
+		processEvents(1000);
+
+		if (completed_.size() != 2 ||
+		    completed_[0] != requests[0].get() ||
+		    completed_[1] != requests[1].get()) {
+			cout << "Fenced requests not completed in order" << endl;
+			return TestFail;
+		}
+
+		if (requests[0]->status() != Request::RequestComplete ||
+		    buffer->acquireFence() != -1 || releaseFences_[0] != -1) {
+			cout << "Invalid fenced request completion" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * Queue a request with a fence that never signals and stop the
+		 * camera. The request shall be cancelled and its acquire fence
+		 * returned as the release fence.
+		 */
+		if (read(fence_, &value, sizeof(value)) != sizeof(value)) {
+			cout << "Failed to reset fence" << endl;
+			return TestFail;
+		}
+
+		buffer = requests[2]->findBuffer(stream);
+		buffer->setAcquireFence(dup(fence_));
+
+		if (camera_->queueRequest(requests[2].get())) {
+			cout << "Failed to queue request" << endl;
+			return TestFail;
+		}
+
+		if (camera_->stop()) {
+			cout << "Failed to stop camera" << endl;
+			return TestFail;
+		}
+
+		if (completed_.size() != 3 || completed_[2] != requests[2].get() ||
+		    requests[2]->status() != Request::RequestCancelled) {
+			cout << "Fenced request not cancelled on stop" << endl;
+			return TestFail;
+		}
+
+		if (releaseFences_[2] == -1 || buffer->acquireFence() != -1) {
+			cout << "Acquire fence not returned as release fence" << endl;
+			return TestFail;
+		}
+
+		if (camera_->freeBuffers()) {
+			cout << "Failed to free buffers" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	std::unique_ptr<CameraConfiguration> config_;
+	int fence_;
+};
+
+} /* namespace */
+
+TEST_REGISTER(FencesTest);
@@ -0,0 +1,136 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * device-cache.cpp - Device cache tests
+ */
+
+#include <fcntl.h>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "device_cache.h"
+#include "formats.h"
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+class DeviceCacheTest : public Test
+{
+protected:
+	int init()
+	{
+		char path[] = "/tmp/libcamera.device-cache.XXXXXX";
+		if (!mkdtemp(path)) {
+			cerr << "Failed to create cache directory" << endl;
+			return TestFail;
+		}
+
+		path_ = path;
+
+		/* The cache is configured when first accessed. */
+		setenv("LIBCAMERA_DEVICE_CACHE", path_.c_str(), 1);
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		DeviceCache *cache = DeviceCache::instance();
+		if (!cache->enabled()) {
+			cerr << "Device cache not enabled" << endl;
+			return TestFail;
+		}
+
+		/* Test device tags. */
+		int fd = open("/dev/null", O_RDWR);
+		string tag = cache->deviceTag(fd);
+		bool stable = tag == cache->deviceTag(fd);
+		close(fd);
+
+		if (tag.empty() || !stable) {
+			cerr << "Invalid device tag '" << tag << "'" << endl;
+			return TestFail;
+		}
+
+		/* Test storing and loading an entry. */
+		ImageFormats formats;
+		formats.addFormat(0x12345678, { SizeRange(64, 48, 1920, 1080, 2, 2) });
+		formats.addFormat(0x87654321, { SizeRange(640, 480), SizeRange(1280, 720) });
+		vector<uint16_t> values = { 1, 2, 3 };
+
+		DeviceCacheData data;
+		data.append<uint32_t>(42);
+		data.append(values);
+		data.append(string("libcamera"));
+		data.append(formats);
+		cache->store("/dev/test:entry", tag, data);
+
+		DeviceCacheData loaded;
+		if (!cache->load("/dev/test:entry", tag, &loaded)) {
+			cerr << "Failed to load entry" << endl;
+			return TestFail;
+		}
+
+		uint32_t number;
+		vector<uint16_t> loadedValues;
+		string str;
+		ImageFormats loadedFormats;
+
+		if (!loaded.extract(&number) || number != 42 ||
+		    !loaded.extract(&loadedValues) || loadedValues != values ||
+		    !loaded.extract(&str) || str != "libcamera" ||
+		    !loaded.extract(&loadedFormats)) {
+			cerr << "Invalid entry data" << endl;
+			return TestFail;
+		}
+
+		if (loadedFormats.data().size() != 2 ||
+		    loadedFormats.sizes(0x12345678)[0].toString() !=
+		    formats.sizes(0x12345678)[0].toString() ||
+		    loadedFormats.sizes(0x87654321).size() != 2) {
+			cerr << "Invalid image formats" << endl;
+			return TestFail;
+		}
+
+		if (loaded.extract(&number)) {
+			cerr << "Extracted data past the end of the entry" << endl;
+			return TestFail;
+		}
+
+		/* Test that a tag mismatch invalidates the entry. */
+		if (cache->load("/dev/test:entry", tag + " changed", &loaded)) {
+			cerr << "Entry loaded with mismatching tag" << endl;
+			return TestFail;
+		}
+
+		if (cache->load("/dev/test:entry", tag, &loaded)) {
+			cerr << "Entry not invalidated" << endl;
+			return TestFail;
+		}
+
+		/* Test that missing entries and empty tags are not loaded. */
+		cache->store("/dev/test:untagged", "", data);
+		if (cache->load("/dev/test:missing", tag, &loaded) ||
+		    cache->load("/dev/test:untagged", "", &loaded)) {
+			cerr << "Invalid entry loaded" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	void cleanup()
+	{
+		unlink((path_ + "/_dev_test_entry").c_str());
+		rmdir(path_.c_str());
+	}
+
+private:
+	string path_;
+};
+
+TEST_REGISTER(DeviceCacheTest)
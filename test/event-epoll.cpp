@@ -0,0 +1,183 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * event-epoll.cpp - Epoll-based event dispatcher test
+ */
+
+#include <iostream>
+#include <string.h>
+#include <unistd.h>
+
+#include <libcamera/event_notifier.h>
+#include <libcamera/timer.h>
+
+#include "event_dispatcher_epoll.h"
+#include "test.h"
+#include "thread.h"
+#include "utils.h"
+
+using namespace std;
+using namespace libcamera;
+
+static constexpr unsigned int kNumPipes = 8;
+
+class EventEpollTest : public Test
+{
+protected:
+	void readReady(EventNotifier *notifier)
+	{
+		char data[16];
+
+		if (read(notifier->fd(), data, sizeof(data)) > 0)
+			notified_++;
+
+		/* Disable the next notifier from within the event handler. */
+		if (disableNext_) {
+			for (unsigned int i = 0; i < kNumPipes; ++i) {
+				if (notifiers_[i].get() != notifier)
+					continue;
+
+				notifiers_[(i + 1) % kNumPipes]->setEnabled(false);
+				break;
+			}
+		}
+	}
+
+	int writeAll()
+	{
+		for (unsigned int i = 0; i < kNumPipes; ++i) {
+			if (write(pipefd_[i][1], "H2G2", 4) < 0) {
+				cout << "Pipe write failed" << endl;
+				return TestFail;
+			}
+		}
+
+		return TestPass;
+	}
+
+	int init()
+	{
+		std::unique_ptr<EventDispatcherEpoll> dispatcher =
+			utils::make_unique<EventDispatcherEpoll>();
+		if (!dispatcher->isValid()) {
+			cout << "Failed to create epoll event dispatcher" << endl;
+			return TestFail;
+		}
+
+		dispatcher_ = dispatcher.get();
+		Thread::current()->setEventDispatcher(std::move(dispatcher));
+		if (Thread::current()->eventDispatcher() != dispatcher_) {
+			cout << "Failed to install epoll event dispatcher" << endl;
+			return TestSkip;
+		}
+
+		for (unsigned int i = 0; i < kNumPipes; ++i) {
+			if (pipe(pipefd_[i]))
+				return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		Timer timeout;
+
+		for (unsigned int i = 0; i < kNumPipes; ++i) {
+			notifiers_[i] = utils::make_unique<EventNotifier>(pipefd_[i][0],
+									  EventNotifier::Read);
+			notifiers_[i]->activated.connect(this, &EventEpollTest::readReady);
+		}
+
+		/* Test notification on all file descriptors in a single pass. */
+		notified_ = 0;
+		disableNext_ = false;
+
+		if (writeAll() != TestPass)
+			return TestFail;
+
+		timeout.start(100);
+		dispatcher_->processEvents();
+		timeout.stop();
+
+		if (notified_ != kNumPipes) {
+			cout << "Multiple notifiers test failed" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * Test disabling notifiers from within an event handler. Only
+		 * half of the notifiers are expected to be notified, as every
+		 * notified handler disables the next one.
+		 */
+		notified_ = 0;
+		disableNext_ = true;
+
+		if (writeAll() != TestPass)
+			return TestFail;
+
+		timeout.start(100);
+		dispatcher_->processEvents();
+		timeout.stop();
+
+		if (notified_ == 0 || notified_ == kNumPipes) {
+			cout << "Notifier disabling from handler test failed" << endl;
+			return TestFail;
+		}
+
+		/* Test re-enabling the notifiers with data pending. */
+		disableNext_ = false;
+
+		for (unsigned int i = 0; i < kNumPipes; ++i)
+			notifiers_[i]->setEnabled(true);
+
+		timeout.start(100);
+		dispatcher_->processEvents();
+		timeout.stop();
+
+		if (notified_ != kNumPipes) {
+			cout << "Notifier re-enabling test failed" << endl;
+			return TestFail;
+		}
+
+		/* Test that no notification is emitted without data. */
+		notified_ = 0;
+
+		timeout.start(100);
+		dispatcher_->processEvents();
+		timeout.stop();
+
+		if (notified_) {
+			cout << "Spurious notification test failed" << endl;
+			return TestFail;
+		}
+
+		if (timeout.isRunning()) {
+			cout << "Timer expiration test failed" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	void cleanup()
+	{
+		for (unsigned int i = 0; i < kNumPipes; ++i) {
+			notifiers_[i].reset();
+			close(pipefd_[i][0]);
+			close(pipefd_[i][1]);
+		}
+	}
+
+private:
+	EventDispatcherEpoll *dispatcher_;
+
+	int pipefd_[kNumPipes][2];
+	std::unique_ptr<EventNotifier> notifiers_[kNumPipes];
+
+	unsigned int notified_;
+	bool disableNext_;
+};
+
+TEST_REGISTER(EventEpollTest)
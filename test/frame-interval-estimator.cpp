@@ -0,0 +1,226 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * frame-interval-estimator.cpp - Frame interval estimator tests
+ */
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "frame_interval_estimator.h"
+#include "test.h"
+#include "utils.h"
+
+using namespace std;
+using namespace libcamera;
+
+static constexpr unsigned int kHistoryDepth = 10;
+static constexpr unsigned int kNumFrames = 200;
+
+class FrameIntervalEstimatorTest : public Test
+{
+protected:
+	static double toMicroseconds(utils::duration value)
+	{
+		return chrono::duration_cast<chrono::nanoseconds>(value).count() / 1000.0;
+	}
+
+	/* Return the ideal time of a frame. */
+	utils::time_point frameTime(unsigned int frame)
+	{
+		return base_ + frame * interval_;
+	}
+
+	/* Return the time of a frame with a uniform jitter of +/- 2ms. */
+	utils::time_point jitteredTime(unsigned int frame)
+	{
+		return frameTime(frame) + chrono::microseconds(jitter_(random_));
+	}
+
+	int init()
+	{
+		base_ = utils::time_point() + chrono::seconds(1000);
+		interval_ = chrono::nanoseconds(33333333);
+		random_.seed(42);
+		jitter_ = uniform_int_distribution<int>(-2000, 2000);
+
+		return TestPass;
+	}
+
+	int testJitter()
+	{
+		FrameIntervalEstimator estimator(kHistoryDepth);
+		double filteredError = 0.0;
+		double naiveError = 0.0;
+		unsigned int count = 0;
+
+		vector<utils::time_point> times;
+
+		for (unsigned int frame = 0; frame < kNumFrames; ++frame) {
+			times.push_back(jitteredTime(frame));
+			estimator.addSample(frame, times.back());
+
+			if (!estimator.valid())
+				continue;
+
+			/*
+			 * Compare the prediction of the next frame time with
+			 * an extrapolation from the last sample using the mean
+			 * interval over the history.
+			 */
+			unsigned int first = frame >= kHistoryDepth - 1
+					   ? frame - kHistoryDepth + 1 : 0;
+			utils::duration mean = (times[frame] - times[first])
+					     / (frame - first);
+			utils::time_point next = frameTime(frame + 1);
+			utils::time_point naive = times[frame] + mean;
+
+			filteredError += abs(toMicroseconds(estimator.estimate(frame + 1) - next));
+			naiveError += abs(toMicroseconds(naive - next));
+			count++;
+
+			double intervalError = toMicroseconds(estimator.interval() - interval_);
+			if (abs(intervalError) > 1000.0) {
+				cerr << "Frame " << frame << ": interval error "
+				     << intervalError << "us" << endl;
+				return TestFail;
+			}
+		}
+
+		if (count != kNumFrames - kHistoryDepth / 2) {
+			cerr << "Estimate valid for " << count << " frames" << endl;
+			return TestFail;
+		}
+
+		filteredError /= count;
+		naiveError /= count;
+
+		cout << "Mean prediction error: " << filteredError
+		     << "us filtered, " << naiveError << "us naive" << endl;
+
+		if (filteredError > 1000.0 || filteredError >= naiveError) {
+			cerr << "Prediction not improved by filtering" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int testDroppedFrames()
+	{
+		FrameIntervalEstimator estimator(kHistoryDepth);
+
+		/* Drop one frame out of three. */
+		for (unsigned int frame = 0; frame < 60; ++frame) {
+			if (frame % 3 == 1)
+				continue;
+
+			estimator.addSample(frame, jitteredTime(frame));
+		}
+
+		double intervalError = toMicroseconds(estimator.interval() - interval_);
+		double error = toMicroseconds(estimator.estimate(60) - frameTime(60));
+
+		if (!estimator.valid() || abs(intervalError) > 1000.0 ||
+		    abs(error) > 2000.0) {
+			cerr << "Invalid estimate with dropped frames: interval error "
+			     << intervalError << "us, prediction error " << error
+			     << "us" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int testOutlier()
+	{
+		FrameIntervalEstimator estimator(kHistoryDepth);
+
+		/* Report the last frame 15ms late. */
+		for (unsigned int frame = 0; frame < 30; ++frame) {
+			utils::time_point time = frameTime(frame);
+			if (frame == 29)
+				time += chrono::milliseconds(15);
+
+			estimator.addSample(frame, time);
+		}
+
+		double intervalError = toMicroseconds(estimator.interval() - interval_);
+		double error = toMicroseconds(estimator.estimate(30) - frameTime(30));
+
+		if (abs(intervalError) > 100.0 || abs(error) > 100.0) {
+			cerr << "Outlier not rejected: interval error "
+			     << intervalError << "us, prediction error " << error
+			     << "us" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int testRestart()
+	{
+		FrameIntervalEstimator estimator(kHistoryDepth);
+
+		for (unsigned int frame = 0; frame < 30; ++frame)
+			estimator.addSample(frame, frameTime(frame));
+
+		/*
+		 * Restart the sequence. The history shall be cleared, and the
+		 * estimate extrapolated from the new sample using the previous
+		 * interval.
+		 */
+		utils::time_point restart = frameTime(100);
+		estimator.addSample(0, restart);
+
+		if (estimator.empty() || estimator.valid()) {
+			cerr << "History not cleared on sequence restart" << endl;
+			return TestFail;
+		}
+
+		double error = toMicroseconds(estimator.estimate(2) - (restart + 2 * interval_));
+		if (abs(error) > 1.0) {
+			cerr << "Invalid estimate after restart: error " << error
+			     << "us" << endl;
+			return TestFail;
+		}
+
+		estimator.reset();
+		if (!estimator.empty()) {
+			cerr << "History not cleared on reset" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		if (testJitter() != TestPass)
+			return TestFail;
+
+		if (testDroppedFrames() != TestPass)
+			return TestFail;
+
+		if (testOutlier() != TestPass)
+			return TestFail;
+
+		if (testRestart() != TestPass)
+			return TestFail;
+
+		return TestPass;
+	}
+
+private:
+	utils::time_point base_;
+	utils::duration interval_;
+
+	minstd_rand random_;
+	uniform_int_distribution<int> jitter_;
+};
+
+TEST_REGISTER(FrameIntervalEstimatorTest)
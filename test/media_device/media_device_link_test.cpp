@@ -5,7 +5,9 @@
  * media_device_link_test.cpp - Tests link handling on VIMC media device
  */
 
+#include <errno.h>
 #include <iostream>
+#include <vector>
 
 #include "media_device_test.h"
 
@@ -210,6 +212,86 @@ class MediaDeviceLinkTest : public MediaDeviceTest
 			return TestFail;
 		}
 
+		/*
+		 * Switch the scaler input from 'Debayer B' to 'Debayer A' with
+		 * a transaction, and verify the link states.
+		 */
+		MediaLink *debayerA = media_->link("Debayer A", 1, "Scaler", 0);
+		MediaLink *debayerB = link;
+
+		MediaLinkTransaction transaction(media_.get());
+		transaction.disableAll();
+		transaction.setEnabled(debayerB, true);
+		if (transaction.commit()) {
+			cerr << "Failed to commit link transaction" << endl;
+			return TestFail;
+		}
+
+		transaction.disableAll();
+		transaction.setEnabled(debayerA, true);
+		if (transaction.commit()) {
+			cerr << "Failed to commit link transaction" << endl;
+			return TestFail;
+		}
+
+		if (!(debayerA->flags() & MEDIA_LNK_FL_ENABLED) ||
+		    debayerB->flags() & MEDIA_LNK_FL_ENABLED) {
+			cerr << "Link transaction applied wrong link states"
+			     << endl;
+			return TestFail;
+		}
+
+		/*
+		 * Changing an immutable link shall fail without modifying any
+		 * other link.
+		 */
+		transaction.setEnabled(debayerA, false);
+		transaction.setEnabled(media_->link("Sensor A", 0, "Raw Capture 0", 0),
+				       false);
+		if (transaction.commit() != -EINVAL) {
+			cerr << "Link transaction changed an immutable link"
+			     << endl;
+			return TestFail;
+		}
+
+		if (!(debayerA->flags() & MEDIA_LNK_FL_ENABLED)) {
+			cerr << "Failed link transaction modified the graph"
+			     << endl;
+			return TestFail;
+		}
+
+		/*
+		 * Find the route from the sensor to the processed capture
+		 * video node, and verify it goes through the debayer and
+		 * scaler in order.
+		 */
+		MediaEntity *sensor = media_->getEntityByName("Sensor A");
+		MediaEntity *capture = media_->getEntityByName("RGB/YUV Capture");
+		if (!sensor || !capture) {
+			cerr << "Unable to find route end entities" << endl;
+			return TestFail;
+		}
+
+		std::vector<MediaLink *> route = media_->route(sensor, capture);
+		std::vector<MediaLink *> expected = {
+			media_->link("Sensor A", 0, "Debayer A", 0),
+			media_->link("Debayer A", 1, "Scaler", 0),
+			media_->link("Scaler", 1, "RGB/YUV Capture", 0),
+		};
+
+		if (route != expected) {
+			cerr << "Invalid route from 'Sensor A' to 'RGB/YUV Capture'"
+			     << endl;
+			return TestFail;
+		}
+
+		/* Routes shall not follow links backwards. */
+		if (!media_->route(capture, sensor).empty()) {
+			cerr << "Route found from 'RGB/YUV Capture' to 'Sensor A'"
+			     << endl;
+			return TestFail;
+		}
+
 		return 0;
 	}
 
@@ -0,0 +1,170 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * message-allocator.cpp - Message allocator recycling test
+ */
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include <libcamera/object.h>
+
+#include "message_allocator.h"
+#include "test.h"
+#include "thread.h"
+
+using namespace std;
+using namespace libcamera;
+
+static constexpr unsigned int kNumRounds = 100;
+static constexpr unsigned int kWarmupRounds = 10;
+static constexpr unsigned int kCallsPerRound = 32;
+
+class InvokeCounter : public Object
+{
+public:
+	InvokeCounter()
+		: count_(0), sum_(0)
+	{
+	}
+
+	void add(unsigned int value)
+	{
+		sum_ += value;
+		count_.fetch_add(1, std::memory_order_release);
+	}
+
+	void addLarge(std::array<unsigned int, 256> values)
+	{
+		for (unsigned int value : values)
+			sum_ += value;
+		count_.fetch_add(1, std::memory_order_release);
+	}
+
+	unsigned int count() const { return count_.load(std::memory_order_acquire); }
+	unsigned long sum() const { return sum_; }
+
+private:
+	std::atomic<unsigned int> count_;
+	unsigned long sum_;
+};
+
+class MessageAllocatorTest : public Test
+{
+protected:
+	int init()
+	{
+		thread_.start();
+		return TestPass;
+	}
+
+	bool waitForCount(InvokeCounter &counter, unsigned int count)
+	{
+		chrono::steady_clock::time_point timeout =
+			chrono::steady_clock::now() + chrono::seconds(5);
+
+		while (counter.count() < count) {
+			if (chrono::steady_clock::now() > timeout)
+				return false;
+			this_thread::yield();
+		}
+
+		return true;
+	}
+
+	int run()
+	{
+		Thread *self = Thread::current();
+		InvokeCounter counter;
+		counter.moveToThread(&thread_);
+
+		/*
+		 * Invoke methods in bounded bursts. The messages, argument
+		 * packs and bound methods are freed by the receiving thread,
+		 * and must be recycled by the sending thread's allocator.
+		 */
+		unsigned long expected = 0;
+		unsigned int calls = 0;
+
+		for (unsigned int round = 0; round < kNumRounds; ++round) {
+			/*
+			 * Exclude the warm-up rounds, during which the
+			 * allocator fills its free lists, from the statistics.
+			 */
+			if (round == kWarmupRounds)
+				self->resetMessageAllocatorStats();
+
+			for (unsigned int i = 0; i < kCallsPerRound; ++i) {
+				counter.invokeMethod(&InvokeCounter::add,
+						     ConnectionTypeQueued, calls);
+				expected += calls++;
+			}
+
+			if (!waitForCount(counter, calls)) {
+				cout << "Timeout waiting for method invocations" << endl;
+				return TestFail;
+			}
+		}
+
+		if (counter.sum() != expected) {
+			cout << "Invalid method arguments" << endl;
+			return TestFail;
+		}
+
+		MessageAllocator::Stats stats = self->messageAllocatorStats();
+
+		cout << "Allocator: " << stats.hits << " hits, " << stats.misses
+		     << " misses, " << stats.remoteFrees << " remote frees" << endl;
+
+		/*
+		 * Messages are freed asynchronously after delivery. Allow for
+		 * misses when a burst starts before the previous one has been
+		 * reclaimed, as long as the vast majority of allocations hit.
+		 */
+		if (stats.hits < stats.misses * 20 || !stats.remoteFrees) {
+			cout << "Allocations not recycled in steady state" << endl;
+			return TestFail;
+		}
+
+		/* Arguments larger than the biggest size class must work too. */
+		std::array<unsigned int, 256> values;
+		values.fill(1);
+
+		self->resetMessageAllocatorStats();
+
+		counter.invokeMethod(&InvokeCounter::addLarge,
+				     ConnectionTypeQueued, values);
+		if (!waitForCount(counter, ++calls)) {
+			cout << "Timeout waiting for large method invocation" << endl;
+			return TestFail;
+		}
+
+		if (counter.sum() != expected + values.size()) {
+			cout << "Invalid large method arguments" << endl;
+			return TestFail;
+		}
+
+		stats = self->messageAllocatorStats();
+		if (!stats.misses) {
+			cout << "Large allocation not reported as a miss" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	void cleanup()
+	{
+		thread_.exit(0);
+		thread_.wait();
+	}
+
+private:
+	Thread thread_;
+};
+
+TEST_REGISTER(MessageAllocatorTest)
@@ -0,0 +1,162 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * message-throughput.cpp - Cross-thread message throughput benchmark
+ */
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "message.h"
+#include "thread.h"
+#include "test.h"
+#include "utils.h"
+
+using namespace std;
+using namespace libcamera;
+
+static constexpr unsigned int kMaxProducers = 4;
+static constexpr unsigned int kNumMessages = 100000;
+
+class SequenceMessage : public Message
+{
+public:
+	SequenceMessage(Message::Type type, unsigned int producer,
+			unsigned int sequence)
+		: Message(type), producer_(producer), sequence_(sequence)
+	{
+	}
+
+	unsigned int producer_;
+	unsigned int sequence_;
+};
+
+class SequenceReceiver : public Object
+{
+public:
+	SequenceReceiver(Message::Type type)
+		: type_(type)
+	{
+		reset();
+	}
+
+	void reset()
+	{
+		for (unsigned int &sequence : sequences_)
+			sequence = 0;
+		received_.store(0, std::memory_order_relaxed);
+		outOfOrder_ = false;
+	}
+
+	unsigned int received() const { return received_.load(std::memory_order_acquire); }
+	bool outOfOrder() const { return outOfOrder_; }
+
+protected:
+	void message(Message *msg)
+	{
+		if (msg->type() != type_) {
+			Object::message(msg);
+			return;
+		}
+
+		SequenceMessage *seqMsg = static_cast<SequenceMessage *>(msg);
+		if (seqMsg->sequence_ != sequences_[seqMsg->producer_]++)
+			outOfOrder_ = true;
+
+		received_.fetch_add(1, std::memory_order_release);
+	}
+
+private:
+	Message::Type type_;
+	unsigned int sequences_[kMaxProducers];
+	std::atomic<unsigned int> received_;
+	bool outOfOrder_;
+};
+
+class MessageThroughputTest : public Test
+{
+protected:
+	int init()
+	{
+		type_ = Message::registerMessageType();
+		thread_.start();
+
+		return TestPass;
+	}
+
+	int measure(unsigned int producers)
+	{
+		SequenceReceiver receiver(type_);
+		receiver.moveToThread(&thread_);
+
+		std::vector<std::thread> threads;
+		unsigned int total = producers * kNumMessages;
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+		for (unsigned int i = 0; i < producers; ++i) {
+			threads.emplace_back([&receiver, i, this]() {
+				for (unsigned int seq = 0; seq < kNumMessages; ++seq)
+					receiver.postMessage(utils::make_unique<SequenceMessage>(type_, i, seq));
+			});
+		}
+
+		for (std::thread &thread : threads)
+			thread.join();
+
+		chrono::steady_clock::time_point timeout = start + chrono::seconds(30);
+		while (receiver.received() < total) {
+			if (chrono::steady_clock::now() > timeout)
+				break;
+			this_thread::yield();
+		}
+
+		chrono::steady_clock::duration duration = chrono::steady_clock::now() - start;
+
+		if (receiver.received() != total) {
+			cout << "Received " << receiver.received() << " messages, expected "
+			     << total << endl;
+			return TestFail;
+		}
+
+		if (receiver.outOfOrder()) {
+			cout << "Messages received out of order" << endl;
+			return TestFail;
+		}
+
+		double secs = chrono::duration<double>(duration).count();
+		cout << producers << " producer(s): " << total << " messages in "
+		     << chrono::duration_cast<chrono::milliseconds>(duration).count()
+		     << "ms, " << static_cast<unsigned long>(total / secs)
+		     << " messages/s" << endl;
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		for (unsigned int producers = 1; producers <= kMaxProducers; producers *= 2) {
+			int ret = measure(producers);
+			if (ret != TestPass)
+				return ret;
+		}
+
+		return TestPass;
+	}
+
+	void cleanup()
+	{
+		thread_.exit(0);
+		thread_.wait();
+	}
+
+private:
+	Message::Type type_;
+	Thread thread_;
+};
+
+TEST_REGISTER(MessageThroughputTest)
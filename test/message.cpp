@@ -9,6 +9,8 @@
 #include <iostream>
 #include <thread>
 
+#include <libcamera/object.h>
+
 #include "message.h"
 #include "thread.h"
 #include "test.h"
@@ -47,6 +49,32 @@ private:
 	Status status_;
 };
 
+class SlowReceiver : public Object
+{
+protected:
+	void message(Message *msg)
+	{
+		this_thread::sleep_for(chrono::milliseconds(500));
+	}
+};
+
+class InvokeReceiver : public Object
+{
+public:
+	InvokeReceiver(bool *invoked)
+		: invoked_(invoked)
+	{
+	}
+
+	void method(int value)
+	{
+		*invoked_ = true;
+	}
+
+private:
+	bool *invoked_;
+};
+
 class MessageTest : public Test
 {
 protected:
@@ -83,6 +111,45 @@ protected:
 			break;
 		}
 
+		/*
+		 * Delete the receiver of a blocking invocation while its
+		 * thread is busy, and verify the sender is released without
+		 * waiting for the thread to process its queue.
+		 */
+		SlowReceiver slowReceiver;
+		slowReceiver.moveToThread(&thread_);
+
+		bool invoked = false;
+		InvokeReceiver *invokeReceiver = new InvokeReceiver(&invoked);
+		invokeReceiver->moveToThread(&thread_);
+
+		slowReceiver.postMessage(utils::make_unique<Message>(Message::None));
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		chrono::steady_clock::duration blocked{};
+
+		std::thread sender([&]() {
+			invokeReceiver->invokeMethod(&InvokeReceiver::method,
+						     ConnectionTypeBlocking, 0);
+			blocked = chrono::steady_clock::now() - start;
+		});
+
+		this_thread::sleep_for(chrono::milliseconds(100));
+		delete invokeReceiver;
+		sender.join();
+
+		if (blocked >= chrono::milliseconds(400)) {
+			cout << "Sender not released by message removal" << endl;
+			return TestFail;
+		}
+
+		this_thread::sleep_for(chrono::milliseconds(500));
+
+		if (invoked) {
+			cout << "Removed invocation delivered" << endl;
+			return TestFail;
+		}
+
 		return TestPass;
 	}
 
@@ -50,6 +50,12 @@ public:
 		value_ = value;
 	}
 
+	int methodWithReturn(int value)
+	{
+		method(value);
+		return value * 2;
+	}
+
 private:
 	Status status_;
 	int value_;
@@ -64,10 +70,11 @@ protected:
 		InvokedObject object;
 
 		/*
-		 * Test that method invocation in the same thread goes through
-		 * the event dispatcher.
+		 * Test that queued method invocation in the same thread goes
+		 * through the event dispatcher.
 		 */
-		object.invokeMethod(&InvokedObject::method, 42);
+		object.invokeMethod(&InvokedObject::method,
+				    ConnectionTypeQueued, 42);
 
 		if (object.status() != InvokedObject::NoCall) {
 			cerr << "Method not invoked asynchronously" << endl;
@@ -92,6 +99,20 @@ protected:
 			return TestFail;
 		}
 
+		/*
+		 * Test that blocking method invocation in the same thread is
+		 * synchronous.
+		 */
+		object.reset();
+		object.invokeMethod(&InvokedObject::method,
+				    ConnectionTypeBlocking, 42);
+
+		if (object.status() != InvokedObject::CallReceived ||
+		    object.value() != 42) {
+			cout << "Blocking method not invoked synchronously for main thread" << endl;
+			return TestFail;
+		}
+
 		/*
 		 * Move the object to a thread and verify that the method is
 		 * delivered in the correct thread.
@@ -101,7 +122,8 @@ protected:
 
 		thread_.start();
 
-		object.invokeMethod(&InvokedObject::method, 42);
+		object.invokeMethod(&InvokedObject::method,
+				    ConnectionTypeQueued, 42);
 		this_thread::sleep_for(chrono::milliseconds(100));
 
 		switch (object.status()) {
@@ -120,6 +142,39 @@ protected:
 			return TestFail;
 		}
 
+		/*
+		 * Test that blocking method invocation completes in the
+		 * object's thread before returning.
+		 */
+		for (int i = 0; i < 1000; ++i) {
+			object.reset();
+			object.invokeMethod(&InvokedObject::method,
+					    ConnectionTypeBlocking, i);
+
+			if (object.status() != InvokedObject::CallReceived) {
+				cout << "Blocking method not invoked in custom thread" << endl;
+				return TestFail;
+			}
+
+			if (object.value() != i) {
+				cout << "Blocking method invoked with incorrect value" << endl;
+				return TestFail;
+			}
+		}
+
+		/*
+		 * Test that the return value of a blocking method invocation
+		 * is passed back to the caller.
+		 */
+		object.reset();
+		int ret = object.invokeMethod(&InvokedObject::methodWithReturn,
+					      ConnectionTypeBlocking, 21);
+
+		if (object.status() != InvokedObject::CallReceived || ret != 42) {
+			cout << "Blocking method returned incorrect value" << endl;
+			return TestFail;
+		}
+
 		return TestPass;
 	}
 
@@ -0,0 +1,123 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * signal-emit.cpp - Signal emission benchmark
+ */
+
+#include <chrono>
+#include <iostream>
+#include <list>
+#include <vector>
+
+#include <libcamera/bound_method.h>
+#include <libcamera/signal.h>
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+static constexpr unsigned int kNumEmits = 1000000;
+
+class Receiver
+{
+public:
+	Receiver()
+		: sum_(0)
+	{
+	}
+
+	void slot(int value)
+	{
+		sum_ += value;
+	}
+
+	unsigned long sum() const { return sum_; }
+
+private:
+	unsigned long sum_;
+};
+
+/*
+ * Reference implementation of the previous Signal storage and emission
+ * strategy, with slots stored in a std::list and copied to a std::vector on
+ * every emission.
+ */
+class ListSignal
+{
+public:
+	~ListSignal()
+	{
+		for (BoundMethodBase *slot : slots_)
+			delete slot;
+	}
+
+	void connect(Receiver *obj, void (Receiver::*func)(int))
+	{
+		slots_.push_back(new BoundMemberMethod<Receiver, void, int>(obj, nullptr, func));
+	}
+
+	void emit(int value)
+	{
+		std::vector<BoundMethodBase *> slots{ slots_.begin(), slots_.end() };
+		for (BoundMethodBase *slot : slots)
+			static_cast<BoundMethodArgs<void, int> *>(slot)->activate(value);
+	}
+
+private:
+	std::list<BoundMethodBase *> slots_;
+};
+
+class SignalEmitTest : public Test
+{
+protected:
+	template<typename S>
+	double measure(unsigned int numSlots, unsigned long *sum)
+	{
+		Receiver receiver;
+		S signal;
+
+		for (unsigned int i = 0; i < numSlots; ++i)
+			signal.connect(&receiver, &Receiver::slot);
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+		for (unsigned int i = 0; i < kNumEmits; ++i)
+			signal.emit(1);
+
+		chrono::steady_clock::duration duration = chrono::steady_clock::now() - start;
+
+		*sum = receiver.sum();
+		return chrono::duration<double, std::nano>(duration).count() / kNumEmits;
+	}
+
+	int run()
+	{
+		for (unsigned int numSlots : { 1, 2, 8 }) {
+			unsigned long expected = static_cast<unsigned long>(numSlots) * kNumEmits;
+			unsigned long sum;
+
+			double list = measure<ListSignal>(numSlots, &sum);
+			if (sum != expected) {
+				cout << "List signal delivered " << sum << " calls, expected "
+				     << expected << endl;
+				return TestFail;
+			}
+
+			double current = measure<Signal<int>>(numSlots, &sum);
+			if (sum != expected) {
+				cout << "Signal delivered " << sum << " calls, expected "
+				     << expected << endl;
+				return TestFail;
+			}
+
+			cout << numSlots << " slot(s): " << current << "ns/emit, "
+			     << list << "ns/emit with list storage" << endl;
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(SignalEmitTest)
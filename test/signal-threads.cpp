@@ -107,6 +107,35 @@ protected:
 			return TestFail;
 		}
 
+		/*
+		 * Verify that a blocking connection delivers the signal before
+		 * emit() returns.
+		 */
+		receiver.reset();
+		signal_.disconnect();
+		signal_.connect(&receiver, &SignalReceiver::slot,
+				ConnectionTypeBlocking);
+
+		signal_.emit(43);
+
+		switch (receiver.status()) {
+		case SignalReceiver::NoSignal:
+			cout << "No signal received for blocking connection" << endl;
+			return TestFail;
+		case SignalReceiver::InvalidThread:
+			cout << "Signal received in incorrect thread "
+				"for blocking connection" << endl;
+			return TestFail;
+		default:
+			break;
+		}
+
+		if (receiver.value() != 43) {
+			cout << "Signal received with incorrect value "
+				"for blocking connection" << endl;
+			return TestFail;
+		}
+
 		return TestPass;
 	}
 
@@ -69,6 +69,22 @@ protected:
 		signalVoid_.disconnect(this, &SignalTest::slotDisconnect);
 	}
 
+	void slotDisconnectOthers()
+	{
+		signalVoid_.disconnect(this, &SignalTest::slotVoid);
+	}
+
+	void slotConnect()
+	{
+		signalVoid_.connect(this, &SignalTest::slotVoid);
+	}
+
+	void slotDeleteObject()
+	{
+		delete slotObject_;
+		slotObject_ = nullptr;
+	}
+
 	void slotInteger1(int value)
 	{
 		values_[0] = value;
@@ -174,6 +190,43 @@ protected:
 			return TestFail;
 		}
 
+		/* Test disconnection of a subsequent slot from a slot. */
+		signalVoid_.disconnect();
+		signalVoid_.connect(this, &SignalTest::slotDisconnectOthers);
+		signalVoid_.connect(this, &SignalTest::slotVoid);
+
+		called_ = false;
+		signalVoid_.emit();
+
+		if (called_) {
+			cout << "Signal disconnection of other slot test failed" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * Test connection from a slot. Growing the slots beyond the
+		 * inline storage shall not disturb the emission in progress,
+		 * and the new slots shall only be called by the next emission.
+		 */
+		signalVoid_.disconnect();
+		signalVoid_.connect(this, &SignalTest::slotConnect);
+
+		called_ = false;
+		signalVoid_.emit();
+
+		if (called_) {
+			cout << "Signal connection from slot test failed" << endl;
+			return TestFail;
+		}
+
+		signalVoid_.emit();
+		signalVoid_.emit();
+
+		if (!called_) {
+			cout << "Signal connection from slot delivery test failed" << endl;
+			return TestFail;
+		}
+
 		/* ----------------- Signal -> Object tests ----------------- */
 
 		/*
@@ -215,6 +268,19 @@ protected:
 
 		delete slotObject;
 
+		/* Test deletion of a slot object from a preceding slot. */
+		signalVoid_.disconnect();
+
+		slotObject_ = new SlotObject();
+		signalVoid_.connect(this, &SignalTest::slotDeleteObject);
+		signalVoid_.connect(slotObject_, &SlotObject::slot);
+		valueStatic_ = 0;
+		signalVoid_.emit();
+		if (valueStatic_ != 0 || slotObject_) {
+			cout << "Signal object deletion from slot test failed" << endl;
+			return TestFail;
+		}
+
 		/* --------- Signal -> Object (multiple inheritance) -------- */
 
 		/*
@@ -268,6 +334,8 @@ private:
 	Signal<int> signalInt_;
 	Signal<int, const std::string &> signalMultiArgs_;
 
+	SlotObject *slotObject_;
+
 	bool called_;
 	int values_[3];
 	std::string name_;
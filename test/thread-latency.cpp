@@ -0,0 +1,224 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * thread-latency.cpp - Thread dispatch latency tracking test
+ */
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <unistd.h>
+
+#include <libcamera/event_dispatcher.h>
+#include <libcamera/event_notifier.h>
+#include <libcamera/object.h>
+#include <libcamera/timer.h>
+
+#include "latency_histogram.h"
+#include "test.h"
+#include "thread.h"
+
+using namespace std;
+using namespace libcamera;
+
+class SlowReceiver : public Object
+{
+public:
+	SlowReceiver()
+		: count_(0)
+	{
+	}
+
+	void stall(unsigned int msecs)
+	{
+		this_thread::sleep_for(chrono::milliseconds(msecs));
+		count_++;
+	}
+
+	unsigned int count() const { return count_; }
+
+private:
+	unsigned int count_;
+};
+
+class ThreadLatencyTest : public Test
+{
+protected:
+	int init()
+	{
+		if (pipe(pipefd_) < 0)
+			return TestFail;
+
+		notified_ = false;
+		return TestPass;
+	}
+
+	void readReady(EventNotifier *notifier)
+	{
+		char data;
+		if (read(notifier->fd(), &data, 1) == 1)
+			notified_ = true;
+	}
+
+	bool checkHistogram(const LatencyHistogram &histogram, const char *name,
+			    uint64_t count)
+	{
+		if (histogram.count() != count) {
+			cout << name << " latency recorded " << histogram.count()
+			     << " samples, expected " << count << endl;
+			return false;
+		}
+
+		uint64_t total = 0;
+		for (unsigned int i = 0; i < LatencyHistogram::NumBuckets; ++i)
+			total += histogram.bucket(i);
+
+		if (total != count) {
+			cout << name << " latency buckets hold " << total
+			     << " samples, expected " << count << endl;
+			return false;
+		}
+
+		if (histogram.percentile(50) > histogram.max() ||
+		    histogram.mean() > histogram.max()) {
+			cout << name << " latency statistics are inconsistent" << endl;
+			return false;
+		}
+
+		cout << name << " latency: " << histogram.toString() << endl;
+
+		return true;
+	}
+
+	int run()
+	{
+		Thread *thread = Thread::current();
+		EventDispatcher *dispatcher = thread->eventDispatcher();
+
+		/* Nothing shall be recorded with latency tracking disabled. */
+		thread->setLatencyTracking(false);
+		thread->resetLatencyHistograms();
+
+		Timer timer;
+		timer.start(10);
+		while (timer.isRunning())
+			dispatcher->processEvents();
+
+		if (thread->latencyHistogram(Thread::TimerLatency).count()) {
+			cout << "Latency recorded with tracking disabled" << endl;
+			return TestFail;
+		}
+
+		thread->setLatencyTracking(true);
+
+		/* Event notifier latency. */
+		EventNotifier notifier(pipefd_[0], EventNotifier::Read);
+		notifier.activated.connect(this, &ThreadLatencyTest::readReady);
+
+		if (write(pipefd_[1], "x", 1) != 1)
+			return TestFail;
+
+		dispatcher->processEvents();
+
+		if (!notified_) {
+			cout << "Event notifier not activated" << endl;
+			return TestFail;
+		}
+
+		if (!checkHistogram(thread->latencyHistogram(Thread::NotifierLatency),
+				    "Notifier", 1) ||
+		    !checkHistogram(thread->latencyHistogram(Thread::NotifierLatency, &notifier),
+				    "Notifier source", 1))
+			return TestFail;
+
+		notifier.setEnabled(false);
+
+		/* Timer lateness. */
+		timer.start(10);
+		while (timer.isRunning())
+			dispatcher->processEvents();
+
+		if (!checkHistogram(thread->latencyHistogram(Thread::TimerLatency),
+				    "Timer", 1) ||
+		    !checkHistogram(thread->latencyHistogram(Thread::TimerLatency, &timer),
+				    "Timer source", 1))
+			return TestFail;
+
+		/* Per-source histograms are destroyed with their source. */
+		{
+			Timer shortTimer;
+			shortTimer.start(1);
+			while (shortTimer.isRunning())
+				dispatcher->processEvents();
+
+			if (thread->latencySources(Thread::TimerLatency).size() != 2) {
+				cout << "Timer latency sources not recorded" << endl;
+				return TestFail;
+			}
+		}
+
+		std::vector<const Object *> sources =
+			thread->latencySources(Thread::TimerLatency);
+		if (sources.size() != 1 || sources[0] != &timer) {
+			cout << "Timer latency source not removed" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * Message residency. The second message waits in the queue
+		 * while the first one stalls the thread for 20ms.
+		 */
+		SlowReceiver receiver;
+		receiver.invokeMethod(&SlowReceiver::stall, ConnectionTypeQueued, 20U);
+		receiver.invokeMethod(&SlowReceiver::stall, ConnectionTypeQueued, 0U);
+
+		thread->dispatchMessages();
+
+		if (receiver.count() != 2) {
+			cout << "Messages not delivered" << endl;
+			return TestFail;
+		}
+
+		LatencyHistogram messages = thread->latencyHistogram(Thread::MessageLatency);
+		if (!checkHistogram(messages, "Message", 2) ||
+		    !checkHistogram(thread->latencyHistogram(Thread::MessageLatency, &receiver),
+				    "Message source", 2))
+			return TestFail;
+
+		if (messages.max() < chrono::milliseconds(20)) {
+			cout << "Message stall not recorded" << endl;
+			return TestFail;
+		}
+
+		/* Histograms reset. */
+		thread->resetLatencyHistograms();
+
+		if (thread->latencyHistogram(Thread::NotifierLatency).count() ||
+		    thread->latencyHistogram(Thread::TimerLatency).count() ||
+		    thread->latencyHistogram(Thread::MessageLatency).count() ||
+		    thread->latencyHistogram(Thread::MessageLatency).max() !=
+		    utils::duration::zero() ||
+		    thread->latencyHistogram(Thread::MessageLatency, &receiver).count() ||
+		    !thread->latencySources(Thread::MessageLatency).empty()) {
+			cout << "Latency histograms not reset" << endl;
+			return TestFail;
+		}
+
+		thread->setLatencyTracking(false);
+
+		return TestPass;
+	}
+
+	void cleanup()
+	{
+		close(pipefd_[0]);
+		close(pipefd_[1]);
+	}
+
+private:
+	int pipefd_[2];
+	bool notified_;
+};
+
+TEST_REGISTER(ThreadLatencyTest)
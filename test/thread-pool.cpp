@@ -0,0 +1,297 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * thread-pool.cpp - Thread pool test and scaling benchmark
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string.h>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include <libcamera/buffer.h>
+#include <libcamera/event_dispatcher.h>
+#include <libcamera/object.h>
+#include <libcamera/timer.h>
+
+#include "test.h"
+#include "thread.h"
+#include "thread_pool.h"
+
+using namespace std;
+using namespace libcamera;
+
+static constexpr unsigned int kWidth = 1920;
+static constexpr unsigned int kHeight = 1080;
+static constexpr unsigned int kFrameSize = kWidth * kHeight;
+static constexpr unsigned int kNumFrames = 16;
+
+/*
+ * Synthetic per-frame kernel, processing a range of lines with a few rounds
+ * of arithmetic per pixel to emulate a CPU-bound conversion.
+ */
+static void processLines(uint8_t *data, unsigned int first, unsigned int last)
+{
+	for (unsigned int y = first; y < last; ++y) {
+		uint8_t *line = data + y * kWidth;
+
+		for (unsigned int x = 0; x < kWidth; ++x) {
+			unsigned int value = line[x];
+			for (unsigned int i = 0; i < 8; ++i)
+				value = (value * 7 + x + y) % 251;
+			line[x] = value;
+		}
+	}
+}
+
+class CompletionReceiver : public Object
+{
+public:
+	CompletionReceiver()
+		: count_(0), invalidThread_(false)
+	{
+	}
+
+	void completed(unsigned int frame)
+	{
+		if (Thread::current() != thread())
+			invalidThread_ = true;
+		count_++;
+	}
+
+	unsigned int count() const { return count_; }
+	bool invalidThread() const { return invalidThread_; }
+
+private:
+	unsigned int count_;
+	bool invalidThread_;
+};
+
+class ThreadPoolTest : public Test
+{
+protected:
+	int init()
+	{
+		fd_ = memfd_create("thread-pool", 0);
+		if (fd_ < 0 || ftruncate(fd_, kFrameSize) < 0) {
+			cout << "Failed to create frame memory" << endl;
+			return TestFail;
+		}
+
+		mem_.planes().emplace_back();
+		if (mem_.planes().back().setDmabuf(fd_, kFrameSize) < 0)
+			return TestFail;
+
+		reference_.resize(kFrameSize);
+		fill(reference_.data());
+		processLines(reference_.data(), 0, kHeight);
+
+		return TestPass;
+	}
+
+	void fill(uint8_t *data)
+	{
+		for (unsigned int i = 0; i < kFrameSize; ++i)
+			data[i] = i % 253;
+	}
+
+	bool waitForCompletion(CompletionReceiver &receiver, unsigned int count)
+	{
+		Thread *thread = Thread::current();
+		EventDispatcher *dispatcher = thread->eventDispatcher();
+		Timer timeout;
+		timeout.start(10000);
+
+		/*
+		 * Completion messages posted while the dispatcher waits only
+		 * interrupt it, dispatch them right away instead of waiting
+		 * for the next event.
+		 */
+		while (receiver.count() < count && timeout.isRunning()) {
+			dispatcher->processEvents();
+			thread->dispatchMessages();
+		}
+
+		return receiver.count() == count;
+	}
+
+	int testTasks()
+	{
+		ThreadPool pool(4);
+		CompletionReceiver receiver;
+		std::atomic<unsigned int> count(0);
+
+		for (unsigned int i = 0; i < 100; ++i)
+			pool.run([&count]() { count++; },
+				 &receiver, &CompletionReceiver::completed, i);
+
+		if (!waitForCompletion(receiver, 100) || count != 100) {
+			cout << "Task completions not delivered" << endl;
+			return TestFail;
+		}
+
+		if (receiver.invalidThread()) {
+			cout << "Task completion delivered in incorrect thread" << endl;
+			return TestFail;
+		}
+
+		/* Nested blocking batches must not deadlock. */
+		std::atomic<unsigned int> sum(0);
+		pool.runBatch(16, [&](unsigned int i) {
+			pool.runBatch(16, [&](unsigned int j) {
+				sum += i * 16 + j;
+			});
+		});
+
+		if (sum != 256 * 255 / 2) {
+			cout << "Nested batch processing failed" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	/*
+	 * Run many small tasks that push more tasks from the workers, to
+	 * exercise the races between pushing to and stealing from the worker
+	 * queues. A lost wakeup strands a task until the next push, and as no
+	 * task is pushed after the last one of a round, stalls the round.
+	 */
+	int testStress()
+	{
+		static constexpr unsigned int kRounds = 50;
+		static constexpr unsigned int kTasks = 200;
+		static constexpr unsigned int kChildren = 4;
+
+		ThreadPool pool(8);
+
+		for (unsigned int round = 0; round < kRounds; ++round) {
+			std::atomic<unsigned int> count(0);
+
+			for (unsigned int i = 0; i < kTasks; ++i) {
+				pool.run([&pool, &count]() {
+					for (unsigned int j = 0; j < kChildren; ++j)
+						pool.run([&count]() { count++; });
+					count++;
+				});
+			}
+
+			chrono::steady_clock::time_point timeout =
+				chrono::steady_clock::now() + chrono::seconds(5);
+			while (count < kTasks * (kChildren + 1) &&
+			       chrono::steady_clock::now() < timeout)
+				this_thread::sleep_for(chrono::microseconds(100));
+
+			if (count != kTasks * (kChildren + 1)) {
+				cout << "Round " << round << ": only " << count
+				     << " of " << kTasks * (kChildren + 1)
+				     << " tasks run" << endl;
+				return TestFail;
+			}
+		}
+
+		return TestPass;
+	}
+
+	int measure(unsigned int workers, double *fps)
+	{
+		ThreadPool pool(workers);
+		CompletionReceiver receiver;
+		uint8_t *data = static_cast<uint8_t *>(mem_.planes()[0].mem());
+		unsigned int slices = pool.workers() * 4;
+
+		ThreadPool::PlaneKernel kernel = [](const ThreadPool::PlaneSlice &slice) {
+			unsigned int first = kHeight * slice.slice / slice.slices;
+			unsigned int last = kHeight * (slice.slice + 1) / slice.slices;
+			processLines(static_cast<uint8_t *>(slice.mem), first, last);
+		};
+
+		chrono::steady_clock::duration duration{ 0 };
+
+		for (unsigned int frame = 0; frame < kNumFrames; ++frame) {
+			fill(data);
+
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+			int ret = pool.processPlanes(&mem_, slices, kernel, &receiver,
+						     &CompletionReceiver::completed, frame);
+			if (ret < 0) {
+				cout << "Failed to process planes" << endl;
+				return TestFail;
+			}
+
+			if (!waitForCompletion(receiver, frame + 1)) {
+				cout << "Frame processing completion not delivered" << endl;
+				return TestFail;
+			}
+
+			duration += chrono::steady_clock::now() - start;
+
+			if (memcmp(data, reference_.data(), kFrameSize)) {
+				cout << "Incorrect frame processing result" << endl;
+				return TestFail;
+			}
+		}
+
+		if (receiver.invalidThread()) {
+			cout << "Frame completion delivered in incorrect thread" << endl;
+			return TestFail;
+		}
+
+		*fps = kNumFrames / chrono::duration<double>(duration).count();
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		int ret = testTasks();
+		if (ret != TestPass)
+			return ret;
+
+		ret = testStress();
+		if (ret != TestPass)
+			return ret;
+
+		unsigned int cores = std::max(std::thread::hardware_concurrency(), 1U);
+		double baseline = 0.0;
+
+		for (unsigned int workers = 1; ; workers = std::min(workers * 2, cores)) {
+			double fps;
+
+			ret = measure(workers, &fps);
+			if (ret != TestPass)
+				return ret;
+
+			if (workers == 1)
+				baseline = fps;
+
+			cout << workers << " worker(s): " << fps << " frames/s, "
+			     << "speedup " << fps / baseline << endl;
+
+			if (workers == cores)
+				break;
+		}
+
+		return TestPass;
+	}
+
+	void cleanup()
+	{
+		if (fd_ >= 0)
+			close(fd_);
+	}
+
+private:
+	int fd_;
+	BufferMemory mem_;
+	std::vector<uint8_t> reference_;
+};
+
+TEST_REGISTER(ThreadPoolTest)
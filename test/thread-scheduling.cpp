@@ -0,0 +1,173 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * thread-scheduling.cpp - Thread scheduling parameters test
+ */
+
+#include <atomic>
+#include <chrono>
+#include <errno.h>
+#include <iostream>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+#include <libcamera/scheduling.h>
+
+#include "test.h"
+#include "thread.h"
+
+using namespace std;
+using namespace libcamera;
+
+class IdentifiedThread : public Thread
+{
+public:
+	IdentifiedThread()
+		: tid_(0)
+	{
+	}
+
+	pid_t tid()
+	{
+		chrono::steady_clock::time_point timeout =
+			chrono::steady_clock::now() + chrono::seconds(1);
+
+		while (!tid_.load() && chrono::steady_clock::now() < timeout)
+			this_thread::yield();
+
+		return tid_.load();
+	}
+
+protected:
+	void run() override
+	{
+		tid_ = syscall(SYS_gettid);
+		exec();
+	}
+
+private:
+	std::atomic<pid_t> tid_;
+};
+
+class ThreadSchedulingTest : public Test
+{
+protected:
+	int checkNice(pid_t tid, int nice)
+	{
+		errno = 0;
+		int value = getpriority(PRIO_PROCESS, tid);
+		if (errno || value != nice) {
+			cout << "Thread nice value is " << value << ", expected "
+			     << nice << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		ThreadScheduling scheduling;
+
+		/* Invalid parameters shall be rejected. */
+		IdentifiedThread thread;
+
+		scheduling.policy = ThreadScheduling::PolicyFifo;
+		scheduling.priority = 0;
+		if (thread.setScheduling(scheduling) != -EINVAL) {
+			cout << "Invalid real-time priority accepted" << endl;
+			return TestFail;
+		}
+
+		scheduling = ThreadScheduling();
+		scheduling.nice = 40;
+		if (thread.setScheduling(scheduling) != -EINVAL) {
+			cout << "Invalid nice value accepted" << endl;
+			return TestFail;
+		}
+
+		scheduling = ThreadScheduling();
+		scheduling.cpus = { CPU_SETSIZE };
+		if (thread.setScheduling(scheduling) != -EINVAL) {
+			cout << "Invalid CPU accepted" << endl;
+			return TestFail;
+		}
+
+		/* Parameters set before start shall be applied at start. */
+		cpu_set_t cpus;
+		if (sched_getaffinity(0, sizeof(cpus), &cpus) < 0)
+			return TestFail;
+
+		unsigned int cpu;
+		for (cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+			if (CPU_ISSET(cpu, &cpus))
+				break;
+		}
+
+		scheduling = ThreadScheduling();
+		scheduling.nice = 5;
+		scheduling.cpus = { cpu };
+		if (thread.setScheduling(scheduling) < 0) {
+			cout << "Failed to set scheduling parameters" << endl;
+			return TestFail;
+		}
+
+		thread.start();
+
+		pid_t tid = thread.tid();
+		if (!tid) {
+			cout << "Thread didn't start" << endl;
+			return TestFail;
+		}
+
+		if (checkNice(tid, 5) != TestPass)
+			return TestFail;
+
+		if (sched_getaffinity(tid, sizeof(cpus), &cpus) < 0 ||
+		    CPU_COUNT(&cpus) != 1 || !CPU_ISSET(cpu, &cpus)) {
+			cout << "Thread CPU affinity not applied" << endl;
+			return TestFail;
+		}
+
+		/* Parameters set while running shall be applied immediately. */
+		scheduling.nice = 10;
+		if (thread.setScheduling(scheduling) < 0) {
+			cout << "Failed to set scheduling parameters of running thread"
+			     << endl;
+			return TestFail;
+		}
+
+		if (checkNice(tid, 10) != TestPass)
+			return TestFail;
+
+		/* Real-time policies require privileges. */
+		scheduling = ThreadScheduling();
+		scheduling.policy = ThreadScheduling::PolicyFifo;
+		scheduling.priority = 1;
+
+		int ret = thread.setScheduling(scheduling);
+		if (ret == 0) {
+			if (sched_getscheduler(tid) != SCHED_FIFO) {
+				cout << "Real-time policy not applied" << endl;
+				return TestFail;
+			}
+		} else if (ret != -EPERM) {
+			cout << "Failed to set real-time policy: " << ret << endl;
+			return TestFail;
+		} else {
+			cout << "Real-time policy not permitted, skipping check"
+			     << endl;
+		}
+
+		thread.exit(0);
+		thread.wait();
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(ThreadSchedulingTest)
@@ -0,0 +1,223 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * timer-jitter.cpp - Timer deadline precision test under load
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include <libcamera/event_notifier.h>
+#include <libcamera/timer.h>
+
+#include "event_dispatcher_epoll.h"
+#include "test.h"
+#include "thread.h"
+#include "utils.h"
+
+using namespace std;
+using namespace libcamera;
+
+static constexpr unsigned int kNumTimers = 256;
+static constexpr unsigned int kNumCancelled = 64;
+
+class JitterTimer : public Timer
+{
+public:
+	JitterTimer()
+		: count_(0)
+	{
+		timeout.connect(this, &JitterTimer::timeoutHandler);
+	}
+
+	unsigned int count() const { return count_; }
+	chrono::steady_clock::duration error() const { return expiration_ - deadline(); }
+	chrono::steady_clock::time_point expiration() const { return expiration_; }
+
+private:
+	void timeoutHandler(Timer *timer)
+	{
+		expiration_ = chrono::steady_clock::now();
+		count_++;
+	}
+
+	unsigned int count_;
+	chrono::steady_clock::time_point expiration_;
+};
+
+class TimerJitterTest : public Test
+{
+protected:
+	void readReady(EventNotifier *notifier)
+	{
+		char data[64];
+
+		if (read(notifier->fd(), data, sizeof(data)) > 0)
+			events_++;
+	}
+
+	int init()
+	{
+		std::unique_ptr<EventDispatcherEpoll> dispatcher =
+			utils::make_unique<EventDispatcherEpoll>(EventDispatcherEpoll::TimerSourceTimerfd);
+		if (!dispatcher->isValid()) {
+			cout << "Failed to create epoll event dispatcher" << endl;
+			return TestFail;
+		}
+
+		dispatcher_ = dispatcher.get();
+		Thread::current()->setEventDispatcher(std::move(dispatcher));
+		if (Thread::current()->eventDispatcher() != dispatcher_) {
+			cout << "Failed to install epoll event dispatcher" << endl;
+			return TestSkip;
+		}
+
+		if (pipe(pipefd_))
+			return TestFail;
+
+		events_ = 0;
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		std::mt19937 generator(42);
+		std::uniform_int_distribution<unsigned int> delay(10000, 300000);
+
+		/*
+		 * Load the dispatcher with a continuous stream of file
+		 * descriptor events generated from a separate thread.
+		 */
+		EventNotifier notifier(pipefd_[0], EventNotifier::Read);
+		notifier.activated.connect(this, &TimerJitterTest::readReady);
+
+		std::atomic<bool> stop(false);
+		std::thread loader([&]() {
+			while (!stop.load(std::memory_order_relaxed)) {
+				if (write(pipefd_[1], "H2G2", 4) < 0)
+					break;
+				this_thread::sleep_for(chrono::microseconds(200));
+			}
+		});
+
+		/*
+		 * Start all timers with random deadlines, then cancel and
+		 * restart a subset to exercise removal from the timer queue.
+		 */
+		std::vector<std::unique_ptr<JitterTimer>> timers;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+		for (unsigned int i = 0; i < kNumTimers; ++i) {
+			timers.emplace_back(new JitterTimer());
+			timers.back()->start(start + chrono::microseconds(delay(generator)));
+		}
+
+		for (unsigned int i = 0; i < kNumCancelled; ++i) {
+			JitterTimer *timer = timers[i * kNumTimers / kNumCancelled].get();
+			timer->stop();
+			if (i % 2)
+				timer->start(start + chrono::microseconds(delay(generator)));
+		}
+
+		Timer timeout;
+		timeout.start(1000);
+
+		while (timeout.isRunning()) {
+			dispatcher_->processEvents();
+
+			bool running = false;
+			for (const auto &timer : timers)
+				running |= timer->isRunning();
+			if (!running)
+				break;
+		}
+
+		stop.store(true, std::memory_order_relaxed);
+		loader.join();
+
+		/* Check the timer expirations and compute statistics. */
+		chrono::steady_clock::duration maxError{ 0 };
+		chrono::steady_clock::duration sumError{ 0 };
+		std::vector<JitterTimer *> expired;
+
+		for (unsigned int i = 0; i < kNumTimers; ++i) {
+			JitterTimer *timer = timers[i].get();
+			bool cancelled = i % (kNumTimers / kNumCancelled) == 0 &&
+					 (i / (kNumTimers / kNumCancelled)) % 2 == 0;
+
+			if (cancelled) {
+				if (timer->count()) {
+					cout << "Stopped timer " << i << " expired" << endl;
+					return TestFail;
+				}
+				continue;
+			}
+
+			if (timer->count() != 1) {
+				cout << "Timer " << i << " expired " << timer->count()
+				     << " times" << endl;
+				return TestFail;
+			}
+
+			if (timer->error() < chrono::steady_clock::duration::zero()) {
+				cout << "Timer " << i << " expired early" << endl;
+				return TestFail;
+			}
+
+			maxError = std::max(maxError, timer->error());
+			sumError += timer->error();
+			expired.push_back(timer);
+		}
+
+		/* Timers must expire in deadline order. */
+		std::sort(expired.begin(), expired.end(),
+			  [](JitterTimer *a, JitterTimer *b) {
+				  return a->deadline() < b->deadline();
+			  });
+
+		for (unsigned int i = 1; i < expired.size(); ++i) {
+			if (expired[i]->expiration() < expired[i - 1]->expiration()) {
+				cout << "Timers expired out of order" << endl;
+				return TestFail;
+			}
+		}
+
+		auto usecs = [](chrono::steady_clock::duration d) {
+			return chrono::duration_cast<chrono::microseconds>(d).count();
+		};
+
+		cout << "Timer deadline error over " << expired.size()
+		     << " timers with " << events_ << " fd events: mean "
+		     << usecs(sumError / expired.size()) << "us, max "
+		     << usecs(maxError) << "us" << endl;
+
+		/* Use a generous bound to avoid failures on loaded systems. */
+		if (maxError > chrono::milliseconds(20)) {
+			cout << "Timer deadline error too large" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	void cleanup()
+	{
+		close(pipefd_[0]);
+		close(pipefd_[1]);
+	}
+
+private:
+	EventDispatcherEpoll *dispatcher_;
+	int pipefd_[2];
+	unsigned int events_;
+};
+
+TEST_REGISTER(TimerJitterTest)
@@ -18,17 +18,29 @@ class CaptureAsyncTest : public V4L2VideoDeviceTest
 {
 public:
 	CaptureAsyncTest()
-		: V4L2VideoDeviceTest("vimc", "Raw Capture 0"), frames(0) {}
+		: V4L2VideoDeviceTest("vimc", "Raw Capture 0"), frames(0),
+		  batchedFrames(0), batchErrors(0) {}
 
 	void receiveBuffer(Buffer *buffer)
 	{
 		std::cout << "Received buffer " << buffer->index() << std::endl;
 		frames++;
+		pending.push_back(buffer);
 
 		/* Requeue the buffer for further use. */
 		capture_->queueBuffer(buffer);
 	}
 
+	void receiveBatch(const std::vector<Buffer *> &buffers)
+	{
+		/* The batch shall match the individually signalled buffers. */
+		if (buffers != pending)
+			batchErrors++;
+
+		batchedFrames += buffers.size();
+		pending.clear();
+	}
+
 protected:
 	int run()
 	{
@@ -45,6 +57,7 @@ protected:
 			return TestFail;
 
 		capture_->bufferReady.connect(this, &CaptureAsyncTest::receiveBuffer);
+		capture_->buffersReady.connect(this, &CaptureAsyncTest::receiveBatch);
 
 		std::vector<std::unique_ptr<Buffer>> buffers;
 		buffers = capture_->queueAllBuffers();
@@ -78,11 +91,20 @@ protected:
 		if (ret)
 			return TestFail;
 
+		if (batchErrors || batchedFrames != frames) {
+			std::cout << "Batched buffers don't match individual buffers"
+				  << std::endl;
+			return TestFail;
+		}
+
 		return TestPass;
 	}
 
 private:
 	unsigned int frames;
+	unsigned int batchedFrames;
+	unsigned int batchErrors;
+	std::vector<Buffer *> pending;
 };
 
 TEST_REGISTER(CaptureAsyncTest);
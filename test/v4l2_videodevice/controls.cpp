@@ -8,6 +8,10 @@
 #include <climits>
 #include <iostream>
 
+#include <libcamera/event_dispatcher.h>
+#include <libcamera/timer.h>
+
+#include "thread.h"
 #include "v4l2_videodevice.h"
 
 #include "v4l2_videodevice_test.h"
@@ -93,6 +97,55 @@ protected:
 			return TestFail;
 		}
 
+		/* Test that values set by another user of the device are seen. */
+		V4L2VideoDevice other(capture_->deviceNode());
+		if (other.open()) {
+			cerr << "Failed to open second device instance" << endl;
+			return TestFail;
+		}
+
+		ControlList otherCtrls(other.controls());
+		otherCtrls.set(V4L2_CID_BRIGHTNESS, brightness.max());
+
+		ret = other.setControls(&otherCtrls);
+		if (ret) {
+			cerr << "Failed to set controls on second instance" << endl;
+			return TestFail;
+		}
+
+		EventDispatcher *dispatcher = Thread::current()->eventDispatcher();
+		Timer timeout;
+		timeout.start(100);
+		while (timeout.isRunning())
+			dispatcher->processEvents();
+
+		ctrls.set(V4L2_CID_BRIGHTNESS, -1);
+		ret = capture_->getControls(&ctrls);
+		if (ret) {
+			cerr << "Failed to get controls" << endl;
+			return TestFail;
+		}
+
+		if (ctrls.get(V4L2_CID_BRIGHTNESS) != brightness.max()) {
+			cerr << "Control changed externally not updated" << endl;
+			return TestFail;
+		}
+
+		/* Test that a stale cached value doesn't prevent writes. */
+		ctrls.set(V4L2_CID_BRIGHTNESS, brightness.min());
+		ret = capture_->setControls(&ctrls);
+		if (ret) {
+			cerr << "Failed to set controls" << endl;
+			return TestFail;
+		}
+
+		otherCtrls.set(V4L2_CID_BRIGHTNESS, -1);
+		ret = other.getControls(&otherCtrls);
+		if (ret || otherCtrls.get(V4L2_CID_BRIGHTNESS) != brightness.min()) {
+			cerr << "Control not written to the device" << endl;
+			return TestFail;
+		}
+
 		return TestPass;
 	}
 };
@@ -0,0 +1,122 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * libcamera V4L2 API tests
+ *
+ * Measure the CPU cost of queuing and dequeuing buffers on a V4L2VideoDevice.
+ */
+
+#include <chrono>
+#include <iostream>
+#include <time.h>
+
+#include <libcamera/buffer.h>
+#include <libcamera/event_dispatcher.h>
+#include <libcamera/timer.h>
+
+#include "thread.h"
+#include "v4l2_videodevice_test.h"
+
+using namespace std;
+
+static constexpr unsigned int kBufferCount = 8;
+static constexpr unsigned int kNumFrames = 300;
+
+class QueueBenchmarkTest : public V4L2VideoDeviceTest
+{
+public:
+	QueueBenchmarkTest()
+		: V4L2VideoDeviceTest("vivid", "vivid-000-vid-cap"), frames_(0),
+		  queueErrors_(0), queueTime_(0)
+	{
+	}
+
+	void receiveBuffer(Buffer *buffer)
+	{
+		frames_++;
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		if (capture_->queueBuffer(buffer))
+			queueErrors_++;
+		queueTime_ += chrono::steady_clock::now() - start;
+	}
+
+protected:
+	static chrono::nanoseconds cpuTime()
+	{
+		struct timespec ts;
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+		return chrono::seconds(ts.tv_sec) + chrono::nanoseconds(ts.tv_nsec);
+	}
+
+	int run()
+	{
+		EventDispatcher *dispatcher = Thread::current()->eventDispatcher();
+
+		pool_.createBuffers(kBufferCount);
+
+		if (capture_->exportBuffers(&pool_)) {
+			cout << "Failed to export buffers" << endl;
+			return TestFail;
+		}
+
+		capture_->bufferReady.connect(this, &QueueBenchmarkTest::receiveBuffer);
+
+		std::vector<std::unique_ptr<Buffer>> buffers;
+		buffers = capture_->queueAllBuffers();
+		if (buffers.empty()) {
+			cout << "Failed to queue buffers" << endl;
+			return TestFail;
+		}
+
+		if (capture_->streamOn()) {
+			cout << "Failed to start streaming" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * Waiting for frames doesn't consume CPU time, the thread CPU
+		 * time thus measures the cost of dequeuing, dispatching and
+		 * requeuing the buffers.
+		 */
+		chrono::nanoseconds cpuStart = cpuTime();
+
+		Timer timeout;
+		timeout.start(30000);
+		while (timeout.isRunning() && frames_ < kNumFrames)
+			dispatcher->processEvents();
+
+		chrono::nanoseconds cpu = cpuTime() - cpuStart;
+
+		if (capture_->streamOff()) {
+			cout << "Failed to stop streaming" << endl;
+			return TestFail;
+		}
+
+		if (frames_ < kNumFrames) {
+			cout << "Captured " << frames_ << " frames, expected "
+			     << kNumFrames << endl;
+			return TestFail;
+		}
+
+		if (queueErrors_) {
+			cout << "Failed to requeue " << queueErrors_ << " buffers" << endl;
+			return TestFail;
+		}
+
+		cout << frames_ << " frames: "
+		     << chrono::duration_cast<chrono::nanoseconds>(queueTime_).count() / frames_
+		     << "ns per queue, "
+		     << cpu.count() / frames_ << "ns CPU time per frame" << endl;
+
+		return TestPass;
+	}
+
+private:
+	unsigned int frames_;
+	unsigned int queueErrors_;
+	chrono::steady_clock::duration queueTime_;
+};
+
+TEST_REGISTER(QueueBenchmarkTest);
@@ -0,0 +1,271 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2019, Google Inc.
+ *
+ * libcamera V4L2 Request API tests
+ *
+ * Queue output buffers and controls of a vim2m device in media requests, and
+ * verify that the control values are applied atomically with the buffers.
+ */
+
+#include <iostream>
+#include <vector>
+
+#include <libcamera/buffer.h>
+#include <libcamera/event_dispatcher.h>
+#include <libcamera/timer.h>
+
+#include "device_enumerator.h"
+#include "media_device.h"
+#include "media_request.h"
+#include "thread.h"
+#include "v4l2_videodevice.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+class RequestAPITest : public Test
+{
+public:
+	RequestAPITest()
+		: vim2m_(nullptr), completedRequests_(0), controlErrors_(0)
+	{
+	}
+
+	void captureBufferComplete(Buffer *buffer)
+	{
+		vim2m_->capture()->queueBuffer(buffer);
+	}
+
+	void outputBufferComplete(Buffer *buffer)
+	{
+		Slot &slot = slots_[buffer->index()];
+		slot.bufferDone = true;
+		requeue(slot);
+	}
+
+	void requestComplete(MediaRequest *request)
+	{
+		for (Slot &slot : slots_) {
+			if (slot.request.get() != request)
+				continue;
+
+			/* Verify the control value applied to the frame. */
+			ControlList ctrls(vim2m_->output()->controls());
+			ctrls.set(V4L2_CID_HFLIP, -1);
+			if (vim2m_->output()->getControls(&ctrls, request) ||
+			    ctrls.get(V4L2_CID_HFLIP).get<int32_t>() != slot.hflip)
+				controlErrors_++;
+
+			completedRequests_++;
+			slot.requestDone = true;
+			requeue(slot);
+			return;
+		}
+	}
+
+protected:
+	struct Slot {
+		std::unique_ptr<Buffer> buffer;
+		std::unique_ptr<MediaRequest> request;
+		int32_t hflip;
+		bool bufferDone;
+		bool requestDone;
+	};
+
+	int queue(Slot &slot)
+	{
+		slot.bufferDone = false;
+		slot.requestDone = false;
+		slot.hflip = !slot.hflip;
+
+		ControlList ctrls(vim2m_->output()->controls());
+		ctrls.set(V4L2_CID_HFLIP, slot.hflip);
+
+		if (vim2m_->output()->setControls(&ctrls, slot.request.get()))
+			return TestFail;
+
+		if (vim2m_->output()->queueBuffer(slot.buffer.get(),
+						  slot.request.get()))
+			return TestFail;
+
+		if (slot.request->queue())
+			return TestFail;
+
+		return TestPass;
+	}
+
+	void requeue(Slot &slot)
+	{
+		if (!slot.bufferDone || !slot.requestDone)
+			return;
+
+		if (slot.request->reinit() || queue(slot) != TestPass)
+			controlErrors_++;
+	}
+
+	int init()
+	{
+		enumerator_ = DeviceEnumerator::create();
+		if (!enumerator_) {
+			cerr << "Failed to create device enumerator" << endl;
+			return TestFail;
+		}
+
+		if (enumerator_->enumerate()) {
+			cerr << "Failed to enumerate media devices" << endl;
+			return TestFail;
+		}
+
+		DeviceMatch dm("vim2m");
+		dm.add("vim2m-source");
+		dm.add("vim2m-sink");
+
+		media_ = enumerator_->search(dm);
+		if (!media_) {
+			cerr << "No vim2m device found" << endl;
+			return TestSkip;
+		}
+
+		if (!media_->acquire()) {
+			cerr << "Failed to acquire media device" << endl;
+			return TestFail;
+		}
+
+		MediaEntity *entity = media_->getEntityByName("vim2m-source");
+		vim2m_ = new V4L2M2MDevice(entity->deviceNode());
+		if (vim2m_->open()) {
+			cerr << "Failed to open VIM2M device" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		constexpr unsigned int bufferCount = 4;
+
+		EventDispatcher *dispatcher = Thread::current()->eventDispatcher();
+		V4L2VideoDevice *capture = vim2m_->capture();
+		V4L2VideoDevice *output = vim2m_->output();
+
+		V4L2DeviceFormat format = {};
+		if (capture->getFormat(&format)) {
+			cerr << "Failed to get capture format" << endl;
+			return TestFail;
+		}
+
+		format.size.width = 640;
+		format.size.height = 480;
+
+		if (capture->setFormat(&format) || output->setFormat(&format)) {
+			cerr << "Failed to set format" << endl;
+			return TestFail;
+		}
+
+		capturePool_.createBuffers(bufferCount);
+		outputPool_.createBuffers(bufferCount);
+
+		if (capture->exportBuffers(&capturePool_) ||
+		    output->exportBuffers(&outputPool_)) {
+			cerr << "Failed to export buffers" << endl;
+			return TestFail;
+		}
+
+		if (!output->supportsRequests()) {
+			cerr << "Request API not supported" << endl;
+			return TestSkip;
+		}
+
+		if (output->controls().find(V4L2_CID_HFLIP) == output->controls().end()) {
+			cerr << "HFLIP control not supported" << endl;
+			return TestSkip;
+		}
+
+		capture->bufferReady.connect(this, &RequestAPITest::captureBufferComplete);
+		output->bufferReady.connect(this, &RequestAPITest::outputBufferComplete);
+
+		std::vector<std::unique_ptr<Buffer>> captureBuffers;
+		captureBuffers = capture->queueAllBuffers();
+		if (captureBuffers.empty()) {
+			cerr << "Failed to queue capture buffers" << endl;
+			return TestFail;
+		}
+
+		slots_.resize(bufferCount);
+		for (unsigned int i = 0; i < bufferCount; ++i) {
+			Slot &slot = slots_[i];
+
+			slot.buffer.reset(new Buffer(i));
+			slot.request = media_->allocateRequest();
+			if (!slot.request) {
+				cerr << "Failed to allocate request" << endl;
+				return TestFail;
+			}
+
+			slot.request->completed.connect(this, &RequestAPITest::requestComplete);
+			slot.hflip = i % 2;
+		}
+
+		if (capture->streamOn() || output->streamOn()) {
+			cerr << "Failed to start streaming" << endl;
+			return TestFail;
+		}
+
+		for (Slot &slot : slots_) {
+			if (queue(slot) != TestPass) {
+				cerr << "Failed to queue request" << endl;
+				return TestFail;
+			}
+		}
+
+		Timer timeout;
+		timeout.start(5000);
+		while (timeout.isRunning() && completedRequests_ < 30)
+			dispatcher->processEvents();
+
+		if (capture->streamOff() || output->streamOff()) {
+			cerr << "Failed to stop streaming" << endl;
+			return TestFail;
+		}
+
+		if (completedRequests_ < 30) {
+			cerr << "Failed to complete 30 requests within timeout" << endl;
+			return TestFail;
+		}
+
+		if (controlErrors_) {
+			cerr << controlErrors_ << " requests applied wrong controls"
+			     << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	void cleanup()
+	{
+		slots_.clear();
+		delete vim2m_;
+
+		if (media_)
+			media_->release();
+	}
+
+private:
+	std::unique_ptr<DeviceEnumerator> enumerator_;
+	std::shared_ptr<MediaDevice> media_;
+	V4L2M2MDevice *vim2m_;
+
+	BufferPool capturePool_;
+	BufferPool outputPool_;
+	std::vector<Slot> slots_;
+
+	unsigned int completedRequests_;
+	unsigned int controlErrors_;
+};
+
+TEST_REGISTER(RequestAPITest);